@@ -290,6 +290,10 @@ def dumpMetaServerChunkMap(metaServer, dumpMetaFile, defaultMetaFile, defaultChe
             continue
         if line.find('Status') == 0:
             continue
+        if line.find('Filename') == 0:
+            # each dump has its own file
+            defaultMetaFile = line.split(':', 1)[1].strip()
+            continue
         if line.find('\r\n') == 0:
             break
     sock.close()
@@ -222,8 +222,11 @@ File_dealloc(PyObject *pself)
 {
 	kfs_File *self = (kfs_File *)pself;
 	kfs_Client *cl = (kfs_Client *)self->pclient;
-	if (self->fd != -1)
+	if (self->fd != -1) {
+		Py_BEGIN_ALLOW_THREADS
 		cl->client->Close(self->fd);
+		Py_END_ALLOW_THREADS
+	}
 	Py_DECREF(self->name);
 	Py_DECREF(self->mode);
 	Py_DECREF(self->pclient);
@@ -261,8 +264,11 @@ set_file_members(
 		return -1;
 
 	// open the file if necessary
-	if (fd < 0)
+	if (fd < 0) {
+		Py_BEGIN_ALLOW_THREADS
 		fd = client->client->Open(path, mode);
+		Py_END_ALLOW_THREADS
+	}
 
 	if (fd < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-fd));
@@ -335,7 +341,11 @@ kfs_reopen(PyObject *pself, PyObject *args)
 	if (mode == -1)
 		return NULL;
 
-	int fd = cl->client->Open(PyString_AsString(self->name), mode);
+	const char *name = PyString_AsString(self->name);
+	int fd;
+	Py_BEGIN_ALLOW_THREADS
+	fd = cl->client->Open(name, mode);
+	Py_END_ALLOW_THREADS
 	if (fd == -1)
 		return NULL;
 
@@ -350,8 +360,13 @@ kfs_close(PyObject *pself, PyObject *args)
 	kfs_File *self = (kfs_File *)pself;
 	kfs_Client *cl = (kfs_Client *)self->pclient;
 	if (self->fd != -1) {
-		cl->client->Close(self->fd);
+		// Take the fd while holding the GIL, so that no other thread
+		// can use or close it once the GIL is released.
+		const int fd = self->fd;
 		self->fd = -1;
+		Py_BEGIN_ALLOW_THREADS
+		cl->client->Close(fd);
+		Py_END_ALLOW_THREADS
 	}
 	Py_RETURN_NONE;
 }
@@ -384,7 +399,11 @@ kfs_read(PyObject *pself, PyObject *args)
 		return NULL;
 
 	char *buf = PyString_AsString(v);
-	ssize_t nr = cl->client->Read(self->fd, buf, rsize);
+	ssize_t nr;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	nr = cl->client->Read(fd, buf, rsize);
+	Py_END_ALLOW_THREADS
 	if (nr < 0) {
 		Py_DECREF(v);
 		PyErr_SetString(PyExc_IOError, strerror(-nr));
@@ -411,7 +430,11 @@ kfs_write(PyObject *pself, PyObject *args)
 		return NULL;
 	}
 
-	ssize_t nw = cl->client->Write(self->fd, buf, (ssize_t)wsize);
+	ssize_t nw;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	nw = cl->client->Write(fd, buf, (ssize_t)wsize);
+	Py_END_ALLOW_THREADS
 	if (nw < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-nw));
 		return NULL;
@@ -424,6 +447,115 @@ kfs_write(PyObject *pself, PyObject *args)
 	Py_RETURN_NONE;
 }
 
+/*
+ * Read into a caller supplied writable buffer (bytearray, array, mmap,
+ * etc.) without allocating a new string per call.
+ */
+static PyObject *
+kfs_readinto(PyObject *pself, PyObject *args)
+{
+	kfs_File *self = (kfs_File *)pself;
+	kfs_Client *cl = (kfs_Client *)self->pclient;
+	Py_buffer pbuf;
+
+	if (!PyArg_ParseTuple(args, "w*", &pbuf))
+		return NULL;
+
+	if (self->fd == -1) {
+		PyBuffer_Release(&pbuf);
+		PyErr_SetString(PyExc_IOError, strerror(EBADF));
+		return NULL;
+	}
+
+	ssize_t nr;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	nr = cl->client->Read(fd, (char *)pbuf.buf, pbuf.len);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&pbuf);
+	if (nr < 0) {
+		PyErr_SetString(PyExc_IOError, strerror(-nr));
+		return NULL;
+	}
+	return PyInt_FromSsize_t(nr);
+}
+
+static PyObject *
+kfs_pread(PyObject *pself, PyObject *args)
+{
+	kfs_File *self = (kfs_File *)pself;
+	kfs_Client *cl = (kfs_Client *)self->pclient;
+	Py_ssize_t rsize = -1;
+	PY_LONG_LONG off = -1;
+
+	if (!PyArg_ParseTuple(args, "nL", &rsize, &off))
+		return NULL;
+
+	if (self->fd == -1) {
+		PyErr_SetString(PyExc_IOError, strerror(EBADF));
+		return NULL;
+	}
+	if (rsize < 0 || off < 0) {
+		PyErr_SetString(PyExc_IOError, strerror(EINVAL));
+		return NULL;
+	}
+
+	PyObject *v = PyString_FromStringAndSize((char *)NULL, rsize);
+	if (v == NULL)
+		return NULL;
+
+	char *buf = PyString_AsString(v);
+	ssize_t nr;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	nr = cl->client->PRead(fd, (off_t)off, buf, rsize);
+	Py_END_ALLOW_THREADS
+	if (nr < 0) {
+		Py_DECREF(v);
+		PyErr_SetString(PyExc_IOError, strerror(-nr));
+		return NULL;
+	}
+	if (nr != rsize)
+		_PyString_Resize(&v, nr);
+	return v;
+}
+
+/*
+ * Write the contents of any object supporting the buffer protocol at the
+ * specified offset; returns the number of bytes written.
+ */
+static PyObject *
+kfs_pwrite(PyObject *pself, PyObject *args)
+{
+	kfs_File *self = (kfs_File *)pself;
+	kfs_Client *cl = (kfs_Client *)self->pclient;
+	Py_buffer pbuf;
+	PY_LONG_LONG off = -1;
+
+	if (!PyArg_ParseTuple(args, "s*L", &pbuf, &off))
+		return NULL;
+
+	if (self->fd == -1 || off < 0) {
+		PyBuffer_Release(&pbuf);
+		PyErr_SetString(PyExc_IOError,
+				strerror(self->fd == -1 ? EBADF : EINVAL));
+		return NULL;
+	}
+
+	ssize_t nw;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	nw = cl->client->PWrite(fd, (off_t)off,
+			(const char *)pbuf.buf, pbuf.len);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&pbuf);
+	if (nw < 0) {
+		PyErr_SetString(PyExc_IOError, strerror(-nw));
+		return NULL;
+	}
+	return PyInt_FromSsize_t(nw);
+}
+
 static PyObject *
 kfs_chunkLocations(PyObject *pself, PyObject *args)
 {
@@ -441,7 +573,11 @@ kfs_chunkLocations(PyObject *pself, PyObject *args)
 
 	vector<vector <string> > results;
 
-	int s = cl->client->GetDataLocation(self->fd, (off_t)off, len, results);
+	int s;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	s = cl->client->GetDataLocation(fd, (off_t)off, len, results);
+	Py_END_ALLOW_THREADS
 	if (s < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-s));
 		return NULL;
@@ -476,7 +612,11 @@ kfs_dataVerify(PyObject *pself, PyObject *args)
 		return NULL;
 	}
 
-        bool res = cl->client->VerifyDataChecksums(self->fd, 0, buf, (ssize_t)wsize);
+	bool res;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	res = cl->client->VerifyDataChecksums(fd, 0, buf, (ssize_t)wsize);
+	Py_END_ALLOW_THREADS
         return Py_BuildValue("b", res);
 }
 
@@ -495,7 +635,11 @@ kfs_truncate(PyObject *pself, PyObject *args)
 		return NULL;
 	}
 
-	int s = cl->client->Truncate(self->fd, (off_t)off);
+	int s;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	s = cl->client->Truncate(fd, (off_t)off);
+	Py_END_ALLOW_THREADS
 	if (s < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-s));
 		return NULL;
@@ -509,7 +653,11 @@ kfs_sync(PyObject *pself, PyObject *args)
 {
 	kfs_File *self = (kfs_File *)pself;
 	kfs_Client *cl = (kfs_Client *)self->pclient;
-	int s = cl->client->Sync(self->fd);
+	int s;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	s = cl->client->Sync(fd);
+	Py_END_ALLOW_THREADS
 	if (s < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-s));
 		return NULL;
@@ -533,7 +681,11 @@ kfs_seek(PyObject *pself, PyObject *args)
 		return NULL;
 	}
 
-	off_t s = cl->client->Seek(self->fd, (off_t)off, whence);
+	off_t s;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	s = cl->client->Seek(fd, (off_t)off, whence);
+	Py_END_ALLOW_THREADS
 	if (s < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-s));
 		return NULL;
@@ -552,7 +704,11 @@ kfs_tell(PyObject *pself, PyObject *args)
 		return NULL;
 	}
 
-	off_t pos = cl->client->Tell(self->fd);
+	off_t pos;
+	const int fd = self->fd;
+	Py_BEGIN_ALLOW_THREADS
+	pos = cl->client->Tell(fd);
+	Py_END_ALLOW_THREADS
 	if (pos < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-pos));
 		return NULL;
@@ -565,6 +721,9 @@ static PyMethodDef File_methods[] = {
 	{ "close", kfs_close, METH_NOARGS, "Close file." },
 	{ "read", kfs_read, METH_VARARGS, "Read from file." },
 	{ "write", kfs_write, METH_VARARGS, "Write to file." },
+	{ "readinto", kfs_readinto, METH_VARARGS, "Read into a buffer." },
+	{ "pread", kfs_pread, METH_VARARGS, "Read from file offset." },
+	{ "pwrite", kfs_pwrite, METH_VARARGS, "Write at file offset." },
 	{ "truncate", kfs_truncate, METH_VARARGS, "Truncate a file." },
 	{ "chunk_locations", kfs_chunkLocations, METH_VARARGS, "Get location(s) of a chunk." },
 	{ "seek", kfs_seek, METH_VARARGS, "Seek to file offset." },
@@ -592,6 +751,9 @@ PyDoc_STRVAR(File_doc,
 "\tclose()     -- close file\n"
 "\tread(len)   -- read len bytes, return as string\n"
 "\twrite(str)  -- write string to file\n"
+"\treadinto(buf) -- read into writable buffer, return bytes read\n"
+"\tpread(len, off) -- read len bytes at offset off, return as string\n"
+"\tpwrite(buf, off) -- write buffer at offset off, return bytes written\n"
 "\ttruncate(off) -- truncate file at specified offset\n"
 "\tseek(off)   -- seek to specified offset\n"
 "\ttell()      -- return current offest\n"
@@ -685,7 +847,10 @@ Client_init(PyObject *pself, PyObject *args, PyObject *kwds)
 	if (!PyArg_ParseTuple(args, "s", &pf))
 		return -1;
 
-	KfsClientPtr client = KFS::getKfsClientFactory()->GetClient(pf);
+	KfsClientPtr client;
+	Py_BEGIN_ALLOW_THREADS
+	client = KFS::getKfsClientFactory()->GetClient(pf);
+	Py_END_ALLOW_THREADS
 	if (!client) {
 		PyErr_SetString(PyExc_IOError, "Unable to start client.");
 		return -1;
@@ -777,7 +942,10 @@ kfs_cd(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	int status = self->client->Stat(path.c_str(), s);
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->Stat(path.c_str(), s);
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -817,7 +985,10 @@ kfs_isdir(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	bool res = self->client->IsDirectory(path.c_str());
+	bool res;
+	Py_BEGIN_ALLOW_THREADS
+	res = self->client->IsDirectory(path.c_str());
+	Py_END_ALLOW_THREADS
         return Py_BuildValue("b", res);
 }
 
@@ -831,7 +1002,10 @@ kfs_isfile(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	bool res = self->client->IsFile(path.c_str());
+	bool res;
+	Py_BEGIN_ALLOW_THREADS
+	res = self->client->IsFile(path.c_str());
+	Py_END_ALLOW_THREADS
         return Py_BuildValue("b", res);
 }
 
@@ -845,7 +1019,10 @@ kfs_mkdir(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	int status  = self->client->Mkdir(path.c_str());
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->Mkdir(path.c_str());
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -863,7 +1040,10 @@ kfs_mkdirs(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	int status  = self->client->Mkdirs(path.c_str());
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->Mkdirs(path.c_str());
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -881,7 +1061,10 @@ kfs_rmdir(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	int status = self->client->Rmdir(path.c_str());
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->Rmdir(path.c_str());
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -899,7 +1082,10 @@ kfs_rmdirs(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	int status = self->client->Rmdirs(path.c_str());
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->Rmdirs(path.c_str());
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -925,7 +1111,10 @@ kfs_readdir(PyObject *pself, PyObject *args)
 
 	string path = build_path(self->cwd, patharg);
 	vector <string> result;
-	int status = self->client->Readdir(path.c_str(), result);
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->Readdir(path.c_str(), result);
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -977,7 +1166,10 @@ kfs_readdirplus(PyObject *pself, PyObject *args)
 	string path = build_path(self->cwd, patharg);
 
 	vector <KfsFileAttr> result;
-	int status = self->client->ReaddirPlus(path.c_str(), result);
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->ReaddirPlus(path.c_str(), result);
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -1002,7 +1194,10 @@ kfs_stat(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	int status = self->client->Stat(path.c_str(), s, true);
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->Stat(path.c_str(), s, true);
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -1036,7 +1231,10 @@ kfs_getNumChunks(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	int chunkCount = self->client->GetNumChunks(path.c_str());
+	int chunkCount;
+	Py_BEGIN_ALLOW_THREADS
+	chunkCount = self->client->GetNumChunks(path.c_str());
+	Py_END_ALLOW_THREADS
 	if (chunkCount < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-1));
 		return NULL;
@@ -1053,7 +1251,10 @@ kfs_getChunkSize(PyObject *pself, PyObject *args)
 	if (PyArg_ParseTuple(args, "s", &patharg) == -1)
 		return NULL;
 	string path = build_path(self->cwd, patharg);
-	int chunksz = self->client->GetChunkSize(path.c_str());
+	int chunksz;
+	Py_BEGIN_ALLOW_THREADS
+	chunksz = self->client->GetChunkSize(path.c_str());
+	Py_END_ALLOW_THREADS
         return Py_BuildValue("i", chunksz);
 }
 
@@ -1068,7 +1269,10 @@ kfs_create(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	int fd = self->client->Create(path.c_str(), numReplicas);
+	int fd;
+	Py_BEGIN_ALLOW_THREADS
+	fd = self->client->Create(path.c_str(), numReplicas);
+	Py_END_ALLOW_THREADS
 	if (fd < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-fd));
 		return NULL;
@@ -1091,7 +1295,10 @@ kfs_remove(PyObject *pself, PyObject *args)
 		return NULL;
 
 	string path = build_path(self->cwd, patharg);
-	int status = self->client->Remove(path.c_str());
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->Remove(path.c_str());
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -1111,7 +1318,10 @@ kfs_rename(PyObject *pself, PyObject *args)
 
 	string spath = build_path(self->cwd, srcpath);
 	string dpath = build_path(self->cwd, dstpath);
-	int status = self->client->Rename(spath.c_str(), dpath.c_str(), overwrite);
+	int status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->Rename(spath.c_str(), dpath.c_str(), overwrite);
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -1131,7 +1341,10 @@ kfs_coalesceblocks(PyObject *pself, PyObject *args)
 	string spath = build_path(self->cwd, srcpath);
 	string dpath = build_path(self->cwd, dstpath);
         off_t dstStartOffset;
-	off_t status = self->client->CoalesceBlocks(spath.c_str(), dpath.c_str(), &dstStartOffset);
+	off_t status;
+	Py_BEGIN_ALLOW_THREADS
+	status = self->client->CoalesceBlocks(spath.c_str(), dpath.c_str(), &dstStartOffset);
+	Py_END_ALLOW_THREADS
 	if (status < 0) {
 		PyErr_SetString(PyExc_IOError, strerror(-status));
 		return NULL;
@@ -0,0 +1,114 @@
+#!/usr/bin/env python
+#
+# $Id$
+#
+# Created 2026/10/17
+#
+# Copyright 2026 Quantcast Corp.
+#
+# This file is part of Kosmos File System (KFS).
+#
+# Licensed under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+#
+# Python binding read / write throughput benchmark.
+#
+# Writes one test file per thread, then reads the files back with
+# read(), readinto() and pread(), with the specified number of threads.
+# Compare the aggregate rate with 1 and N threads to see how much of the
+# time is spent in the client with the interpreter lock released, and
+# read() vs readinto() to see the cost of the per call string allocation.
+#
+# Usage:
+#   python kfs_pybench.py <kfs properties> [<test dir>] [<threads>]
+#       [<file size MB>] [<io size KB>]
+#
+
+import kfs
+import sys
+import time
+import threading
+
+def run_threads(nthreads, target, args):
+	"""Run target(i, *args) in nthreads threads, return elapsed time"""
+	threads = [threading.Thread(target=target, args=(i,) + args)
+			for i in range(nthreads)]
+	start = time.time()
+	for t in threads:
+		t.start()
+	for t in threads:
+		t.join()
+	return time.time() - start
+
+def write_file(i, client, testdir, filesize, iosize):
+	f = client.create("%s/file.%d" % (testdir, i))
+	data = "%c" % (ord('a') + i % 26) * iosize
+	for off in range(0, filesize, iosize):
+		f.write(data)
+	f.sync()
+	f.close()
+
+def pwrite_file(i, client, testdir, filesize, iosize):
+	f = client.open("%s/file.%d" % (testdir, i), 'w')
+	data = bytearray("%c" % (ord('A') + i % 26) * iosize)
+	for off in range(0, filesize, iosize):
+		f.pwrite(data, off)
+	f.sync()
+	f.close()
+
+def read_file(i, client, testdir, filesize, iosize):
+	f = client.open("%s/file.%d" % (testdir, i), 'r')
+	while len(f.read(iosize)) == iosize:
+		pass
+	f.close()
+
+def readinto_file(i, client, testdir, filesize, iosize):
+	f = client.open("%s/file.%d" % (testdir, i), 'r')
+	buf = bytearray(iosize)
+	while f.readinto(buf) == iosize:
+		pass
+	f.close()
+
+def pread_file(i, client, testdir, filesize, iosize):
+	f = client.open("%s/file.%d" % (testdir, i), 'r')
+	for off in range(0, filesize, iosize):
+		f.pread(iosize, off)
+	f.close()
+
+def report(name, nthreads, filesize, elapsed):
+	total = nthreads * filesize
+	print "%-9s threads: %2d %8.3f sec %8.2f MB/sec" % (
+			name, nthreads, elapsed, total / elapsed / (1 << 20))
+
+if __name__ == '__main__':
+	if len(sys.argv) < 2:
+		print "Usage: %s <kfs properties> [<test dir>] [<threads>]" \
+			" [<file size MB>] [<io size KB>]" % sys.argv[0]
+		sys.exit(1)
+	client = kfs.client(sys.argv[1])
+	testdir = len(sys.argv) > 2 and sys.argv[2] or "/pybench"
+	nthreads = len(sys.argv) > 3 and int(sys.argv[3]) or 4
+	filesize = (len(sys.argv) > 4 and int(sys.argv[4]) or 64) << 20
+	iosize = (len(sys.argv) > 5 and int(sys.argv[5]) or 1024) << 10
+
+	client.mkdirs(testdir)
+	for n in sorted(set([1, nthreads])):
+		args = (client, testdir, filesize, iosize)
+		report("write", n, filesize, run_threads(n, write_file, args))
+		report("pwrite", n, filesize, run_threads(n, pwrite_file, args))
+		report("read", n, filesize, run_threads(n, read_file, args))
+		report("readinto", n, filesize,
+				run_threads(n, readinto_file, args))
+		report("pread", n, filesize, run_threads(n, pread_file, args))
+	for i in range(nthreads):
+		client.remove("%s/file.%d" % (testdir, i))
+	client.rmdir(testdir)
@@ -276,6 +276,12 @@ public:
         { return mCanDoLowOnBuffersFlushFlag; }
     void LowOnBuffersFlush()
         { FlushFullBlocks(); }
+    int BytesBuffered() const
+        { return mBuffer.BytesConsumable(); }
+    const DiskIo::File* GetChunkFile() const
+        { return mChunkFileHandle.get(); }
+    void ScheduledFlush()
+        { FlushFullBlocks(); }
     void UpdateFlushLimit(int flushLimit)
     {
         if (mBuffer.BytesConsumable() > flushLimit) {
@@ -1275,9 +1281,12 @@ AtomicRecordAppender::AppendBegin(
             }
         }
         // Do space accounting and flush if needed.
+        // The flush might be deferred to the manager's per disk flush cycle,
+        // in order to issue fewer and larger writes.
         if (mBuffer.BytesConsumable() >=
                 gAtomicRecordAppendManager.GetFlushLimit(*this,
-                    mBuffer.BytesConsumable() - prevNumBytes)) {
+                    mBuffer.BytesConsumable() - prevNumBytes) &&
+                ! gAtomicRecordAppendManager.DeferFlush(*this)) {
             // Align the flush to checksum boundaries.
             FlushFullBlocks();
         } else {
@@ -1851,8 +1860,9 @@ AtomicRecordAppender::Timeout()
     const int   cleanupTimeout = gAtomicRecordAppendManager.GetCleanUpSec() *
         ((IsMaster() || mState != kStateOpen) ? 1 : 4);
     const time_t now           = Now();
-    if (mBuffer.BytesConsumable() >=
-                gAtomicRecordAppendManager.GetFlushLimit(*this) ||
+    if ((mBuffer.BytesConsumable() >=
+                gAtomicRecordAppendManager.GetFlushLimit(*this) &&
+                ! gAtomicRecordAppendManager.DeferFlush(*this)) ||
             (flushInterval >= 0 && mLastFlushTime + flushInterval <= now)) {
         FlushFullBlocks();
     } else if (! mBuffer.IsEmpty() && flushInterval >= 0) {
@@ -2362,6 +2372,8 @@ AtomicRecordAppender::FlushSelf(bool flushFullChecksumBlocks)
                 mBufFrontPadding = off;
             }
         }
+        Cntrs().mFlushWriteCount++;
+        Cntrs().mFlushWriteByteCount += bytesToFlush;
         mIoOpsInFlight++;
         int res = gChunkManager.WriteChunk(wop);
         if (res < 0) {
@@ -2549,6 +2561,9 @@ AtomicRecordAppendManager::AtomicRecordAppendManager()
       mAppendersWithWidCount(0),
       mBufferLimitRatio(0.6),
       mMaxWriteIdsPerChunk(16 << 10),
+      mFlushMinWriteBytes(4 * CHECKSUM_BLOCKSIZE),
+      mFlushMaxDiskQueueRequests(8),
+      mFlushQueue(),
       mInstanceNum(0),
       mCounters()
 {
@@ -2586,6 +2601,11 @@ AtomicRecordAppendManager::SetParameters(const Properties& props)
         "chunkServer.recAppender.bufferLimitRatio",    mBufferLimitRatio),
     mMaxWriteIdsPerChunk     = props.getValue(
         "chunkServer.recAppender.maxWriteIdsPerChunk", mMaxWriteIdsPerChunk);
+    mFlushMinWriteBytes      = props.getValue(
+        "chunkServer.recAppender.flushMinWriteBytes",  mFlushMinWriteBytes);
+    mFlushMaxDiskQueueRequests = props.getValue(
+        "chunkServer.recAppender.flushMaxDiskQueueRequests",
+        mFlushMaxDiskQueueRequests);
     mTotalBuffersBytes       = 0;
     if (! mAppenders.empty()) {
         UpdateAppenderFlushLimit();
@@ -2604,6 +2624,47 @@ AtomicRecordAppendManager::GetFlushLimit(
     return mMaxAppenderBytes;
 }
 
+int
+AtomicRecordAppendManager::GetDiskQueueFreeRequests(
+    const DiskIo::File& file) const
+{
+    int     freeRequestCount;
+    int     requestCount;
+    int64_t readBlockCount;
+    int64_t writeBlockCount;
+    int     blockSize;
+    file.GetDiskQueuePendingCount(freeRequestCount, requestCount,
+        readBlockCount, writeBlockCount, blockSize);
+    if (freeRequestCount <= 0) {
+        return 0;
+    }
+    return std::max(0, mFlushMaxDiskQueueRequests - requestCount);
+}
+
+bool
+AtomicRecordAppendManager::DeferFlush(AtomicRecordAppender& appender)
+{
+    // Let the appender accumulate more data while the buffers are plentiful
+    // and either the disk queue is busy, or the write would be small. The
+    // flush cycle, or low on buffers flush, will write the data out.
+    // Never grow past the configured per appender limit.
+    const int nBytes = appender.BytesBuffered();
+    if (nBytes >= mFlushLimit ||
+            DiskIo::GetBufferManager().IsLowOnBuffers()) {
+        return false;
+    }
+    const DiskIo::File* const file = appender.GetChunkFile();
+    if (! file || ! file->GetDiskQueuePtr()) {
+        return false;
+    }
+    if (nBytes >= std::min(mFlushMinWriteBytes, mFlushLimit) &&
+            GetDiskQueueFreeRequests(*file) > 0) {
+        return false;
+    }
+    mCounters.mFlushDeferredCount++;
+    return true;
+}
+
 void
 AtomicRecordAppendManager::UpdateAppenderFlushLimit(const AtomicRecordAppender* appender /* = 0 */)
 {
@@ -2740,6 +2801,63 @@ void
 AtomicRecordAppendManager::Timeout()
 {
     FlushIfLowOnBuffers();
+    FlushPendingByDisk();
+}
+
+static bool
+FlushQueueCmp(
+    const std::pair<const DiskQueue*, AtomicRecordAppender*>& lhs,
+    const std::pair<const DiskQueue*, AtomicRecordAppender*>& rhs)
+{
+    // Group by disk queue, and largest buffered first within each group.
+    return (lhs.first < rhs.first || (lhs.first == rhs.first &&
+        lhs.second->BytesBuffered() > rhs.second->BytesBuffered()));
+}
+
+void
+AtomicRecordAppendManager::FlushPendingByDisk()
+{
+    // Flush the appenders that have accumulated enough data to do a large
+    // write, drive by drive, starting with the largest, while the respective
+    // disk queue has room for more requests. The remaining appenders keep
+    // accumulating data until the next cycle, the flush interval, or low on
+    // buffers condition.
+    const int minBytes = std::min(mFlushMinWriteBytes, mFlushLimit);
+    mFlushQueue.clear();
+    PendingFlushList::Iterator it(mPendingFlushList);
+    AtomicRecordAppender* appender;
+    while ((appender = it.Next())) {
+        const DiskIo::File* const file = appender->GetChunkFile();
+        if (appender->BytesBuffered() >= minBytes && file) {
+            mFlushQueue.push_back(
+                std::make_pair(file->GetDiskQueuePtr(), appender));
+        }
+    }
+    if (mFlushQueue.empty()) {
+        return;
+    }
+    mCounters.mFlushCycleCount++;
+    std::sort(mFlushQueue.begin(), mFlushQueue.end(), &FlushQueueCmp);
+    const DiskQueue* queue     = 0;
+    int              freeCount = 0;
+    for (FlushQueue::const_iterator fit = mFlushQueue.begin();
+            fit != mFlushQueue.end();
+            ++fit) {
+        if (fit == mFlushQueue.begin() || fit->first != queue) {
+            queue     = fit->first;
+            freeCount = queue ?
+                GetDiskQueueFreeRequests(*fit->second->GetChunkFile()) : 1;
+        }
+        if (freeCount <= 0) {
+            continue;
+        }
+        if (queue) {
+            freeCount--;
+        }
+        mCounters.mFlushCycleAppenderCount++;
+        fit->second->ScheduledFlush();
+    }
+    mFlushQueue.clear();
 }
 
 void
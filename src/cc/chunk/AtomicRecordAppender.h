@@ -27,6 +27,7 @@
 
 #include <tr1/unordered_map>
 #include <string>
+#include <vector>
 
 #include "DiskIo.h"
 #include "KfsOps.h"
@@ -75,6 +76,11 @@ public:
         Counter mLeaseExpiredCount;
         Counter mTimeoutLostCount;
         Counter mLostChunkCount;
+        Counter mFlushWriteCount;
+        Counter mFlushWriteByteCount;
+        Counter mFlushDeferredCount;
+        Counter mFlushCycleCount;
+        Counter mFlushCycleAppenderCount;
 
         void Clear()
         {
@@ -108,6 +114,11 @@ public:
             mLeaseExpiredCount = 0;
             mTimeoutLostCount = 0;
             mLostChunkCount = 0;
+            mFlushWriteCount = 0;
+            mFlushWriteByteCount = 0;
+            mFlushDeferredCount = 0;
+            mFlushCycleCount = 0;
+            mFlushCycleAppenderCount = 0;
         }
     };
     AtomicRecordAppendManager();
@@ -126,6 +137,7 @@ public:
     int    GetFlushLimit()              const { return mFlushLimit;              }
     double GetBufferLimitRatio()        const { return mBufferLimitRatio;        }
     int    GetMaxWriteIdsPerChunk()     const { return mMaxWriteIdsPerChunk;     }
+    int    GetFlushMinWriteBytes()      const { return mFlushMinWriteBytes;      }
     bool   IsChunkStable(kfsChunkId_t chunkId) const;
     /// For record appends, (1) clients will reserve space in a chunk and
     /// then write and (2) clients can release their reserved space.
@@ -167,6 +179,7 @@ public:
 
     void   UpdateAppenderFlushLimit(const AtomicRecordAppender* appender = 0);
     int    GetFlushLimit(AtomicRecordAppender& appender, int addBytes = 0);
+    bool   DeferFlush(AtomicRecordAppender& appender);
     inline void UpdatePendingFlush(AtomicRecordAppender& appender);
     inline void Detach(AtomicRecordAppender& appender);
     inline void DecOpenAppenderCount();
@@ -176,6 +189,8 @@ public:
 
 private:
     typedef std::tr1::unordered_map<kfsChunkId_t, AtomicRecordAppender*> ARAMap;
+    typedef std::vector<std::pair<const DiskQueue*, AtomicRecordAppender*> >
+        FlushQueue;
 
     ARAMap                mAppenders;
     int                   mCleanUpSec;
@@ -193,9 +208,15 @@ private:
     int64_t               mAppendersWithWidCount;
     double                mBufferLimitRatio;
     int                   mMaxWriteIdsPerChunk;
+    int                   mFlushMinWriteBytes;
+    int                   mFlushMaxDiskQueueRequests;
+    FlushQueue            mFlushQueue;
     AtomicRecordAppender* mPendingFlushList[1];
     const uint64_t        mInstanceNum;
     Counters              mCounters;
+
+    int  GetDiskQueueFreeRequests(const DiskIo::File& file) const;
+    void FlushPendingByDisk();
 };
 
 extern AtomicRecordAppendManager gAtomicRecordAppendManager;
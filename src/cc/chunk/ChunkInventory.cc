@@ -0,0 +1,489 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \file ChunkInventory.cc
+// \brief Per chunk directory inventory of the stable chunks.
+//
+//----------------------------------------------------------------------------
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+}
+
+#include <errno.h>
+#include <string.h>
+#include <tr1/unordered_map>
+
+#include "common/log.h"
+#include "libkfsIO/Checksum.h"
+#include "qcdio/qcutils.h"
+#include "qcdio/qcthread.h"
+#include "qcdio/qcmutex.h"
+#include "qcdio/qcstutils.h"
+
+#include "ChunkInventory.h"
+
+namespace KFS
+{
+
+using std::string;
+
+// "KFSCINV1"
+const int64_t kChunkInventoryMagic  = 0x4b465343494e5631LL;
+const int64_t kChunkInventoryFormat = 1;
+const size_t  kChunkInventoryReadSize = 1 << 20;
+
+//
+// Writes the new inventory into a temporary file, syncs it, renames it
+// over the inventory, and syncs the directory, all in its own thread.
+//
+class ChunkInventory::Compactor : public QCRunnable
+{
+public:
+    Compactor(const string& dirname, const string& filename,
+            Entries& entries)
+        : QCRunnable(),
+          mDirname(dirname),
+          mFilename(filename),
+          mEntries(),
+          mFd(-1),
+          mErr(0),
+          mRecordCount(0),
+          mDoneFlag(false),
+          mMutex(),
+          mThread(0, "ChunkInventory")
+        { mEntries.swap(entries); }
+    virtual ~Compactor()
+    {
+        Join();
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+    virtual void Run()
+    {
+        const string tmpName = mFilename + ".tmp";
+        int fd = open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = fd < 0 ? errno : 0;
+        if (err == 0) {
+            string buf;
+            AppendRecord(buf, kRecordTypeHeader, 0, kChunkInventoryMagic,
+                kChunkInventoryFormat, 0);
+            for (Entries::const_iterator it = mEntries.begin();
+                    it != mEntries.end() && err == 0;
+                    ++it) {
+                AppendRecord(buf, kRecordTypeUpdate, it->fileId, it->chunkId,
+                    it->chunkVersion, it->chunkSize);
+                if (buf.size() >= kMaxBufferedBytes) {
+                    err = WriteAll(fd, buf.data(), buf.size());
+                    buf.clear();
+                }
+            }
+            if (err == 0) {
+                err = WriteAll(fd, buf.data(), buf.size());
+            }
+        }
+        if (err == 0 && fsync(fd) != 0) {
+            err = errno;
+        }
+        if (err == 0 && rename(tmpName.c_str(), mFilename.c_str()) != 0) {
+            err = errno;
+        }
+        if (err == 0) {
+            // Make the rename itself durable.
+            const int dfd = open(mDirname.c_str(), O_RDONLY);
+            if (dfd < 0 || fsync(dfd) != 0) {
+                err = errno;
+            }
+            if (dfd >= 0) {
+                close(dfd);
+            }
+        }
+        if (err != 0) {
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+            unlink(tmpName.c_str());
+        }
+        const int64_t recordCount = (int64_t)mEntries.size() + 1;
+        Entries().swap(mEntries);
+        QCStMutexLocker locker(mMutex);
+        mFd          = fd;
+        mErr         = err;
+        mRecordCount = recordCount;
+        mDoneFlag    = true;
+    }
+    void Start()
+    {
+        if (mThread.TryToStart(this) != 0) {
+            // Compact in the caller's thread.
+            Run();
+        }
+    }
+    void Join()
+    {
+        if (mThread.IsStarted()) {
+            mThread.Join();
+        }
+    }
+    bool IsDone()
+    {
+        QCStMutexLocker locker(mMutex);
+        return mDoneFlag;
+    }
+    /// The following are valid once the thread is joined.
+    int TakeFd()
+    {
+        const int fd = mFd;
+        mFd = -1;
+        return fd;
+    }
+    int GetError() const             { return mErr; }
+    int64_t GetRecordCount() const   { return mRecordCount; }
+    size_t GetChunkCount() const     { return (size_t)(mRecordCount - 1); }
+private:
+    const string mDirname;
+    const string mFilename;
+    Entries      mEntries;
+    int          mFd;
+    int          mErr;
+    int64_t      mRecordCount;
+    bool         mDoneFlag;
+    QCMutex      mMutex;
+    QCThread     mThread;
+private:
+    Compactor(const Compactor&);
+    Compactor& operator=(const Compactor&);
+};
+
+ChunkInventory::ChunkInventory(const string& dirname)
+    : mDirname(dirname),
+      mFilename(dirname + "/chunk_inventory"),
+      mFd(-1),
+      mRecordCount(0),
+      mAppendCount(0),
+      mCompactedCount(0),
+      mBuffer(),
+      mCompactor(0),
+      mPending(),
+      mPendingCount(0)
+{
+}
+
+ChunkInventory::~ChunkInventory()
+{
+    delete mCompactor;
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+uint32_t
+ChunkInventory::ComputeChecksum(const Record& rec)
+{
+    return ComputeBlockChecksum(reinterpret_cast<const char*>(&rec),
+        sizeof(rec) - sizeof(rec.checksum));
+}
+
+bool
+ChunkInventory::Load(Entries& entries, string& errMsg) const
+{
+    entries.clear();
+    const int fd = open(mFilename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        errMsg = QCUtils::SysError(errno, mFilename.c_str());
+        return false;
+    }
+    typedef std::tr1::unordered_map<kfsChunkId_t, Entry> Chunks;
+    Chunks  chunks;
+    char*   const buf = new char[kChunkInventoryReadSize];
+    size_t  len       = 0;
+    int64_t recCount  = 0;
+    bool    cleanFlag = false;
+    ssize_t nrd;
+    errMsg.clear();
+    while (errMsg.empty() &&
+            (nrd = read(fd, buf + len, kChunkInventoryReadSize - len)) > 0) {
+        len += nrd;
+        const char* p = buf;
+        for (; p + sizeof(Record) <= buf + len; p += sizeof(Record)) {
+            Record rec;
+            memcpy(&rec, p, sizeof(rec));
+            if (rec.checksum != ComputeChecksum(rec)) {
+                errMsg = "record checksum mismatch";
+                break;
+            }
+            if (cleanFlag) {
+                errMsg = "records past the clean record";
+                break;
+            }
+            if ((recCount == 0) != (rec.type == kRecordTypeHeader)) {
+                errMsg = "invalid header";
+                break;
+            }
+            recCount++;
+            switch (rec.type) {
+                case kRecordTypeHeader:
+                    if (rec.chunkId != kChunkInventoryMagic ||
+                            rec.chunkVersion != kChunkInventoryFormat) {
+                        errMsg = "invalid magic or format version";
+                    }
+                    break;
+                case kRecordTypeUpdate: {
+                    Entry& entry = chunks[rec.chunkId];
+                    entry.fileId       = rec.fileId;
+                    entry.chunkId      = rec.chunkId;
+                    entry.chunkVersion = rec.chunkVersion;
+                    entry.chunkSize    = rec.chunkSize;
+                    break;
+                }
+                case kRecordTypeRemove:
+                    chunks.erase(rec.chunkId);
+                    break;
+                case kRecordTypeClean:
+                    // The clean record has the preceding records count.
+                    if (rec.chunkId != recCount - 1) {
+                        errMsg = "clean record count mismatch";
+                    }
+                    cleanFlag = true;
+                    break;
+                default:
+                    errMsg = "invalid record type";
+                    break;
+            }
+            if (! errMsg.empty()) {
+                break;
+            }
+        }
+        len -= p - buf;
+        memmove(buf, p, len);
+    }
+    if (errMsg.empty() && nrd < 0) {
+        errMsg = QCUtils::SysError(errno, mFilename.c_str());
+    }
+    close(fd);
+    delete [] buf;
+    if (errMsg.empty()) {
+        if (len != 0) {
+            errMsg = "partial record";
+        } else if (! cleanFlag) {
+            errMsg = "no clean shutdown record";
+        }
+    }
+    if (! errMsg.empty()) {
+        return false;
+    }
+    entries.reserve(chunks.size());
+    for (Chunks::const_iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        entries.push_back(it->second);
+    }
+    return true;
+}
+
+bool
+ChunkInventory::StartCompaction(Entries& entries)
+{
+    if (mCompactor) {
+        return false;
+    }
+    mPending.clear();
+    mPendingCount = 0;
+    mAppendCount  = 0;
+    mCompactor = new Compactor(mDirname, mFilename, entries);
+    mCompactor->Start();
+    return true;
+}
+
+bool
+ChunkInventory::IsCompacting(bool waitFlag)
+{
+    if (! mCompactor) {
+        return false;
+    }
+    if (! waitFlag && ! mCompactor->IsDone()) {
+        return true;
+    }
+    mCompactor->Join();
+    const int     err         = mCompactor->GetError();
+    const int     fd          = mCompactor->TakeFd();
+    const int64_t recordCount = mCompactor->GetRecordCount();
+    const size_t  chunkCount  = mCompactor->GetChunkCount();
+    delete mCompactor;
+    mCompactor = 0;
+    if (err != 0) {
+        mPending.clear();
+        mPendingCount = 0;
+        Disable(err);
+        return false;
+    }
+    // The current file has been replaced. Its buffered records are in
+    // the pending records, which go to the new file.
+    if (mFd >= 0) {
+        close(mFd);
+    }
+    mFd = fd;
+    mBuffer.clear();
+    mBuffer.swap(mPending);
+    mCompactedCount = recordCount;
+    mRecordCount    = recordCount + mPendingCount;
+    mAppendCount    = mPendingCount;
+    mPendingCount   = 0;
+    if (Flush()) {
+        KFS_LOG_STREAM_INFO <<
+            "chunk inventory: " << mFilename <<
+            " chunks: " << chunkCount << " compacted" <<
+        KFS_LOG_EOM;
+    }
+    return false;
+}
+
+void
+ChunkInventory::Update(kfsFileId_t fileId, kfsChunkId_t chunkId,
+    int64_t chunkVersion, int64_t chunkSize)
+{
+    Append(kRecordTypeUpdate, fileId, chunkId, chunkVersion, chunkSize);
+}
+
+void
+ChunkInventory::Remove(kfsChunkId_t chunkId)
+{
+    Append(kRecordTypeRemove, 0, chunkId, 0, 0);
+}
+
+void
+ChunkInventory::AppendRecord(string& buf, RecordType type,
+    int64_t fileId, int64_t chunkId, int64_t chunkVersion, int64_t chunkSize)
+{
+    Record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.fileId       = fileId;
+    rec.chunkId      = chunkId;
+    rec.chunkVersion = chunkVersion;
+    rec.chunkSize    = chunkSize;
+    rec.type         = type;
+    rec.checksum     = ComputeChecksum(rec);
+    buf.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+}
+
+void
+ChunkInventory::Append(RecordType type, int64_t fileId, int64_t chunkId,
+    int64_t chunkVersion, int64_t chunkSize)
+{
+    if (mCompactor) {
+        AppendRecord(mPending, type, fileId, chunkId, chunkVersion, chunkSize);
+        mPendingCount++;
+    }
+    if (mFd < 0) {
+        return;
+    }
+    AppendRecord(mBuffer, type, fileId, chunkId, chunkVersion, chunkSize);
+    mRecordCount++;
+    mAppendCount++;
+    if (mBuffer.size() >= kMaxBufferedBytes) {
+        Flush();
+    }
+}
+
+int
+ChunkInventory::WriteAll(int fd, const char* buf, size_t len)
+{
+    while (len > 0) {
+        const ssize_t nwr = write(fd, buf, len);
+        if (nwr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        buf += nwr;
+        len -= nwr;
+    }
+    return 0;
+}
+
+bool
+ChunkInventory::Write(const char* buf, size_t len)
+{
+    const int err = WriteAll(mFd, buf, len);
+    if (err != 0) {
+        Disable(err);
+        return false;
+    }
+    return true;
+}
+
+bool
+ChunkInventory::Flush()
+{
+    if (mFd < 0) {
+        return false;
+    }
+    if (mBuffer.empty()) {
+        return true;
+    }
+    const bool ok = Write(mBuffer.data(), mBuffer.size());
+    mBuffer.clear();
+    return ok;
+}
+
+bool
+ChunkInventory::Close(bool cleanFlag)
+{
+    IsCompacting(true);
+    if (mFd < 0) {
+        return false;
+    }
+    if (cleanFlag) {
+        Append(kRecordTypeClean, 0, mRecordCount, 0, 0);
+    }
+    bool ok = Flush();
+    if (ok && cleanFlag && fsync(mFd) != 0) {
+        Disable(errno);
+        ok = false;
+    }
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
+    }
+    return ok;
+}
+
+void
+ChunkInventory::Disable(int err)
+{
+    KFS_LOG_STREAM_ERROR <<
+        "chunk inventory: " << QCUtils::SysError(err, mFilename.c_str()) <<
+        "; the chunk directory will be scanned on restart" <<
+    KFS_LOG_EOM;
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
+    }
+    mBuffer.clear();
+    // Without the inventory the next restart has to scan the directory.
+    unlink(mFilename.c_str());
+}
+
+}
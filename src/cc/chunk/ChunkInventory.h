@@ -0,0 +1,159 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \file ChunkInventory.h
+// \brief Per chunk directory inventory of the stable chunks.
+//
+//----------------------------------------------------------------------------
+
+#ifndef CHUNKSERVER_CHUNKINVENTORY_H
+#define CHUNKSERVER_CHUNKINVENTORY_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "common/kfstypes.h"
+
+namespace KFS
+{
+
+///
+/// The inventory is an append only file with fixed size records, one
+/// file per chunk directory. Each record is either the current state of
+/// a stable chunk (file id, chunk id, version, and size), or a chunk
+/// removal. The chunk manager appends a record every time a stable
+/// chunk is created, changes version, is closed, or is removed, and
+/// periodically re-writes (compacts) the file to drop the superseded
+/// records.
+/// On a clean shutdown a "clean" record is appended after all chunks
+/// are closed, and the file is synced. On restart the inventory is used
+/// to rebuild the chunk table with a few large sequential reads instead
+/// of the chunk directory scan, only if the last record is the clean
+/// record, and all record checksums match. The inventory is re-written
+/// on startup without the clean record, therefore an unclean shutdown
+/// always results in the directory scan.
+/// The compaction writes, syncs, and renames the new file in a helper
+/// thread. The records appended in the meantime still go to the current
+/// file, and are also kept in memory, then appended to the new file
+/// once it replaces the current one. A crash in between loses nothing:
+/// neither file has the clean record.
+/// The methods are not thread safe. Load() is invoked by the restart
+/// scan threads, one thread per inventory, all other methods are
+/// invoked by the main thread.
+///
+class ChunkInventory
+{
+public:
+    struct Entry
+    {
+        kfsFileId_t  fileId;
+        kfsChunkId_t chunkId;
+        int64_t      chunkVersion;
+        int64_t      chunkSize;
+    };
+    typedef std::vector<Entry> Entries;
+
+    ChunkInventory(const std::string& dirname);
+    ~ChunkInventory();
+    /// Read the inventory.
+    /// @param[out] entries  The chunks in the inventory.
+    /// @param[out] errMsg   The reason the inventory can not be used.
+    /// @retval true if the inventory was closed cleanly and is valid.
+    bool Load(Entries& entries, std::string& errMsg) const;
+    /// Start writing out a new inventory with the specified entries in
+    /// the helper thread. The entries are swapped out of the argument.
+    /// @retval false if a compaction is already in progress.
+    bool StartCompaction(Entries& entries);
+    /// Switch to the new inventory, and keep it open for appending, if
+    /// the compaction is done, or once it is done if waitFlag is set.
+    /// @retval true if the compaction is still in progress.
+    bool IsCompacting(bool waitFlag = false);
+    void Update(kfsFileId_t fileId, kfsChunkId_t chunkId,
+        int64_t chunkVersion, int64_t chunkSize);
+    void Remove(kfsChunkId_t chunkId);
+    /// Write out the buffered records.
+    bool Flush();
+    /// Flush, and if cleanFlag is set append the clean record and sync.
+    bool Close(bool cleanFlag);
+    /// Return true if the number of records appended since the last
+    /// compaction exceeds both minRecords and the number of records
+    /// written by the compaction.
+    bool NeedsCompaction(int64_t minRecords) const
+    {
+        return (mFd >= 0 && ! mCompactor &&
+            mAppendCount > std::max(minRecords, mCompactedCount));
+    }
+    bool IsOpen() const
+        { return (mFd >= 0); }
+    const std::string& GetDirname() const
+        { return mDirname; }
+    const std::string& GetFilename() const
+        { return mFilename; }
+private:
+    enum RecordType
+    {
+        kRecordTypeHeader = 1,
+        kRecordTypeUpdate = 2,
+        kRecordTypeRemove = 3,
+        kRecordTypeClean  = 4
+    };
+    struct Record
+    {
+        int64_t  fileId;
+        int64_t  chunkId;
+        int64_t  chunkVersion;
+        int64_t  chunkSize;
+        uint32_t type;
+        uint32_t checksum;
+    };
+    enum { kMaxBufferedBytes = 64 << 10 };
+    class Compactor;
+
+    const std::string mDirname;
+    const std::string mFilename;
+    int               mFd;
+    int64_t           mRecordCount;
+    int64_t           mAppendCount;
+    int64_t           mCompactedCount;
+    std::string       mBuffer;
+    Compactor*        mCompactor;
+    /// Records appended since the compaction started.
+    std::string       mPending;
+    int64_t           mPendingCount;
+
+    void Append(RecordType type, int64_t fileId, int64_t chunkId,
+        int64_t chunkVersion, int64_t chunkSize);
+    bool Write(const char* buf, size_t len);
+    void Disable(int err);
+    static uint32_t ComputeChecksum(const Record& rec);
+    static void AppendRecord(std::string& buf, RecordType type,
+        int64_t fileId, int64_t chunkId,
+        int64_t chunkVersion, int64_t chunkSize);
+    static int WriteAll(int fd, const char* buf, size_t len);
+private:
+    ChunkInventory(const ChunkInventory&);
+    ChunkInventory& operator=(const ChunkInventory&);
+};
+
+}
+
+#endif // CHUNKSERVER_CHUNKINVENTORY_H
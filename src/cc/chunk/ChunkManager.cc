@@ -25,6 +25,7 @@
 
 extern "C" {
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
@@ -38,6 +39,7 @@ extern "C" {
 #include "common/kfstypes.h"
 
 #include "ChunkManager.h"
+#include "ChunkInventory.h"
 #include "ChunkServer.h"
 #include "MetaServerSM.h"
 #include "LeaseClerk.h"
@@ -49,6 +51,7 @@ extern "C" {
 #include "libkfsIO/Counter.h"
 #include "libkfsIO/Checksum.h"
 #include "libkfsIO/Globals.h"
+#include "qcdio/qcthread.h"
 
 #include <fstream>
 #include <sstream>
@@ -223,6 +226,10 @@ inline void ChunkManager::LruUpdate(ChunkInfoHandle& cih) {
 }
 
 inline void ChunkManager::Release(ChunkInfoHandle& cih) {
+    if (cih.IsFileOpen()) {
+        // Record the final size.
+        InventoryUpdate(&cih);
+    }
     cih.Release(mChunkInfoLists);
 }
 
@@ -376,6 +383,9 @@ ChunkManager::ChunkManager()
     // check once every 6 hours
     mNextChunkDirsCheckTime = 0;
     mChunkDirsCheckIntervalSecs = 6 * 3600;
+    mInventoryEnabledFlag = true;
+    mInventoryVerifyCount = 64;
+    mInventoryMinCompactRecords = 64 << 10;
     // Seed write id.
     RAND_pseudo_bytes(
         reinterpret_cast<unsigned char*>(&mWriteId), int(sizeof(mWriteId)));
@@ -429,6 +439,24 @@ ChunkManager::Shutdown()
         }
         usleep(10000);
     }
+    // The inventories are valid on the next restart only if all chunks
+    // were closed, and therefore their final sizes recorded.
+    const bool cleanFlag = mChunkTable.empty();
+    for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
+        ChunkInventory* const inv = mChunkDirs[i].inventory;
+        if (! inv) {
+            continue;
+        }
+        if (inv->IsOpen()) {
+            KFS_LOG_STREAM_INFO <<
+                "closing chunk inventory: " << inv->GetFilename() <<
+                (cleanFlag ? "" : " not clean") <<
+            KFS_LOG_EOM;
+            inv->Close(cleanFlag);
+        }
+        delete inv;
+        mChunkDirs[i].inventory = 0;
+    }
     globalNetManager().UnRegisterTimeoutHandler(mChunkManagerTimeoutImpl);
     delete mChunkManagerTimeoutImpl;
     mChunkManagerTimeoutImpl = 0;
@@ -468,6 +496,15 @@ ChunkManager::Init(const vector<string> &chunkDirs, int64_t totalSpace, const Pr
     mChunkDirsCheckIntervalSecs = std::max(1, prop.getValue(
         "chunkServer.chunkDirsCheckIntervalSecs",
         mChunkDirsCheckIntervalSecs));
+    mInventoryEnabledFlag = prop.getValue(
+        "chunkServer.inventory.enabled",
+        mInventoryEnabledFlag ? 1 : 0) != 0;
+    mInventoryVerifyCount = std::max(0, prop.getValue(
+        "chunkServer.inventory.verifyCount",
+        mInventoryVerifyCount));
+    mInventoryMinCompactRecords = std::max(int64_t(1024), prop.getValue(
+        "chunkServer.inventory.minCompactRecords",
+        mInventoryMinCompactRecords));
 
     mTotalSpace = totalSpace;
     for (uint32_t i = 0; i < chunkDirs.size(); i++) {
@@ -627,6 +664,7 @@ ChunkManager::MakeChunkStable(kfsChunkId_t chunkId)
     cih->chunkInfo.SetDirname(dirname);
     const string newName = MakeChunkPathname(cih);
     rename(oldName.c_str(), newName.c_str());
+    InventoryUpdate(cih);
     KFS_LOG_STREAM_INFO << "Making chunk: " << chunkId << " stable (final dir: " << dirname << ")" << KFS_LOG_EOM;
     return 0;
 }
@@ -698,6 +736,7 @@ ChunkManager::CoalesceBlock(kfsFileId_t srcFid, kfsChunkId_t srcChunkId,
         mChunkTable[dstChunkId] = dstCih;
         mIsChunkTableDirty = true;
         mNumChunks++;
+        InventoryUpdate(dstCih);
 
         // when the coalesce succeeds, we unlink the original file. that'll get the used value back down.
         UpdateDirSpace(dstCih, dstCih->chunkInfo.chunkSize);
@@ -738,6 +777,7 @@ ChunkManager::DeleteChunk(kfsChunkId_t chunkId)
 
     mUsedSpace -= cih->chunkInfo.chunkSize;
     mPendingWrites.Delete(chunkId, cih->chunkInfo.chunkVersion);
+    InventoryRemove(cih);
     mChunkTable.erase(tableEntry);
     Delete(*cih);
     return 0;
@@ -976,6 +1016,7 @@ ChunkManager::StaleChunk(kfsChunkId_t chunkId, bool deleteOk)
     }
     UpdateDirSpace(cih, -cih->chunkInfo.chunkSize);
     mUsedSpace -= cih->chunkInfo.chunkSize;
+    InventoryRemove(cih);
     mChunkTable.erase(it);
     Delete(*cih);
     return 0;
@@ -1015,6 +1056,9 @@ ChunkManager::TruncateChunk(kfsChunkId_t chunkId, off_t chunkSize)
 
     // XXX: Could do better; recompute the checksum for this last block
     cih->chunkInfo.chunkBlockChecksum[lastChecksumBlock] = 0;
+    if (! cih->IsFileOpen()) {
+        InventoryUpdate(cih);
+    }
 
     return 0;
 }
@@ -1061,6 +1105,8 @@ ChunkManager::ChangeChunkVers(kfsFileId_t fileId,
                             << errno << KFS_LOG_EOM;
     } else if (! IsChunkStable(chunkId)) {
         MakeChunkStable(chunkId);
+    } else {
+        InventoryUpdate(cih);
     }
     return ret;
 }
@@ -1194,49 +1240,6 @@ ChunkManager::MakeStaleChunkPathname(ChunkInfoHandle *cih)
     );
 }
 
-void
-ChunkManager::MakeChunkInfoFromPathname(const string &pathname, off_t filesz, ChunkInfoHandle **result)
-{
-    string::size_type slash = pathname.rfind('/');
-    ChunkInfoHandle *cih;
-
-    if (slash == string::npos) {
-        *result = NULL;
-        return;
-    }
-    
-    string chunkFn, dirname;
-    vector<string> component;
-
-    dirname.assign(pathname, 0, slash);
-    chunkFn.assign(pathname, slash + 1, string::npos);
-    split(component, chunkFn, '.');
-    assert(component.size() == 3);
-
-    chunkId_t chunkId = atoll(component[1].c_str());
-    if (GetChunkInfoHandle(chunkId, &cih) == 0) {
-        KFS_LOG_STREAM_INFO << "Duplicate chunk " << chunkId <<
-            " with path: " << pathname << KFS_LOG_EOM;
-        *result = NULL;
-        return;
-    }
-
-    cih = new ChunkInfoHandle();    
-    cih->chunkInfo.fileId = atoll(component[0].c_str());
-    cih->chunkInfo.chunkId = atoll(component[1].c_str());
-    cih->chunkInfo.chunkVersion = atoll(component[2].c_str());
-    if (filesz >= (off_t) KFS_CHUNK_HEADER_SIZE)
-        cih->chunkInfo.chunkSize = filesz - KFS_CHUNK_HEADER_SIZE;
-    cih->chunkInfo.SetDirname(dirname);
-    *result = cih;
-    /*
-    KFS_LOG_STREAM_DEBUG << "From " << chunkFn << " restored: " <<
-        cih->chunkInfo.fileId << ", " << cih->chunkInfo.chunkId << ", " <<
-        cih->chunkInfo.chunkVersion <<
-    KFS_LOG_EOM;
-    */
-}
-
 int
 ChunkManager::OpenChunk(kfsChunkId_t chunkId, 
                         int openFlags)
@@ -1707,6 +1710,7 @@ ChunkManager::NotifyMetaChunksLost(const string &dirname)
         ccop->isChunkLost = 1;
         gMetaServerSM.EnqueueOp(ccop);
         // get rid of chunkid from our list
+        InventoryRemove(cih);
         mChunkTable.erase(iter++);
         Delete(*cih);
     }
@@ -1902,119 +1906,370 @@ ChunkManager::GetChunkDirsEntries(struct dirent ***namelist)
     return numChunkFiles;
 }
 
-void
-ChunkManager::GetChunkPathEntries(vector<string> &pathnames)
-{
-    uint32_t i;
-    struct dirent **entries = NULL;
-    int res;
-
-    for (i = 0; i < mChunkDirs.size(); i++) {
-        res = scandir(mChunkDirs[i].dirname.c_str(), &entries, 0, alphasort);
-        if (res < 0) {
-            KFS_LOG_STREAM_INFO <<
-                "unable to open " << mChunkDirs[i].dirname <<
-            KFS_LOG_EOM;
-            mChunkDirs[i].availableSpace = -1;
-            continue;
-        }
-        for (int j = 0; j < res; j++) {
-            string s = mChunkDirs[i].dirname + "/" + entries[j]->d_name;
-            pathnames.push_back(s);
-            free(entries[j]);
-        }
-        free(entries);
-    }
-}
-
 void
 ChunkManager::Restart()
 {
     int version;
 
     version = gLogger.GetVersionFromCkpt();
-    if (version == gLogger.GetLoggerVersionNum()) {
+    if (gLogger.IsRestartSupported(version)) {
         Restore();
     } else {
         std::cout << "Unsupported version...copy out the data and copy it back in...." << std::endl;
         exit(-1);
     }
 
-    // Write out a new checkpoint file with just version and set it at 2
+    // Write out a new checkpoint file with just the current version
     gLogger.Checkpoint(NULL);
 }
 
 //
-// On a restart, whatever chunks were dirty need to be nuked: we may
-// have had writes pending to them and we never flushed them to disk.
+// Restart scan of a single chunk directory. On a restart the chunk
+// directories (typically one per drive) are scanned in parallel, one
+// thread per directory, and the results are merged into the chunk table
+// by the caller once all scans are done. If the directory has a valid
+// inventory, the chunk list is loaded from the inventory instead.
 //
-void
-ChunkManager::RemoveDirtyChunks()
+class ChunkDirScanner : public QCRunnable
 {
-    uint32_t i;
-    struct dirent **entries = NULL;
-
-    for (i = 0; i < mChunkDirs.size(); i++) {
-        string dirname = GetDirtyChunkPath(mChunkDirs[i].dirname);
-        int nentries = scandir(dirname.c_str(), &entries, 0, alphasort);
-        if (nentries < 0) {
+public:
+    typedef ChunkInventory::Entry   Entry;
+    typedef ChunkInventory::Entries Entries;
+
+    ChunkDirScanner(const string& dirname,
+            const ChunkInventory* inventory, int verifyCount)
+        : QCRunnable(),
+          mDirname(dirname),
+          mInventory(inventory),
+          mVerifyCount(verifyCount),
+          mEntries(),
+          mOpenFailedFlag(false),
+          mInventoryUsedFlag(false),
+          mScanTime(0),
+          mThread(0, "ChunkDirScanner")
+        {}
+    virtual void Run()
+    {
+        struct timeval start, end;
+        gettimeofday(&start, 0);
+        RemoveDirtyChunks();
+        mInventoryUsedFlag = mInventory && LoadInventory();
+        if (! mInventoryUsedFlag) {
+            Scan();
+        }
+        gettimeofday(&end, 0);
+        mScanTime = (end.tv_sec - start.tv_sec) +
+            (end.tv_usec - start.tv_usec) * 1e-6;
+    }
+    void Start()
+    {
+        if (mThread.TryToStart(this) != 0) {
+            // Scan in the caller's thread.
+            Run();
+        }
+    }
+    void Join()
+    {
+        if (mThread.IsStarted()) {
+            mThread.Join();
+        }
+    }
+    const string& GetDirname() const     { return mDirname; }
+    const Entries& GetEntries() const    { return mEntries; }
+    bool IsOpenFailed() const            { return mOpenFailedFlag; }
+    bool IsInventoryUsed() const         { return mInventoryUsedFlag; }
+    double GetScanTime() const           { return mScanTime; }
+private:
+    const string                mDirname;
+    const ChunkInventory* const mInventory;
+    const int                   mVerifyCount;
+    Entries                     mEntries;
+    bool                        mOpenFailedFlag;
+    bool                        mInventoryUsedFlag;
+    double                      mScanTime;
+    QCThread                    mThread;
+
+    // Chunk file name is of the form: <fileid>.<chunkid>.<chunkversion>
+    static bool ParseChunkFilename(const char* name, Entry& entry)
+    {
+        const char* p = name;
+        char*       end;
+        int64_t     val[3];
+        for (int i = 0; i < 3; i++) {
+            if (*p < '0' || *p > '9') {
+                return false;
+            }
+            val[i] = strtoll(p, &end, 10);
+            if (*end != (i < 2 ? '.' : 0)) {
+                return false;
+            }
+            p = end + 1;
+        }
+        entry.fileId       = val[0];
+        entry.chunkId      = val[1];
+        entry.chunkVersion = val[2];
+        return true;
+    }
+    static bool MayBeRegularFile(const struct dirent* ent)
+    {
+#ifdef DT_UNKNOWN
+        return (ent->d_type == DT_REG || ent->d_type == DT_UNKNOWN ||
+            ent->d_type == DT_LNK);
+#else
+        return true;
+#endif
+    }
+    void Scan()
+    {
+        DIR* const dir = opendir(mDirname.c_str());
+        if (! dir) {
+            mOpenFailedFlag = true;
+            return;
+        }
+        const int dfd = dirfd(dir);
+        struct dirent* ent;
+        Entry entry;
+        while ((ent = readdir(dir))) {
+            // Use the directory entry type and the name to skip
+            // everything but the chunk files without stat; the file size
+            // is the only attribute that isn't in the name.
+            if (! MayBeRegularFile(ent) ||
+                    ! ParseChunkFilename(ent->d_name, entry)) {
+                continue;
+            }
+            struct stat buf;
+            if (fstatat(dfd, ent->d_name, &buf, 0) != 0 ||
+                    ! S_ISREG(buf.st_mode)) {
+                continue;
+            }
+            entry.chunkSize = buf.st_size >= (off_t)KFS_CHUNK_HEADER_SIZE ?
+                buf.st_size - KFS_CHUNK_HEADER_SIZE : 0;
+            mEntries.push_back(entry);
+        }
+        closedir(dir);
+    }
+    bool LoadInventory()
+    {
+        string errMsg;
+        if (! mInventory->Load(mEntries, errMsg)) {
             KFS_LOG_STREAM_INFO <<
-                "unable to open " << mChunkDirs[i].dirname <<
+                "not using chunk inventory: " << mInventory->GetFilename() <<
+                ": " << errMsg <<
+            KFS_LOG_EOM;
+            return false;
+        }
+        // Spot check the inventory against the chunk files.
+        const size_t step = mVerifyCount > 0 ?
+            max(size_t(1), mEntries.size() / mVerifyCount) : 0;
+        for (size_t i = 0; step > 0 && i < mEntries.size(); i += step) {
+            const Entry& entry = mEntries[i];
+            ostringstream os;
+            os << mDirname << '/' << entry.fileId << '.' <<
+                entry.chunkId << '.' << entry.chunkVersion;
+            struct stat buf;
+            if (stat(os.str().c_str(), &buf) != 0 ||
+                    ! S_ISREG(buf.st_mode) ||
+                    buf.st_size != entry.chunkSize +
+                        (off_t)KFS_CHUNK_HEADER_SIZE) {
+                KFS_LOG_STREAM_INFO <<
+                    "not using chunk inventory: " <<
+                        mInventory->GetFilename() <<
+                    ": chunk file " << os.str() << " mismatch" <<
                 KFS_LOG_EOM;
-            continue;
+                mEntries.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+    // On a restart, whatever chunks were dirty need to be nuked: we may
+    // have had writes pending to them and we never flushed them to disk.
+    void RemoveDirtyChunks()
+    {
+        const string dirname = GetDirtyChunkPath(mDirname);
+        DIR* const dir = opendir(dirname.c_str());
+        if (! dir) {
+            KFS_LOG_STREAM_INFO <<
+                "unable to open " << dirname <<
+            KFS_LOG_EOM;
+            return;
         }
-        for (int j = 0; j < nentries; j++) {
-            string s = dirname + "/" + entries[j]->d_name;
+        const int dfd = dirfd(dir);
+        struct dirent* ent;
+        while ((ent = readdir(dir))) {
             struct stat buf;
-            int res;
+            if (! MayBeRegularFile(ent) ||
+                    fstatat(dfd, ent->d_name, &buf, 0) != 0 ||
+                    ! S_ISREG(buf.st_mode)) {
+                continue;
+            }
+            KFS_LOG_STREAM_INFO <<
+                "Cleaning out dirty chunk: " << dirname << "/" << ent->d_name <<
+            KFS_LOG_EOM;
+            unlinkat(dfd, ent->d_name, 0);
+        }
+        closedir(dir);
+    }
+private:
+    ChunkDirScanner(const ChunkDirScanner&);
+    ChunkDirScanner& operator=(const ChunkDirScanner&);
+};
 
-            free(entries[j]);
-            res = stat(s.c_str(), &buf);
+void
+ChunkManager::Restore()
+{
+    struct timeval start, end;
+    gettimeofday(&start, 0);
 
-            if ((res < 0) || (!S_ISREG(buf.st_mode)))
-                continue;
+    vector<ChunkDirScanner*> scanners;
+    scanners.reserve(mChunkDirs.size());
+    for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
+        if (mInventoryEnabledFlag && ! mChunkDirs[i].inventory) {
+            mChunkDirs[i].inventory = new ChunkInventory(mChunkDirs[i].dirname);
+        }
+        scanners.push_back(new ChunkDirScanner(mChunkDirs[i].dirname,
+            mChunkDirs[i].inventory, mInventoryVerifyCount));
+        scanners.back()->Start();
+    }
+    for (uint32_t i = 0; i < scanners.size(); i++) {
+        scanners[i]->Join();
+    }
 
+    // Build the chunk table in the order of the chunk directories; if
+    // the same chunk is found more than once, the first one found wins.
+    for (uint32_t i = 0; i < scanners.size(); i++) {
+        const ChunkDirScanner& scanner = *scanners[i];
+        if (scanner.IsOpenFailed()) {
             KFS_LOG_STREAM_INFO <<
-                "Cleaning out dirty chunk: " << s <<
+                "unable to open " << mChunkDirs[i].dirname <<
             KFS_LOG_EOM;
-            unlink(s.c_str());
+            mChunkDirs[i].availableSpace = -1;
+            continue;
         }
-        free(entries);
+        const ChunkDirScanner::Entries& entries = scanner.GetEntries();
+        KFS_LOG_STREAM_INFO <<
+            "chunk dir: " << scanner.GetDirname() <<
+            " chunks: "    << entries.size() <<
+            (scanner.IsInventoryUsed() ? " inventory" : " scan") <<
+            " time: " << scanner.GetScanTime() << " sec" <<
+        KFS_LOG_EOM;
+        for (ChunkDirScanner::Entries::const_iterator it = entries.begin();
+                it != entries.end();
+                ++it) {
+            ChunkInfoHandle *cih;
+            if (GetChunkInfoHandle(it->chunkId, &cih) == 0) {
+                const string s = MakeChunkPathname(scanner.GetDirname(),
+                    it->fileId, it->chunkId, it->chunkVersion);
+                KFS_LOG_STREAM_INFO <<
+                    "Duplicate chunk " << it->chunkId <<
+                    " with path: " << s <<
+                KFS_LOG_EOM;
+                KFS_LOG_STREAM_INFO <<
+                    "Deleting possibly duplicate file " << s <<
+                KFS_LOG_EOM;
+                unlink(s.c_str());
+                continue;
+            }
+            cih = new ChunkInfoHandle();
+            cih->chunkInfo.fileId       = it->fileId;
+            cih->chunkInfo.chunkId      = it->chunkId;
+            cih->chunkInfo.chunkVersion = it->chunkVersion;
+            cih->chunkInfo.chunkSize    = it->chunkSize;
+            cih->chunkInfo.SetDirname(scanner.GetDirname());
+            AddMapping(cih);
+        }
+    }
+    for (uint32_t i = 0; i < scanners.size(); i++) {
+        delete scanners[i];
     }
+    // Start new inventories without the clean shutdown record, so that
+    // the inventory isn't used after an unclean shutdown.
+    CompactInventories(true);
+    gettimeofday(&end, 0);
+    KFS_LOG_STREAM_INFO <<
+        "restored chunks: " << mNumChunks <<
+        " dirs: "           << mChunkDirs.size() <<
+        " time: "           << ((end.tv_sec - start.tv_sec) +
+            (end.tv_usec - start.tv_usec) * 1e-6) << " sec" <<
+    KFS_LOG_EOM;
 }
 
-void
-ChunkManager::Restore()
+ChunkInventory*
+ChunkManager::GetInventory(const ChunkInfoHandle *cih) const
 {
-    // sort all the chunk names alphabetically in each of the
-    // directories
-    vector<string> chunkPathnames;
-    struct stat buf;
-    int res;
-    uint32_t i, numChunkFiles;
+    const string& dirname = cih->chunkInfo.GetDirname();
+    for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
+        // Dirty chunks have no inventory.
+        if (mChunkDirs[i].inventory && mChunkDirs[i].dirname == dirname) {
+            return mChunkDirs[i].inventory;
+        }
+    }
+    return 0;
+}
 
-    RemoveDirtyChunks();
+void
+ChunkManager::InventoryUpdate(const ChunkInfoHandle *cih)
+{
+    ChunkInventory* const inv = GetInventory(cih);
+    if (inv) {
+        inv->Update(cih->chunkInfo.fileId, cih->chunkInfo.chunkId,
+            cih->chunkInfo.chunkVersion, cih->chunkInfo.chunkSize);
+    }
+}
 
-    GetChunkPathEntries(chunkPathnames);
+void
+ChunkManager::InventoryRemove(const ChunkInfoHandle *cih)
+{
+    ChunkInventory* const inv = GetInventory(cih);
+    if (inv) {
+        inv->Remove(cih->chunkInfo.chunkId);
+    }
+}
 
-    numChunkFiles = chunkPathnames.size();
-    // each chunk file is of the form: <fileid>.<chunkid>.<chunkversion>  
-    // parse the filename to extract out the chunk info
-    for (i = 0; i < numChunkFiles; ++i) {
-        string s = chunkPathnames[i];
-        ChunkInfoHandle *cih;
-        res = stat(s.c_str(), &buf);
-        if ((res < 0) || (!S_ISREG(buf.st_mode)))
+void
+ChunkManager::CompactInventories(bool force)
+{
+    vector<ChunkInventory::Entries> entries(mChunkDirs.size());
+    vector<bool>                    compact(mChunkDirs.size(), false);
+    bool                            compactFlag = false;
+    for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
+        ChunkInventory* const inv = mChunkDirs[i].inventory;
+        if (! inv || mChunkDirs[i].availableSpace < 0 ||
+                inv->IsCompacting()) {
             continue;
-        MakeChunkInfoFromPathname(s, buf.st_size, &cih);
-        if (cih != NULL)
-            AddMapping(cih);
-        else {
-            KFS_LOG_STREAM_INFO <<
-                "Deleting possibly duplicate file " << s <<
-            KFS_LOG_EOM;
-            unlink(s.c_str());
         }
+        compact[i] = force || inv->NeedsCompaction(mInventoryMinCompactRecords);
+        if (compact[i]) {
+            compactFlag = true;
+        } else {
+            inv->Flush();
+        }
+    }
+    if (! compactFlag) {
+        return;
+    }
+    for (CMI it = mChunkTable.begin(); it != mChunkTable.end(); ++it) {
+        const ChunkInfoHandle* const cih = it->second;
+        const string& dirname = cih->chunkInfo.GetDirname();
+        for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
+            if (compact[i] && mChunkDirs[i].dirname == dirname) {
+                ChunkInventory::Entry entry;
+                entry.fileId       = cih->chunkInfo.fileId;
+                entry.chunkId      = cih->chunkInfo.chunkId;
+                entry.chunkVersion = cih->chunkInfo.chunkVersion;
+                entry.chunkSize    = cih->chunkInfo.chunkSize;
+                entries[i].push_back(entry);
+                break;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
+        if (! compact[i]) {
+            continue;
+        }
+        // The file is written out by the inventory's helper thread, the
+        // time out handler picks up the result.
+        mChunkDirs[i].inventory->StartCompaction(entries[i]);
     }
 }
 
@@ -2312,6 +2567,12 @@ ChunkManager::Timeout()
     verifyExecutingOnEventProcessor();
 #endif
 
+    // Switch to the compacted inventories that are ready.
+    for (uint32_t i = 0; i < mChunkDirs.size(); i++) {
+        if (mChunkDirs[i].inventory) {
+            mChunkDirs[i].inventory->IsCompacting();
+        }
+    }
     if (now >= mNextCheckpointTime) {
         Checkpoint();
         // if any writes have been around for "too" long, remove them
@@ -2319,6 +2580,7 @@ ChunkManager::Timeout()
         ScavengePendingWrites(now);
         // cleanup inactive fd's and thereby free up fd's
         CleanupInactiveFds(now);
+        CompactInventories(false);
     } else if (now > mNextPendingMetaSyncScanTime) {
         PendingMetaSyncQueue::Iterator it(mChunkInfoLists);
         int i = 0;
@@ -30,6 +30,7 @@
 
 #include <tr1/unordered_map>
 #include <vector>
+#include <list>
 #include <string>
 #include <set>
 #include <map>
@@ -48,6 +49,7 @@ namespace KFS
 const size_t KFS_CHUNK_HEADER_SIZE = 16384;
 
 class ChunkInfoHandle;
+class ChunkInventory;
 
 class DiskIo;
 class Properties;
@@ -600,10 +602,13 @@ private:
     };
 
     struct ChunkDirInfo_t {
-        ChunkDirInfo_t() : usedSpace(0), availableSpace(0) { }
+        ChunkDirInfo_t() : usedSpace(0), availableSpace(0), inventory(0) { }
         std::string dirname;
         int64_t usedSpace;
         int64_t availableSpace;
+        /// inventory of the stable chunks in this dir; used on restart
+        /// instead of the dir scan
+        ChunkInventory* inventory;
     };
 
     /// Map from a chunk id to a chunk handle
@@ -670,13 +675,17 @@ private:
 
     Counters mCounters;
 
+    /// maintain the chunk inventories
+    bool    mInventoryEnabledFlag;
+    /// # of the inventory entries to validate against the chunk files
+    /// on restart
+    int     mInventoryVerifyCount;
+    /// min # of records appended to an inventory before compacting it
+    int64_t mInventoryMinCompactRecords;
+
     inline void Delete(ChunkInfoHandle& cih);
     inline void Release(ChunkInfoHandle& cih);
 
-    /// Given a chunk file name, extract out the
-    /// fileid/chunkid/chunkversion from it and build a chunkinfo structure
-    void MakeChunkInfoFromPathname(const std::string &pathname, off_t filesz, ChunkInfoHandle **result);
-
     /// Of the various directories this chunkserver is configured with, find the directory to store a chunk file.  
     /// This method does a "directory allocation".
     std::string GetDirForChunk();
@@ -741,17 +750,23 @@ private:
     /// @retval on success, # of entries in the array;
     ///         on failures, -1
     int GetChunkDirsEntries(struct dirent ***namelist);
-    /// Get all the chunk pathnames into a single vector
-    void GetChunkPathEntries(std::vector<std::string> &pathnames);
 
     /// Helper function to move a chunk to the stale dir
     void MarkChunkStale(ChunkInfoHandle *cih);
 
-    /// On a restart, nuke out all the dirty chunks
-    void RemoveDirtyChunks();
-
-    /// Scan the chunk dirs and rebuild the list of chunks that are hosted on this server
+    /// Scan the chunk dirs and rebuild the list of chunks that are hosted
+    /// on this server.  The dirs are scanned in parallel, one thread per
+    /// dir, and the dirty chunks are removed.
     void Restore();
+    /// Return the inventory of the dir where the chunk resides if the
+    /// chunk is stable.
+    ChunkInventory* GetInventory(const ChunkInfoHandle *cih) const;
+    /// Append chunk's current state, or removal to its dir inventory.
+    void InventoryUpdate(const ChunkInfoHandle *cih);
+    void InventoryRemove(const ChunkInfoHandle *cih);
+    /// Flush the inventories, and re-write the ones with too many
+    /// appended records, or all of them if force is set.
+    void CompactInventories(bool force);
     /// Restore the chunk meta-data from the specified file name.
     void RestoreChunkMeta(const std::string &chunkMetaFn);
     
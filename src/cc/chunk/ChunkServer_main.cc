@@ -322,7 +322,7 @@ main(int argc, char **argv)
 
     gChunkServer.Init();
     gChunkManager.Init(gChunkDirs, gTotalSpace, gProp);
-    gLogger.Init(gLogDir);
+    gLogger.Init(gLogDir, gProp);
     gMetaServerSM.SetMetaInfo(gMetaServerLoc, gClusterKey, gChunkServerRackId, gMD5Sum, gProp);
 
     signal(SIGPIPE, SIG_IGN);
@@ -502,9 +502,15 @@ ReadChunkServerProperties(char *fileName)
         gProp.getValue("chunkServer.remoteSync.responseTimeoutSec",
             RemoteSyncSM::GetResponseTimeoutSec())
     );
+    // Millisecond timeout, if set, takes precedence.
+    RemoteSyncSM::SetResponseTimeoutMs(
+        gProp.getValue("chunkServer.remoteSync.responseTimeoutMs",
+            RemoteSyncSM::GetResponseTimeoutMs())
+    );
     RemoteSyncSM::SetTraceRequestResponse(
         gProp.getValue("chunkServer.remoteSync.traceRequestResponse", false)
     );
+    gOpTracer.SetParameters(gProp);
     NetErrorSimulatorConfigure(
         libkfsio::globalNetManager(),
         gProp.getValue("chunkServer.netErrorSimulator", "")
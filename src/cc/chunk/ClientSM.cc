@@ -149,6 +149,8 @@ ClientSM::SendResponse(KfsOp *op)
     op->ResponseContent(iobuf, len);
     mNetConnection->Write(iobuf, len);
     gClientManager.RequestDone((int64_t)(timespent * 1e6), *op);
+    op->TraceStage(OpTrace::kStageResponseSent);
+    gOpTracer.Done(*op);
 }
 
 ///
@@ -652,6 +654,7 @@ ClientSM::HandleClientCmd(IOBuffer *iobuf, int cmdLen)
 
     mOps.push_back(std::make_pair(op, bufferBytes));
     op->clnt = this;
+    op->TraceStage(OpTrace::kStageSubmitted);
     gChunkServer.OpInserted();
     if (submitResponseFlag) {
         HandleRequest(EVENT_CMD_DONE, op);
@@ -693,6 +696,7 @@ ClientSM::OpFinished(KfsOp *doneOp)
         mPendingSubmitQueue.pop_front();
         gChunkServer.OpInserted();
         mOps.push_back(std::make_pair(op, 0));
+        op->TraceStage(OpTrace::kStageSubmitted);
         SubmitOp(op);
     }
 }
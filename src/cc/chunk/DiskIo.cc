@@ -31,6 +31,7 @@
 
 #include "libkfsIO/IOBuffer.h"
 #include "libkfsIO/Globals.h"
+#include "libkfsIO/Counter.h"
 #include "common/properties.h"
 #include "common/log.h"
 #include "common/kfstypes.h"
@@ -54,6 +55,12 @@ class DiskQueue : public QCDiskQueue
 {
 public:
     typedef QCDLList<DiskQueue, 0> DiskQueueList;
+    enum IoType
+    {
+        kIoTypeRead,
+        kIoTypeWrite,
+        kIoTypeSync
+    };
 
     DiskQueue(
         DiskQueue**   inListPtr,
@@ -61,11 +68,24 @@ public:
         const char*   inFileNamePrefixPtr)
         : QCDiskQueue(),
           mFileNamePrefixes(inFileNamePrefixPtr ? inFileNamePrefixPtr : ""),
-          mDeviceId(inDeviceId)
+          mDeviceId(inDeviceId),
+          mPendingCount(0),
+          mPendingCounter(CounterName(inFileNamePrefixPtr, "pending").c_str()),
+          mReadLatency(CounterName(inFileNamePrefixPtr,
+            "read latency").c_str()),
+          mWriteLatency(CounterName(inFileNamePrefixPtr,
+            "write latency").c_str()),
+          mSyncLatency(CounterName(inFileNamePrefixPtr,
+            "sync latency").c_str())
     {
         mFileNamePrefixes.append(1, (char)0);
         DiskQueueList::Init(*this);
         DiskQueueList::PushBack(inListPtr, *this);
+        CounterManager& theManager = libkfsio::globals().counterManager;
+        theManager.AddCounter(&mPendingCounter);
+        theManager.AddCounter(&mReadLatency);
+        theManager.AddCounter(&mWriteLatency);
+        theManager.AddCounter(&mSyncLatency);
     }
     void Delete(
         DiskQueue** inListPtr)
@@ -73,6 +93,30 @@ public:
         DiskQueueList::Remove(inListPtr, *this);
         delete this;
     }
+    static IoType GetIoType(
+        size_t inReadLength,
+        bool   inNoBuffersFlag)
+    {
+        return (inReadLength > 0 ? kIoTypeRead :
+            (inNoBuffersFlag ? kIoTypeSync : kIoTypeWrite));
+    }
+    void IoQueued()
+        { mPendingCounter.Set(++mPendingCount); }
+    // The time spent waiting in the queue, doing io, and waiting for the
+    // completion to run on the event thread.
+    void IoDone(
+        IoType  inType,
+        int64_t inQueuedTimeUsec)
+    {
+        mPendingCounter.Set(--mPendingCount);
+        if (inQueuedTimeUsec <= 0) {
+            return; // Cancelled.
+        }
+        Histogram& theHistogram =
+            inType == kIoTypeRead  ? mReadLatency :
+            inType == kIoTypeWrite ? mWriteLatency : mSyncLatency;
+        theHistogram.RecordUsec(inQueuedTimeUsec, Histogram::NowUsec());
+    }
     bool IsFileNamePrefixMatches(
         const char* inFileNamePtr) const
     {
@@ -106,11 +150,32 @@ public:
 private:
     std::string         mFileNamePrefixes;
     const unsigned long mDeviceId;
+    int                 mPendingCount;
+    Counter             mPendingCounter;
+    Histogram           mReadLatency;
+    Histogram           mWriteLatency;
+    Histogram           mSyncLatency;
     DiskQueue*          mPrevPtr[1];
     DiskQueue*          mNextPtr[1];
 
+    static std::string CounterName(
+        const char* inFileNamePrefixPtr,
+        const char* inSuffixPtr)
+    {
+        std::string theRet("Disk ");
+        theRet += inFileNamePrefixPtr ? inFileNamePrefixPtr : "";
+        theRet += " ";
+        theRet += inSuffixPtr;
+        return theRet;
+    }
      ~DiskQueue()
-        {}
+    {
+        CounterManager& theManager = libkfsio::globals().counterManager;
+        theManager.RemoveCounter(&mPendingCounter);
+        theManager.RemoveCounter(&mReadLatency);
+        theManager.RemoveCounter(&mWriteLatency);
+        theManager.RemoveCounter(&mSyncLatency);
+    }
    friend class QCDLListOp<DiskQueue, 0>;
 private:
     DiskQueue(
@@ -133,23 +198,30 @@ public:
     DiskIoQueues(
             const Properties& inConfig)
         : ITimeout(),
+          mBufferPoolBufferSize(inConfig.getValue(
+            "chunkServer.ioBufferPool.bufferSize", 4 << 10)),
           mDiskQueueThreadCount(inConfig.getValue(
             "chunkServer.diskQueue.threadCount", 2)),
           mDiskQueueMaxQueueDepth(inConfig.getValue(
             "chunkServer.diskQueue.maxDepth", 4 << 10)),
+          // By default limit request size to 1MB, regardless of the buffer
+          // size.
           mDiskQueueMaxBuffersPerRequest(inConfig.getValue(
-            "chunkServer.diskQueue.maxBuffersPerRequest", 1 << 8)),
+            "chunkServer.diskQueue.maxBuffersPerRequest",
+                std::max(1, (1 << 20) / std::max(1, mBufferPoolBufferSize)))),
           mDiskQueueMaxEnqueueWaitNanoSec(inConfig.getValue(
             "chunkServer.diskQueue.maxEnqueueWaitTimeMilliSec", 0) * 1000000),
           mBufferPoolPartitionCount(inConfig.getValue(
             "chunkServer.ioBufferPool.partitionCount", 1)),
+          // The default pool size doesn't depend on the buffer size.
           mBufferPoolPartitionBufferCount(inConfig.getValue(
             "chunkServer.ioBufferPool.partitionBufferCount",
-                (sizeof(size_t) < 8 ? 32 : 192) << 10)),
-          mBufferPoolBufferSize(inConfig.getValue(
-            "chunkServer.ioBufferPool.bufferSize", 4 << 10)),
+                int((int64_t((sizeof(size_t) < 8 ? 32 : 192) << 10) *
+                    (4 << 10)) / std::max(1, mBufferPoolBufferSize)))),
           mBufferPoolLockMemoryFlag(inConfig.getValue(
             "chunkServer.ioBufferPool.lockMemory", false)),
+          mBufferPoolHugePagesFlag(inConfig.getValue(
+            "chunkServer.ioBufferPool.hugePages", false)),
           mDiskOverloadedPendingRequestCount(inConfig.getValue(
             "chunkServer.diskIo.OverloadedPendingRequestCount",
                 mDiskQueueMaxQueueDepth * 3 / 4)),
@@ -201,13 +273,20 @@ public:
             mBufferPoolPartitionCount,
             mBufferPoolPartitionBufferCount,
             mBufferPoolBufferSize,
-            mBufferPoolLockMemoryFlag
+            mBufferPoolLockMemoryFlag,
+            mBufferPoolHugePagesFlag
         );
         if (theSysError) {
             if (inErrMessagePtr) {
                 *inErrMessagePtr = QCUtils::SysError(theSysError);
             }
         } else {
+            if (mBufferPoolHugePagesFlag) {
+                KFS_LOG_VA_INFO("io buffer pool: huge pages used by"
+                    " %d partitions out of %d",
+                    GetBufferPool().GetHugePagesPartitionCount(),
+                    mBufferPoolPartitionCount);
+            }
             if (! libkfsio::SetIOBufferAllocator(&GetBufferAllocator())) {
                 DiskIoReportError("failed to set buffer allocator");
                 if (inErrMessagePtr) {
@@ -295,6 +374,8 @@ public:
         }
         DiskQueue* const theQueuePtr = inIo.mFilePtr->GetDiskQueuePtr();
         if (theQueuePtr) {
+            theQueuePtr->IoDone(DiskQueue::GetIoType(
+                inIo.mReadLength, inIo.mIoBuffers.empty()), 0);
             if (inIo.mReadLength <= 0 && ! inIo.mIoBuffers.empty()) {
                 // Hold on to the write buffers, while waiting for write to
                 // complete.
@@ -503,14 +584,15 @@ private:
             const BufferAllocator& inAllocator);
     };
 
+    const int             mBufferPoolBufferSize;
     const int             mDiskQueueThreadCount;
     const int             mDiskQueueMaxQueueDepth;
     const int             mDiskQueueMaxBuffersPerRequest;
     const DiskQueue::Time mDiskQueueMaxEnqueueWaitNanoSec;
     const int             mBufferPoolPartitionCount;
     const int             mBufferPoolPartitionBufferCount;
-    const int             mBufferPoolBufferSize;
     const int             mBufferPoolLockMemoryFlag;
+    const bool            mBufferPoolHugePagesFlag;
     const int             mDiskOverloadedPendingRequestCount;
     const int             mDiskClearOverloadedPendingRequestCount;
     const int             mDiskOverloadedMinFreeBufferCount;
@@ -748,7 +830,7 @@ DiskIo::File::GetDiskQueuePendingCount(
     int&     outRequestCount,
     int64_t& outReadBlockCount,
     int64_t& outWriteBlockCount,
-    int&     outBlockSize)
+    int&     outBlockSize) const
 {
     if (mQueuePtr) {
         mQueuePtr->GetPendingCount(
@@ -823,7 +905,8 @@ DiskIo::DiskIo(
       mReadLength(0),
       mIoRetCode(0),
       mCompletionRequestId(QCDiskQueue::kRequestIdNone),
-      mCompletionCode(QCDiskQueue::kErrorNone)
+      mCompletionCode(QCDiskQueue::kErrorNone),
+      mQueuedTimeUsec(0)
 {
     QCRTASSERT(mCallbackObjPtr && mFilePtr.get());
     DiskIoQueues::DoneQueue::Init(*this);
@@ -893,6 +976,8 @@ DiskIo::Read(
     if (theStatus.IsGood()) {
         sDiskIoQueuesPtr->ReadPending(inNumBytes);
         mRequestId = theStatus.GetRequestId();
+        mQueuedTimeUsec = Histogram::NowUsec();
+        theQueuePtr->IoQueued();
         QCRTASSERT(mRequestId != QCDiskQueue::kRequestIdNone);
         return inNumBytes;
     }
@@ -998,6 +1083,8 @@ DiskIo::Write(
     if (theStatus.IsGood()) {
         sDiskIoQueuesPtr->WritePending(inNumBytes - theNWr);
         mRequestId = theStatus.GetRequestId();
+        mQueuedTimeUsec = Histogram::NowUsec();
+        theQueuePtr->IoQueued();
         QCRTASSERT(mRequestId != QCDiskQueue::kRequestIdNone);
         return (inNumBytes - theNWr);
     }
@@ -1039,6 +1126,8 @@ DiskIo::Sync(
         if (inNotifyDoneFlag) {
             mRequestId = theStatus.GetRequestId();
             QCRTASSERT(mRequestId != QCDiskQueue::kRequestIdNone);
+            mQueuedTimeUsec = Histogram::NowUsec();
+            theQueuePtr->IoQueued();
         }
         return 0;
     }
@@ -1112,6 +1201,11 @@ DiskIo::RunCompletion()
 {
     QCASSERT(mCompletionRequestId == mRequestId && sDiskIoQueuesPtr);
     mRequestId = QCDiskQueue::kRequestIdNone;
+    DiskQueue* const theQueuePtr = mFilePtr->GetDiskQueuePtr();
+    if (theQueuePtr) {
+        theQueuePtr->IoDone(DiskQueue::GetIoType(
+            mReadLength, mIoBuffers.empty()), mQueuedTimeUsec);
+    }
     if (mReadLength > 0) {
         sDiskIoQueuesPtr->ReadPending(-int64_t(mReadLength), mIoRetCode);
     } else if (! mIoBuffers.empty()) {
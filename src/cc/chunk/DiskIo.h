@@ -133,7 +133,7 @@ public:
             int&     outRequestCount,
             int64_t& outReadBlockCount,
             int64_t& outWriteBlockCount,
-            int&     outBlockSize);
+            int&     outBlockSize) const;
     private:
         DiskQueue* mQueuePtr;
         int        mFileIdx;
@@ -193,6 +193,7 @@ private:
     ssize_t                mIoRetCode;
     QCDiskQueue::RequestId mCompletionRequestId;
     QCDiskQueue::Error     mCompletionCode;
+    int64_t                mQueuedTimeUsec;
     DiskIo*                mPrevPtr[1];
     DiskIo*                mNextPtr[1];
 
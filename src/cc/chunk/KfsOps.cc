@@ -77,7 +77,8 @@ static struct OpCounterMap : public map<KfsOp_t, Counter *>
     OpCounterMap()
         : map<KfsOp_t, Counter *>(),
           mWriteMaster("Write Master"),
-          mWriteDuration("Write Duration")
+          mWriteDuration("Write Duration"),
+          mLatencies()
       {}
     ~OpCounterMap()
     {
@@ -85,11 +86,19 @@ static struct OpCounterMap : public map<KfsOp_t, Counter *>
             globals().counterManager.RemoveCounter(i->second);
             delete i->second;
         }
+        for (Latencies::iterator i = mLatencies.begin();
+                i != mLatencies.end(); ++i) {
+            globals().counterManager.RemoveCounter(i->second);
+            delete i->second;
+        }
         globals().counterManager.RemoveCounter(&mWriteMaster);
         globals().counterManager.RemoveCounter(&mWriteDuration);
     }
-    Counter mWriteMaster;
-    Counter mWriteDuration;
+    typedef map<KfsOp_t, Histogram *> Latencies;
+    Counter   mWriteMaster;
+    Counter   mWriteDuration;
+    // op life time histograms, usec
+    Latencies mLatencies;
 } gCounters;
 typedef OpCounterMap::iterator OpCounterMapIter;
 
@@ -122,6 +131,7 @@ int parseHandlerStaleChunks(Properties &prop, KfsOp **c);
 int parseHandlerRetire(Properties &prop, KfsOp **c);
 int parseHandlerPing(Properties &prop, KfsOp **c);
 int parseHandlerDumpChunkMap(Properties &prop, KfsOp **c);
+int parseHandlerDumpOpTraces(Properties &prop, KfsOp **c);
 int parseHandlerStats(Properties &prop, KfsOp **c);
 int parseHandlerSetProperties(Properties &prop, KfsOp **c);
 int parseRestartChunkServer(Properties &prop, KfsOp **c);
@@ -182,6 +192,7 @@ KFS::InitParseHandlers()
     gParseHandlers["RETIRE"] = parseHandlerRetire;
     gParseHandlers["PING"] = parseHandlerPing;
     gParseHandlers["DUMP_CHUNKMAP"] = parseHandlerDumpChunkMap;
+    gParseHandlers["DUMP_OP_TRACES"] = parseHandlerDumpOpTraces;
     gParseHandlers["STATS"] = parseHandlerStats;
     gParseHandlers["CMD_SET_PROPERTIES"] = &parseHandlerSetProperties;
     gParseHandlers["RESTART_CHUNK_SERVER"] = &parseRestartChunkServer;
@@ -195,6 +206,10 @@ AddCounter(const char *name, KfsOp_t opName)
     c = new Counter(name);
     globals().counterManager.AddCounter(c);
     gCounters[opName] = c;
+
+    Histogram* const h = new Histogram((string(name) + " latency").c_str());
+    globals().counterManager.AddCounter(h);
+    gCounters.mLatencies[opName] = h;
 }
 
 void
@@ -267,6 +282,13 @@ UpdateMsgProcessingTime(const KfsOp *op)
 
     timeSpent = ComputeTimeDiff(op->startTime, timeNow);
 
+    OpCounterMap::Latencies::iterator const hi =
+        gCounters.mLatencies.find(op->op);
+    if (hi != gCounters.mLatencies.end()) {
+        hi->second->RecordUsec(
+            int64_t(op->startTime.tv_sec) * 1000000 + op->startTime.tv_usec,
+            int64_t(timeNow.tv_sec) * 1000000 + timeNow.tv_usec);
+    }
     OpCounterMapIter iter = gCounters.find(op->op);
     if (iter == gCounters.end())
         return;
@@ -809,6 +831,16 @@ parseHandlerDumpChunkMap(Properties &prop, KfsOp **c)
     return 0;
 }
 
+int
+parseHandlerDumpOpTraces(Properties &prop, KfsOp **c)
+{
+    kfsSeq_t seq;
+
+    parseCommon(prop, seq);
+    *c = new DumpOpTracesOp(seq);
+    return 0;
+}
+
 int
 parseHandlerStats(Properties &prop, KfsOp **c)
 {
@@ -884,11 +916,13 @@ ReadOp::HandleDone(int code, void *data)
             dataBuf = new IOBuffer();
         }
         b = (IOBuffer *) data;
+        TraceStage(OpTrace::kStageDiskDone);
         // Order matters...when we append b, we take the data from b
         // and put it into our buffer.
         dataBuf->Append(b);
         // verify checksum
         gChunkManager.ReadChunkDone(this);
+        TraceStage(OpTrace::kStageChecksumDone);
         numBytesIO = dataBuf->BytesConsumable();
         if (status == 0)
             // checksum verified
@@ -1013,6 +1047,7 @@ WriteOp::HandleWriteDone(int code, void *data)
         return clnt->HandleEvent(code, this);
     }
     assert(wpop != NULL);
+    wpop->TraceStage(OpTrace::kStageDiskDone);
 
     if (code == EVENT_DISK_ERROR) {
         // eat up everything that was sent
@@ -1103,6 +1138,7 @@ WriteOp::HandleSyncDone(int code, void *data)
         kfsFileId_t dummy;
         gChunkManager.ChunkSize(chunkId, dummy, &chunkSize);
         SET_HANDLER(this, &WriteOp::HandleLoggingDone);
+        wpop->TraceStage(OpTrace::kStageLogQueued);
         gLogger.Submit(this);
     }
     else {
@@ -1116,6 +1152,7 @@ int
 WriteOp::HandleLoggingDone(int code, void *data)
 {
     assert(wpop != NULL);
+    wpop->TraceStage(OpTrace::kStageLogged);
     return wpop->HandleEvent(EVENT_CMD_DONE, this);
 }
 
@@ -1125,63 +1162,48 @@ WriteOp::HandleLoggingDone(int code, void *data)
 /// need to add locking.
 ///
 void
-AllocChunkOp::Log(ofstream &ofs)
+AllocChunkOp::Log(LogWriter &writer)
 {
-    ofs << "ALLOCATE " << chunkId << ' ' << fileId << ' ';
-    ofs << chunkVersion << "\n";
-    assert(!ofs.fail());
+    writer.Put(chunkId).Put(fileId).Put(chunkVersion);
 }
 
 /// Resetting a chunk's version # is equivalent to doing an allocation
 /// of an existing chunk.
 void
-ChangeChunkVersOp::Log(ofstream &ofs)
+ChangeChunkVersOp::Log(LogWriter &writer)
 {
-    ofs << "CHANGE_CHUNK_VERS " << chunkId << ' ' << fileId << ' ';
-    ofs << chunkVersion << "\n";
-    assert(!ofs.fail());
+    writer.Put(chunkId).Put(fileId).Put(chunkVersion);
 }
 
 void
-DeleteChunkOp::Log(ofstream &ofs)
+DeleteChunkOp::Log(LogWriter &writer)
 {
-    ofs << "DELETE " << chunkId << "\n";
-    assert(!ofs.fail());
+    writer.Put(chunkId);
 }
 
 void
-MakeChunkStableOp::Log(ofstream &ofs)
+MakeChunkStableOp::Log(LogWriter &writer)
 {
-    ofs << "MAKE_CHUNK_STABLE " << chunkId << "\n";
-    assert(!ofs.fail());
+    writer.Put(chunkId);
 }
 
 void
-CoalesceBlockOp::Log(ofstream &ofs)
+CoalesceBlockOp::Log(LogWriter &writer)
 {
-    ofs << "COALESCE_BLOCK " << srcFileId << ' ' << srcChunkId << ' ' 
-        << dstFileId << ' ' << dstChunkId << "\n";
-    assert(!ofs.fail());
+    writer.Put(srcFileId).Put(srcChunkId).Put(dstFileId).Put(dstChunkId);
 }
 
 void
-WriteOp::Log(ofstream &ofs)
+WriteOp::Log(LogWriter &writer)
 {
-    ofs << "WRITE " << chunkId << ' ' << chunkSize << ' ';
-    ofs << offset << ' ';
-    ofs << checksums.size();
-    for (vector<uint32_t>::size_type i = 0; i < checksums.size(); i++) {
-        ofs << ' ' << checksums[i];
-    }
-    ofs << "\n";
-    assert(!ofs.fail());
+    writer.Put(chunkId).Put(chunkSize).Put(offset);
+    writer.Put(checksums.empty() ? 0 : &checksums[0], checksums.size());
 }
 
 void
-TruncateChunkOp::Log(ofstream &ofs)
+TruncateChunkOp::Log(LogWriter &writer)
 {
-    ofs << "TRUNCATE " << chunkId << ' ' << chunkSize << "\n";
-    assert(!ofs.fail());
+    writer.Put(chunkId).Put(chunkSize);
 }
 
 // For replicating a chunk, we log nothing.  We don't write out info
@@ -1189,7 +1211,7 @@ TruncateChunkOp::Log(ofstream &ofs)
 // This way, if we ever crash during chunk-replication, we'll simply
 // nuke out the chunk on startup.
 void
-ReplicateChunkOp::Log(ofstream &ofs)
+ReplicateChunkOp::Log(LogWriter &writer)
 {
 
 }
@@ -1651,6 +1673,14 @@ HeartbeatOp::Execute()
     cmdShow << " lost:";
     Append("WAppend-lost-timeouts", "tm",   wa.mTimeoutLostCount);
     Append("WAppend-lost-chunks",   "csum", wa.mLostChunkCount);
+    cmdShow << " flush:";
+    Append("WAppend-flush-writes",      "cnt",   wa.mFlushWriteCount);
+    Append("WAppend-flush-bytes",       "bytes", wa.mFlushWriteByteCount);
+    Append("WAppend-flush-avg-bytes",   "avg",   wa.mFlushWriteCount > 0 ?
+        wa.mFlushWriteByteCount / wa.mFlushWriteCount : int64_t(0));
+    Append("WAppend-flush-deferred",    "def",   wa.mFlushDeferredCount);
+    Append("WAppend-flush-cycles",      "cyc",   wa.mFlushCycleCount);
+    Append("WAppend-flush-cycle-writes","cycw",  wa.mFlushCycleAppenderCount);
 
     const BufferManager&  bufMgr = DiskIo::GetBufferManager();
     cmdShow <<  " buffers: bytes:";
@@ -1686,6 +1716,42 @@ HeartbeatOp::Execute()
     Append("Disk-sync-count", "cnt",   dio.mSyncCount);
     Append("Disk-sync-errors","err",   dio.mSyncErrorCount);
 
+    Logger::Counters logCntrs;
+    gLogger.GetCounters(logCntrs);
+    cmdShow <<  " log:";
+    Append("Log-batch-count",       "batch", logCntrs.mBatchCount);
+    Append("Log-record-count",      "cnt",   logCntrs.mRecordCount);
+    Append("Log-bytes",             "bytes", logCntrs.mByteCount);
+    Append("Log-sync-count",        "sync",  logCntrs.mSyncCount);
+    Append("Log-write-errors",      "werr",  logCntrs.mWriteErrorCount);
+    Append("Log-sync-errors",       "serr",  logCntrs.mSyncErrorCount);
+    Append("Log-commit-micro-sec",  "tm",    logCntrs.mCommitMicroSecs);
+    Append("Log-commit-max-micro-sec", "maxtm",
+        logCntrs.mMaxCommitMicroSecs);
+    // Histograms: <upper bound>:<count>,... the last bucket is unbounded.
+    ostringstream logHist;
+    for (int i = 0; i < Logger::Counters::kCommitTimeBuckets; i++) {
+        logHist << (i > 0 ? "," : "");
+        if (i < Logger::Counters::kCommitTimeBuckets - 1) {
+            logHist << (int64_t(Logger::Counters::kCommitTimeMinMicroSecs) << i);
+        } else {
+            logHist << "inf";
+        }
+        logHist << ":" << logCntrs.mCommitTimeHist[i];
+    }
+    Append("Log-commit-micro-sec-hist", "tmhist", logHist.str());
+    logHist.str(string());
+    for (int i = 0; i < Logger::Counters::kBatchSizeBuckets; i++) {
+        logHist << (i > 0 ? "," : "");
+        if (i < Logger::Counters::kBatchSizeBuckets - 1) {
+            logHist << (2 << i);
+        } else {
+            logHist << "inf";
+        }
+        logHist << ":" << logCntrs.mBatchSizeHist[i];
+    }
+    Append("Log-batch-size-hist", "bhist", logHist.str());
+
     cmdShow <<  " msglog:";
     MsgLogger::Counters msgLogCntrs;
     MsgLogger::GetLogger()->GetCounters(msgLogCntrs);
@@ -1783,6 +1849,7 @@ ReadOp::HandleChunkMetaReadDone(int code, void *data)
     }
 
     SET_HANDLER(this, &ReadOp::HandleDone);    
+    TraceStage(OpTrace::kStageDiskQueued);
     status = gChunkManager.ReadChunk(this);
 
     if (status < 0) {
@@ -2088,6 +2155,7 @@ WritePrepareOp::Execute()
         " checksum: " << checksum <<
     KFS_LOG_EOM;
 
+    TraceStage(OpTrace::kStageDiskQueued);
     status = gChunkManager.WriteChunk(writeOp);    
     if (status < 0) {
         Done(EVENT_CMD_DONE, this);
@@ -2551,6 +2619,13 @@ DumpChunkMapOp::Execute()
    gLogger.Submit(this);
 }
 
+void
+DumpOpTracesOp::Execute()
+{
+   status = 0;
+   gLogger.Submit(this);
+}
+
 void
 StatsOp::Execute()
 {
@@ -2895,6 +2970,18 @@ DumpChunkMapOp::Response(ostream &os)
     }
 }
 
+void
+DumpOpTracesOp::Response(ostream &os)
+{
+    ostringstream v;
+    gOpTracer.Dump(v);
+    PutHeader(this, os) <<
+        "Content-length: " << v.str().length() << "\r\n\r\n";
+    if (v.str().length() > 0) {
+       os << v.str();
+    }
+}
+
 void
 StatsOp::Response(ostream &os)
 {
@@ -3181,6 +3268,7 @@ SetProperties::Execute()
             MsgLogger::GetLogger()->SetParameters(
                 properties, "chunkServer.msgLogWriter.");
         }
+        gOpTracer.SetParameters(properties);
     }
     gLogger.Submit(this);
 }
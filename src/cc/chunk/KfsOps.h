@@ -33,12 +33,14 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <list>
 #include <sys/time.h>
 
 namespace KFS
 {
 // forward declaration to get compiler happy
 struct KfsOp;
+class LogWriter;
 }
 
 #include "libkfsIO/KfsCallbackObj.h"
@@ -49,6 +51,7 @@ struct KfsOp;
 #include "common/kfsdecls.h"
 #include "Chunk.h"
 #include "DiskIo.h"
+#include "OpTracer.h"
 
 namespace KFS
 {
@@ -99,6 +102,7 @@ enum KfsOp_t {
     CMD_PING,
     CMD_STATS,
     CMD_DUMP_CHUNKMAP,
+    CMD_DUMP_OP_TRACES,
     // Internally generated ops
     CMD_CHECKPOINT,
     CMD_WRITE,
@@ -132,14 +136,18 @@ struct KfsOp : public KfsCallbackObj {
     KfsCallbackObj* clnt;
     // keep statistics
     struct timeval  startTime;
+    OpTrace         trace;
 
     KfsOp (KfsOp_t o, kfsSeq_t s, KfsCallbackObj *c = NULL) :
         op(o), type(OP_REQUEST), seq(s), status(0), cancelled(false), done(false),
-        statusMsg(), clnt(c)
+        statusMsg(), clnt(c), trace()
     {
         SET_HANDLER(this, &KfsOp::HandleDone);
         gettimeofday(&startTime, NULL);
     }
+    void TraceStage(OpTrace::Stage stage) {
+        trace.Stamp(stage, startTime);
+    }
     void Cancel() {
         cancelled = true;
     }
@@ -158,7 +166,8 @@ struct KfsOp : public KfsCallbackObj {
         size = 0;
     }
     virtual void Execute() = 0;
-    virtual void Log(std::ofstream &ofs) { };
+    // Append the op's binary log record payload.
+    virtual void Log(LogWriter &writer) { };
     // Return info. about op for debugging
     virtual std::string Show() const = 0;
     // If the execution of an op suspends and then resumes and
@@ -193,7 +202,7 @@ struct AllocChunkOp : public KfsOp {
         // All inputs will be parsed in
     }
     void Execute();
-    void Log(std::ofstream &ofs);
+    void Log(LogWriter &writer);
     // handlers for reading/writing out the chunk meta-data
     int HandleChunkMetaReadDone(int code, void *data);
     std::string Show() const {
@@ -252,7 +261,7 @@ struct MakeChunkStableOp : public KfsOp {
             hasChecksum(false), next(0)
         {}
     void Execute();
-    void Log(std::ofstream &ofs);
+    void Log(LogWriter &writer);
     // handler for waiting for the AtomicRecordAppender to finish up
     int HandleARAFinalizeDone(int code, void *data);
     std::string Show() const {
@@ -283,7 +292,7 @@ struct CoalesceBlockOp : public KfsOp {
         // All inputs will be parsed in
     }
     void Execute();
-    void Log(std::ofstream &ofs);
+    void Log(LogWriter &writer);
     std::string Show() const {
         std::ostringstream os;
 
@@ -305,7 +314,7 @@ struct ChangeChunkVersOp : public KfsOp {
 
     }
     void Execute();
-    void Log(std::ofstream &ofs);
+    void Log(LogWriter &writer);
     // handler for reading in the chunk meta-data
     int HandleChunkMetaReadDone(int code, void *data);
     std::string Show() const {
@@ -325,7 +334,7 @@ struct DeleteChunkOp : public KfsOp {
 
     }
     void Execute();
-    void Log(std::ofstream &ofs);
+    void Log(LogWriter &writer);
     std::string Show() const {
         std::ostringstream os;
 
@@ -343,7 +352,7 @@ struct TruncateChunkOp : public KfsOp {
 
     }
     void Execute();
-    void Log(std::ofstream &ofs);
+    void Log(LogWriter &writer);
     // handler for reading in the chunk meta-data
     int HandleChunkMetaReadDone(int code, void *data);
     std::string Show() const {
@@ -373,7 +382,7 @@ struct ReplicateChunkOp : public KfsOp {
     void Execute();
     void Response(std::ostream &os);
     int HandleDone(int code, void *data);
-    void Log(std::ofstream &ofs);
+    void Log(LogWriter &writer);
     std::string Show() const {
         std::ostringstream os;
 
@@ -784,7 +793,7 @@ struct WriteOp : public KfsOp {
     }
     void Response(std::ostream &os) { };
     void Execute();
-    void Log(std::ofstream &ofs);
+    void Log(LogWriter &writer);
 
     // for record appends, this handler will be called back; on the
     // callback, notify the atomic record appender of
@@ -1111,6 +1120,17 @@ struct DumpChunkMapOp : public KfsOp {
     }
 };
 
+// dump the sampled client op traces
+struct DumpOpTracesOp : public KfsOp {
+    DumpOpTracesOp(kfsSeq_t s) :
+       KfsOp(CMD_DUMP_OP_TRACES, s) { }
+    void Response(std::ostream &os);
+    void Execute();
+    std::string Show() const {
+       return "dumping op traces";
+    }
+};
+
 // used to extract out all the counters we have
 struct StatsOp : public KfsOp {
     std::string stats; // result
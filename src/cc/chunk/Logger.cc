@@ -27,10 +27,16 @@
 #include<sstream>
 extern "C" {
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <strings.h>
 }
 
 #include "libkfsIO/Globals.h"
+#include "libkfsIO/Checksum.h"
+#include "common/properties.h"
+#include "qcdio/qcstutils.h"
 
 #include "Logger.h"
 #include "ChunkManager.h"
@@ -72,28 +78,101 @@ file_exists(string name)
     return S_ISREG(s.st_mode);
 }
 
+static int64_t
+NowMicroSecs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (int64_t(tv.tv_sec) * 1000000 + tv.tv_usec);
+}
+
+void
+LogWriter::Append(const void* data, size_t len)
+{
+    if (mLen + len > mBuf.size()) {
+        mBuf.resize(std::max(mBuf.size() * 2, mLen + len));
+    }
+    memcpy(&mBuf[mLen], data, len);
+    mLen += len;
+}
+
+void
+LogWriter::BeginRecord(int type)
+{
+    mRecordStart = mLen;
+    RecordHeader hdr;
+    hdr.length   = 0;
+    hdr.type     = (uint32_t)type;
+    hdr.checksum = 0;
+    Append(&hdr, sizeof(hdr));
+}
+
+void
+LogWriter::EndRecord()
+{
+    const size_t len = mLen - mRecordStart;
+    if (len <= sizeof(RecordHeader)) {
+        mLen = mRecordStart;
+        return;
+    }
+    RecordHeader hdr;
+    memcpy(&hdr, &mBuf[mRecordStart], sizeof(hdr));
+    hdr.length   = (uint32_t)len;
+    hdr.checksum = ComputeBlockChecksum(
+        &mBuf[mRecordStart + sizeof(hdr)], len - sizeof(hdr));
+    memcpy(&mBuf[mRecordStart], &hdr, sizeof(hdr));
+    mRecordCount++;
+}
+
 Logger::Logger()
+    : mLogGenNum(1),
+      mFd(-1),
+      mEnabledFlag(false),
+      mSyncFlag(true),
+      mCommitWindowMicroSecs(500),
+      mMaxBatchRecords(1024),
+      mMaxBatchBytes(1 << 20),
+      mWriter(),
+      mCounters(),
+      mMutex(),
+      mPendingCond(),
+      mPending()
 {
     mLogDir = "";
     mLogFilename = "";
     mLoggerTimeoutImpl = new LoggerTimeoutImpl(this);
-    mLogGenNum = 1;
+    mCounters.Clear();
     sprintf(ckptLogVersionStr, "version: %d", KFS_LOG_VERSION);
 }
 
 Logger::~Logger()
 {
-    mFile.close();
+    if (mFd >= 0) {
+        close(mFd);
+    }
     delete mLoggerTimeoutImpl;
 }
 
 void
-Logger::Init(const string &logDir)
+Logger::Init(const string &logDir, const Properties& props)
 {
     mLogDir = logDir;
     mLogFilename = mLogDir;
     mLogFilename += "/logs";
 
+    mEnabledFlag = props.getValue(
+        "chunkServer.logger.enabled", mEnabledFlag ? 1 : 0) != 0;
+    mSyncFlag = props.getValue(
+        "chunkServer.logger.sync", mSyncFlag ? 1 : 0) != 0;
+    mCommitWindowMicroSecs = std::max(0, props.getValue(
+        "chunkServer.logger.commitWindowMicroSecs", mCommitWindowMicroSecs));
+    mMaxBatchRecords = std::max(1, props.getValue(
+        "chunkServer.logger.maxBatchRecords", mMaxBatchRecords));
+    mMaxBatchBytes = std::max(4 << 10, props.getValue(
+        "chunkServer.logger.maxBatchBytes", mMaxBatchBytes));
+    // Preallocate the batch buffer; a batch can exceed the limit by at
+    // most one record.
+    mWriter.Reserve(mMaxBatchBytes + (8 << 10));
 }
 
 static void *
@@ -107,49 +186,202 @@ logger_main(void *dummy)
 void
 Logger::MainLoop()
 {
-    KfsOp *op;
+    std::deque<KfsOp*> batch;
     list<KfsOp *> done;
-    list<KfsOp *>::iterator iter;
+    int uncommitted = 0;
 
     while (1) {
-        op = mPending.dequeue();
-        while (op != NULL) {
-            // pull as many as we can and log them
+        {
+            QCStMutexLocker lock(mMutex);
+            while (mPending.empty()) {
+                mPendingCond.Wait(mMutex);
+            }
+            batch.swap(mPending);
+            // With sync, wait for more ops to amortize the sync over a
+            // larger batch, but no longer than the commit window.
+            const int64_t end = mSyncFlag && mCommitWindowMicroSecs > 0 ?
+                NowMicroSecs() + mCommitWindowMicroSecs : 0;
+            int64_t now;
+            while ((int)batch.size() < mMaxBatchRecords &&
+                    end > (now = NowMicroSecs())) {
+                if (mPending.empty()) {
+                    mPendingCond.Wait(mMutex, (end - now) * 1000);
+                }
+                batch.insert(batch.end(), mPending.begin(), mPending.end());
+                mPending.clear();
+            }
+        }
+        while (! batch.empty()) {
+            KfsOp* const op = batch.front();
+            batch.pop_front();
             if (op->op == CMD_CHECKPOINT) {
                 // Checkpoint ops are special.  There is log handling
                 // that needs to be done.  After writing out the
                 // checkpoint, get rid of the op.
-                mFile.flush();
+                Commit(done, uncommitted);
                 Checkpoint(op);
                 delete op;
-            } else { 
-                if (op->status >= 0) {
-                    op->Log(mFile);
-                }
-                done.push_back(op);
+                continue;
+            }
+            if (op->status >= 0) {
+                mWriter.BeginRecord(op->op);
+                op->Log(mWriter);
+                mWriter.EndRecord();
+                uncommitted++;
+            }
+            done.push_back(op);
+            if ((int)mWriter.GetSize() >= mMaxBatchBytes) {
+                Commit(done, uncommitted);
             }
-            op = mPending.dequeue_nowait();
         }
-        // one flush for everything we have in the queue
-        mFile.flush();
-        // now, allow everything that was flushed
-        while ((iter = done.begin()) != done.end()) {
-            op = *iter;
-            done.erase(iter);
-            mLogged.enqueue(op);
+        // one write and sync for everything we have in the batch
+        Commit(done, uncommitted);
+        // now, allow everything that was committed
+        while (! done.empty()) {
+            mLogged.enqueue(done.front());
+            done.pop_front();
         }
         globalNetManager().Wakeup();
         KFS_LOG_DEBUG("Kicked the net manager");
     }
 }
 
+//
+// Fail the ops whose records were in a batch that didn't make it to disk:
+// the ops are still dispatched, but with an error status, so that their
+// completion isn't reported as durable.
+//
+void
+Logger::Commit(list<KfsOp*>& done, int& uncommitted)
+{
+    const int status = Commit();
+    if (status < 0) {
+        list<KfsOp*>::reverse_iterator it = done.rbegin();
+        for (int i = 0; i < uncommitted && it != done.rend(); ++it) {
+            if ((*it)->status >= 0) {
+                (*it)->status = status;
+                i++;
+            }
+        }
+    }
+    uncommitted = 0;
+}
+
+int
+Logger::Commit()
+{
+    const int records = mWriter.GetRecordCount();
+    if (records <= 0) {
+        mWriter.Reset();
+        return 0;
+    }
+    const int64_t start      = NowMicroSecs();
+    const char*   p          = mWriter.GetData();
+    size_t        len        = mWriter.GetSize();
+    const size_t  bytes      = len;
+    int           status     = mFd < 0 ? -EIO : 0;
+    const off_t   pos        = mFd < 0 ? -1 : lseek(mFd, 0, SEEK_END);
+    bool          writeError = status != 0;
+    while (! writeError && len > 0) {
+        const ssize_t nwr = write(mFd, p, len);
+        if (nwr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = -errno;
+            KFS_LOG_VA_ERROR("log write failure: %s", strerror(errno));
+            writeError = true;
+            break;
+        }
+        p   += nwr;
+        len -= nwr;
+    }
+    if (writeError && pos >= 0 && ftruncate(mFd, pos) != 0) {
+        // don't leave a partial batch in front of the next one
+        KFS_LOG_VA_ERROR("log truncate failure: %s", strerror(errno));
+    }
+    bool syncError = false;
+    if (! writeError && mSyncFlag && fdatasync(mFd) != 0) {
+        status = -errno;
+        KFS_LOG_VA_ERROR("log sync failure: %s", strerror(errno));
+        syncError = true;
+    }
+    mWriter.Reset();
+    const int64_t commitTime = NowMicroSecs() - start;
+
+    QCStMutexLocker lock(mMutex);
+    mCounters.mBatchCount++;
+    mCounters.mRecordCount += records;
+    if (writeError) {
+        mCounters.mWriteErrorCount++;
+        return status;
+    }
+    mCounters.mByteCount += bytes;
+    if (mSyncFlag) {
+        mCounters.mSyncCount++;
+    }
+    if (syncError) {
+        mCounters.mSyncErrorCount++;
+    }
+    mCounters.mCommitMicroSecs += commitTime;
+    if (commitTime > mCounters.mMaxCommitMicroSecs) {
+        mCounters.mMaxCommitMicroSecs = commitTime;
+    }
+    int i = 0;
+    while (i < Counters::kCommitTimeBuckets - 1 &&
+            commitTime >= (int64_t(Counters::kCommitTimeMinMicroSecs) << i)) {
+        i++;
+    }
+    mCounters.mCommitTimeHist[i]++;
+    i = 0;
+    while (i < Counters::kBatchSizeBuckets - 1 && records >= (2 << i)) {
+        i++;
+    }
+    mCounters.mBatchSizeHist[i]++;
+    return status;
+}
+
+void
+Logger::GetCounters(Counters& counters)
+{
+    QCStMutexLocker lock(mMutex);
+    counters = mCounters;
+}
+
+bool
+Logger::IsLogged(const KfsOp* op) const
+{
+    switch (op->op) {
+        case CMD_ALLOC_CHUNK:
+        case CMD_DELETE_CHUNK:
+        case CMD_TRUNCATE_CHUNK:
+        case CMD_CHANGE_CHUNK_VERS:
+        case CMD_MAKE_CHUNK_STABLE:
+        case CMD_COALESCE_BLOCK:
+        case CMD_WRITE:
+        case CMD_CHECKPOINT:
+            return (mEnabledFlag && op->status >= 0);
+        default:
+            break;
+    }
+    return false;
+}
+
 void
 Logger::Submit(KfsOp *op)
 {
+    op->TraceStage(OpTrace::kStageLogQueued);
+    if (IsLogged(op)) {
+        QCStMutexLocker lock(mMutex);
+        mPending.push_back(op);
+        mPendingCond.Notify();
+        return;
+    }
     if (op->op == CMD_CHECKPOINT) {
         delete op;
         return;
     }
+    op->TraceStage(OpTrace::kStageLogged);
     if (op->op == CMD_WRITE) {
         KFS::SubmitOpResponse(op);
     } else {
@@ -173,6 +405,7 @@ Logger::Dispatch()
         op = mLogged.dequeue_nowait();
         if (op == NULL)
             break;
+        op->TraceStage(OpTrace::kStageLogged);
 
         // When internally generated ops are done, they go
         // back to the event processor to finish up processing
@@ -187,29 +420,34 @@ Logger::Dispatch()
 
 
 void
-Logger::Start()
+Logger::OpenLog(bool truncateFlag)
 {
-    string filename;
-    bool writeHeader = false;
-
-    if (mFile.is_open()) {
-        mFile.close();
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
     }
-    filename = MakeLogFilename();
-    if (!file_exists(filename.c_str()))
-        writeHeader = true;
+    const string filename = MakeLogFilename();
+    const bool writeHeader = truncateFlag || !file_exists(filename.c_str());
 
-    mFile.open(filename.c_str(), ios_base::app);
+    mFd = open(filename.c_str(),
+        O_WRONLY | O_CREAT | (truncateFlag ? O_TRUNC : O_APPEND), 0644);
+    if (mFd < 0) {
+        KFS_LOG_VA_WARN("Unable to open: %s", filename.c_str());
+        return;
+    }
     if (writeHeader) {
-        // KFS_LOG_VA_DEBUG("Writing out a log header");
-        mFile << ckptLogVersionStr << '\n';
-        mFile.flush();
+        // The header is text, the records that follow are binary.
+        const string hdr = string(ckptLogVersionStr) + "\n";
+        if (write(mFd, hdr.data(), hdr.size()) != (ssize_t)hdr.size()) {
+            KFS_LOG_VA_WARN("Unable to write header: %s", filename.c_str());
+        }
     }
+}
 
-    if (!mFile.is_open()) {
-        KFS_LOG_VA_WARN("Unable to open: %s", filename.c_str());
-    }
-    assert(!mFile.fail());
+void
+Logger::Start()
+{
+    OpenLog(false);
     globalNetManager().RegisterTimeoutHandler(mLoggerTimeoutImpl);
     mWorker.start(logger_main, NULL);
 }
@@ -284,27 +522,13 @@ Logger::MakeLatestCkptFilename()
 void 
 Logger::RotateLog()
 {
-    string filename;
-
-    if (mFile.is_open()) {
-        mFile.close();
-    }
-
-    filename = MakeLogFilename();
     // For log rotation, get rid of the old log and start a new one.
     // For now, preserve all the log files.
 
-    // unlink(filename.c_str());
+    // unlink(MakeLogFilename().c_str());
 
     mLogGenNum++;
-    filename = MakeLogFilename();
-    mFile.open(filename.c_str());
-    if (!mFile.is_open()) {
-        KFS_LOG_VA_WARN("Unable to open: %s", filename.c_str());
-        return;
-    }
-    mFile << ckptLogVersionStr << '\n';
-    mFile.flush();
+    OpenLog(true);
 }
 
 int
@@ -344,6 +568,10 @@ Logger::GetCkptVersion(const char *versionLine)
     }
     // check if it is an earlier version
     char olderVersionStr[128];
+    sprintf(olderVersionStr, "version: %d", KFS_LOG_VERSION_V2);
+    if (strncmp(versionLine, olderVersionStr, strlen(olderVersionStr)) == 0) {
+        return KFS_LOG_VERSION_V2;
+    }
     sprintf(olderVersionStr, "version: %d", KFS_LOG_VERSION_V1);
     if (strncmp(versionLine, olderVersionStr, strlen(olderVersionStr)) == 0) {
         return KFS_LOG_VERSION_V1;
@@ -524,6 +752,126 @@ ParseChangeChunkVers(istringstream &ist)
                                         chunkVersion);
 }
 
+//
+// Reads the fields of a binary log record, in the order in which the
+// op's Log() method put them.
+//
+class LogReader {
+public:
+    LogReader(const char* buf, size_t len)
+        : mCur(buf), mEnd(buf + len), mOk(true)
+        {}
+    LogReader& Get(int64_t& val) {
+        return Read(&val, sizeof(val));
+    }
+    LogReader& Get(vector<uint32_t>& vals) {
+        uint32_t n = 0;
+        Read(&n, sizeof(n));
+        if (mOk && n <= (mEnd - mCur) / sizeof(uint32_t)) {
+            vals.resize(n);
+            Read(n > 0 ? &vals[0] : 0, n * sizeof(uint32_t));
+        } else {
+            mOk = false;
+        }
+        return *this;
+    }
+    bool IsOk() const { return mOk; }
+private:
+    const char*       mCur;
+    const char* const mEnd;
+    bool              mOk;
+
+    LogReader& Read(void* val, size_t len) {
+        if (! mOk || (size_t)(mEnd - mCur) < len) {
+            mOk = false;
+        } else {
+            memcpy(val, mCur, len);
+            mCur += len;
+        }
+        return *this;
+    }
+};
+
+//
+// Each record of a V3 log is a LogWriter::RecordHeader followed by the
+// op's fields.  The replay stops at the first truncated or corrupted
+// record: that is where the last batch before the shutdown was cut.
+//
+void
+Logger::ReplayBinaryLog(ifstream& ifs)
+{
+    vector<char> buf;
+    int64_t      count = 0;
+    for (; ;) {
+        LogWriter::RecordHeader hdr;
+        if (! ifs.read(reinterpret_cast<char*>(&hdr), sizeof(hdr))) {
+            break;
+        }
+        if (hdr.length <= sizeof(hdr) || hdr.length > (64 << 20)) {
+            KFS_LOG_VA_ERROR("Replay log: invalid record length: %u",
+                             hdr.length);
+            break;
+        }
+        const size_t len = hdr.length - sizeof(hdr);
+        buf.resize(len);
+        if (! ifs.read(&buf[0], len)) {
+            KFS_LOG_VA_ERROR("Replay log: truncated record: %u", hdr.length);
+            break;
+        }
+        if (ComputeBlockChecksum(&buf[0], len) != hdr.checksum) {
+            KFS_LOG_VA_ERROR("Replay log: record checksum mismatch: type: %u",
+                             hdr.type);
+            break;
+        }
+        LogReader rd(&buf[0], len);
+        int64_t chunkId = -1, fileId = -1, chunkVersion = -1;
+        int64_t chunkSize = -1, offset = -1;
+        vector<uint32_t> checksums;
+        switch (hdr.type) {
+            case CMD_ALLOC_CHUNK:
+                if (rd.Get(chunkId).Get(fileId).Get(chunkVersion).IsOk()) {
+                    gChunkManager.ReplayAllocChunk(fileId, chunkId,
+                                                   chunkVersion);
+                }
+                break;
+            case CMD_CHANGE_CHUNK_VERS:
+                if (rd.Get(chunkId).Get(fileId).Get(chunkVersion).IsOk()) {
+                    gChunkManager.ReplayChangeChunkVers(fileId, chunkId,
+                                                        chunkVersion);
+                }
+                break;
+            case CMD_DELETE_CHUNK:
+                if (rd.Get(chunkId).IsOk()) {
+                    gChunkManager.ReplayDeleteChunk(chunkId);
+                }
+                break;
+            case CMD_WRITE:
+                if (rd.Get(chunkId).Get(chunkSize).Get(offset).Get(
+                        checksums).IsOk()) {
+                    gChunkManager.ReplayWriteDone(chunkId, chunkSize,
+                                                  offset, checksums);
+                }
+                break;
+            case CMD_TRUNCATE_CHUNK:
+                if (rd.Get(chunkId).Get(chunkSize).IsOk()) {
+                    gChunkManager.ReplayTruncateDone(chunkId, chunkSize);
+                }
+                break;
+            default:
+                // make stable and coalesce aren't replayed, as with the
+                // text logs
+                continue;
+        }
+        if (! rd.IsOk()) {
+            KFS_LOG_VA_ERROR("Replay log: invalid record: type: %u",
+                             hdr.type);
+            continue;
+        }
+        count++;
+    }
+    KFS_LOG_VA_INFO("Replay log: %lld records replayed", (long long)count);
+}
+
 //
 // Each log entry is of the form <OP-NAME> <op args>\n
 // To replay the log, read a line, from the <OP-NAME> identify the
@@ -566,7 +914,12 @@ Logger::ReplayLog()
     }
     
     version = GetLogVersion(line);
-    if (version != KFS_LOG_VERSION_V1) {
+    if (version == KFS_LOG_VERSION) {
+        ReplayBinaryLog(ifs);
+        ifs.close();
+        return;
+    }
+    if (version != KFS_LOG_VERSION_V1 && version != KFS_LOG_VERSION_V2) {
         KFS_LOG_VA_ERROR("Replay log failed: Log version str mismatch: read: %s",
                          line);
         ifs.close();
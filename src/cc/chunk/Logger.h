@@ -30,6 +30,9 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
+#include <deque>
+#include <list>
 
 #include "libkfsIO/ITimeout.h"
 #include "libkfsIO/NetManager.h"
@@ -38,23 +41,123 @@
 
 #include "meta/queue.h"
 #include "meta/thread.h"
+#include "qcdio/qcmutex.h"
 
 namespace KFS
 {
 
 class LoggerTimeoutImpl;
+class Properties;
+
+///
+/// Builds the compact binary log records in a preallocated buffer.  Each
+/// record has a fixed header: the record length including the header,
+/// the op type, and the payload checksum, followed by the op specific
+/// payload of 64 bit and 32 bit fields in the host byte order.
+///
+class LogWriter {
+public:
+    struct RecordHeader {
+        uint32_t length;
+        uint32_t type;
+        uint32_t checksum;
+    };
+
+    LogWriter()
+        : mBuf(), mLen(0), mRecordStart(0), mRecordCount(0)
+        {}
+    void Reserve(size_t size) {
+        if (mBuf.size() < size) {
+            mBuf.resize(size);
+        }
+    }
+    void BeginRecord(int type);
+    LogWriter& Put(int64_t val) {
+        Append(&val, sizeof(val));
+        return *this;
+    }
+    LogWriter& Put(const uint32_t* vals, size_t count) {
+        const uint32_t n = (uint32_t)count;
+        Append(&n, sizeof(n));
+        Append(vals, count * sizeof(*vals));
+        return *this;
+    }
+    /// Finish the current record; records without payload are dropped.
+    void EndRecord();
+    const char* GetData() const { return (mLen > 0 ? &mBuf[0] : 0); }
+    size_t GetSize() const { return mLen; }
+    int GetRecordCount() const { return mRecordCount; }
+    void Reset() {
+        mLen         = 0;
+        mRecordStart = 0;
+        mRecordCount = 0;
+    }
+private:
+    std::vector<char> mBuf;
+    size_t            mLen;
+    size_t            mRecordStart;
+    int               mRecordCount;
+
+    void Append(const void* data, size_t len);
+};
 
 ///
 /// Between a pair of checkpoints, the operations at the chunk server
 /// relating to allocate/delete chunks as well as writes to chunks are
 /// logged.  The logs are stored at: <logDir>/logs
+/// The logger thread commits the ops in batches (group commit): all ops
+/// queued while the previous batch was being written, or that arrive
+/// within the commit window, are written with a single write, and
+/// optionally a single fdatasync(), before any of them is dispatched.
 ///
 class Logger {
 public:
+    struct Counters
+    {
+        typedef int64_t Counter;
+        /// Commit time histogram bucket i counts the commits that took
+        /// less than (kCommitTimeMinMicroSecs << i) micro seconds, the
+        /// last bucket counts the rest.
+        enum { kCommitTimeBuckets = 16 };
+        enum { kCommitTimeMinMicroSecs = 64 };
+        /// Batch size histogram bucket i counts the batches with less
+        /// than (2 << i) records, the last bucket counts the rest.
+        enum { kBatchSizeBuckets = 12 };
+
+        Counter mBatchCount;
+        Counter mRecordCount;
+        Counter mByteCount;
+        Counter mSyncCount;
+        Counter mWriteErrorCount;
+        Counter mSyncErrorCount;
+        Counter mCommitMicroSecs;
+        Counter mMaxCommitMicroSecs;
+        Counter mCommitTimeHist[kCommitTimeBuckets];
+        Counter mBatchSizeHist[kBatchSizeBuckets];
+
+        void Clear()
+        {
+            mBatchCount         = 0;
+            mRecordCount        = 0;
+            mByteCount          = 0;
+            mSyncCount          = 0;
+            mWriteErrorCount    = 0;
+            mSyncErrorCount     = 0;
+            mCommitMicroSecs    = 0;
+            mMaxCommitMicroSecs = 0;
+            for (int i = 0; i < kCommitTimeBuckets; i++) {
+                mCommitTimeHist[i] = 0;
+            }
+            for (int i = 0; i < kBatchSizeBuckets; i++) {
+                mBatchSizeHist[i] = 0;
+            }
+        }
+    };
+
     Logger();
     ~Logger();
 
-    void Init(const std::string &logDir);
+    void Init(const std::string &logDir, const Properties& props);
 
     /// Set up for logging
     void Start();
@@ -88,9 +191,19 @@ public:
         return KFS_LOG_VERSION;
     }
 
+    /// V2 checkpoints have the same contents as the current ones: just
+    /// the version and the log file name.
+    bool IsRestartSupported(int version) const {
+        return (version == KFS_LOG_VERSION || version == KFS_LOG_VERSION_V2);
+    }
+
+    void GetCounters(Counters& counters);
+
 private:
-    /// Version # to be written out in the ckpt file
-    static const int KFS_LOG_VERSION = 2;
+    /// Version # to be written out in the ckpt file.  V3 logs have
+    /// binary records; V1 and V2 logs are text.
+    static const int KFS_LOG_VERSION = 3;
+    static const int KFS_LOG_VERSION_V2 = 2;
     static const int KFS_LOG_VERSION_V1 = 1;
 
     /// The path to the directory for writing out logs
@@ -100,10 +213,25 @@ private:
     /// counter that tracks the generation # of the log file
     long long mLogGenNum;
 
-    /// The handle to the log file
-    std::ofstream mFile;
+    /// The log file descriptor
+    int mFd;
+    /// When set mutations are logged; otherwise ops bypass the logger.
+    bool mEnabledFlag;
+    /// fdatasync() the log after each batch
+    bool mSyncFlag;
+    /// Max time to wait for more ops to join a batch, before committing
+    /// it; used only with sync.
+    int  mCommitWindowMicroSecs;
+    int  mMaxBatchRecords;
+    int  mMaxBatchBytes;
+    /// batch buffer
+    LogWriter mWriter;
+    Counters  mCounters;
+    /// protects the pending queue and the counters
+    QCMutex   mMutex;
+    QCCondVar mPendingCond;
     /// pending ops that need to be logged
-    MetaQueue<KfsOp> mPending;
+    std::deque<KfsOp*> mPending;
     /// ops for which logging is done
     MetaQueue<KfsOp> mLogged;
     /// thread that does the logging and flushes the log file to disk
@@ -115,6 +243,15 @@ private:
     /// Rotate the logs whenever the system takes a checkpoint
     void RotateLog();
 
+    /// Open the log file, and write the header if the file is new.
+    void OpenLog(bool truncateFlag);
+    /// Write out and optionally sync the batch, and update the counters.
+    /// @retval 0 if the batch is on disk; -errno otherwise
+    int Commit();
+    /// Commit, and on failure, fail the last uncommitted ops in done.
+    void Commit(std::list<KfsOp*>& done, int& uncommitted);
+    bool IsLogged(const KfsOp* op) const;
+
     /// Helper function that builds the log file's name using the generation #
     /// @retval The name of the log file that includes the generation #
     std::string MakeLogFilename();
@@ -137,6 +274,8 @@ private:
 
     /// Replay the log after a dirty shutdown
     void ReplayLog();
+    /// Replay the binary records of a V3 log
+    void ReplayBinaryLog(std::ifstream& ifs);
     
     /// parse the line to get the version #
     int GetCkptVersion(const char *versionLine);
@@ -0,0 +1,216 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Client op life cycle tracing: per stage latency histograms, and
+// a ring buffer of the sampled op traces.
+//
+//----------------------------------------------------------------------------
+
+#include "OpTracer.h"
+#include "KfsOps.h"
+#include "libkfsIO/Counter.h"
+#include "libkfsIO/Globals.h"
+#include "common/properties.h"
+
+#include <algorithm>
+#include <string>
+
+namespace KFS
+{
+
+bool OpTrace::sEnabledFlag = true;
+OpTracer gOpTracer;
+
+static const char* const kStageNames[OpTrace::kStageCount] = {
+    "submit",
+    "disk-queue",
+    "disk-io",
+    "checksum",
+    "log-queue",
+    "log",
+    "response"
+};
+
+// Same names as the op counters.
+static const char* const kOpNames[] = {
+    "Read",
+    "Write Prepare",
+    "Write Sync",
+    "Record append"
+};
+static const char* const kOpRpcNames[] = {
+    "READ",
+    "WRITE_PREPARE",
+    "WRITE_SYNC",
+    "RECORD_APPEND"
+};
+
+OpTracer::OpTracer()
+    : mSampleInterval(0),
+      mSlowThresholdUsec(0),
+      mDoneCount(0),
+      mNext(0),
+      mSize(0),
+      mEntries()
+{
+    for (int i = 0; i < kTracedOpCount; i++) {
+        for (int k = 0; k < OpTrace::kStageCount; k++) {
+            mHistograms[i][k] = 0;
+        }
+    }
+}
+
+OpTracer::~OpTracer()
+{
+    for (int i = 0; i < kTracedOpCount; i++) {
+        for (int k = 0; k < OpTrace::kStageCount; k++) {
+            if (mHistograms[i][k]) {
+                libkfsio::globals().counterManager.RemoveCounter(
+                    mHistograms[i][k]);
+                delete mHistograms[i][k];
+            }
+        }
+    }
+}
+
+    void
+OpTracer::SetParameters(
+    const Properties& inProps)
+{
+    OpTrace::SetEnabled(inProps.getValue(
+        "chunkServer.opTrace.enabled", OpTrace::IsEnabled() ? 1 : 0) != 0);
+    // Sample every n-th op, 0 -- no sampling.
+    mSampleInterval = std::max(0, inProps.getValue(
+        "chunkServer.opTrace.sampleInterval", mSampleInterval));
+    // Always sample the ops that took longer than this, 0 -- no threshold.
+    mSlowThresholdUsec = std::max(0, inProps.getValue(
+        "chunkServer.opTrace.slowThresholdMicroSec", mSlowThresholdUsec));
+    const size_t theRingSize = (size_t)std::max(0, inProps.getValue(
+        "chunkServer.opTrace.ringSize", (int)(mEntries.empty() ?
+            size_t(1) << 10 : mEntries.size())));
+    if (theRingSize != mEntries.size()) {
+        mEntries.clear();
+        mEntries.resize(theRingSize);
+        mNext = 0;
+        mSize = 0;
+    }
+}
+
+    /* static */ int
+OpTracer::GetOpIdx(
+    const KfsOp& inOp)
+{
+    switch (inOp.op) {
+        case CMD_READ:          return 0;
+        case CMD_WRITE_PREPARE: return 1;
+        case CMD_WRITE_SYNC:    return 2;
+        case CMD_RECORD_APPEND: return 3;
+        default:                break;
+    }
+    return -1;
+}
+
+    Histogram&
+OpTracer::GetHistogram(
+    int            inOpIdx,
+    OpTrace::Stage inStage)
+{
+    Histogram*& theHistPtr = mHistograms[inOpIdx][inStage];
+    if (! theHistPtr) {
+        const std::string theName = std::string(kOpNames[inOpIdx]) +
+            " " + kStageNames[inStage] + " latency";
+        theHistPtr = new Histogram(theName.c_str());
+        libkfsio::globals().counterManager.AddCounter(theHistPtr);
+    }
+    return *theHistPtr;
+}
+
+    void
+OpTracer::Done(
+    const KfsOp& inOp)
+{
+    if (! OpTrace::IsEnabled()) {
+        return;
+    }
+    const int theOpIdx = GetOpIdx(inOp);
+    if (theOpIdx < 0) {
+        return;
+    }
+    const OpTrace& theTrace = inOp.trace;
+    int32_t thePrev = 0;
+    for (int i = 0; i < OpTrace::kStageCount; i++) {
+        const OpTrace::Stage theStage  = OpTrace::Stage(i);
+        const int32_t        theStamp  = theTrace.Get(theStage);
+        if (theStamp < 0) {
+            continue;
+        }
+        GetHistogram(theOpIdx, theStage).Record(
+            std::max(0, theStamp - thePrev));
+        thePrev = std::max(thePrev, theStamp);
+    }
+    mDoneCount++;
+    if (mEntries.empty() ||
+            ! ((mSampleInterval > 0 && mDoneCount % mSampleInterval == 0) ||
+            (mSlowThresholdUsec > 0 && thePrev >= mSlowThresholdUsec))) {
+        return;
+    }
+    Entry& theEntry = mEntries[mNext];
+    theEntry.mStartTime =
+        int64_t(inOp.startTime.tv_sec) * 1000000 + inOp.startTime.tv_usec;
+    theEntry.mSeq       = inOp.seq;
+    theEntry.mStatus    = inOp.status;
+    theEntry.mOpIdx     = theOpIdx;
+    for (int i = 0; i < OpTrace::kStageCount; i++) {
+        theEntry.mStamps[i] = theTrace.Get(OpTrace::Stage(i));
+    }
+    if (++mNext >= mEntries.size()) {
+        mNext = 0;
+    }
+    mSize = std::min(mSize + 1, mEntries.size());
+}
+
+    void
+OpTracer::Dump(
+    std::ostream& inStream) const
+{
+    size_t theIdx = (mNext + mEntries.size() - mSize) %
+        std::max(size_t(1), mEntries.size());
+    for (size_t n = 0; n < mSize; n++) {
+        const Entry& theEntry = mEntries[theIdx];
+        inStream <<
+            "start="   << theEntry.mStartTime <<
+            " op="     << kOpRpcNames[theEntry.mOpIdx] <<
+            " seq="    << theEntry.mSeq <<
+            " status=" << theEntry.mStatus;
+        for (int i = 0; i < OpTrace::kStageCount; i++) {
+            if (theEntry.mStamps[i] >= 0) {
+                inStream << " " << kStageNames[i] << "=" <<
+                    theEntry.mStamps[i];
+            }
+        }
+        inStream << "\n";
+        if (++theIdx >= mEntries.size()) {
+            theIdx = 0;
+        }
+    }
+}
+
+}
@@ -0,0 +1,160 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Client op life cycle tracing: per stage latency histograms, and
+// a ring buffer of the sampled op traces.
+//
+//----------------------------------------------------------------------------
+
+#ifndef CHUNK_OP_TRACER_H
+#define CHUNK_OP_TRACER_H
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <ostream>
+#include <vector>
+
+namespace KFS
+{
+
+class Properties;
+class Histogram;
+struct KfsOp;
+
+///
+/// Compact time stamps of the stages that a client op goes through. The
+/// stamps are micro seconds since the op start time (the op creation by
+/// the request parser), -1 if the op has not reached the stage. The first
+/// stamp of a stage wins, thus the ops that are re-submitted internally,
+/// for example to the logger, keep the time of the first pass.
+///
+class OpTrace
+{
+public:
+    enum Stage
+    {
+        // The request, its data, and the io buffers for the response are
+        // available: the time from the start is the buffer wait, and the
+        // time it takes to receive the data.
+        kStageSubmitted,
+        kStageDiskQueued,
+        // Disk io is done, and the completion ran on the event thread.
+        kStageDiskDone,
+        kStageChecksumDone,
+        kStageLogQueued,
+        kStageLogged,
+        kStageResponseSent,
+        kStageCount
+    };
+
+    OpTrace()
+        { Clear(); }
+    void Clear()
+    {
+        for (int i = 0; i < kStageCount; i++) {
+            mStamps[i] = -1;
+        }
+    }
+    void Stamp(
+        Stage                 inStage,
+        const struct timeval& inStartTime)
+    {
+        if (! sEnabledFlag || mStamps[inStage] >= 0) {
+            return;
+        }
+        struct timeval theNow;
+        gettimeofday(&theNow, 0);
+        const int64_t theUsec =
+            int64_t(theNow.tv_sec - inStartTime.tv_sec) * 1000000 +
+            (theNow.tv_usec - inStartTime.tv_usec);
+        mStamps[inStage] = theUsec <= 0 ? 0 :
+            (theUsec >= 0x7FFFFFFF ? 0x7FFFFFFF : int32_t(theUsec));
+    }
+    int32_t Get(
+        Stage inStage) const
+        { return mStamps[inStage]; }
+    static void SetEnabled(
+        bool inFlag)
+        { sEnabledFlag = inFlag; }
+    static bool IsEnabled()
+        { return sEnabledFlag; }
+private:
+    int32_t     mStamps[kStageCount];
+    static bool sEnabledFlag;
+};
+
+///
+/// Aggregates the traces of the completed client ops into the per op
+/// type and stage latency histograms, exported by the stats RPC, and keeps
+/// the sampled traces in a ring buffer, dumped by the DUMP_OP_TRACES RPC.
+/// A stage latency is the time since the previous stage the op reached.
+/// Runs on the event thread.
+///
+class OpTracer
+{
+public:
+    OpTracer();
+    ~OpTracer();
+    void SetParameters(
+        const Properties& inProps);
+    /// The op response is sent.
+    void Done(
+        const KfsOp& inOp);
+    /// Dump the sampled traces, the oldest first, one per line.
+    void Dump(
+        std::ostream& inStream) const;
+private:
+    enum { kTracedOpCount = 4 };
+    struct Entry
+    {
+        int64_t mStartTime; // usec
+        int64_t mSeq;
+        int32_t mStatus;
+        int32_t mOpIdx;
+        int32_t mStamps[OpTrace::kStageCount];
+    };
+    typedef std::vector<Entry> Entries;
+
+    int        mSampleInterval;
+    int        mSlowThresholdUsec;
+    int64_t    mDoneCount;
+    size_t     mNext;
+    size_t     mSize;
+    Entries    mEntries;
+    Histogram* mHistograms[kTracedOpCount][OpTrace::kStageCount];
+
+    static int GetOpIdx(
+        const KfsOp& inOp);
+    Histogram& GetHistogram(
+        int            inOpIdx,
+        OpTrace::Stage inStage);
+private:
+    OpTracer(
+        const OpTracer& inTracer);
+    OpTracer& operator=(
+        const OpTracer& inTracer);
+};
+
+extern OpTracer gOpTracer;
+
+}
+
+#endif /* CHUNK_OP_TRACER_H */
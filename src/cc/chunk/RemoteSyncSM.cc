@@ -38,11 +38,13 @@
 #include <sstream>
 #include <string>
 #include <algorithm>
+#include <map>
 using std::find_if;
 using std::for_each;
 using std::istringstream;
 using std::ostringstream;
 using std::list;
+using std::map;
 using std::string;
 
 using namespace KFS;
@@ -50,7 +52,7 @@ using namespace KFS::libkfsio;
 
 const int kMaxCmdHeaderLength = 2 << 10;
 bool RemoteSyncSM::sTraceRequestResponse = false;
-int  RemoteSyncSM::sOpResponseTimeoutSec = 5 * 60; // 5 min op response timeout
+int  RemoteSyncSM::sOpResponseTimeoutMs = 5 * 60 * 1000; // 5 min op response timeout
 
 inline static kfsSeq_t
 InitialSeqNo()
@@ -70,19 +72,45 @@ NextSeq()
 inline void
 RemoteSyncSM::UpdateRecvTimeout()
 {
-    if (sOpResponseTimeoutSec < 0 || ! mNetConnection) {
+    if (sOpResponseTimeoutMs < 0 || ! mNetConnection) {
         return;
     }
-    const time_t now = globalNetManager().Now();
-    const time_t end = mLastRecvTime + sOpResponseTimeoutSec;
-    mNetConnection->SetInactivityTimeout(end > now ? end - now : 0);
+    const int64_t now = globalNetManager().NowMs();
+    const int64_t end = mLastRecvTime + sOpResponseTimeoutMs;
+    mNetConnection->SetInactivityTimeoutMs(end > now ? int(end - now) : 0);
 }
 
+Histogram&
+RemoteSyncSM::GetLatencyHistogram(const ServerLocation &location)
+{
+    // One histogram per peer, the number of peers is bounded by the
+    // cluster size.
+    static map<ServerLocation, Histogram*> sLatencies;
+    Histogram*& h = sLatencies[location];
+    if (! h) {
+        h = new Histogram(
+            ("Peer " + location.ToString() + " latency").c_str());
+        globals().counterManager.AddCounter(h);
+    }
+    return *h;
+}
+
+// Helper functor that finds the dispatched op by sequence number.
+class DispatchedOpMatcher {
+    kfsSeq_t seqNum;
+public:
+    DispatchedOpMatcher(kfsSeq_t s) : seqNum(s) { }
+    template<typename T> bool operator() (const T &d) const {
+        return d.mOp->seq == seqNum;
+    }
+};
+
 RemoteSyncSM::RemoteSyncSM(const ServerLocation &location)         
     : mLocation(location),
       mReplySeqNum(-1),
       mReplyNumBytes(0),
-      mLastRecvTime(0)
+      mLastRecvTime(0),
+      mLatency(GetLatencyHistogram(location))
 {
     mSeqnum = NextSeq();
 }
@@ -129,11 +157,11 @@ RemoteSyncSM::Connect()
     mNetConnection.reset(new NetConnection(sock, this));
     mNetConnection->SetDoingNonblockingConnect();
     mNetConnection->SetMaxReadAhead(kMaxCmdHeaderLength);
-    mLastRecvTime = globalNetManager().Now();
+    mLastRecvTime = globalNetManager().NowMs();
     
     // If there is no activity on this socket, we want
     // to be notified, so that we can close connection.
-    mNetConnection->SetInactivityTimeout(sOpResponseTimeoutSec);
+    mNetConnection->SetInactivityTimeoutMs(sOpResponseTimeoutMs);
     // Add this to the poll vector
     globalNetManager().AddConnection(mNetConnection);
 
@@ -146,21 +174,21 @@ RemoteSyncSM::Enqueue(KfsOp *op)
     if (!mNetConnection) {
         if (!Connect()) {
             KFS_LOG_VA_INFO("Connect to peer %s failed; failing ops", mLocation.ToString().c_str());
-            mDispatchedOps.push_back(op);
+            mDispatchedOps.push_back(DispatchedOp(op, 0));
             FailAllOps();
             return;
         }
     }
     if (!mNetConnection->IsGood()) {
         KFS_LOG_VA_INFO("Lost the connection to peer %s; failing ops", mLocation.ToString().c_str());
-        mDispatchedOps.push_back(op);
+        mDispatchedOps.push_back(DispatchedOp(op, 0));
         FailAllOps();
         mNetConnection->Close();
         mNetConnection.reset();
         return;
     }
     if (mDispatchedOps.empty()) {
-        mLastRecvTime = globalNetManager().Now();
+        mLastRecvTime = globalNetManager().NowMs();
     }
     IOBuffer::OStream os;
     op->Request(os);
@@ -197,7 +225,7 @@ RemoteSyncSM::Enqueue(KfsOp *op)
             RecordAppendOp *ra = static_cast<RecordAppendOp *>(op);
             mNetConnection->Write(&ra->dataBuf, ra->numBytes);
         }
-        mDispatchedOps.push_back(op);
+        mDispatchedOps.push_back(DispatchedOp(op, Histogram::NowUsec()));
     }
     UpdateRecvTimeout();
     if (mNetConnection) {
@@ -222,7 +250,7 @@ RemoteSyncSM::HandleEvent(int code, void *data)
 
     switch (code) {
     case EVENT_NET_READ:
-        mLastRecvTime = globalNetManager().Now();
+        mLastRecvTime = globalNetManager().NowMs();
 	// We read something from the network.  Run the RPC that
 	// came in if we got all the data for the RPC
 	iobuf = (IOBuffer *) data;
@@ -266,7 +294,7 @@ RemoteSyncSM::HandleEvent(int code, void *data)
 int
 RemoteSyncSM::HandleResponse(IOBuffer *iobuf, int msgLen)
 {
-    list<KfsOp *>::iterator i = mDispatchedOps.end();
+    DispatchedOps::iterator i = mDispatchedOps.end();
     int nAvail = iobuf->BytesConsumable();
 
     if (mReplyNumBytes <= 0) {
@@ -299,8 +327,8 @@ RemoteSyncSM::HandleResponse(IOBuffer *iobuf, int msgLen)
         mReplyNumBytes = prop.getValue("Content-length", (long long) 0);
         nAvail -= msgLen;
         i = find_if(mDispatchedOps.begin(), mDispatchedOps.end(), 
-                    OpMatcher(mReplySeqNum));
-        KfsOp* const op = i != mDispatchedOps.end() ? *i : 0;
+                    DispatchedOpMatcher(mReplySeqNum));
+        KfsOp* const op = i != mDispatchedOps.end() ? i->mOp : 0;
         if (op) {
             op->status = prop.getValue("Status", -1);
             if (op->op == CMD_WRITE_ID_ALLOC) {
@@ -354,10 +382,11 @@ RemoteSyncSM::HandleResponse(IOBuffer *iobuf, int msgLen)
     // find the matching op
     if (i == mDispatchedOps.end()) {
         i = find_if(mDispatchedOps.begin(), mDispatchedOps.end(), 
-                    OpMatcher(mReplySeqNum));
+                    DispatchedOpMatcher(mReplySeqNum));
     }
     if (i != mDispatchedOps.end()) {
-        KfsOp *const op = *i;
+        KfsOp *const op = i->mOp;
+        mLatency.RecordUsec(i->mSendTime, Histogram::NowUsec());
         mDispatchedOps.erase(i);
         if (op->op == CMD_READ) {
             ReadOp *rop = static_cast<ReadOp *> (op);
@@ -386,7 +415,8 @@ class OpFailer {
     int errCode;
 public:
     OpFailer(int c) : errCode(c) { };
-    void operator() (KfsOp *op) {
+    template<typename T> void operator() (const T &d) {
+        KfsOp* const op = d.mOp;
         op->status = errCode;
         // op->HandleEvent(EVENT_DONE, op);
         KFS::SubmitOpResponse(op);
@@ -406,7 +436,7 @@ RemoteSyncSM::FailAllOps()
     // notified and the client calls to close out this object.  We'll
     // be right back here trying  to fail an op and will core.  To
     // avoid, swap out the ops and try.
-    list<KfsOp *> opsToFail;
+    DispatchedOps opsToFail;
 
     mDispatchedOps.swap(opsToFail);
     for_each(opsToFail.begin(), opsToFail.end(),
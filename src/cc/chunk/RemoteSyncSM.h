@@ -33,6 +33,7 @@
 #include "KfsOps.h"
 #include "Chunk.h"
 #include "libkfsIO/ITimeout.h"
+#include "libkfsIO/Counter.h"
 #include "meta/queue.h"
 
 #include <sys/types.h>
@@ -75,10 +76,17 @@ public:
         sTraceRequestResponse = flag;
     }
     static void SetResponseTimeoutSec(int timeoutSec) {
-        sOpResponseTimeoutSec = timeoutSec;
+        SetResponseTimeoutMs(timeoutSec < 0 ? -1 : timeoutSec * 1000);
     }
     static int GetResponseTimeoutSec() {
-        return sOpResponseTimeoutSec;
+        return (sOpResponseTimeoutMs < 0 ? -1 :
+            (sOpResponseTimeoutMs + 999) / 1000);
+    }
+    static void SetResponseTimeoutMs(int timeoutMs) {
+        sOpResponseTimeoutMs = timeoutMs;
+    }
+    static int GetResponseTimeoutMs() {
+        return sOpResponseTimeoutMs;
     }
 
 private:
@@ -89,12 +97,25 @@ private:
     /// Assign a sequence # for each op we send to the remote server
     kfsSeq_t mSeqnum;
 
+    struct DispatchedOp
+    {
+        DispatchedOp(KfsOp* op, int64_t sendTime)
+            : mOp(op), mSendTime(sendTime)
+            {}
+        KfsOp*  mOp;
+        int64_t mSendTime; // usec
+    };
+    typedef std::list<DispatchedOp> DispatchedOps;
     /// Queue of outstanding ops sent to remote server.
-    std::list<KfsOp *> mDispatchedOps;
+    DispatchedOps mDispatchedOps;
 
     kfsSeq_t mReplySeqNum;
     int      mReplyNumBytes;
-    time_t   mLastRecvTime;
+    int64_t  mLastRecvTime; // msec
+
+    /// Response time histogram of the peer, shared by all the state
+    /// machines that talk to the peer.
+    Histogram& mLatency;
 
     /// We (may) have got a response from the peer.  If we are doing
     /// re-replication, then we need to wait until we got all the data
@@ -104,8 +125,9 @@ private:
     int HandleResponse(IOBuffer *iobuf, int cmdLen);
     void FailAllOps();
     inline void UpdateRecvTimeout();
+    static Histogram& GetLatencyHistogram(const ServerLocation& location);
     static bool sTraceRequestResponse;
-    static int  sOpResponseTimeoutSec;
+    static int  sOpResponseTimeoutMs;
 };
 
 typedef boost::shared_ptr<RemoteSyncSM> RemoteSyncSMPtr;
@@ -25,6 +25,7 @@
 //----------------------------------------------------------------------------
 
 #include <dirent.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -99,9 +100,12 @@ int main(int argc, char **argv)
     for (int i = 0; i < count; i++) {
         string fn = chunkDir;
         fn = fn + "/" + entries[i]->d_name;
+        // skip the chunk server's chunk inventory file(s)
+        const bool isInventory = strncmp(entries[i]->d_name,
+            "chunk_inventory", 15) == 0;
         res = stat(fn.c_str(), &statBuf);
         free(entries[i]);
-        if ((res < 0) || (!S_ISREG(statBuf.st_mode)))
+        if ((res < 0) || (!S_ISREG(statBuf.st_mode)) || isInventory)
             continue;
         if (samplingMode) {
             randval = drand48();
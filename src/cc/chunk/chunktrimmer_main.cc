@@ -31,6 +31,7 @@
 //----------------------------------------------------------------------------
 
 #include <dirent.h>
+#include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -112,9 +113,12 @@ int main(int argc, char **argv)
     for (int i = 0; i < count; i++) {
         string fn = pathname;
         fn = fn + "/" + entries[i]->d_name;
+        // skip the chunk server's chunk inventory file(s)
+        const bool isInventory = strncmp(entries[i]->d_name,
+            "chunk_inventory", 15) == 0;
         res = stat(fn.c_str(), &statBuf);
         free(entries[i]);
-        if ((res < 0) || (!S_ISREG(statBuf.st_mode)) ||
+        if ((res < 0) || (!S_ISREG(statBuf.st_mode)) || isInventory ||
             (fn.rfind(".corrupt") != string::npos)) {
             // either it is not a file or it has been trimmed earlier
             // and renamed to .corrupt
@@ -173,16 +173,14 @@ LayoutEmulator::ChunkReplicationDone(MetaChunkReplicate *req)
     vector<ChunkServerPtr>::iterator source;
 
     mOngoingReplicationStats->Update(-1);
+    if (mNumOngoingReplications > 0)
+        mNumOngoingReplications--;
 
     // Book-keeping....
     CSMapIter iter = mChunkToServerMap.find(req->chunkId);
 
     if (iter != mChunkToServerMap.end()) {
         iter->second.ongoingReplications--;
-        if (iter->second.ongoingReplications == 0)
-            // if all the replications for this chunk are done,
-            // then update the global counter.
-            mNumOngoingReplications--;
 
         if (iter->second.ongoingReplications < 0)
             // sanity...
@@ -192,6 +190,9 @@ LayoutEmulator::ChunkReplicationDone(MetaChunkReplicate *req)
     mNumBlksRebalanced++;
 
     req->server->ReplicateChunkDone(req->chunkId);
+    // The chunk was taken out of the replication queue when the
+    // replication was started: re-check it on the next pass.
+    mChunkReplicationCandidates.Reindex(req->chunkId);
 
     source = find_if(mChunkServers.begin(), mChunkServers.end(),
                      MatchingServer(req->srcLocation));
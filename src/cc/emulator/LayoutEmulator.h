@@ -77,6 +77,9 @@ namespace KFS
         int GetNumBlksRebalanced() const {
             return mNumBlksRebalanced;
         }
+        size_t GetNumReplicationCandidates() const {
+            return mChunkReplicationCandidates.size();
+        }
     private:
         void Parse(const char *line, bool addChunksToReplicationChecker);
         bool mDoingRebalancePlanning;
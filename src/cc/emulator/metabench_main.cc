@@ -0,0 +1,430 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Metaserver scalability benchmark. Synthesize a namespace, a set of
+// emulated chunk servers and a chunk to server map, then time the layout
+// manager hot paths: chunk server hello, replication check passes, read
+// lease acquisition, chunk allocation, fsck, and chunk server down.
+// The results are printed as a table, one row per operation.
+//
+//----------------------------------------------------------------------------
+
+#include "LayoutEmulator.h"
+#include "ChunkServerEmulator.h"
+
+#include "meta/kfstree.h"
+#include "meta/request.h"
+#include "meta/MetaScanner.h"
+#include "libkfsIO/Counter.h"
+#include "common/properties.h"
+#include "common/log.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::endl;
+using std::setw;
+using std::left;
+using std::right;
+using std::ostringstream;
+using std::max;
+using std::min;
+
+using namespace KFS;
+
+// Latency of the individual invocations of one operation, in usec.
+class BenchOp {
+public:
+    BenchOp(const char *name)
+        : mHist(name)
+        {}
+    void Record(int64_t startUsec) {
+        mHist.RecordUsec(startUsec, Histogram::NowUsec());
+    }
+    static void PrintHeader() {
+        cout << left << setw(26) << "op" << right <<
+            setw(10) << "count" <<
+            setw(12) << "ops/sec" <<
+            setw(12) << "avg usec" <<
+            setw(12) << "p50" <<
+            setw(12) << "p90" <<
+            setw(12) << "p99" <<
+            setw(12) << "max" <<
+        endl;
+    }
+    void Print() const {
+        const int64_t count = (int64_t)mHist.GetValue();
+        const int64_t sum   = mHist.GetSum();
+        cout << left << setw(26) << mHist.GetName() << right <<
+            setw(10) << count <<
+            setw(12) << (sum > 0 ? (int64_t)(count * 1e6 / sum) : 0) <<
+            setw(12) << (count > 0 ? sum / count : 0) <<
+            setw(12) << mHist.GetPercentile(0.5) <<
+            setw(12) << mHist.GetPercentile(0.9) <<
+            setw(12) << mHist.GetPercentile(0.99) <<
+            setw(12) << mHist.GetMax() <<
+        endl;
+    }
+private:
+    Histogram mHist;
+};
+
+struct BenchServer {
+    ServerLocation    loc;
+    int               rack;
+    vector<ChunkInfo> chunks;
+    ChunkServerPtr    server;
+};
+
+static seq_t sSeq = 1;
+
+static void
+DispatchAll(vector<BenchServer> &servers)
+{
+    for (vector<BenchServer>::iterator it = servers.begin();
+            it != servers.end(); ++it) {
+        if (it->server && ! it->server->IsDown()) {
+            it->server->Dispatch();
+        }
+    }
+}
+
+// Connect a new emulated server with the chunk inventory of the given slot.
+static void
+Hello(BenchServer &bs, BenchOp &op)
+{
+    ChunkServerEmulator * const cse = new ChunkServerEmulator(bs.loc, bs.rack);
+    bs.server.reset(cse);
+    for (vector<ChunkInfo>::const_iterator it = bs.chunks.begin();
+            it != bs.chunks.end(); ++it) {
+        cse->HostingChunk(it->chunkId, CHUNKSIZE);
+    }
+    const uint64_t usedSpace  = (uint64_t)bs.chunks.size() * CHUNKSIZE;
+    MetaHello hello(sSeq++);
+    hello.server     = bs.server;
+    hello.location   = bs.loc;
+    hello.peerName   = bs.loc.ToString();
+    hello.totalSpace = max((uint64_t)cse->GetTotalSpace(), 4 * usedSpace);
+    hello.usedSpace  = usedSpace;
+    hello.uptime     = 0;
+    hello.rackId     = bs.rack;
+    hello.numChunks  = (int)bs.chunks.size();
+    hello.numNotStableAppendChunks = 0;
+    hello.numNotStableChunks       = 0;
+    hello.contentLength            = 0;
+    hello.numAppendsWithWid        = 0;
+    hello.chunks     = bs.chunks;
+
+    const int64_t start = Histogram::NowUsec();
+    gLayoutEmulator.AddNewServer(&hello);
+    op.Record(start);
+}
+
+// Run replication check passes, and complete the scheduled replications,
+// until there is nothing left to check, or the pass limit is reached.
+static void
+ReplicationCheck(vector<BenchServer> &servers, BenchOp &op, int maxPasses)
+{
+    for (int i = 0; i < maxPasses &&
+            gLayoutEmulator.GetNumReplicationCandidates() > 0; i++) {
+        const int64_t start = Histogram::NowUsec();
+        gLayoutEmulator.ChunkReplicationChecker();
+        op.Record(start);
+        DispatchAll(servers);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    KFS::MsgLogger::Init(NULL);
+    int numServers   = 100;
+    int numRacks     = 10;
+    int numChunks    = 100000;
+    int numFiles     = 10000;
+    int numReplicas  = 3;
+    int numAllocs    = 10000;
+    int numLeases    = 100000;
+    int numDown      = -1;
+    int maxPasses    = 16;
+    int numFsck      = 3;
+    bool rebalance   = false;
+    bool verbose     = false;
+    bool help        = false;
+    char optchar;
+
+    while ((optchar = getopt(argc, argv, "s:r:c:f:n:a:l:d:p:k:bvh")) != -1) {
+        switch (optchar) {
+            case 's':
+                numServers = atoi(optarg);
+                break;
+            case 'r':
+                numRacks = atoi(optarg);
+                break;
+            case 'c':
+                numChunks = atoi(optarg);
+                break;
+            case 'f':
+                numFiles = atoi(optarg);
+                break;
+            case 'n':
+                numReplicas = atoi(optarg);
+                break;
+            case 'a':
+                numAllocs = atoi(optarg);
+                break;
+            case 'l':
+                numLeases = atoi(optarg);
+                break;
+            case 'd':
+                numDown = atoi(optarg);
+                break;
+            case 'p':
+                maxPasses = atoi(optarg);
+                break;
+            case 'k':
+                numFsck = atoi(optarg);
+                break;
+            case 'b':
+                rebalance = true;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            case 'h':
+                help = true;
+                break;
+            default:
+                KFS_LOG_VA_ERROR("Unrecognized flag %c", optchar);
+                help = true;
+                break;
+        }
+    }
+    if (numDown < 0) {
+        numDown = max(1, numServers / 20);
+    }
+    if (help || numServers <= 0 || numRacks <= 0 || numFiles <= 0 ||
+            numChunks < 0 || numReplicas <= 0 || numDown > numServers) {
+        cout << "Usage: " << argv[0] << " [-s <servers>] [-r <racks>]"
+             " [-c <chunks>] [-f <files>] [-n <replicas>] [-a <allocations>]"
+             " [-l <read leases>] [-d <servers down>] [-p <max checker passes>]"
+             " [-k <fsck passes>] [-b] [-v]" << endl;
+        cout << "      -s : # of chunk servers (" << numServers << ")" << endl;
+        cout << "      -r : # of racks (" << numRacks << ")" << endl;
+        cout << "      -c : # of chunks (" << numChunks << ")" << endl;
+        cout << "      -f : # of files (" << numFiles << ")" << endl;
+        cout << "      -n : replicas per chunk (" << numReplicas << ")" << endl;
+        cout << "      -a : # of chunk allocations (" << numAllocs << ")" << endl;
+        cout << "      -l : # of read lease requests (" << numLeases << ")" << endl;
+        cout << "      -d : # of servers to take down (5% of servers)" << endl;
+        cout << "      -p : max replication checker passes per phase (" <<
+            maxPasses << ")" << endl;
+        cout << "      -k : # of fsck passes (" << numFsck << ")" << endl;
+        cout << "      -b : enable rebalancing in replication checker" << endl;
+        cout << "      -v : verbose, log at info level" << endl;
+        exit(-1);
+    }
+
+    MsgLogger::SetLevel(verbose ?
+        MsgLogger::kLogLevelINFO : MsgLogger::kLogLevelFATAL);
+
+    // Re-replicate immediately when a server goes down, instead of
+    // waiting for it to reconnect.
+    Properties props;
+    props.setValue("metaServer.serverDownReplicationDelay", "0");
+    gLayoutEmulator.SetParameters(props);
+    gLayoutEmulator.ToggleRebalancing(rebalance);
+
+    BenchOp helloOp("HELLO");
+    BenchOp helloCheckOp("ReplicationChecker/hello");
+    BenchOp leaseOp("GetChunkReadLease");
+    BenchOp allocOp("AllocateChunk");
+    BenchOp fsckOp("Fsck");
+    BenchOp downOp("ServerDown");
+    BenchOp downCheckOp("ReplicationChecker/down");
+    BenchOp rejoinOp("HELLO/rejoin");
+
+    // Namespace: files in directories of at most 1000 entries, the chunks
+    // spread evenly over the files.
+    int64_t start = Histogram::NowUsec();
+    if (metatree.new_tree() != 0) {
+        cout << "failed to create the namespace" << endl;
+        return -1;
+    }
+    const int kFilesPerDir = 1000;
+    fid_t benchDir = 0;
+    metatree.mkdir(ROOTFID, "bench", &benchDir);
+    vector<chunkId_t> chunkIds;
+    chunkIds.reserve(numChunks);
+    vector<BenchServer> servers(numServers);
+    for (int i = 0; i < numServers; i++) {
+        ostringstream os;
+        os << "10." << ((i >> 16) & 0xFF) << "." << ((i >> 8) & 0xFF) <<
+            "." << (i & 0xFF);
+        servers[i].loc  = ServerLocation(os.str(), 30000);
+        servers[i].rack = i % numRacks;
+    }
+    fid_t dir = 0;
+    for (int i = 0, c = 0; i < numFiles; i++) {
+        if (i % kFilesPerDir == 0) {
+            ostringstream os;
+            os << "d" << i / kFilesPerDir;
+            dir = 0;
+            metatree.mkdir(benchDir, os.str(), &dir);
+        }
+        ostringstream os;
+        os << "f" << i;
+        fid_t fid = 0;
+        if (metatree.create(dir, os.str(), &fid, numReplicas, true) != 0) {
+            cout << "failed to create file: " << os.str() << endl;
+            return -1;
+        }
+        const int n = numChunks / numFiles + (i < numChunks % numFiles ? 1 : 0);
+        for (int k = 0; k < n; k++, c++) {
+            chunkOff_t offset = (chunkOff_t)k * CHUNKSIZE;
+            chunkId_t  chunkId = 0;
+            seq_t      version = 0;
+            int16_t    repl    = 0;
+            metatree.allocateChunkId(fid, offset, &chunkId, &version, &repl);
+            metatree.assignChunkId(fid, offset, chunkId, version);
+            gLayoutEmulator.AddChunkToServerMapping(chunkId, fid, offset, 0);
+            chunkIds.push_back(chunkId);
+            // Consecutive servers are on different racks.
+            const int first = (int)(((uint64_t)c * 2654435761U) % numServers);
+            for (int r = 0; r < min(numReplicas, numServers); r++) {
+                ChunkInfo ci;
+                ci.allocFileId  = fid;
+                ci.chunkId      = chunkId;
+                ci.chunkVersion = version;
+                servers[(first + r) % numServers].chunks.push_back(ci);
+            }
+        }
+        MetaFattr * const fa = metatree.getFattr(fid);
+        if (fa) {
+            metatree.setFileSize(fa, (off_t)n * CHUNKSIZE);
+        }
+    }
+    const int64_t setupUsec = Histogram::NowUsec() - start;
+
+    cout << "servers: " << numServers <<
+        " racks: "    << numRacks <<
+        " files: "    << numFiles <<
+        " chunks: "   << numChunks <<
+        " replicas: " << numReplicas <<
+        " namespace setup: " << setupUsec * 1e-6 << " sec" <<
+    endl;
+
+    for (int i = 0; i < numServers; i++) {
+        Hello(servers[i], helloOp);
+    }
+    DispatchAll(servers);
+    ReplicationCheck(servers, helloCheckOp, maxPasses);
+
+    if (! chunkIds.empty()) {
+        srand(1);
+        for (int i = 0; i < numLeases; i++) {
+            MetaLeaseAcquire req(sSeq++, 0,
+                chunkIds[rand() % chunkIds.size()], string());
+            start = Histogram::NowUsec();
+            gLayoutEmulator.GetChunkReadLease(&req);
+            leaseOp.Record(start);
+        }
+    }
+
+    // Allocate the first chunk of new files.
+    fid_t allocDir = 0;
+    metatree.mkdir(benchDir, "alloc", &allocDir);
+    for (int i = 0; i < numAllocs; i++) {
+        ostringstream os;
+        os << "a" << i;
+        fid_t fid = 0;
+        if (metatree.create(allocDir, os.str(), &fid, numReplicas, true) != 0) {
+            break;
+        }
+        MetaAllocate req(sSeq++, 0, fid, 0);
+        int16_t repl = 0;
+        req.chunkId = 0;
+        metatree.allocateChunkId(fid, req.offset, &req.chunkId,
+            &req.chunkVersion, &repl);
+        req.numReplicas = repl;
+        req.pathname    = os.str();
+        start = Histogram::NowUsec();
+        const int status = gLayoutEmulator.AllocateChunk(&req);
+        allocOp.Record(start);
+        // The allocation op queued for the servers refers to the request.
+        DispatchAll(servers);
+        if (status == 0) {
+            metatree.assignChunkId(fid, req.offset, req.chunkId,
+                req.chunkVersion);
+        }
+    }
+
+    for (int i = 0; i < numFsck; i++) {
+        MetaFsck req(sSeq++, 0);
+        start = Histogram::NowUsec();
+        gLayoutEmulator.Fsck(&req);
+        while (req.suspended) {
+            gMetaScanner.Timeout();
+        }
+        fsckOp.Record(start);
+    }
+
+    // Take down servers spread over the racks.
+    vector<int> down;
+    for (int i = 0; i < numDown; i++) {
+        const int idx = (int)((int64_t)i * numServers / numDown);
+        start = Histogram::NowUsec();
+        gLayoutEmulator.ServerDown(servers[idx].server.get());
+        downOp.Record(start);
+        down.push_back(idx);
+    }
+    ReplicationCheck(servers, downCheckOp, maxPasses);
+    const size_t candidatesLeft = gLayoutEmulator.GetNumReplicationCandidates();
+
+    for (vector<int>::const_iterator it = down.begin(); it != down.end(); ++it) {
+        Hello(servers[*it], rejoinOp);
+    }
+    DispatchAll(servers);
+
+    cout << "replication candidates left after server down: " <<
+        candidatesLeft << endl;
+    cout << endl;
+    BenchOp::PrintHeader();
+    helloOp.Print();
+    helloCheckOp.Print();
+    leaseOp.Print();
+    allocOp.Print();
+    fsckOp.Print();
+    downOp.Print();
+    downCheckOp.Print();
+    rejoinOp.Print();
+    return 0;
+}
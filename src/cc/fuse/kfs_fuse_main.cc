@@ -24,23 +24,284 @@
 #include "libkfsClient/KfsClient.h"
 
 extern "C" {
-#define FUSE_USE_VERSION	25
+#define FUSE_USE_VERSION	26
 #define _FILE_OFFSET_BITS	64
 #include <fuse.h>
+#include <fuse_opt.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 }
 
+#include <map>
+#include <string>
+
 using std::vector;
+using std::string;
+using std::map;
+using std::pair;
+using std::make_pair;
 using namespace KFS;
 
-static char *FUSE_KFS_PROPERTIES = "./kfs.prp";
 static KFS::KfsClientPtr client;
 
+//
+// Mount options, in addition to the standard fuse options:
+// -o kfs_config=<path>		client properties file; default ./kfs.prp
+// -o kfs_cache_timeout=<sec>	getattr/readdir cache timeout; 0 disables
+//				the cache; default 1 sec
+// -o kfs_cache_size=<n>	max number of cached attributes and directory
+//				entries; default 65536
+// -o kfs_max_io=<bytes>	max read / write request size; default 1MB
+//
+struct kfs_fuse_config {
+	char	*config;
+	int	cache_timeout;
+	int	cache_size;
+	int	max_io;
+};
+
+static struct kfs_fuse_config fuse_config = {
+	(char *) "./kfs.prp",
+	1,
+	1 << 16,
+	1 << 20
+};
+
+#define KFS_FUSE_OPT(t, p, v) { t, offsetof(struct kfs_fuse_config, p), v }
+
+static struct fuse_opt kfs_fuse_opts[] = {
+	KFS_FUSE_OPT("kfs_config=%s",		config,		0),
+	KFS_FUSE_OPT("kfs_cache_timeout=%d",	cache_timeout,	0),
+	KFS_FUSE_OPT("kfs_cache_size=%d",	cache_size,	0),
+	KFS_FUSE_OPT("kfs_max_io=%d",		max_io,		0),
+	FUSE_OPT_END
+};
+
+//
+// The kernel asks for the attributes of every path component on each
+// lookup, and "ls -l" does a getattr per directory entry after readdir.
+// Keep the attributes and the directory listings for a short time, to
+// avoid a metaserver round trip for each of these. Readdir also fills
+// in the attributes of the directory entries. Any modification through
+// this mount invalidates the affected entries once it is done;
+// modifications by other clients become visible after the cache timeout.
+// A lookup that raced with an invalidation isn't cached: it may have
+// fetched the attributes from before the modification.
+// Expired entries are purged at most once per timeout interval, and no
+// new entries are added once the cache holds maxSize attributes and
+// directory entries, so a walk over a large tree does not grow it
+// without bound.
+//
+class AttrCache {
+public:
+	AttrCache() : timeout(0), maxSize(0), size(0), nextPurge(0),
+			generation(0) {
+		pthread_mutex_init(&mutex, NULL);
+	}
+	~AttrCache() {
+		pthread_mutex_destroy(&mutex);
+	}
+	void SetTimeout(int sec) {
+		timeout = sec;
+	}
+	void SetMaxSize(int n) {
+		maxSize = n > 0 ? n : 0;
+	}
+	bool GetAttr(const string &path, struct stat &s) {
+		Lock l(mutex);
+		Attrs::iterator it = attrs.find(path);
+		if (it == attrs.end())
+			return false;
+		if (it->second.expires <= Now()) {
+			EraseAttr(it);
+			return false;
+		}
+		s = it->second.attr;
+		return true;
+	}
+	// Take before the lookup, and pass to PutAttr() / PutDir().
+	unsigned long Generation() {
+		Lock l(mutex);
+		return generation;
+	}
+	void PutAttr(const string &path, const struct stat &s,
+			unsigned long gen) {
+		if (timeout <= 0)
+			return;
+		Lock l(mutex);
+		if (gen != generation)
+			return;
+		const time_t now = Now();
+		Attrs::iterator it = attrs.find(path);
+		if (it == attrs.end()) {
+			if (! Reserve(1, now))
+				return;
+			it = attrs.insert(make_pair(path, Attr())).first;
+			size++;
+		}
+		it->second.attr = s;
+		it->second.expires = now + timeout;
+	}
+	bool GetDir(const string &path, vector <KfsFileAttr> &contents) {
+		Lock l(mutex);
+		Dirs::iterator it = dirs.find(path);
+		if (it == dirs.end())
+			return false;
+		if (it->second.expires <= Now()) {
+			EraseDir(it);
+			return false;
+		}
+		contents = it->second.contents;
+		return true;
+	}
+	void PutDir(const string &path, const vector <KfsFileAttr> &contents,
+			unsigned long gen) {
+		if (timeout <= 0)
+			return;
+		Lock l(mutex);
+		if (gen != generation)
+			return;
+		const time_t now = Now();
+		Dirs::iterator dit = dirs.find(path);
+		if (dit != dirs.end())
+			EraseDir(dit);
+		// The listing, and the attributes of its entries.
+		const int n = contents.size();
+		if (! Reserve(2 * (size_t)n + 1, now))
+			return;
+		Dir &d = dirs[path];
+		d.contents = contents;
+		d.expires = now + timeout;
+		size += n + 1;
+		const string prefix = path == "/" ? path : path + "/";
+		for (int i = 0; i != n; i++) {
+			pair <Attrs::iterator, bool> const res = attrs.insert(
+				make_pair(prefix + contents[i].filename, Attr()));
+			if (res.second)
+				size++;
+			ToStat(contents[i], res.first->second.attr);
+			res.first->second.expires = d.expires;
+		}
+	}
+	// Invalidate the path attributes and the parent directory listing.
+	void Invalidate(const string &path) {
+		Lock l(mutex);
+		generation++;
+		Attrs::iterator ait = attrs.find(path);
+		if (ait != attrs.end())
+			EraseAttr(ait);
+		Dirs::iterator dit = dirs.find(path);
+		if (dit != dirs.end())
+			EraseDir(dit);
+		const size_t pos = path.rfind('/');
+		if (pos != string::npos) {
+			dit = dirs.find(pos == 0 ? string("/") : path.substr(0, pos));
+			if (dit != dirs.end())
+				EraseDir(dit);
+		}
+		const time_t now = Now();
+		if (nextPurge <= now)
+			Purge(now);
+	}
+	void Clear() {
+		Lock l(mutex);
+		generation++;
+		attrs.clear();
+		dirs.clear();
+		size = 0;
+	}
+	static void ToStat(const KfsFileAttr &fa, struct stat &s) {
+		// Same as KfsClient::Stat()
+		memset(&s, 0, sizeof s);
+		s.st_ino = fa.fileId;
+		s.st_mode = fa.isDirectory ? S_IFDIR : S_IFREG;
+		s.st_size = fa.fileSize;
+		s.st_atime = fa.crtime.tv_sec;
+		s.st_mtime = fa.mtime.tv_sec;
+		s.st_ctime = fa.ctime.tv_sec;
+	}
+private:
+	struct Attr {
+		struct stat	attr;
+		time_t		expires;
+	};
+	struct Dir {
+		vector <KfsFileAttr>	contents;
+		time_t			expires;
+	};
+	typedef map <string, Attr> Attrs;
+	typedef map <string, Dir> Dirs;
+	class Lock {
+	public:
+		Lock(pthread_mutex_t &m) : mutex(m) {
+			pthread_mutex_lock(&mutex);
+		}
+		~Lock() {
+			pthread_mutex_unlock(&mutex);
+		}
+	private:
+		pthread_mutex_t &mutex;
+	};
+
+	pthread_mutex_t	mutex;
+	int		timeout;
+	size_t		maxSize;
+	size_t		size;
+	time_t		nextPurge;
+	unsigned long	generation;
+	Attrs		attrs;
+	Dirs		dirs;
+
+	void EraseAttr(Attrs::iterator it) {
+		attrs.erase(it);
+		size--;
+	}
+	void EraseDir(Dirs::iterator it) {
+		size -= it->second.contents.size() + 1;
+		dirs.erase(it);
+	}
+	void Purge(time_t now) {
+		nextPurge = now + timeout;
+		for (Attrs::iterator it = attrs.begin(); it != attrs.end(); ) {
+			if (it->second.expires <= now)
+				EraseAttr(it++);
+			else
+				++it;
+		}
+		for (Dirs::iterator it = dirs.begin(); it != dirs.end(); ) {
+			if (it->second.expires <= now)
+				EraseDir(it++);
+			else
+				++it;
+		}
+	}
+	// Returns true if n more entries fit.
+	bool Reserve(size_t n, time_t now) {
+		if (nextPurge <= now)
+			Purge(now);
+		return size + n <= maxSize;
+	}
+
+	static time_t Now() {
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return tv.tv_sec;
+	}
+};
+
+static AttrCache cache;
+
 void *
-fuse_init()
+fuse_init(struct fuse_conn_info *conn)
 {
-	client = getKfsClientFactory()->GetClient(FUSE_KFS_PROPERTIES);
+	client = getKfsClientFactory()->GetClient(fuse_config.config);
+	if (conn->max_readahead > (unsigned) fuse_config.max_io)
+		conn->max_readahead = fuse_config.max_io;
 	return client->IsInitialized() ? client.get() : NULL;
 }
 
@@ -53,31 +314,47 @@ fuse_destroy(void *cookie)
 static int
 fuse_getattr(const char *path, struct stat *s)
 {
-	return client->Stat(path, *s);
+	if (cache.GetAttr(path, *s))
+		return 0;
+	const unsigned long gen = cache.Generation();
+	int status = client->Stat(path, *s);
+	if (status == 0)
+		cache.PutAttr(path, *s, gen);
+	return status;
 }
 
 static int
 fuse_mkdir(const char *path, mode_t mode)
 {
-	return client->Mkdir(path);
+	int status = client->Mkdir(path);
+	cache.Invalidate(path);
+	return status;
 }
 
 static int
 fuse_unlink(const char *path)
 {
-	return client->Remove(path);
+	int status = client->Remove(path);
+	cache.Invalidate(path);
+	return status;
 }
 
 static int
 fuse_rmdir(const char *path)
 {
-	return client->Rmdir(path);
+	int status = client->Rmdir(path);
+	cache.Invalidate(path);
+	return status;
 }
 
 static int
 fuse_rename(const char *src, const char *dst)
 {
-	return client->Rename(src, dst, false);
+	// The cache is keyed by path: renaming a directory changes the
+	// paths of everything under it.
+	int status = client->Rename(src, dst, false);
+	cache.Clear();
+	return status;
 }
 
 static int
@@ -88,71 +365,84 @@ fuse_truncate(const char *path, off_t size)
 		return fd;
 	int status = client->Truncate(fd, size);
 	client->Close(fd);
+	cache.Invalidate(path);
 	return status;
 }
 
+static int
+fuse_ftruncate(const char *path, off_t size, struct fuse_file_info *finfo)
+{
+	int status = client->Truncate(finfo->fh, size);
+	cache.Invalidate(path);
+	return status;
+}
+
+//
+// The KFS fd is kept in the fuse file handle from open / create until
+// release, so that the path is resolved once per open, and the client
+// read ahead and write buffers are used across the fuse read / write
+// requests.
+//
 static int
 fuse_open(const char *path, struct fuse_file_info *finfo)
 {
-	int res = client->Open(path, finfo->flags);
-	if (res >= 0)
-		return 0;
-	return res;
+	int fd = client->Open(path, finfo->flags);
+	if ((finfo->flags & O_ACCMODE) != O_RDONLY)
+		cache.Invalidate(path);
+	if (fd < 0)
+		return fd;
+	finfo->fh = fd;
+	return 0;
 }
 
 static int
 fuse_create(const char *path, mode_t mode, struct fuse_file_info *finfo)
 {
-	int res = client->Create(path);
-	if (res >= 0)
-		return 0;
-	return res;
+	int fd = client->Create(path);
+	cache.Invalidate(path);
+	if (fd < 0)
+		return fd;
+	finfo->fh = fd;
+	return 0;
 }
 
 static int
 fuse_read(const char *path, char *buf, size_t nread, off_t off,
 		struct fuse_file_info *finfo)
 {
-	int fd = client->Open(path, O_RDONLY);
-	if (fd < 0)
-		return fd;
-	int status = client->Seek(fd, off, SEEK_SET);
-	if (status == 0)
-		status = client->Read(fd, buf, nread);
-	client->Close(fd);
-	return status;
+	return client->PRead(finfo->fh, off, buf, nread);
 }
 
 static int
 fuse_write(const char *path, const char *buf, size_t nwrite, off_t off,
 		struct fuse_file_info *finfo)
 {
-	int fd = client->Open(path, O_WRONLY);
-	if (fd < 0)
-		return fd;
-	int status = client->Seek(fd, off, SEEK_SET);
-	if (status == 0)
-		status = client->Write(fd, buf, nwrite);
-	client->Close(fd);
+	int status = client->PWrite(finfo->fh, off, buf, nwrite);
+	cache.Invalidate(path);
 	return status;
 }
 
 static int
 fuse_flush(const char *path, struct fuse_file_info *finfo)
 {
-	int fd = client->Fileno(path);
-	if (fd < 0)
-		return fd;
-	return client->Sync(fd);
+	int status = client->Sync(finfo->fh);
+	cache.Invalidate(path);
+	return status;
+}
+
+static int
+fuse_release(const char *path, struct fuse_file_info *finfo)
+{
+	int status = client->Close(finfo->fh);
+	if ((finfo->flags & O_ACCMODE) != O_RDONLY)
+		cache.Invalidate(path);
+	return status;
 }
 
 static int
 fuse_fsync(const char *path, int flags, struct fuse_file_info *finfo)
 {
-	int fd = client->Open(path, O_RDONLY);
-	if (fd < 0)
-		return fd;
-	return client->Sync(fd);
+	return client->Sync(finfo->fh);
 }
 
 static int
@@ -161,61 +451,64 @@ fuse_readdir(const char *path, void *buf,
 		struct fuse_file_info *finfo)
 {
 	vector <KfsFileAttr> contents;
-	int status = client->ReaddirPlus(path, contents);
-	if (status < 0)
-		return status;
+	if (! cache.GetDir(path, contents)) {
+		const unsigned long gen = cache.Generation();
+		int status = client->ReaddirPlus(path, contents);
+		if (status < 0)
+			return status;
+		cache.PutDir(path, contents, gen);
+	}
 	int n = contents.size();
 	for (int i = 0; i != n; i++) {
 		struct stat s;
-		memset(&s, 0, sizeof s);
-		s.st_ino = contents[i].fileId;
-		s.st_mode = contents[i].isDirectory ? S_IFDIR : S_IFREG;
+		AttrCache::ToStat(contents[i], s);
 		if (filler(buf, contents[i].filename.c_str(), &s, 0) != 0)
 			break;
 	}
 	return 0;
 }
 
-struct fuse_operations ops = {
-	fuse_getattr,
-	NULL,			/* readlink */
-	NULL,			/* getdir */
-	NULL,			/* mknod */
-	fuse_mkdir,
-	fuse_unlink,
-	fuse_rmdir,
-	NULL,			/* symlink */
-	fuse_rename,
-	NULL,			/* link */
-	NULL,			/* chmod */
-	NULL,			/* chown */
-	fuse_truncate,
-	NULL,			/* utime */
-	fuse_open,
-	fuse_read,
-	fuse_write,
-	NULL,			/* statfs */
-	fuse_flush,		/* flush */
-	NULL,			/* release */
-	fuse_fsync,		/* fsync */
-	NULL,			/* setxattr */
-	NULL,			/* getxattr */
-	NULL,			/* listxattr */
-	NULL,			/* removexattr */
-	NULL,			/* opendir */
-	fuse_readdir,
-	NULL,			/* releasedir */
-	NULL,			/* fsyncdir */
-	fuse_init,
-	fuse_destroy,
-	NULL,			/* access */
-	fuse_create,		/* create */
-	NULL,			/* ftruncate */
-	NULL			/* fgetattr */
-};
-
 int
 main(int argc, char **argv)
 {
-	return fuse_main(argc, argv, &ops);
+	struct fuse_operations ops;
+	memset(&ops, 0, sizeof ops);
+	ops.getattr	= fuse_getattr;
+	ops.mkdir	= fuse_mkdir;
+	ops.unlink	= fuse_unlink;
+	ops.rmdir	= fuse_rmdir;
+	ops.rename	= fuse_rename;
+	ops.truncate	= fuse_truncate;
+	ops.open	= fuse_open;
+	ops.read	= fuse_read;
+	ops.write	= fuse_write;
+	ops.flush	= fuse_flush;
+	ops.release	= fuse_release;
+	ops.fsync	= fuse_fsync;
+	ops.readdir	= fuse_readdir;
+	ops.init	= fuse_init;
+	ops.destroy	= fuse_destroy;
+	ops.create	= fuse_create;
+	ops.ftruncate	= fuse_ftruncate;
+
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	if (fuse_opt_parse(&args, &fuse_config, kfs_fuse_opts, NULL) != 0)
+		return 1;
+	cache.SetTimeout(fuse_config.cache_timeout);
+	cache.SetMaxSize(fuse_config.cache_size);
+
+	// Large requests: by default the kernel splits writes into 4KB
+	// requests, and reads into 128KB requests. Fuse runs the file
+	// system multi-threaded unless -s is specified; the client is
+	// thread safe.
+	char opts[128];
+	snprintf(opts, sizeof opts, "-omax_read=%d%s%d",
+		fuse_config.max_io,
+		fuse_version() >= 28 ? ",big_writes,max_write=" : ",max_write=",
+		fuse_config.max_io);
+	fuse_opt_add_arg(&args, opts);
+
+	int status = fuse_main(args.argc, args.argv, &ops, NULL);
+	fuse_opt_free_args(&args);
+	return status;
 }
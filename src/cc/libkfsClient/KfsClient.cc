@@ -121,9 +121,19 @@ KfsClientFactory::GetClient(const char *propFile)
 	return clnt;
     }
 
-    return GetClient(theProps().getValue("metaServer.name", ""),
-                     theProps().getValue("metaServer.port", -1));
-
+    KfsClientPtr clnt = GetClient(theProps().getValue("metaServer.name", ""),
+                                  theProps().getValue("metaServer.port", -1));
+    const int metaCacheSize = theProps().getValue("client.metaCache.maxEntries", 0);
+    if (clnt && metaCacheSize > 0) {
+        clnt->SetMetaCache(metaCacheSize,
+                           theProps().getValue("client.metaCache.ttlSec", 30));
+    }
+    if (clnt) {
+        clnt->SetConnPool(
+            theProps().getValue("client.connPool.maxConnsPerServer", 2),
+            theProps().getValue("client.connPool.idleTimeoutSec", 60));
+    }
+    return clnt;
 }
 
 class MatchingServer {
@@ -249,6 +259,20 @@ KfsClient::ReaddirPlus(const char *pathname, std::vector<KfsFileAttr> &result)
     return mImpl->ReaddirPlus(pathname, result);
 }
 
+int 
+KfsClient::ReaddirPage(const char *pathname, std::string &cursor,
+                       std::vector<std::string> &result, bool &hasMore)
+{
+    return mImpl->ReaddirPage(pathname, cursor, result, hasMore);
+}
+
+int 
+KfsClient::ReaddirPlusPage(const char *pathname, std::string &cursor,
+                           std::vector<KfsFileAttr> &result, bool &hasMore)
+{
+    return mImpl->ReaddirPlusPage(pathname, cursor, result, hasMore);
+}
+
 int 
 KfsClient::GetDirSummary(const char *pathname, uint64_t &numFiles, uint64_t &numBytes)
 {
@@ -375,6 +399,12 @@ KfsClient::AtomicRecordAppend(int fd, const char *buf, int reclen)
     return mImpl->AtomicRecordAppend(fd, buf, reclen);
 }
 
+int
+KfsClient::SetRecordAppendBlocks(int blockSize, bool compressFlag)
+{
+    return mImpl->SetRecordAppendBlocks(blockSize, compressFlag);
+}
+
 void
 KfsClient::EnableAsyncRW()
 {
@@ -405,6 +435,18 @@ KfsClient::Write(int fd, const char *buf, size_t numBytes)
     return mImpl->Write(fd, buf, numBytes);
 }
 
+ssize_t 
+KfsClient::PRead(int fd, off_t offset, char *buf, size_t numBytes)
+{
+    return mImpl->PRead(fd, offset, buf, numBytes);
+}
+
+ssize_t 
+KfsClient::PWrite(int fd, off_t offset, const char *buf, size_t numBytes)
+{
+    return mImpl->PWrite(fd, offset, buf, numBytes);
+}
+
 int
 KfsClient::WriteAsync(int fd, const char *buf, size_t numBytes)
 {
@@ -557,6 +599,110 @@ KfsClient::GetReadAheadSize(int fd) const
     return mImpl->GetReadAheadSize(fd);
 }
 
+size_t
+KfsClient::SetDefaultWriteBehind(size_t size)
+{
+    return mImpl->SetDefaultWriteBehind(size);
+}
+
+size_t
+KfsClient::GetDefaultWriteBehind() const
+{
+    return mImpl->GetDefaultWriteBehind();
+}
+
+size_t
+KfsClient::SetWriteBehind(int fd, size_t size)
+{
+    return mImpl->SetWriteBehind(fd, size);
+}
+
+size_t
+KfsClient::GetWriteBehind(int fd) const
+{
+    return mImpl->GetWriteBehind(fd);
+}
+
+void
+KfsClient::GetWriteBehindStats(int64_t &writes, int64_t &bytes,
+    int64_t &allocations, int64_t &retries, int64_t &errors,
+    int64_t &enqueueWaitUsecs) const
+{
+    KfsWriteBehind::Stats stats;
+    mImpl->GetWriteBehindStats(stats);
+    writes           = stats.mWriteCount;
+    bytes            = stats.mWriteByteCount;
+    allocations      = stats.mAllocateCount;
+    retries          = stats.mRetryCount;
+    errors           = stats.mErrorCount;
+    enqueueWaitUsecs = stats.mEnqueueWaitUsecs;
+}
+
+void
+KfsClient::SetReadHedging(int percentile, int minDelayMs, int maxDelayMs)
+{
+    mImpl->SetReadHedging(percentile, minDelayMs, maxDelayMs);
+}
+
+void
+KfsClient::GetReadHedgingStats(int64_t &issued, int64_t &won)
+{
+    mImpl->GetReadHedgingStats(issued, won);
+}
+
+void
+KfsClient::GetReadAheadStats(int64_t &requests, int64_t &hits,
+    int64_t &hitBytes, int64_t &wasteBytes, int64_t &nextChunks)
+{
+    PendingChunkRead::Stats stats;
+    mImpl->GetReadAheadStats(stats);
+    requests   = stats.mRequestCount;
+    hits       = stats.mHitCount;
+    hitBytes   = stats.mHitByteCount;
+    wasteBytes = stats.mWasteByteCount;
+    nextChunks = stats.mNextChunkCount;
+}
+
+void
+KfsClient::SetMetaCache(int maxEntries, int ttlSec)
+{
+    mImpl->SetMetaCache(maxEntries, ttlSec);
+}
+
+void
+KfsClient::GetMetaCacheStats(int64_t &attrHits, int64_t &attrMisses,
+    int64_t &layoutHits, int64_t &layoutMisses, int64_t &invalidations,
+    int64_t &evictions)
+{
+    KfsMetaCache::Stats stats;
+    mImpl->GetMetaCacheStats(stats);
+    attrHits      = stats.mAttrHitCount;
+    attrMisses    = stats.mAttrMissCount;
+    layoutHits    = stats.mLayoutHitCount;
+    layoutMisses  = stats.mLayoutMissCount;
+    invalidations = stats.mInvalidateCount;
+    evictions     = stats.mEvictCount;
+}
+
+void
+KfsClient::SetConnPool(int maxConnsPerServer, int idleTimeoutSec)
+{
+    mImpl->SetConnPool(maxConnsPerServer, idleTimeoutSec);
+}
+
+void
+KfsClient::GetConnPoolStats(int64_t &connects, int64_t &reuses,
+    int64_t &stashed, int64_t &abandoned, int64_t &idleClosed)
+{
+    KfsConnPool::Stats stats;
+    mImpl->GetConnPoolStats(stats);
+    connects   = stats.mConnectCount;
+    reuses     = stats.mReuseCount;
+    stashed    = stats.mStashCount;
+    abandoned  = stats.mAbandonCount;
+    idleClosed = stats.mIdleCloseCount;
+}
+
 //
 // Now, the real work is done by the impl object....
 //
@@ -565,6 +711,10 @@ KfsClientImpl::KfsClientImpl()
     : mPendingOp(*this),
       mFileInstance(0),
       mProtocolWorker(0),
+      mRecordAppendBlockSize(0),
+      mRecordAppendBlockCompressFlag(true),
+      mWriteBehind(0),
+      mReadAheadLocator(0),
       mMaxNumRetriesPerOp(DEFAULT_NUM_RETRIES_PER_OP)
 {
     pthread_mutexattr_t mutexAttr;
@@ -606,7 +756,9 @@ KfsClientImpl::KfsClientImpl()
     // 64MB before
     const size_t BUF_SIZE = min(KFS::CHUNKSIZE, size_t(4) << 20);
     mDefaultIoBufferSize  = BUF_SIZE;
-    mDefaultReadAheadSize = min(BUF_SIZE, size_t(1) << 20);
+    // the read ahead window grows up to this with sequential access
+    mDefaultReadAheadSize = BUF_SIZE;
+    mDefaultWriteBehind   = 0;
     // for random # generation, seed it
     srand(getpid());
     // turn off the read-ahead thread for now
@@ -617,10 +769,13 @@ KfsClientImpl::~KfsClientImpl()
 {
     mPendingOp.Stop();
     delete mProtocolWorker;
+    delete mWriteBehind;
     std::vector <FileTableEntry *>::iterator it = mFileTable.begin();
     while (it != mFileTable.end()) {
         delete *it++;
     }
+    // the read ahead of the files above cancels the locator requests
+    delete mReadAheadLocator;
 }
 
 int KfsClientImpl::Init(const string metaServerHost, int metaServerPort)
@@ -790,6 +945,8 @@ KfsClientImpl::Mkdir(const char *pathname)
     if (res < 0)
 	return res;
 
+    // Drop the cached negative knowledge, if any, of the name.
+    mMetaCache.InvalidateAttr(parentFid, dirname);
     MkdirOp op(nextSeq(), parentFid, dirname.c_str());
     DoMetaOpWithRetry(&op);
     if (op.status < 0) {
@@ -826,6 +983,7 @@ KfsClientImpl::Rmdir(const char *pathname)
     int fte = LookupFileTableEntry(parentFid, dirname.c_str());
     if (fte > 0)
 	ReleaseFileTableEntry(fte);
+    mMetaCache.InvalidateAttr(parentFid, dirname);
     RmdirOp op(nextSeq(), parentFid, dirname.c_str(), pathname);
     (void)DoMetaOpWithRetry(&op);
     return op.status;
@@ -951,6 +1109,7 @@ KfsClientImpl::Rmdirs(const string &parentDir, kfsFileId_t parentFid,
     if (res < 0)
         return res;
 
+    mMetaCache.InvalidateAttr(parentFid, dirname);
     RmdirOp op(nextSeq(), parentFid, dirname.c_str(), p.c_str());
     (void)DoMetaOpWithRetry(&op);
     return op.status;
@@ -962,11 +1121,32 @@ int
 KfsClientImpl::Remove(const string &dirname, kfsFileId_t dirFid, const string &filename)
 {
     string pathname = dirname + "/" + filename;
+    mMetaCache.InvalidateAttr(dirFid, filename);
     RemoveOp op(nextSeq(), dirFid, filename.c_str(), pathname.c_str());
     (void)DoMetaOpWithRetry(&op);
     return op.status;
 }
 
+///
+/// Get the file id of a directory, opening it if it isn't in the
+/// file table.
+///
+int
+KfsClientImpl::LookupDirectory(const char *pathname, kfsFileId_t &dirFid)
+{
+    int fte = LookupFileTableEntry(pathname);
+    if (fte < 0)	 // open the directory for reading
+	fte = Open(pathname, O_RDONLY);
+    if (fte < 0)
+	return fte;
+
+    FileAttr *fa = FdAttr(fte);
+    if (!fa->isDirectory)
+	return -ENOTDIR;
+    dirFid = fa->fileId;
+    return 0;
+}
+
 ///
 /// Read a directory's contents.  This is analogous to READDIR in
 /// NFS---just reads the directory contents and returns the names;
@@ -984,39 +1164,65 @@ KfsClientImpl::Readdir(const char *pathname, vector<string> &result)
 {
     MutexLock l(&mMutex);
 
-    int fte = LookupFileTableEntry(pathname);
-    if (fte < 0) {
-	// open the directory for reading
-	fte = Open(pathname, O_RDONLY);
-    }
+    kfsFileId_t dirFid = -1;
+    int res = LookupDirectory(pathname, dirFid);
+    if (res < 0)
+        return res;
 
-    if (fte < 0)
-	return fte;
+    result.clear();
+    string cursor;
+    for (bool hasMore = true; hasMore; ) {
+        if ((res = ReaddirPage(dirFid, cursor, result, hasMore)) < 0)
+            return res;
+    }
+    sort(result.begin(), result.end());
+    return res;
+}
 
-    if (!mFileTable[fte]->fattr.isDirectory)
-	return -ENOTDIR;
+int
+KfsClientImpl::ReaddirPage(const char *pathname, string &cursor,
+                           vector<string> &result, bool &hasMore)
+{
+    MutexLock l(&mMutex);
 
-    kfsFileId_t dirFid = mFileTable[fte]->fattr.fileId;
+    kfsFileId_t dirFid = -1;
+    result.clear();
+    hasMore = false;
+    const int res = LookupDirectory(pathname, dirFid);
+    if (res < 0)
+        return res;
+    return ReaddirPage(dirFid, cursor, result, hasMore);
+}
 
-    ReaddirOp op(nextSeq(), dirFid);
+///
+/// Get one page of the directory entries starting at the cursor, and
+/// append them to the result.  On return, the cursor is set to where
+/// the next page starts.
+///
+int
+KfsClientImpl::ReaddirPage(kfsFileId_t dirFid, string &cursor,
+                           vector<string> &result, bool &hasMore)
+{
+    ReaddirOp op(nextSeq(), dirFid, cursor, READDIR_PAGE_ENTRIES);
     DoMetaOpWithRetry(&op);
-    int res = op.status;
-    if (res < 0)
-	return res;
+    hasMore = false;
+    if (op.status < 0)
+        return op.status;
 
     istringstream ist;
     char filename[MAX_FILENAME_LEN];
-    assert(op.contentBuf != NULL);
-    ist.str(op.contentBuf);
-    result.resize(op.numEntries);
+    assert(op.contentBuf != NULL || op.numEntries == 0);
+    if (op.contentBuf != NULL)
+        ist.str(op.contentBuf);
     for (int i = 0; i < op.numEntries; ++i) {
-	// ist >> result[i];
-	ist.getline(filename, MAX_FILENAME_LEN);
-	result[i] = filename;
+        // ist >> result[i];
+        ist.getline(filename, MAX_FILENAME_LEN);
+        result.push_back(filename);
         // KFS_LOG_VA_DEBUG("Entry: %s", filename);
     }
-    sort(result.begin(), result.end());
-    return res;
+    hasMore = op.hasMoreEntries && ! op.nextCursor.empty();
+    cursor = hasMore ? op.nextCursor : string();
+    return 0;
 }
 
 ///
@@ -1033,38 +1239,58 @@ KfsClientImpl::ReaddirPlus(const char *pathname, vector<KfsFileAttr> &result,
 {
     MutexLock l(&mMutex);
 
-    int fte = LookupFileTableEntry(pathname);
-    if (fte < 0)	 // open the directory for reading
-	fte = Open(pathname, O_RDONLY);
-    if (fte < 0)
-	   return fte;
+    kfsFileId_t dirFid = -1;
+    const int res = LookupDirectory(pathname, dirFid);
+    if (res < 0)
+        return res;
 
-    FileAttr *fa = FdAttr(fte);
-    if (!fa->isDirectory)
-	return -ENOTDIR;
+    return ReaddirPlus(pathname, dirFid, result, computeFilesize);
+}
+
+int
+KfsClientImpl::ReaddirPlusPage(const char *pathname, string &cursor,
+                               vector<KfsFileAttr> &result, bool &hasMore)
+{
+    MutexLock l(&mMutex);
 
-    return ReaddirPlus(pathname, fa->fileId, result, computeFilesize);
+    kfsFileId_t dirFid = -1;
+    result.clear();
+    hasMore = false;
+    const int res = LookupDirectory(pathname, dirFid);
+    if (res < 0)
+        return res;
+    vector<FileChunkInfo> fileChunkInfo;
+    return ReaddirPlusPage(dirFid, cursor, result, fileChunkInfo, true,
+                           hasMore);
 }
 
+///
+/// Get one page of the directory entries with their attributes starting
+/// at the cursor, and append them to the result.  The file sizes of the
+/// entries are computed per page, so that a large directory is
+/// processed as it arrives.
+///
 int
-KfsClientImpl::ReaddirPlus(const char *pathname, kfsFileId_t dirFid, 
-                           vector<KfsFileAttr> &result, bool computeFilesize,
-                           bool updateClientCache)
+KfsClientImpl::ReaddirPlusPage(kfsFileId_t dirFid, string &cursor,
+                               vector<KfsFileAttr> &result,
+                               vector<FileChunkInfo> &fileChunkInfo,
+                               bool computeFilesize, bool &hasMore)
 {
-    ReaddirPlusOp op(nextSeq(), dirFid);
+    ReaddirPlusOp op(nextSeq(), dirFid, cursor, READDIR_PAGE_ENTRIES);
     (void)DoMetaOpWithRetry(&op);
-    int res = op.status;
-    if (res < 0) {
-	return res;
+    hasMore = false;
+    if (op.status < 0) {
+        return op.status;
     }
 
-    vector<FileChunkInfo> fileChunkInfo;
+    vector<KfsFileAttr> entries;
+    vector<FileChunkInfo> pageChunkInfo;
     istringstream ist;
     string entryInfo;
     boost::scoped_array<char> line;
     int count = 0, linelen = 1 << 20, numchars;
     const string entryDelim = "Begin-entry";
-    string s(op.contentBuf, op.contentLength);
+    string s(op.contentBuf ? op.contentBuf : "", op.contentLength);
 
     ist.str(s);
 
@@ -1154,30 +1380,54 @@ KfsClientImpl::ReaddirPlus(const char *pathname, kfsFileId_t dirFid,
                 lastChunkInfo.cattr.chunkServerLoc.push_back(loc);
             }
         }
-        fileChunkInfo.push_back(lastChunkInfo);
-        result.push_back(fattr);
+        pageChunkInfo.push_back(lastChunkInfo);
+        entries.push_back(fattr);
     }
 
     if (computeFilesize) {
 
-        for (uint32_t i = 0; i < result.size(); i++) {
-            if ((fileChunkInfo[i].chunkCount == 0) || (result[i].isDirectory)) {
-                result[i].fileSize = 0;
+        for (uint32_t i = 0; i < entries.size(); i++) {
+            if ((pageChunkInfo[i].chunkCount == 0) || (entries[i].isDirectory)) {
+                entries[i].fileSize = 0;
                 continue;
             }
 
-            int fte = LookupFileTableEntry(dirFid, result[i].filename.c_str());
+            int fte = LookupFileTableEntry(dirFid, entries[i].filename.c_str());
 
             if (fte >= 0) {
-                result[i].fileSize = mFileTable[fte]->fattr.fileSize;
+                entries[i].fileSize = mFileTable[fte]->fattr.fileSize;
             } 
         }
-        ComputeFilesizes(result, fileChunkInfo);
+        ComputeFilesizes(entries, pageChunkInfo);
+
+        for (uint32_t i = 0; i < entries.size(); i++) 
+            if (entries[i].fileSize < 0)
+                entries[i].fileSize = 0;
 
-        for (uint32_t i = 0; i < result.size(); i++) 
-            if (result[i].fileSize < 0)
-                result[i].fileSize = 0;
+    }
+
+    result.insert(result.end(), entries.begin(), entries.end());
+    fileChunkInfo.insert(fileChunkInfo.end(),
+        pageChunkInfo.begin(), pageChunkInfo.end());
+    hasMore = op.hasMoreEntries && ! op.nextCursor.empty();
+    cursor = hasMore ? op.nextCursor : string();
+    return 0;
+}
+
+int
+KfsClientImpl::ReaddirPlus(const char *pathname, kfsFileId_t dirFid, 
+                           vector<KfsFileAttr> &result, bool computeFilesize,
+                           bool updateClientCache)
+{
+    vector<FileChunkInfo> fileChunkInfo;
+    string cursor;
+    int res = 0;
 
+    for (bool hasMore = true; hasMore; ) {
+        res = ReaddirPlusPage(dirFid, cursor, result, fileChunkInfo,
+                              computeFilesize, hasMore);
+        if (res < 0)
+            return res;
     }
 
     // if there are too many entries in the dir, then the caller is
@@ -1377,15 +1627,19 @@ KfsClientImpl::LookupAttr(kfsFileId_t parentFid, const char *filename,
 	return -EINVAL;
     
     int fte = LookupFileTableEntry(parentFid, filename);
-    LookupOp op(nextSeq(), parentFid, filename);
-
-    (void)DoMetaOpWithRetry(&op);
-    if (op.status < 0)
-        return op.status;
+    KfsServerAttr fattr;
+    // the directory sizes are maintained by the meta server; always get
+    // the current value
+    if (! mMetaCache.GetAttr(parentFid, filename, fattr) ||
+            fattr.isDirectory) {
+        const int status = LookupFattr(parentFid, filename, fattr, false);
+        if (status < 0)
+            return status;
+    }
 
-    result = op.fattr;
+    result = fattr;
 
-    result.fileSize = op.fattr.fileSize;
+    result.fileSize = fattr.fileSize;
     
     if ((!result.isDirectory) && computeFilesize) {
         if (result.fileSize < 0) {
@@ -1394,6 +1648,7 @@ KfsClientImpl::LookupAttr(kfsFileId_t parentFid, const char *filename,
                 // We are asked for filesize and if we can't compute it, fail
                 return -EIO;
             }
+            mMetaCache.SetFileSize(parentFid, filename, result.fileSize);
         }
     }
 
@@ -1407,15 +1662,15 @@ KfsClientImpl::LookupAttr(kfsFileId_t parentFid, const char *filename,
     // cache the entry if possible
     fte = AllocFileTableEntry(parentFid, filename, "");
     if (fte < 0)		
-	return op.status;
+	return 0;
     
-    mFileTable[fte]->fattr = op.fattr;
+    mFileTable[fte]->fattr = fattr;
     mFileTable[fte]->openMode = 0;
     // if we computed the filesize, then we stash it; otherwise, we'll
     // set the value to -1 and force a recompute later...
     mFileTable[fte]->fattr.fileSize = result.fileSize;
 
-    return op.status;
+    return 0;
 }
 
 int
@@ -1434,6 +1689,7 @@ KfsClientImpl::Create(const char *pathname, int numReplicas, bool exclusive)
     if (filename.size() >= MAX_FILENAME_LEN)
 	return -ENAMETOOLONG;
 
+    mMetaCache.InvalidateAttr(parentFid, filename);
     CreateOp op(nextSeq(), parentFid, filename.c_str(), numReplicas, exclusive);
     (void)DoMetaOpWithRetry(&op);
     if (op.status < 0) {
@@ -1469,8 +1725,12 @@ KfsClientImpl::Remove(const char *pathname)
 	return res;
 
     int fte = LookupFileTableEntry(parentFid, filename.c_str());
-    if (fte > 0)
+    kfsFileId_t fid = -1;
+    if (fte > 0) {
+        fid = mFileTable[fte]->fattr.fileId;
 	ReleaseFileTableEntry(fte);
+    }
+    mMetaCache.InvalidateAttr(parentFid, filename, fid);
 
     RemoveOp op(nextSeq(), parentFid, filename.c_str(), pathname);
     (void)DoMetaOpWithRetry(&op);
@@ -1493,6 +1753,18 @@ KfsClientImpl::Rename(const char *oldpath, const char *newpath, bool overwrite)
                 absNewpath.c_str(), oldpath, overwrite);
     (void)DoMetaOpWithRetry(&op);
 
+    // The renamed entry might be a directory, and its path components
+    // are cached by the parent fid: only the old and new names can be
+    // invalidated precisely.
+    mMetaCache.InvalidateAttr(parentFid, oldfilename);
+    kfsFileId_t newParentFid;
+    string newfilename;
+    if (GetPathComponents(absNewpath.c_str(), &newParentFid, newfilename) == 0) {
+        mMetaCache.InvalidateAttr(newParentFid, newfilename);
+    } else {
+        mMetaCache.Clear();
+    }
+
     KFS_LOG_VA_DEBUG("Status of renaming %s -> %s is: %d", 
                      oldpath, newpath, op.status);
 
@@ -1521,6 +1793,8 @@ KfsClientImpl::CoalesceBlocks(const char *srcPath, const char *dstPath, off_t *d
 
     CoalesceBlocksOp op(nextSeq(), srcPath, dstPath);
     (void)DoMetaOpWithRetry(&op);
+    // both files change, and only the path names are known here
+    mMetaCache.Clear();
     *dstStartOffset = op.dstStartOffset;
     return op.status;
 }
@@ -1532,6 +1806,11 @@ KfsClientImpl::SetMtime(const char *pathname, const struct timeval &mtime)
 
     SetMtimeOp op(nextSeq(), pathname, mtime);
     (void)DoMetaOpWithRetry(&op);
+    kfsFileId_t parentFid;
+    string filename;
+    if (GetPathComponents(pathname, &parentFid, filename) == 0) {
+        mMetaCache.InvalidateAttr(parentFid, filename);
+    }
     return op.status;
 }
 
@@ -1561,10 +1840,17 @@ KfsClientImpl::Open(const char *pathname, int openMode, int numReplicas)
     if (filename.size() >= MAX_FILENAME_LEN)
 	return -ENAMETOOLONG;
 
-    LookupOp op(nextSeq(), parentFid, filename.c_str());
-    (void)DoMetaOpWithRetry(&op);
+    // Only the read only opens use the cached attributes; the file size
+    // must be current for writing.
+    const bool useCache =
+        (openMode & (O_WRONLY | O_RDWR | O_CREAT | O_TRUNC | O_APPEND)) == 0;
+    KfsServerAttr fattr;
+    const bool cached = useCache &&
+        mMetaCache.GetAttr(parentFid, filename, fattr);
+    const int status = cached ? 0 :
+        LookupFattr(parentFid, filename.c_str(), fattr, false);
 
-    if (op.status < 0) {
+    if (status < 0) {
 	if (openMode & O_CREAT) {
 	    // file doesn't exist.  Create it
 	    const int fte = Create(pathname, numReplicas, openMode & O_EXCL);
@@ -1574,7 +1860,7 @@ KfsClientImpl::Open(const char *pathname, int openMode, int numReplicas)
             }
             return fte;
 	}
-	return op.status;
+	return status;
     } else {
         // file exists; now fail open if: O_CREAT | O_EXCL
         if ((openMode & (O_CREAT|O_EXCL)) == (O_CREAT|O_EXCL))
@@ -1600,15 +1886,21 @@ KfsClientImpl::Open(const char *pathname, int openMode, int numReplicas)
         entry->openMode = 0;
 
     // We got a path...get the fattr
-    entry->fattr = op.fattr;
+    entry->fattr = fattr;
 
     if ((cachedFte > 0) && (mFileTable[cachedFte]->fattr.fileSize > 0)) {
             entry->fattr.fileSize = 
                 mFileTable[cachedFte]->fattr.fileSize;
+    } else if (cached && fattr.fileSize >= 0) {
+        entry->fattr.fileSize = fattr.fileSize;
     } else {
         if (entry->fattr.chunkCount > 0) {
             entry->fattr.fileSize =
-                ComputeFilesize(op.fattr.fileId);
+                ComputeFilesize(fattr.fileId);
+            if (useCache && entry->fattr.fileSize >= 0) {
+                mMetaCache.SetFileSize(parentFid, filename,
+                    entry->fattr.fileSize);
+            }
         }
     }
 
@@ -1651,7 +1943,11 @@ KfsClientImpl::Close(int fd)
         ) ? entry.fattr.fileId : -1;
         pathName     = entry.pathname;
         fileInstance = entry.instance;
-        if (entry.buffer.dirty) {
+        if (IsWriteBehind(fd)) {
+            // a hand off error is also returned by close
+            WriteBehindBuffer(fd);
+            status = mWriteBehind ? mWriteBehind->Close(fileInstance) : 0;
+        } else if (entry.buffer.dirty) {
             status = FlushBuffer(fd);
             if (status > 0) {
                 status = 0;
@@ -1661,6 +1957,10 @@ KfsClientImpl::Close(int fd)
             }
         }
         CloseChunk(fd);
+        if (entry.openMode != 0) {
+            // the size, and the last chunk might have changed
+            mMetaCache.InvalidateAttr(entry.parentFid, entry.name);
+        }
         KFS_LOG_VA_DEBUG("Closing filetable entry: %d", fd);
         ReleaseFileTableEntry(fd);
     }
@@ -1695,6 +1995,9 @@ KfsClientImpl::Sync(int fd, bool flushOnlyIfHasFullChecksumBlock)
 	return -EBADF;
     }
     FileTableEntry& entry = *mFileTable[fd];
+    if (IsWriteBehind(fd)) {
+        return SyncWriteBehind(fd);
+    }
     if (entry.buffer.dirty) {
        const int status = FlushBuffer(fd, flushOnlyIfHasFullChecksumBlock);
        if (status < 0)
@@ -1745,6 +2048,8 @@ KfsClientImpl::Truncate(int fd, off_t offset)
     FileAttr *fa = FdAttr(fd);
     TruncateOp op(nextSeq(), FdInfo(fd)->pathname.c_str(), fa->fileId, offset);
     (void)DoMetaOpWithRetry(&op);
+    mMetaCache.InvalidateAttr(FdInfo(fd)->parentFid, FdInfo(fd)->name);
+    mMetaCache.InvalidateChunks(fa->fileId);
     int res = op.status;
 
     if (res == 0) {
@@ -1785,6 +2090,8 @@ KfsClientImpl::PruneFromHead(int fd, off_t offset)
     TruncateOp op(nextSeq(), FdInfo(fd)->pathname.c_str(), fa->fileId, offset);
     op.pruneBlksFromHead = true;
     (void)DoMetaOpWithRetry(&op);
+    mMetaCache.InvalidateAttr(FdInfo(fd)->parentFid, FdInfo(fd)->name);
+    mMetaCache.InvalidateChunks(fa->fileId);
     int res = op.status;
 
     if (res == 0) {
@@ -1897,6 +2204,7 @@ KfsClientImpl::SetReplicationFactor(const char *pathname, int16_t numReplicas)
     ChangeFileReplicationOp op(nextSeq(), FdAttr(fd)->fileId, numReplicas);
     (void) DoMetaOpWithRetry(&op);
 
+    mMetaCache.InvalidateChunks(FdAttr(fd)->fileId);
     if (op.status == 0) {
         FdAttr(fd)->numReplicas = op.numReplicas;
         res = op.numReplicas;
@@ -1977,6 +2285,30 @@ KfsClientImpl::Seek(int fd, off_t offset, int whence, bool flushIfBufDirty)
     return newOff;
 }
 
+ssize_t
+KfsClientImpl::PRead(int fd, off_t offset, char *buf, size_t numBytes)
+{
+    // The mutex is recursive: hold it across the seek and the read, to
+    // prevent other threads from moving the file pointer in between.
+    MutexLock l(&mMutex);
+
+    const off_t pos = Seek(fd, offset, SEEK_SET);
+    if (pos < 0)
+        return pos;
+    return Read(fd, buf, numBytes);
+}
+
+ssize_t
+KfsClientImpl::PWrite(int fd, off_t offset, const char *buf, size_t numBytes)
+{
+    MutexLock l(&mMutex);
+
+    const off_t pos = Seek(fd, offset, SEEK_SET);
+    if (pos < 0)
+        return pos;
+    return Write(fd, buf, numBytes);
+}
+
 off_t KfsClientImpl::Tell(int fd)
 {
     MutexLock l(&mMutex);
@@ -2011,6 +2343,8 @@ KfsClientImpl::AllocChunk(int fd, bool append)
         op.fileOffset = ((pos->fileOffset / KFS::CHUNKSIZE) * KFS::CHUNKSIZE);
     else
         op.append = true;
+    // the chunk version changes with the write lease
+    InvalidateCachedChunk(fd);
 
     (void) DoMetaOpWithRetry(&op);
     if (op.status < 0) {
@@ -2087,25 +2421,51 @@ KfsClientImpl::LocateChunk(int fd, int chunkNum)
     if (c != mFileTable[fd]->cattr.end() && c->second.chunkId > 0)
 	return 0;
 
-    GetAllocOp op(nextSeq(), mFileTable[fd]->fattr.fileId,
+    FileTableEntry* const entry = mFileTable[fd];
+    ChunkAttr chunk;
+    if (mMetaCache.GetChunk(entry->fattr.fileId, chunkNum, chunk)) {
+        entry->cattr[chunkNum] = chunk;
+        return 0;
+    }
+
+    GetAllocOp op(nextSeq(), entry->fattr.fileId,
 		  (off_t) chunkNum * KFS::CHUNKSIZE);
-    op.filename = mFileTable[fd]->pathname;
+    op.filename = entry->pathname;
     (void)DoMetaOpWithRetry(&op);
     if (op.status < 0) {
 	string errstr = ErrorCodeToStr(op.status);
 	KFS_LOG_VA_DEBUG("LocateChunk (%d): %s", op.status, errstr.c_str());
+        if (op.status == -ENOENT) {
+            // the file is gone, or its cached attributes are stale
+            mMetaCache.InvalidateAttr(entry->parentFid, entry->name,
+                entry->fattr.fileId);
+        }
 	return op.status;
     }
 
-    ChunkAttr chunk;
     chunk.chunkId = op.chunkId;
     chunk.chunkVersion = op.chunkVersion;
     chunk.chunkServerLoc = op.chunkServers;
-    mFileTable[fd]->cattr[chunkNum] = chunk;
+    SetLocatedChunk(*entry, chunkNum, chunk);
 
     return 0;
 }
 
+void
+KfsClientImpl::SetLocatedChunk(FileTableEntry& entry, int chunkNum,
+    const ChunkAttr& chunk)
+{
+    entry.cattr[chunkNum] = chunk;
+    // Only the full chunks are cached: the last chunk can still be
+    // appended to, with its version bumped. The size of a file that is
+    // being written can be unknown (-1), thus the signed comparison.
+    if (entry.fattr.fileSize >= 0 &&
+            (off_t)(chunkNum + 1) * (off_t)KFS::CHUNKSIZE <
+            entry.fattr.fileSize) {
+        mMetaCache.PutChunk(entry.fattr.fileId, chunkNum, chunk);
+    }
+}
+
 bool
 KfsClientImpl::IsCurrChunkAttrKnown(int fd)
 {
@@ -2166,8 +2526,9 @@ size_t
 KfsClientImpl::SetDefaultReadAheadSize(size_t size)
 {
     MutexLock lock(&mMutex);
-    mDefaultReadAheadSize = (size + CHECKSUM_BLOCKSIZE - 1) /
-                CHECKSUM_BLOCKSIZE * CHECKSUM_BLOCKSIZE;
+    mDefaultReadAheadSize = min(size_t(PendingChunkRead::kMaxReadAhead),
+        (size + CHECKSUM_BLOCKSIZE - 1) /
+                CHECKSUM_BLOCKSIZE * CHECKSUM_BLOCKSIZE);
     return mDefaultReadAheadSize;
 }
 
@@ -2186,7 +2547,7 @@ KfsClientImpl::SetReadAheadSize(int fd, size_t size)
         return 0;
     }
     FilePosition& pos = *FdPos(fd);
-    const size_t readAhead = min(size_t(PendingChunkRead::kMaxReadRequest),
+    const size_t readAhead = min(size_t(PendingChunkRead::kMaxReadAhead),
         (size + CHECKSUM_BLOCKSIZE - 1) /
             CHECKSUM_BLOCKSIZE * CHECKSUM_BLOCKSIZE);
     if (pos.pendingChunkRead) {
@@ -2214,17 +2575,98 @@ KfsClientImpl::GetReadAheadSize(int fd) const
     return (pos.pendingChunkRead ? pos.pendingChunkRead->GetReadAhead() : 0);
 }
 
+size_t
+KfsClientImpl::SetDefaultWriteBehind(size_t size)
+{
+    MutexLock lock(&mMutex);
+    mDefaultWriteBehind = size;
+    return mDefaultWriteBehind;
+}
+
+size_t
+KfsClientImpl::GetDefaultWriteBehind() const
+{
+    MutexLock lock(&const_cast<KfsClientImpl*>(this)->mMutex);
+    return mDefaultWriteBehind;
+}
+
+size_t
+KfsClientImpl::SetWriteBehind(int fd, size_t size)
+{
+    MutexLock lock(&mMutex);
+    if (fd < 0 || size_t(fd) >= mFileTable.size() || ! mFileTable[fd]) {
+        return 0;
+    }
+    if (size <= 0 && IsWriteBehind(fd)) {
+        // Drain before turning write behind off. Keep it on if the write
+        // failed, the next write, sync, or close returns the error.
+        if (SyncWriteBehind(fd, false) < 0) {
+            return mFileTable[fd]->writeBehind;
+        }
+        mWriteBehind->Close(mFileTable[fd]->instance);
+    }
+    mFileTable[fd]->writeBehind = size;
+    return mFileTable[fd]->writeBehind;
+}
+
+size_t
+KfsClientImpl::GetWriteBehind(int fd) const
+{
+    MutexLock lock(&const_cast<KfsClientImpl*>(this)->mMutex);
+    if (fd < 0 || size_t(fd) >= mFileTable.size() || ! mFileTable[fd]) {
+        return 0;
+    }
+    return mFileTable[fd]->writeBehind;
+}
+
+void
+KfsClientImpl::GetWriteBehindStats(KfsWriteBehind::Stats& stats) const
+{
+    MutexLock lock(&const_cast<KfsClientImpl*>(this)->mMutex);
+    stats = mWriteBehind ? mWriteBehind->GetStats() : KfsWriteBehind::Stats();
+}
+
+void
+KfsClientImpl::SetMetaCache(int maxEntries, int ttlSec)
+{
+    MutexLock l(&mMutex);
+    mMetaCache.SetParameters(maxEntries, ttlSec);
+}
+
+void
+KfsClientImpl::GetMetaCacheStats(KfsMetaCache::Stats& stats)
+{
+    MutexLock l(&mMutex);
+    stats = mMetaCache.GetStats();
+}
+
+void
+KfsClientImpl::SetConnPool(int maxConnsPerServer, int idleTimeoutSec)
+{
+    MutexLock l(&mMutex);
+    mConnPool.SetParameters(maxConnsPerServer, idleTimeoutSec);
+}
+
+void
+KfsClientImpl::GetConnPoolStats(KfsConnPool::Stats& stats)
+{
+    MutexLock l(&mMutex);
+    stats = mConnPool.GetStats();
+}
+
 ///
 /// Helper function that does the work for sending out an op to the
 /// server.
 ///
 /// @param[in] op the op to be sent out
 /// @param[in] sock the socket on which we communicate with server
+/// @param[in] pool the connection pool: if the socket is pooled, the op
+/// is recorded as in flight on the connection, see DoOpResponse()
 /// @retval 0 on success; -1 on failure
 /// (On failure, op->status contains error code.)
 ///
 int
-KFS::DoOpSend(KfsOp *op, TcpSocket *sock)
+KFS::DoOpSend(KfsOp *op, TcpSocket *sock, KfsConnPool *pool)
 {
     ostringstream os;
 
@@ -2251,6 +2693,9 @@ KFS::DoOpSend(KfsOp *op, TcpSocket *sock)
 	    return -1;
 	}
     }
+    if (pool) {
+        pool->Sent(sock, op->seq);
+    }
     return 0;
 }
 
@@ -2350,17 +2795,104 @@ GetSeqContentLen(const char *resp, int respLen,
     *contentLength = prop.getValue("Content-length", 0);
 }
 
+///
+/// Copy out the data that follows the response header, and that was
+/// received earlier.
+///
+static void
+SetResponseContent(KfsOp *op, const char *data, size_t len)
+{
+    if (op->contentBufLen == 0) {
+	op->contentBuf = new char[op->contentLength + 1];
+	op->contentBuf[op->contentLength] = '\0';
+    }
+    if (len > 0) {
+	assert(len <= op->contentLength);
+	memcpy(op->contentBuf, data, min(len, size_t(op->contentLength)));
+    }
+}
+
+///
+/// The response header in buf belongs to another op: keep the response in
+/// the pool for that op, or discard it.
+/// @retval false if the connection failed, and was closed
+///
+static bool
+KeepOrDiscardResponse(TcpSocket *sock, KfsConnPool *pool, bool keepFlag,
+    const char *buf, int len, kfsSeq_t resSeq, int contentLen)
+{
+    struct timeval timeout = gDefaultTimeout;
+
+    if (! keepFlag) {
+        if (contentLen > 0 &&
+                sock->DoSynchDiscard(contentLen, timeout) != contentLen) {
+            sock->Close();
+            return false;
+        }
+        return true;
+    }
+    KfsConnPool::Response resp;
+    resp.mHeader.assign(buf, len);
+    resp.mContent.resize(max(0, contentLen));
+    if (contentLen > 0 &&
+            sock->DoSynchRecv(&resp.mContent[0], contentLen, timeout) !=
+                contentLen) {
+        sock->Close();
+        return false;
+    }
+    pool->PutResponse(sock, resSeq, resp);
+    return true;
+}
+
+///
+/// Receive one response on the pooled connection, and keep it in the pool
+/// for its op; the response of seq is kept too, and DoOpResponse() then
+/// takes it.
+///
+/// @retval 1 if the response of seq is now kept in the pool; 0 if the
+/// response was for another op; -1 if the connection failed
+///
+int
+KFS::ReceiveResponse(TcpSocket *sock, KfsConnPool *pool, kfsSeq_t seq)
+{
+    char buf[CMD_BUF_SIZE];
+    int len;
+    kfsSeq_t resSeq;
+    int contentLen;
+    Properties prop;
+
+    if ((sock == NULL) || (!sock->IsGood()))
+        return -1;
+    memset(buf, '\0', CMD_BUF_SIZE);
+    if (GetResponse(buf, CMD_BUF_SIZE, &len, sock) <= 0) {
+        KFS_LOG_DEBUG("Get response failed...closing socket");
+        sock->Close();
+        return -1;
+    }
+    GetSeqContentLen(buf, len, &resSeq, &contentLen, prop);
+    if (! KeepOrDiscardResponse(sock, pool, pool->IsExpected(sock, resSeq),
+            buf, len, resSeq, contentLen)) {
+        return -1;
+    }
+    if (! sock->IsGood())
+        return -1;
+    return (resSeq == seq && pool->HasResponse(sock, seq)) ? 1 : 0;
+}
+
 ///
 /// Helper function that does the work of getting a response from the
 /// server and parsing it out.
 ///
 /// @param[in] op the op for which a response is to be gotten
 /// @param[in] sock the socket on which we communicate with server
+/// @param[in] pool the connection pool: if the socket is pooled, the
+/// responses to the other ops in flight on the connection are kept for
+/// them
 /// @retval 0 on success; -1 on failure
 /// (On failure, op->status contains error code.)
 ///
 int
-KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
+KFS::DoOpResponse(KfsOp *op, TcpSocket *sock, KfsConnPool *pool)
 {
     int numIO;
     char buf[CMD_BUF_SIZE];
@@ -2370,6 +2902,7 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
     int contentLen;
     bool printMatchingResponse = false;
     Properties prop;
+    KfsConnPool::Response resp;
 
     if ((sock == NULL) || (!sock->IsGood())) {
 	op->status = -EHOSTUNREACH;
@@ -2377,6 +2910,20 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
 	return -1;
     }
 
+    if (pool && pool->TakeResponse(sock, op->seq, resp)) {
+        // another op's response loop got it
+        numIO = (int) resp.mHeader.size();
+        GetSeqContentLen(resp.mHeader.data(), numIO, &resSeq, &contentLen, prop);
+        contentLen = op->contentLength;
+        op->ParseResponseHeader(prop);
+        if (op->contentLength == 0) {
+            op->contentLength = contentLen;
+            return numIO;
+        }
+        SetResponseContent(op, resp.mContent.data(), resp.mContent.size());
+        return numIO + (int) resp.mContent.size();
+    }
+
     while (1) {
 	memset(buf, '\0', CMD_BUF_SIZE);
 
@@ -2405,6 +2952,9 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
 	GetSeqContentLen(buf, len, &resSeq, &contentLen, prop);
 
 	if (resSeq == op->seq) {
+            if (pool) {
+                pool->Received(sock, resSeq);
+            }
             if (printMatchingResponse) {
                 KFS_LOG_VA_DEBUG("Seq #'s match (after mismatch seq): Expect: %lld, got: %lld",
                                  op->seq, resSeq);
@@ -2412,18 +2962,17 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
             }
 	    break;
 	}
-	KFS_LOG_VA_DEBUG("Seq #'s dont match: Expect: %lld, got: %lld",
-                         op->seq, resSeq);
-        printMatchingResponse = true;
-
-        if (contentLen > 0) {
-            struct timeval timeout = gDefaultTimeout;
-            int len = sock->DoSynchDiscard(contentLen, timeout);
-            if (len != contentLen) {
-                sock->Close();
-                op->status = -EHOSTUNREACH;
-                return -1;
-            }
+        // the response to another op on the shared connection is kept
+        const bool keepFlag = pool && pool->IsExpected(sock, resSeq);
+        if (! keepFlag) {
+            KFS_LOG_VA_DEBUG("Seq #'s dont match: Expect: %lld, got: %lld",
+                             op->seq, resSeq);
+            printMatchingResponse = true;
+        }
+        if (! KeepOrDiscardResponse(sock, pool, keepFlag, buf, len,
+                resSeq, contentLen)) {
+            op->status = -EHOSTUNREACH;
+            return -1;
         }
     }
 
@@ -2444,18 +2993,10 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
     // related to attributes already.  So, copy them out and then read
     // whatever else is left
 
-    if (op->contentBufLen == 0) {
-	op->contentBuf = new char[op->contentLength + 1];
-	op->contentBuf[op->contentLength] = '\0';
-    }
-
     // len bytes belongs to the RPC reply.  Whatever is left after
     // stripping that data out is the data.
     navail = numIO - len;
-    if (navail > 0) {
-	assert(navail <= (ssize_t)op->contentLength);
-	memcpy(op->contentBuf, buf + len, navail);
-    }
+    SetResponseContent(op, buf + len, max(ssize_t(0), navail));
     nleft = op->contentLength - navail;
 
     assert(nleft >= 0);
@@ -2465,8 +3006,10 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
 
 	nread = sock->DoSynchRecv(op->contentBuf + navail, nleft, timeout);
 	if (nread == -ETIMEDOUT) {
-	    KFS_LOG_DEBUG("Recv timed out...");
+	    KFS_LOG_DEBUG("Recv timed out...closing socket");
 	    op->status = -ETIMEDOUT;
+            // the rest of the data would be taken for the next response
+            sock->Close();
 	} else if (nread <= 0) {
 	    KFS_LOG_DEBUG("Recv failed...closing socket");
 	    op->status = -EHOSTUNREACH;
@@ -2488,11 +3031,12 @@ KFS::DoOpResponse(KfsOp *op, TcpSocket *sock)
 ///
 /// @param[in] op the op to be done
 /// @param[in] sock the socket on which we communicate with server
+/// @param[in] pool the connection pool of the socket, see DoOpResponse()
 ///
 /// @retval # of bytes read from the server.
 ///
 int
-KFS::DoOpCommon(KfsOp *op, TcpSocket *sock)
+KFS::DoOpCommon(KfsOp *op, TcpSocket *sock, KfsConnPool *pool)
 {
     if (sock == NULL) {
 	KFS_LOG_VA_DEBUG("%s: send failed; no socket", op->Show().c_str());
@@ -2500,13 +3044,13 @@ KFS::DoOpCommon(KfsOp *op, TcpSocket *sock)
 	return -EHOSTUNREACH;
     }
 
-    int res = DoOpSend(op, sock);
+    int res = DoOpSend(op, sock, pool);
     if (res < 0) {
 	KFS_LOG_VA_DEBUG("%s: send failure code: %d", op->Show().c_str(), res);
 	return res;
     }
 
-    res = DoOpResponse(op, sock);
+    res = DoOpResponse(op, sock, pool);
 
     if (res < 0) {
 	KFS_LOG_VA_DEBUG("%s: recv failure code: %d", op->Show().c_str(), res);
@@ -2542,20 +3086,21 @@ struct RespondingServer {
 	    client(cli), layout(lay), status(st), size(sz) { }
     bool operator() (ServerLocation loc)
     {
-	TcpSocket sock;
+        KfsConnPool& pool = client->GetConnPool();
+	TcpSocketPtr sock = pool.Get(loc, false);
 
         *status = -EIO;
         *size = -1;
 
-        if (sock.Connect(loc) < 0) {
+        if (!sock->IsGood()) {
             *size = 0;
 	    return false;
         }
 
 	SizeOp sop(client->nextSeq(), layout.chunkId, layout.chunkVersion);
         sop.status = -1;
-	int numIO = DoOpCommon(&sop, &sock);
-	if ((numIO < 0) || (!sock.IsGood())) {
+	int numIO = DoOpCommon(&sop, sock.get(), &pool);
+	if ((numIO < 0) || (!sock->IsGood())) {
             return false;
         }
 
@@ -2574,15 +3119,16 @@ struct RespondingServer2 {
         client(cli), layout(lay) { }
     ssize_t operator() (ServerLocation loc)
     {
-	TcpSocket sock;
+        KfsConnPool& pool = client->GetConnPool();
+	TcpSocketPtr sock = pool.Get(loc, false);
 
-        if (sock.Connect(loc) < 0) {
+        if (!sock->IsGood()) {
             return -1;
         }
 
 	SizeOp sop(client->nextSeq(), layout.chunkId, layout.chunkVersion);
-	int numIO = DoOpCommon(&sop, &sock);
-	if (numIO < 0 && !sock.IsGood()) {
+	int numIO = DoOpCommon(&sop, sock.get(), &pool);
+	if (numIO < 0 && !sock->IsGood()) {
             return -1;
         }
 
@@ -2623,6 +3169,19 @@ KfsClientImpl::ComputeFilesize(kfsFileId_t kfsfid)
     if (lop.chunks.size() == 0)
 	return 0;
 
+    if (mMetaCache.IsEnabled()) {
+        // the layout of all but the last chunk comes for free
+        ChunkAttr chunk;
+        for (size_t i = 0; i + 1 < lop.chunks.size(); i++) {
+            const ChunkLayoutInfo& info = lop.chunks[i];
+            chunk.chunkId        = info.chunkId;
+            chunk.chunkVersion   = info.chunkVersion;
+            chunk.chunkServerLoc = info.chunkServers;
+            mMetaCache.PutChunk(kfsfid, (int)(info.fileOffset / KFS::CHUNKSIZE),
+                chunk);
+        }
+    }
+
     vector <ChunkLayoutInfo>::reverse_iterator last = lop.chunks.rbegin();
     off_t filesize = last->fileOffset;
     off_t endsize = 0;
@@ -2704,10 +3263,10 @@ void
 KfsClientImpl::ComputeFilesizes(vector<KfsFileAttr> &fattrs, vector<FileChunkInfo> &lastChunkInfo,
                                 uint32_t startIdx, const ServerLocation &loc)
 {
-    TcpSocket sock;
+    TcpSocketPtr sock = mConnPool.Get(loc, false);
     vector<ServerLocation>::const_iterator iter;
 
-    if (sock.Connect(loc) < 0) {
+    if (!sock->IsGood()) {
         return;
     }
 
@@ -2724,8 +3283,8 @@ KfsClientImpl::ComputeFilesizes(vector<KfsFileAttr> &fattrs, vector<FileChunkInf
             continue;
 
         SizeOp sop(nextSeq(), lastChunkInfo[i].cattr.chunkId, lastChunkInfo[i].cattr.chunkVersion);
-	int numIO = DoOpCommon(&sop, &sock);
-	if (numIO < 0 && !sock.IsGood()) {
+	int numIO = DoOpCommon(&sop, sock.get(), &mConnPool);
+	if (numIO < 0 && !sock->IsGood()) {
             return;
         }
         if (sop.status >= 0) {
@@ -2881,7 +3440,7 @@ KfsClientImpl::CloseChunk(int fd)
             cop.chunkServerLoc = citer->second.chunkServerLoc;
         }
 
-        DoOpCommon(&cop, masterSock);
+        DoOpCommon(&cop, masterSock, &mConnPool);
         return cop.status;
     }
     return 0;
@@ -2902,7 +3461,7 @@ KfsClientImpl::SizeChunk(int fd)
     SizeOp op(nextSeq(), chunk->chunkId, chunk->chunkVersion);
     op.size = 0;
 
-    (void)DoOpCommon(&op, FdPos(fd)->preferredServer);
+    (void)DoOpCommon(&op, FdPos(fd)->preferredServer, &mConnPool);
     if (op.status >= 0)
         chunk->chunkSize = op.size;
 
@@ -3096,6 +3655,7 @@ KfsClientImpl::AllocFileTableEntry(kfsFileId_t parentFid, const char *name,
         */
 
 	mFileTable[fte] = new FileTableEntry(parentFid, name, ++mFileInstance);
+        mFileTable[fte]->currPos.connPool = &mConnPool;
         mFileTable[fte]->validatedTime = mFileTable[fte]->lastAccessTime = 
             time(NULL);
         if (pathname != "") {
@@ -3105,6 +3665,7 @@ KfsClientImpl::AllocFileTableEntry(kfsFileId_t parentFid, const char *name,
         }
         mFileTable[fte]->pathname = pathname;
         mFileTable[fte]->buffer.bufsz = mDefaultIoBufferSize;
+        mFileTable[fte]->writeBehind = mDefaultWriteBehind;
     }
     return fte;
 }
@@ -3138,10 +3699,10 @@ KfsClientImpl::Lookup(kfsFileId_t parentFid, const char *name)
     if (fte >= 0)
 	return fte;
 
-    LookupOp op(nextSeq(), parentFid, name);
-    (void) DoMetaOpWithRetry(&op);
-    if (op.status < 0) {
-	return op.status;
+    KfsServerAttr fattr;
+    const int status = LookupFattr(parentFid, name, fattr);
+    if (status < 0) {
+	return status;
     }
     // Everything is good now...
     fte = ClaimFileTableEntry(parentFid, name, "");
@@ -3149,11 +3710,29 @@ KfsClientImpl::Lookup(kfsFileId_t parentFid, const char *name)
 	return -EMFILE;
 
     FileAttr *fa = FdAttr(fte);
-    *fa = op.fattr;
+    *fa = fattr;
 
     return fte;
 }
 
+int
+KfsClientImpl::LookupFattr(kfsFileId_t parentFid, const char *name,
+                           KfsServerAttr &fattr, bool useCache)
+{
+    if (useCache && mMetaCache.GetAttr(parentFid, name, fattr)) {
+        return 0;
+    }
+    LookupOp op(nextSeq(), parentFid, name);
+    (void) DoMetaOpWithRetry(&op);
+    if (op.status < 0) {
+        mMetaCache.InvalidateAttr(parentFid, name);
+	return op.status;
+    }
+    fattr = op.fattr;
+    mMetaCache.PutAttr(parentFid, name, fattr);
+    return 0;
+}
+
 ///
 /// Given a path, break it down into: parentFid and filename.  If the
 /// path does not begin with "/", the current working directory is
@@ -128,6 +128,27 @@ public:
     ///
     int ReaddirPlus(const char *pathname, std::vector<KfsFileAttr> &result);
 
+    ///
+    /// Read a directory's contents a page at a time, so that a large
+    /// directory can be processed as it arrives instead of all at once.
+    /// Within a page, the entries are not sorted.
+    /// @param[in] pathname	The full pathname such as /.../dir
+    /// @param[in,out] cursor	Where to start: empty for the beginning
+    /// of the directory; on return, where the next page starts.
+    /// @param[out] result	The entries of this page
+    /// @param[out] hasMore	Set if there are more pages to read
+    /// @retval 0 if readdir is successful; -errno otherwise
+    ///
+    int ReaddirPage(const char *pathname, std::string &cursor,
+                    std::vector<std::string> &result, bool &hasMore);
+
+    ///
+    /// Same as ReaddirPage(), but with the attributes of the entries;
+    /// the file sizes are computed per page.
+    ///
+    int ReaddirPlusPage(const char *pathname, std::string &cursor,
+                        std::vector<KfsFileAttr> &result, bool &hasMore);
+
     ///
     /// Do a du on the metaserver side for pathname and return the #
     /// of files/bytes in the directory tree starting at pathname.
@@ -274,6 +295,19 @@ public:
     ///
     int AtomicRecordAppend(int fd, const char *buf, int reclen);
 
+    ///
+    /// Pack the atomic record appends into framed blocks, optionally
+    /// compressed, instead of appending each record as is. Each block
+    /// holds whole records, and is appended atomically. The files written
+    /// this way must be read with RecordBlockReader (RecordBlock.h).
+    /// Must be called before the first atomic record append.
+    /// @param[in] blockSize max. block size before compression, 0
+    /// turns packing off
+    /// @param[in] compressFlag compress the blocks
+    /// @retval 0 on success, -EBUSY if record appends have already started
+    ///
+    int SetRecordAppendBlocks(int blockSize, bool compressFlag = true);
+
     void EnableAsyncRW();
     void DisableAsyncRW();
 
@@ -345,6 +379,18 @@ public:
     ssize_t Read(int fd, char *buf, size_t numBytes);
     ssize_t Write(int fd, const char *buf, size_t numBytes);
 
+    ///
+    /// Positional read/write: seek to the offset and do the I/O as one
+    /// operation with respect to the other threads using the client,
+    /// similar to pread()/pwrite().  The file pointer is left at the end
+    /// of the I/O.  Sequential positional reads keep the read ahead
+    /// buffer, as a seek within the current chunk does.
+    /// @retval On success, return of bytes of I/O done (>= 0);
+    /// on failure, return status code (< 0).
+    ///
+    ssize_t PRead(int fd, off_t offset, char *buf, size_t numBytes);
+    ssize_t PWrite(int fd, off_t offset, const char *buf, size_t numBytes);
+
     /// If there are any holes in a file, such as those at the end of
     /// a chunk, skip over them.  
     void SkipHolesInFile(int fd);
@@ -462,7 +508,9 @@ public:
     size_t GetIoBufferSize(int fd) const;
 
     ///
-    /// Set default read ahead size.
+    /// Set default read ahead size: the max. amount of data requested
+    /// ahead of the reader. The read ahead window starts small, grows
+    /// with sequential or strided reads, and is closed by random reads.
     /// This has no effect on already opened files.
     /// @param[in] desired read ahead size
     /// @retval actual default read ahead size
@@ -492,6 +540,136 @@ public:
     /// @retval read ahead size
     //
     size_t GetReadAheadSize(int fd) const;
+
+    ///
+    /// Set default write behind size.
+    /// With write behind the full io buffers are handed off to the
+    /// background threads, and written to the chunk servers while the
+    /// application continues to write; the chunks are allocated by the
+    /// background threads as well. The write errors are returned by the
+    /// subsequent write, sync, or close.
+    /// This has no effect on already opened files.
+    /// @param[in] max. bytes handed off and not yet written per file;
+    /// 0 turns write behind off
+    /// @retval actual default write behind size
+    //
+    size_t SetDefaultWriteBehind(size_t size);
+
+    ///
+    /// Get default write behind size.
+    /// @retval write behind size
+    //
+    size_t GetDefaultWriteBehind() const;
+
+    ///
+    /// Set file write behind size. Turning write behind off waits for
+    /// the pending writes to finish.
+    /// @param[in] fd that corresponds to a previously opened file
+    /// @param[in] desired write behind size
+    /// @retval actual write behind size
+    //
+    size_t SetWriteBehind(int fd, size_t size);
+
+    ///
+    /// Get file write behind size.
+    /// @param[in] fd that corresponds to a previously opened file
+    /// @retval write behind size
+    //
+    size_t GetWriteBehind(int fd) const;
+
+    ///
+    /// Get write behind counters.
+    /// @param[out] writes # of write ids (chunk server writes) done
+    /// @param[out] bytes # of bytes written
+    /// @param[out] allocations # of chunk allocations
+    /// @param[out] retries # of write retries
+    /// @param[out] errors # of failed writes
+    /// @param[out] enqueueWaitUsecs time the application spent waiting
+    /// for the pending writes to drop below the write behind size
+    ///
+    void GetWriteBehindStats(int64_t &writes, int64_t &bytes,
+        int64_t &allocations, int64_t &retries, int64_t &errors,
+        int64_t &enqueueWaitUsecs) const;
+
+    ///
+    /// Enable hedged reads: if a chunk server has not started to respond
+    /// to a read within the given percentile of the recent read response
+    /// times (bounded by the min and max delays), the read is sent to
+    /// another replica, and the response that arrives first is used.
+    /// @param[in] percentile of the response times; 0 disables hedging
+    /// @param[in] minDelayMs lower bound of the hedge delay in ms
+    /// @param[in] maxDelayMs upper bound of the hedge delay in ms
+    ///
+    void SetReadHedging(int percentile, int minDelayMs, int maxDelayMs);
+
+    ///
+    /// Get hedged read counters.
+    /// @param[out] issued # of reads re-issued to another replica
+    /// @param[out] won # of hedged reads where the other replica answered first
+    ///
+    void GetReadHedgingStats(int64_t &issued, int64_t &won);
+
+    ///
+    /// Get read ahead counters.
+    /// @param[out] requests # of read ahead requests sent
+    /// @param[out] hits # of read ahead requests used by the readers
+    /// @param[out] hitBytes # of bytes read ahead and used
+    /// @param[out] wasteBytes # of bytes read ahead and discarded
+    /// @param[out] nextChunks # of chunk boundaries crossed with the next
+    /// chunk already being read
+    ///
+    void GetReadAheadStats(int64_t &requests, int64_t &hits,
+        int64_t &hitBytes, int64_t &wasteBytes, int64_t &nextChunks);
+
+    ///
+    /// Enable the meta data cache: the file and directory attributes,
+    /// and the chunk locations of the full chunks are cached in a
+    /// bounded LRU cache, and re-used for up to ttlSec seconds. The
+    /// entries are invalidated by this client's mutations, and by the
+    /// errors that indicate stale entries; the changes made by other
+    /// clients might not be visible until the entries expire.
+    /// @param[in] maxEntries max. # of cached attributes, and max. # of
+    /// cached chunk locations; 0 disables the cache
+    /// @param[in] ttlSec entry time to live in seconds
+    ///
+    void SetMetaCache(int maxEntries, int ttlSec);
+
+    ///
+    /// Get meta data cache counters.
+    /// @param[out] attrHits # of attribute lookups served from the cache
+    /// @param[out] attrMisses # of attribute lookups sent to the meta server
+    /// @param[out] layoutHits # of chunk location lookups served from the cache
+    /// @param[out] layoutMisses # of chunk location lookups sent to the
+    /// meta server
+    /// @param[out] invalidations # of invalidated entries
+    /// @param[out] evictions # of entries evicted to stay within the limit
+    ///
+    void GetMetaCacheStats(int64_t &attrHits, int64_t &attrMisses,
+        int64_t &layoutHits, int64_t &layoutMisses, int64_t &invalidations,
+        int64_t &evictions);
+
+    ///
+    /// Configure the chunk server connection pool. The files that read
+    /// from, or write to the same chunk server share up to
+    /// maxConnsPerServer connections, and the responses are matched to
+    /// the requests by sequence number. The connections that aren't used
+    /// for idleTimeoutSec seconds are closed.
+    /// @param[in] maxConnsPerServer max. # of connections per chunk
+    /// server; 0 disables the pool: each file uses its own connections
+    /// @param[in] idleTimeoutSec idle connection timeout in seconds
+    ///
+    void SetConnPool(int maxConnsPerServer, int idleTimeoutSec);
+
+    ///
+    /// Get connection pool counters.
+    /// @param[out] connects # of chunk server connections opened
+    /// @param[out] reuses # of times a pooled connection was re-used
+    /// @param[out] stashed # of responses kept for the ops of other files
+    /// @param[out] abandoned # of responses of the cancelled ops dropped
+    /// @param[out] idleClosed # of idle connections closed
+    ///
+    void GetConnPoolStats(int64_t &connects, int64_t &reuses,
+        int64_t &stashed, int64_t &abandoned, int64_t &idleClosed);
 private:
     KfsClientImpl *mImpl;
 };
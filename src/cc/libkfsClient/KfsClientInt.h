@@ -28,6 +28,7 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <tr1/unordered_map>
 #include <poll.h>
 #include "common/log.h"
@@ -46,6 +47,10 @@
 #include "concurrency.h"
 #include "KfsPendingOp.h"
 #include "KfsAsyncRW.h"
+#include "KfsWriteBehind.h"
+#include "KfsReadAheadLocator.h"
+#include "KfsMetaCache.h"
+#include "KfsConnPool.h"
 
 namespace KFS {
 
@@ -68,6 +73,14 @@ const int RETRY_DELAY_SECS = 5;
 /// Whenever we have issues with lease failures, we retry the op after 5 secs
 const int LEASE_RETRY_DELAY_SECS = 5;
 
+/// Number of write behind threads, i.e. the max. number of write ids
+/// (chunk server write transactions) in flight per client.
+const int WRITE_BEHIND_THREADS = 4;
+
+/// Read directories in pages of at most this many entries, so that
+/// listing a large directory doesn't tie up the metaserver.
+const int READDIR_PAGE_ENTRIES = 1024;
+
 /// Directory entries that we may have cached are valid for 30 secs;
 /// after that force a revalidataion.
 const int FILE_CACHE_ENTRY_VALID_TIME = 30;
@@ -121,6 +134,7 @@ struct ChunkServerConn {
     /// connected TCP socket.  If this object is copy constructed, we
     /// really can't afford this socket to close when the "original"
     /// is destructed. To protect such issues, make this a smart pointer.
+    /// The pooled sockets are also shared with the other files.
     TcpSocketPtr   sock;
 
     ChunkServerConn(const ServerLocation &l) :
@@ -128,33 +142,13 @@ struct ChunkServerConn {
         sock.reset(new TcpSocket());
     }
     
-    void Connect(bool nonblockingConnect = false) {
+    /// A broken connection is replaced, not reconnected: the other users
+    /// of a pooled socket must see it fail.
+    void Connect(KfsConnPool *pool = 0, bool nonblockingConnect = false) {
         if (sock->IsGood())
             return;
-        int res;
-
-        res = sock->Connect(location, nonblockingConnect);
-        if (res == -EINPROGRESS) {
-            // 30 seconds: poll expects values in milli-seconds
-            int pollTimeout = 30 * 1000;
-            struct pollfd pfd;
-
-            pfd.fd = sock->GetFd();
-            pfd.events = POLLOUT;
-            pfd.revents = 0;
-
-            res = poll(&pfd, 1, pollTimeout);
-            if ((res > 0) && (pfd.revents & POLLOUT)) {
-                    // connection completed
-                    return;
-            }
-            KFS_LOG_VA_INFO("Non-blocking connect to location %s failed", location.ToString().c_str());
-            res = -EHOSTUNREACH;
-        }
-        if (res < 0) {
-            sock.reset(new TcpSocket());
-        }
-            
+        sock = pool ? pool->Get(location, nonblockingConnect) :
+            KfsConnPool::Connect(location, nonblockingConnect);
     }
     bool operator == (const ServerLocation &other) const {
         return other == location;
@@ -164,31 +158,139 @@ struct ChunkServerConn {
 class KfsClientImpl;
 
 ///
-/// The following class is used for chunk read ahead:
-/// Start() sends chunk read request to chunk server, and
-/// Read() retrieves the data.
-/// Reset() cancels read request by resetting chunk server connection.
+/// Adaptive chunk read ahead. Update() is called after each read from
+/// the chunk server: it classifies the access pattern, and keeps a window
+/// of read requests in flight ahead of the reader; Read() retrieves the
+/// data of the requests at the current position.
+/// The window starts with one request, doubles with each sequential or
+/// strided (same size, same gap) read up to the read ahead size, and is
+/// closed by a read that does not follow the pattern, so that random
+/// readers do not pay for data they never use.
+/// When the sequential window nears the end of a full chunk, the
+/// locator thread locates the next chunk, acquires its read lease, and
+/// sizes it, without the client mutex held; once the window reaches the
+/// end, Update() sends its first requests on a separate connection, which
+/// IsChunkReadable() adopts once the reader crosses the chunk boundary.
+/// The lease must be acquired before the requests are sent: otherwise
+/// GetLease() would size the chunk on the adopted connection, and
+/// discard the read ahead responses in flight.
+/// Reset() cancels the requests in flight: the pool drops their responses
+/// as they arrive, or, if the connection isn't pooled, Reset() closes it.
 ///
 class PendingChunkRead
 {
 public:
     enum { kMaxReadRequest = 1 << 20 };
+    enum { kMaxReadAhead = 16 << 20 };
+
+    struct Stats
+    {
+        Stats()
+            : mRequestCount(0),
+              mHitCount(0),
+              mHitByteCount(0),
+              mWasteByteCount(0),
+              mNextChunkCount(0)
+            {}
+        int64_t mRequestCount;   // read ahead requests sent
+        int64_t mHitCount;       // read ahead requests used by the reader
+        int64_t mHitByteCount;
+        int64_t mWasteByteCount; // read ahead and discarded
+        int64_t mNextChunkCount; // chunk boundaries crossed with read ahead
+    };
 
     PendingChunkRead(KfsClientImpl& impl, size_t readAhead);
     ~PendingChunkRead();
-    bool Start(int fd, size_t off);
+    /// Record the read of numBytes at the current position, and send
+    /// more read ahead requests if the access pattern warrants.
+    void Update(int fd, size_t numBytes);
     ssize_t Read(char *buf, size_t numBytes);
-    bool IsValid() const { return (mFd >= 0); }
-    void Reset() { Start(-1, 0); }
+    /// Switch to the next chunk read ahead, if it was started for the
+    /// current chunk and position.
+    /// @retval true if the connection and the chunk size were set up
+    bool AdoptNextChunk(int fd);
+    bool IsValid() const { return (! mQueue.empty()); }
+    /// @param[in] keepNextChunk  cancel only the current chunk requests
+    void Reset(bool keepNextChunk = false);
     void SetReadAhead(size_t readAhead) { mReadAhead = readAhead; }
     size_t GetReadAhead() const { return mReadAhead; }
-    off_t GetChunkOffset() const { return (IsValid() ? mReadOp.offset : -1); }
+    off_t GetChunkOffset() const
+        { return (IsValid() ? mQueue.front()->offset : -1); }
 private:
-    ReadOp         mReadOp;
-    TcpSocket*     mSocket;
+    typedef std::deque<ReadOp*> Queue;
+
     KfsClientImpl& mImpl;
     int            mFd;
-    size_t         mReadAhead;
+    size_t         mReadAhead;   // max. window size
+    size_t         mWindow;      // current window size, 0 -- no read ahead
+    off_t          mLastEnd;     // file offset past the last read
+    off_t          mLastSize;
+    off_t          mStride;      // gap between the last two reads
+    TcpSocketPtr   mSocket;
+    Queue          mQueue;
+    off_t          mIssueOffset; // chunk offset of the next request
+    int            mNextChunkNum;
+    kfsChunkId_t   mNextChunkId; // read lease acquired by the read ahead
+    ServerLocation mNextLocation;
+    TcpSocketPtr   mNextSocket;
+    off_t          mNextChunkSize;
+    Queue          mNextQueue;
+    off_t          mNextIssueOffset;
+    int64_t        mLocateId;    // next chunk locator request in flight
+    int            mLocateChunkNum;
+
+    bool Issue(TcpSocket* sock, const ChunkAttr& chunk, off_t offset,
+        size_t numBytes, Queue& queue);
+    /// @param[in] sendFlag  send the next chunk requests, or only set
+    /// up the next chunk
+    void StartNextChunk(int fd, size_t queued, bool sendFlag);
+    /// @retval true if the next chunk is set up
+    bool LocateNextChunk(int fd, int chunkNum);
+    void CancelLocate();
+    void DiscardNextChunk(bool relinquishLease = true);
+    /// @retval true if the pool drops the responses of the discarded
+    /// requests, false if the connection has to be closed.
+    bool Discard(Queue& queue, const TcpSocket* sock);
+    static size_t QueuedBytes(const Queue& queue);
+private:
+    PendingChunkRead(const PendingChunkRead&);
+    PendingChunkRead& operator=(const PendingChunkRead&);
+};
+
+///
+/// Hedged read support: keeps a window of the recent chunk server read
+/// response times, and computes the delay after which a read that the
+/// server has not yet started to answer is re-issued to another replica.
+/// The delay is the configured percentile of the response times, bounded
+/// by the min and max delays. Until enough samples are collected the max
+/// delay is used. Percentile 0 disables hedging.
+///
+class ReadHedgeTracker
+{
+public:
+    ReadHedgeTracker();
+    void SetParameters(int percentile, int minDelayMs, int maxDelayMs);
+    bool IsEnabled() const { return (mPercentile > 0); }
+    int GetDelayMs() const { return mDelayMs; }
+    void Update(int responseTimeMs);
+    void Issued() { mIssuedCount++; }
+    void Won() { mWonCount++; }
+    int64_t GetIssuedCount() const { return mIssuedCount; }
+    int64_t GetWonCount() const { return mWonCount; }
+private:
+    enum { kMaxSamples = 256, kMinSamples = 16, kUpdateInterval = 16 };
+
+    int              mPercentile;
+    int              mMinDelayMs;
+    int              mMaxDelayMs;
+    int              mDelayMs;
+    std::vector<int> mSamples;
+    size_t           mNextSample;
+    int              mSamplesSinceUpdate;
+    int64_t          mIssuedCount;
+    int64_t          mWonCount;
+
+    void ComputeDelay();
 };
 
 ///
@@ -205,6 +307,7 @@ struct FilePosition {
         preferredServer = NULL;
         pendingChunkRead = 0;
         prefetchReq = NULL;
+        connPool = NULL;
     }
     ~FilePosition() {
         delete pendingChunkRead;
@@ -240,6 +343,8 @@ struct FilePosition {
     PendingChunkRead* pendingChunkRead;
     /// for read prefetching
     AsyncReadReq *prefetchReq;
+    /// the chunk server connections are shared by the client's files
+    KfsConnPool *connPool;
 
     void ResetServers() {
         writeId.clear();
@@ -264,7 +369,7 @@ struct FilePosition {
 
         iter = std::find(chunkServers.begin(), chunkServers.end(), loc);
         if (iter != chunkServers.end()) {
-            iter->Connect(nonblockingConnect);
+            iter->Connect(connPool, nonblockingConnect);
             TcpSocket *s = iter->sock.get();
 
             if (s->IsGood())
@@ -277,7 +382,7 @@ struct FilePosition {
         // socket it has will go.  To avoid that, we need the socket
         // to be a smart pointer.
         chunkServers.push_back(ChunkServerConn(loc));
-        chunkServers[chunkServers.size()-1].Connect(nonblockingConnect);
+        chunkServers[chunkServers.size()-1].Connect(connPool, nonblockingConnect);
 
         TcpSocket *s = chunkServers[chunkServers.size()-1].sock.get();
         if (s->IsGood())
@@ -317,7 +422,8 @@ struct FilePosition {
     }
     void CancelPendingRead() {
         if (pendingChunkRead) {
-            pendingChunkRead->Reset();
+            // keep the next chunk read ahead for the chunk switch
+            pendingChunkRead->Reset(true);
         }
     }
     void CancelNonAdjacentPendingRead() {
@@ -370,12 +476,15 @@ struct FileTableEntry {
     unsigned int instance;
     int appendPending;
     bool didAppend;
+    // max. number of bytes handed off to the write behind threads and
+    // not yet written; 0 -- write behind is off
+    size_t writeBehind;
 
     FileTableEntry(kfsFileId_t p, const char *n, unsigned int instance):
 	parentFid(p), name(n), eofMark(-1), 
         lastAccessTime(0), validatedTime(0), 
         skipHoles(false), instance(instance), appendPending(0),
-        didAppend(false) { }
+        didAppend(false), writeBehind(0) { }
 };
 
 class KfsProtocolWorker;
@@ -458,6 +567,27 @@ public:
     int ReaddirPlus(const char *pathname, std::vector<KfsFileAttr> &result,
                     bool computeFilesize = true);
 
+    ///
+    /// Read a directory's contents a page at a time, so that a large
+    /// directory can be processed as it arrives instead of all at once.
+    /// Within a page, the entries are not sorted.
+    /// @param[in] pathname	The full pathname such as /.../dir
+    /// @param[in,out] cursor	Where to start: empty for the beginning
+    /// of the directory; on return, where the next page starts.
+    /// @param[out] result	The entries of this page
+    /// @param[out] hasMore	Set if there are more pages to read
+    /// @retval 0 if readdir is successful; -errno otherwise
+    ///
+    int ReaddirPage(const char *pathname, std::string &cursor,
+                    std::vector<std::string> &result, bool &hasMore);
+
+    ///
+    /// Same as ReaddirPage(), but with the attributes of the entries;
+    /// the file sizes are computed per page.
+    ///
+    int ReaddirPlusPage(const char *pathname, std::string &cursor,
+                        std::vector<KfsFileAttr> &result, bool &hasMore);
+
     ///
     /// Do a du on the metaserver side for pathname and return the #
     /// of files/bytes in the directory tree starting at pathname.
@@ -581,6 +711,7 @@ public:
     ///
     int RecordAppend(int fd, const char *buf, int reclen);
     int AtomicRecordAppend(int fd, const char *buf, int reclen);
+    int SetRecordAppendBlocks(int blockSize, bool compressFlag);
 
     /// See the comments in KfsClient.h
     int ReadPrefetch(int fd, char *buf, size_t numBytes);
@@ -608,6 +739,8 @@ public:
     ///
     ssize_t Read(int fd, char *buf, size_t numBytes);
     ssize_t Write(int fd, const char *buf, size_t numBytes);
+    ssize_t PRead(int fd, off_t offset, char *buf, size_t numBytes);
+    ssize_t PWrite(int fd, off_t offset, const char *buf, size_t numBytes);
 
     /// If there are any holes in a file, such as those at the end of
     /// a chunk, skip over them.  
@@ -700,7 +833,14 @@ public:
     size_t GetDefaultReadAheadSize() const;
     size_t SetReadAheadSize(int fd, size_t size);
     size_t GetReadAheadSize(int fd) const;
+
+    size_t SetDefaultWriteBehind(size_t size);
+    size_t GetDefaultWriteBehind() const;
+    size_t SetWriteBehind(int fd, size_t size);
+    size_t GetWriteBehind(int fd) const;
+    void GetWriteBehindStats(KfsWriteBehind::Stats& stats) const;
     pthread_mutex_t& GetMutex() { return mMutex; }
+    KfsConnPool& GetConnPool() { return mConnPool; }
 
     /// A read for an offset that is after the specified value will result in EOF
     void SetEOFMark(int fd, off_t offset);
@@ -711,7 +851,17 @@ public:
     void SetMaxNumRetriesPerOp(int maxNumRetries) {
         mMaxNumRetriesPerOp = maxNumRetries;
     }
-    
+
+    void SetReadHedging(int percentile, int minDelayMs, int maxDelayMs);
+    void GetReadHedgingStats(int64_t &issued, int64_t &won);
+    void GetReadAheadStats(PendingChunkRead::Stats& stats);
+
+    void SetMetaCache(int maxEntries, int ttlSec);
+    void GetMetaCacheStats(KfsMetaCache::Stats& stats);
+
+    void SetConnPool(int maxConnsPerServer, int idleTimeoutSec);
+    void GetConnPoolStats(KfsConnPool::Stats& stats);
+
 private:
      /// Maximum # of files a client can have open.
     static const int MAX_FILES = 512000;
@@ -749,13 +899,22 @@ private:
     std::vector<struct in_addr> mSlowNodes;
     size_t mDefaultIoBufferSize;
     size_t mDefaultReadAheadSize;
+    size_t mDefaultWriteBehind;
     KfsPendingOp mPendingOp;
 
     Asyncer mAsyncer;
     std::vector<AsyncWriteReq *> mAsyncWrites;
     unsigned int mFileInstance;
     KfsProtocolWorker* mProtocolWorker;
+    int mRecordAppendBlockSize;
+    bool mRecordAppendBlockCompressFlag;
+    KfsWriteBehind* mWriteBehind;
+    KfsReadAheadLocator* mReadAheadLocator;
     int mMaxNumRetriesPerOp;
+    ReadHedgeTracker mReadHedgeTracker;
+    PendingChunkRead::Stats mReadAheadStats;
+    KfsMetaCache mMetaCache;
+    KfsConnPool mConnPool;
 
     /// Check that fd is in range
     bool valid_fd(int fd) { return (fd >= 0 && fd < MAX_FILES && (size_t)fd < mFileTable.size() && mFileTable[fd]); }
@@ -873,6 +1032,10 @@ private:
     /// a hole in the file.
     /// @retval status code: 0 on success; < 0 => failure
     int LocateChunk(int fd, int chunkNum);
+    /// Record the chunk layout that the meta server returned, and cache
+    /// it if the chunk is full.
+    void SetLocatedChunk(FileTableEntry& entry, int chunkNum,
+        const ChunkAttr& chunk);
 
 
     // Helper functions to deal with write and buffering at the client.
@@ -891,6 +1054,20 @@ private:
     /// @retval  # of bytes written; -1 on failure
     ssize_t FlushBuffer(int fd, bool flushOnlyIfHasFullChecksumBlock = false);
 
+    /// Write behind is used for files opened for write, and not for
+    /// append, with non zero write behind and io buffer sizes.
+    bool IsWriteBehind(int fd) const;
+
+    /// Hand off the dirty chunk buffer to the write behind threads.
+    /// @retval  # of bytes handed off; the first write error otherwise
+    ssize_t WriteBehindBuffer(int fd);
+
+    /// Hand off the dirty chunk buffer and wait for the write behind
+    /// threads to write all the file data.
+    /// @param[in] resetError  clear the error after returning it
+    /// @retval 0 on success; the first write error otherwise
+    int SyncWriteBehind(int fd, bool resetError = true);
+
     /// Helper function that does the write RPC.
     /// @param[in] fd  The file to which data is to be written
     /// @param[in] offset  The offset in the chunk at which data has
@@ -951,8 +1128,14 @@ private:
 	return &FdInfo(fd)->cattr[FdPos(fd)->chunkNum];
     }
     void ClearCurrChunkAttr(int fd) {
+        InvalidateCachedChunk(fd);
         FdInfo(fd)->cattr.erase(FdPos(fd)->chunkNum);
     }
+    /// The current chunk location turned out to be stale: make sure
+    /// that the next LocateChunk() asks the meta server.
+    void InvalidateCachedChunk(int fd) {
+        mMetaCache.InvalidateChunk(FdAttr(fd)->fileId, FdPos(fd)->chunkNum);
+    }
 
     /// Do the work for an op with the metaserver; if the metaserver
     /// dies in the middle, retry the op a few times before giving up.
@@ -963,6 +1146,25 @@ private:
     /// submit a new one.
     int DoPipelinedRead(int fd, std::vector<ReadOp *> &ops, TcpSocket *sock);
 
+    /// If the server doesn't start responding to the read ops that were
+    /// sent within the hedge delay, re-send the ops to another replica.
+    /// Returns the socket of the server that responded first; the
+    /// outstanding requests to the other server are cancelled.
+    TcpSocket *HedgeRead(int fd, std::vector<ReadOp *> &ops, size_t count,
+                         TcpSocket *sock);
+
+    /// Wait for the response of the op seqs[i] on socks[i], up to count
+    /// connections. The responses of the other ops on a pooled connection
+    /// are kept for their ops, as readable doesn't mean the op's response.
+    /// @retval the index of the connection with the response; -1 on
+    /// timeout; -2 if the connection failed
+    int WaitForResponse(TcpSocket **socks, const kfsSeq_t *seqs, int count,
+                        int timeoutMs);
+
+    /// Cancel the ops sent on the connection: abandon their responses if
+    /// the connection is pooled, close the connection otherwise.
+    void CancelOps(TcpSocket *sock, const std::vector<kfsSeq_t> &seqs);
+
     int DoPipelinedWrite(int fd, std::vector<WritePrepareOp *> &ops, TcpSocket *masterSock);
 
     /// Helpers for pipelined write
@@ -1012,6 +1214,14 @@ private:
     /// downloaded from the server.
     int Lookup(kfsFileId_t parentFid, const char *name);
 
+    /// Get the attributes of parentFid/name from the meta data cache,
+    /// or from the meta server and cache them.
+    /// @param[in] useCache  if false, ask the meta server, and replace
+    /// the cached attributes
+    /// @retval 0 on success; -errno otherwise
+    int LookupFattr(kfsFileId_t parentFid, const char *name,
+                    KfsServerAttr &fattr, bool useCache = true);
+
     // name -- is the last component of the pathname
     int ClaimFileTableEntry(kfsFileId_t parentFid, const char *name, std::string pathname);
     int AllocFileTableEntry(kfsFileId_t parentFid, const char *name, std::string pathname);
@@ -1036,6 +1246,13 @@ private:
     int ReaddirPlus(const char *pathname, kfsFileId_t dirFid, 
                     std::vector<KfsFileAttr> &result, bool computeFilesize = true,
                     bool updateClientCache = true);
+    int LookupDirectory(const char *pathname, kfsFileId_t &dirFid);
+    int ReaddirPage(kfsFileId_t dirFid, std::string &cursor,
+                    std::vector<std::string> &result, bool &hasMore);
+    int ReaddirPlusPage(kfsFileId_t dirFid, std::string &cursor,
+                        std::vector<KfsFileAttr> &result,
+                        std::vector<FileChunkInfo> &fileChunkInfo,
+                        bool computeFilesize, bool &hasMore);
 
     int Rmdirs(const std::string &parentDir, kfsFileId_t parentFid, const std::string &dirname, kfsFileId_t dirFid);
     int Remove(const std::string &parentDir, kfsFileId_t parentFid, const std::string &entryName);
@@ -1047,9 +1264,13 @@ private:
 
 
 // Helper functions
-extern int DoOpSend(KfsOp *op, TcpSocket *sock);
-extern int DoOpResponse(KfsOp *op, TcpSocket *sock);
-extern int DoOpCommon(KfsOp *op, TcpSocket *sock);
+extern int DoOpSend(KfsOp *op, TcpSocket *sock, KfsConnPool *pool = 0);
+/// With the pool, the responses of the other ops multiplexed on the
+/// pooled connection are kept for these ops, rather than discarded.
+extern int DoOpResponse(KfsOp *op, TcpSocket *sock, KfsConnPool *pool = 0);
+extern int DoOpCommon(KfsOp *op, TcpSocket *sock, KfsConnPool *pool = 0);
+/// Receive one response on the pooled connection, and keep it for its op.
+extern int ReceiveResponse(TcpSocket *sock, KfsConnPool *pool, kfsSeq_t seq);
 
 }
 
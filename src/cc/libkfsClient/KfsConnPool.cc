@@ -0,0 +1,346 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Client chunk server connection pool.
+//
+//----------------------------------------------------------------------------
+
+#include "KfsConnPool.h"
+#include "common/log.h"
+
+#include <errno.h>
+#include <poll.h>
+
+namespace KFS {
+
+using std::string;
+
+KfsConnPool::KfsConnPool()
+    : mMaxConnsPerServer(2),
+      mIdleTimeoutSec(60),
+      mLastSweepTime(0),
+      mServers(),
+      mSockets(),
+      mStats()
+{
+}
+
+KfsConnPool::~KfsConnPool()
+{
+    KfsConnPool::Clear();
+}
+
+    void
+KfsConnPool::SetParameters(
+    int inMaxConnsPerServer,
+    int inIdleTimeoutSec)
+{
+    mMaxConnsPerServer = inMaxConnsPerServer > 0 ? inMaxConnsPerServer : 0;
+    mIdleTimeoutSec    = inIdleTimeoutSec > 0 ? inIdleTimeoutSec : 0;
+    // The existing connections stay in the pool, as their users might
+    // still have ops in flight that rely on the response matching.
+}
+
+    /* static */ TcpSocketPtr
+KfsConnPool::Connect(
+    const ServerLocation& inLocation,
+    bool                  inNonblockingConnect)
+{
+    TcpSocketPtr theSockPtr(new TcpSocket());
+    int theRes = theSockPtr->Connect(inLocation, inNonblockingConnect);
+    if (theRes == -EINPROGRESS) {
+        // 30 seconds: poll expects values in milli-seconds
+        const int kPollTimeout = 30 * 1000;
+        struct pollfd thePfd;
+        thePfd.fd      = theSockPtr->GetFd();
+        thePfd.events  = POLLOUT;
+        thePfd.revents = 0;
+        theRes = poll(&thePfd, 1, kPollTimeout);
+        if (theRes > 0 && (thePfd.revents & POLLOUT) != 0) {
+            // connection completed
+            return theSockPtr;
+        }
+        KFS_LOG_VA_INFO("Non-blocking connect to location %s failed",
+            inLocation.ToString().c_str());
+        theRes = -EHOSTUNREACH;
+    }
+    if (theRes < 0) {
+        theSockPtr.reset(new TcpSocket());
+    }
+    return theSockPtr;
+}
+
+    TcpSocketPtr
+KfsConnPool::Get(
+    const ServerLocation& inLocation,
+    bool                  inNonblockingConnect)
+{
+    if (mMaxConnsPerServer <= 0) {
+        mStats.mConnectCount++;
+        return Connect(inLocation, inNonblockingConnect);
+    }
+    const time_t theNow = time(0);
+    if (mLastSweepTime != theNow) {
+        Sweep(theNow);
+    }
+    // Find the least shared connection, the pool's own reference counts
+    // as one user.
+    Conn* theBestPtr  = 0;
+    int   theConnCount = 0;
+    for (Servers::iterator theIt = mServers.lower_bound(inLocation);
+            theIt != mServers.end() && theIt->first == inLocation; ) {
+        Conn& theConn = *theIt->second;
+        if (! theConn.mSockPtr->IsGood()) {
+            Remove(theIt++);
+            continue;
+        }
+        if (! theBestPtr || theConn.mSockPtr.use_count() <
+                theBestPtr->mSockPtr.use_count()) {
+            theBestPtr = &theConn;
+        }
+        theConnCount++;
+        ++theIt;
+    }
+    if (theBestPtr && (theBestPtr->mSockPtr.use_count() <= 1 ||
+            theConnCount >= mMaxConnsPerServer)) {
+        mStats.mReuseCount++;
+        theBestPtr->mLastUsed = theNow;
+        return theBestPtr->mSockPtr;
+    }
+    TcpSocketPtr const theSockPtr = Connect(inLocation, inNonblockingConnect);
+    if (! theSockPtr->IsGood()) {
+        return theSockPtr;
+    }
+    mStats.mConnectCount++;
+    Servers::iterator const theIt = mServers.insert(std::make_pair(
+        inLocation, new Conn(inLocation, theSockPtr, theNow)));
+    mSockets[theSockPtr.get()] = theIt;
+    return theSockPtr;
+}
+
+    void
+KfsConnPool::Add(
+    const ServerLocation& inLocation,
+    const TcpSocketPtr&   inSockPtr)
+{
+    if (mMaxConnsPerServer <= 0 || ! inSockPtr || ! inSockPtr->IsGood() ||
+            Find(inSockPtr.get())) {
+        return;
+    }
+    Servers::iterator const theIt = mServers.insert(std::make_pair(
+        inLocation, new Conn(inLocation, inSockPtr, time(0))));
+    mSockets[inSockPtr.get()] = theIt;
+}
+
+    KfsConnPool::Conn*
+KfsConnPool::Find(
+    const TcpSocket* inSockPtr) const
+{
+    Sockets::const_iterator const theIt = mSockets.find(inSockPtr);
+    return (theIt == mSockets.end() ? 0 : theIt->second->second);
+}
+
+    void
+KfsConnPool::Sent(
+    const TcpSocket* inSockPtr,
+    kfsSeq_t         inSeq)
+{
+    Conn* const theConnPtr = Find(inSockPtr);
+    if (! theConnPtr) {
+        return;
+    }
+    std::map<kfsSeq_t, bool>& theInFlight = theConnPtr->mInFlight;
+    theInFlight[inSeq] = false;
+    if (theInFlight.size() > size_t(kMaxInFlight)) {
+        // the oldest op is the most likely to be given up
+        theInFlight.erase(theInFlight.begin());
+    }
+}
+
+    void
+KfsConnPool::Received(
+    const TcpSocket* inSockPtr,
+    kfsSeq_t         inSeq)
+{
+    Conn* const theConnPtr = Find(inSockPtr);
+    if (theConnPtr) {
+        theConnPtr->mInFlight.erase(inSeq);
+    }
+}
+
+    bool
+KfsConnPool::IsExpected(
+    const TcpSocket* inSockPtr,
+    kfsSeq_t         inSeq)
+{
+    Conn* const theConnPtr = Find(inSockPtr);
+    if (! theConnPtr) {
+        return false;
+    }
+    std::map<kfsSeq_t, bool>::iterator const theIt =
+        theConnPtr->mInFlight.find(inSeq);
+    if (theIt == theConnPtr->mInFlight.end()) {
+        return false;
+    }
+    if (theIt->second) {
+        theConnPtr->mInFlight.erase(theIt);
+        mStats.mAbandonCount++;
+        return false;
+    }
+    return true;
+}
+
+    void
+KfsConnPool::PutResponse(
+    const TcpSocket* inSockPtr,
+    kfsSeq_t         inSeq,
+    Response&        ioResponse)
+{
+    Conn* const theConnPtr = Find(inSockPtr);
+    if (! theConnPtr) {
+        return;
+    }
+    Conn& theConn = *theConnPtr;
+    theConn.mInFlight.erase(inSeq);
+    theConn.mResponseBytes +=
+        ioResponse.mHeader.size() + ioResponse.mContent.size();
+    if (theConn.mResponseBytes > size_t(kMaxResponseBytes)) {
+        // The ops that the responses belong to fail, as they would if the
+        // connection broke, and their callers retry.
+        KFS_LOG_VA_INFO("closing connection to %s: %d bytes of responses"
+            " kept", theConn.mLocation.ToString().c_str(),
+            (int)theConn.mResponseBytes);
+        theConn.mSockPtr->Close();
+        theConn.mInFlight.clear();
+        theConn.mResponses.clear();
+        theConn.mResponseBytes = 0;
+        return;
+    }
+    Response& theResponse = theConn.mResponses[inSeq];
+    theResponse.mHeader.swap(ioResponse.mHeader);
+    theResponse.mContent.swap(ioResponse.mContent);
+    mStats.mStashCount++;
+}
+
+    bool
+KfsConnPool::HasResponse(
+    const TcpSocket* inSockPtr,
+    kfsSeq_t         inSeq) const
+{
+    const Conn* const theConnPtr = Find(inSockPtr);
+    return (theConnPtr &&
+        theConnPtr->mResponses.find(inSeq) != theConnPtr->mResponses.end());
+}
+
+    bool
+KfsConnPool::TakeResponse(
+    const TcpSocket* inSockPtr,
+    kfsSeq_t         inSeq,
+    Response&        outResponse)
+{
+    Conn* const theConnPtr = Find(inSockPtr);
+    if (! theConnPtr) {
+        return false;
+    }
+    std::map<kfsSeq_t, Response>::iterator const theIt =
+        theConnPtr->mResponses.find(inSeq);
+    if (theIt == theConnPtr->mResponses.end()) {
+        return false;
+    }
+    outResponse.mHeader.swap(theIt->second.mHeader);
+    outResponse.mContent.swap(theIt->second.mContent);
+    theConnPtr->mResponses.erase(theIt);
+    theConnPtr->mResponseBytes -=
+        outResponse.mHeader.size() + outResponse.mContent.size();
+    return true;
+}
+
+    bool
+KfsConnPool::Abandon(
+    const TcpSocket* inSockPtr,
+    kfsSeq_t         inSeq)
+{
+    Conn* const theConnPtr = Find(inSockPtr);
+    if (! theConnPtr || ! theConnPtr->mSockPtr->IsGood()) {
+        return false;
+    }
+    std::map<kfsSeq_t, Response>::iterator const theIt =
+        theConnPtr->mResponses.find(inSeq);
+    if (theIt != theConnPtr->mResponses.end()) {
+        theConnPtr->mResponseBytes -=
+            theIt->second.mHeader.size() + theIt->second.mContent.size();
+        theConnPtr->mResponses.erase(theIt);
+        mStats.mAbandonCount++;
+        return true;
+    }
+    // Nothing to do if the op is not in flight: the response that
+    // nobody expects is discarded.
+    std::map<kfsSeq_t, bool>::iterator const theInFlightIt =
+        theConnPtr->mInFlight.find(inSeq);
+    if (theInFlightIt != theConnPtr->mInFlight.end()) {
+        theInFlightIt->second = true;
+    }
+    return true;
+}
+
+    void
+KfsConnPool::Remove(
+    Servers::iterator inIt)
+{
+    Conn* const theConnPtr = inIt->second;
+    mSockets.erase(theConnPtr->mSockPtr.get());
+    mServers.erase(inIt);
+    delete theConnPtr;
+}
+
+    void
+KfsConnPool::Sweep(
+    time_t inNow)
+{
+    mLastSweepTime = inNow;
+    for (Servers::iterator theIt = mServers.begin();
+            theIt != mServers.end(); ) {
+        Conn& theConn = *theIt->second;
+        if (! theConn.mSockPtr->IsGood()) {
+            Remove(theIt++);
+            continue;
+        }
+        if (theConn.mSockPtr.use_count() > 1) {
+            theConn.mLastUsed = inNow;
+        } else if (mIdleTimeoutSec > 0 &&
+                theConn.mLastUsed + mIdleTimeoutSec < inNow) {
+            mStats.mIdleCloseCount++;
+            Remove(theIt++);
+            continue;
+        }
+        ++theIt;
+    }
+}
+
+    void
+KfsConnPool::Clear()
+{
+    while (! mServers.empty()) {
+        Remove(mServers.begin());
+    }
+}
+
+} /* namespace KFS */
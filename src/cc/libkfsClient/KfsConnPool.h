@@ -0,0 +1,199 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Client chunk server connection pool.
+//
+//----------------------------------------------------------------------------
+
+#ifndef KFS_CONN_POOL_H
+#define KFS_CONN_POOL_H
+
+#include <time.h>
+#include <string>
+#include <map>
+
+#include "common/kfstypes.h"
+#include "common/kfsdecls.h"
+#include "libkfsIO/TcpSocket.h"
+
+namespace KFS {
+
+///
+/// Pool of the chunk server connections shared by all files of the
+/// client. Each server has up to "max connections per server" connections;
+/// a new user gets an idle connection, a new connection while the limit
+/// allows, and the least shared connection otherwise.
+/// The ops of different files are multiplexed on the shared connections,
+/// and the responses are matched by sequence number: DoOpSend() records
+/// the sequence numbers of the ops in flight on the connection, and
+/// DoOpResponse() keeps the response that belongs to another op in flight
+/// in the pool until that op asks for it. The responses of the abandoned
+/// (cancelled) ops, and the responses that no op in flight expects, are
+/// discarded. Cancelling read ahead therefore no longer requires closing
+/// the connection. The kept responses are bounded by bytes: the
+/// connection is closed when the bound is exceeded.
+/// A pooled socket is connected only once: a broken connection is removed
+/// from the pool and replaced with a new one, the users that hold the
+/// broken one fail their pending ops, as they would without the pool.
+/// The pool is not thread safe, the client mutex protects it.
+///
+class KfsConnPool
+{
+public:
+    struct Stats
+    {
+        Stats()
+            : mConnectCount(0),
+              mReuseCount(0),
+              mStashCount(0),
+              mAbandonCount(0),
+              mIdleCloseCount(0)
+            {}
+        int64_t mConnectCount;   // connections opened
+        int64_t mReuseCount;     // requests served with a pooled connection
+        int64_t mStashCount;     // responses kept for other ops
+        int64_t mAbandonCount;   // responses of the cancelled ops dropped
+        int64_t mIdleCloseCount; // idle connections closed
+    };
+    struct Response
+    {
+        Response()
+            : mHeader(),
+              mContent()
+            {}
+        std::string mHeader;
+        std::string mContent;
+    };
+
+    KfsConnPool();
+    ~KfsConnPool();
+    /// @param[in] inMaxConnsPerServer 0 disables the pool: each user
+    /// gets its own connection.
+    /// @param[in] inIdleTimeoutSec unused connections are closed after
+    /// this many seconds.
+    void SetParameters(
+        int inMaxConnsPerServer,
+        int inIdleTimeoutSec);
+    /// @retval the pooled connection; on failure a socket that is not
+    /// connected
+    TcpSocketPtr Get(
+        const ServerLocation& inLocation,
+        bool                  inNonblockingConnect);
+    /// Open a connection that is not shared with other users.
+    /// @retval the connection; on failure a socket that is not connected
+    static TcpSocketPtr Connect(
+        const ServerLocation& inLocation,
+        bool                  inNonblockingConnect);
+    /// Add the connection opened with Connect() to the pool, so that the
+    /// responses of the ops sent on it are matched as on the pooled ones.
+    /// Does nothing if the pool is disabled.
+    void Add(
+        const ServerLocation& inLocation,
+        const TcpSocketPtr&   inSockPtr);
+    /// The op was sent on the connection.
+    void Sent(
+        const TcpSocket* inSockPtr,
+        kfsSeq_t         inSeq);
+    /// The op received its response.
+    void Received(
+        const TcpSocket* inSockPtr,
+        kfsSeq_t         inSeq);
+    /// @retval true if the response with this sequence number arrived on
+    /// the pooled connection, and its op is in flight, and not abandoned.
+    bool IsExpected(
+        const TcpSocket* inSockPtr,
+        kfsSeq_t         inSeq);
+    /// Keep the response that DoOpResponse() received for another op.
+    /// Closes the connection if the responses kept exceed the bound.
+    void PutResponse(
+        const TcpSocket* inSockPtr,
+        kfsSeq_t         inSeq,
+        Response&        ioResponse);
+    /// @retval true if the response was received earlier, and is kept.
+    bool HasResponse(
+        const TcpSocket* inSockPtr,
+        kfsSeq_t         inSeq) const;
+    /// @retval true if the response was received earlier.
+    bool TakeResponse(
+        const TcpSocket* inSockPtr,
+        kfsSeq_t         inSeq,
+        Response&        outResponse);
+    /// The op sent on the connection is cancelled: discard its response.
+    /// @retval false if the socket isn't pooled, and the caller has to
+    /// close the connection to cancel the op.
+    bool Abandon(
+        const TcpSocket* inSockPtr,
+        kfsSeq_t         inSeq);
+    void Clear();
+    Stats GetStats() const
+        { return mStats; }
+
+private:
+    // Bound the ops in flight whose callers gave up without abandoning,
+    // and the memory used by the responses kept.
+    enum { kMaxInFlight = 4096 };
+    enum { kMaxResponseBytes = 64 << 20 };
+    struct Conn
+    {
+        Conn(
+            const ServerLocation& inLocation,
+            const TcpSocketPtr&   inSockPtr,
+            time_t                inNow)
+            : mLocation(inLocation),
+              mSockPtr(inSockPtr),
+              mLastUsed(inNow),
+              mInFlight(),
+              mResponses(),
+              mResponseBytes(0)
+            {}
+        ServerLocation                mLocation;
+        TcpSocketPtr                  mSockPtr;
+        time_t                        mLastUsed;
+        std::map<kfsSeq_t, bool>      mInFlight; // true -- abandoned
+        std::map<kfsSeq_t, Response>  mResponses;
+        size_t                        mResponseBytes;
+    };
+    typedef std::multimap<ServerLocation, Conn*> Servers;
+    typedef std::map<const TcpSocket*, Servers::iterator> Sockets;
+
+    int     mMaxConnsPerServer;
+    int     mIdleTimeoutSec;
+    time_t  mLastSweepTime;
+    Servers mServers;
+    Sockets mSockets;
+    Stats   mStats;
+
+    Conn* Find(
+        const TcpSocket* inSockPtr) const;
+    void Remove(
+        Servers::iterator inIt);
+    void Sweep(
+        time_t inNow);
+private:
+    KfsConnPool(
+        const KfsConnPool& inPool);
+    KfsConnPool& operator=(
+        const KfsConnPool& inPool);
+};
+
+} /* namespace KFS */
+
+#endif /* KFS_CONN_POOL_H */
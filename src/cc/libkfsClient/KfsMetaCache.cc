@@ -0,0 +1,192 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Client side meta data cache: file attributes and chunk layouts.
+//
+//----------------------------------------------------------------------------
+
+#include "KfsMetaCache.h"
+
+#include <limits>
+
+namespace KFS {
+
+using std::string;
+
+KfsMetaCache::KfsMetaCache()
+    : mMaxEntries(0),
+      mTtlSec(30),
+      mAttrs(),
+      mChunks(),
+      mStats()
+{
+}
+
+KfsMetaCache::~KfsMetaCache()
+{
+}
+
+    void
+KfsMetaCache::SetParameters(
+    int inMaxEntries,
+    int inTtlSec)
+{
+    mMaxEntries = inMaxEntries > 0 ? inMaxEntries : 0;
+    mTtlSec     = inTtlSec > 0 ? inTtlSec : 0;
+    // Shrink or discard, and apply the new ttl to all entries.
+    Clear();
+}
+
+    bool
+KfsMetaCache::GetAttr(
+    kfsFileId_t    inParentFid,
+    const string&  inName,
+    KfsServerAttr& outAttr)
+{
+    if (mMaxEntries <= 0) {
+        return false;
+    }
+    const KfsServerAttr* const theAttrPtr =
+        mAttrs.Get(AttrKey(inParentFid, inName), time(0));
+    if (! theAttrPtr) {
+        mStats.mAttrMissCount++;
+        return false;
+    }
+    mStats.mAttrHitCount++;
+    outAttr = *theAttrPtr;
+    return true;
+}
+
+    void
+KfsMetaCache::PutAttr(
+    kfsFileId_t          inParentFid,
+    const string&        inName,
+    const KfsServerAttr& inAttr)
+{
+    if (mMaxEntries <= 0) {
+        return;
+    }
+    mStats.mEvictCount += mAttrs.Put(AttrKey(inParentFid, inName), inAttr,
+        time(0) + mTtlSec, mMaxEntries);
+}
+
+    void
+KfsMetaCache::SetFileSize(
+    kfsFileId_t   inParentFid,
+    const string& inName,
+    off_t         inFileSize)
+{
+    if (mMaxEntries <= 0) {
+        return;
+    }
+    KfsServerAttr* const theAttrPtr =
+        mAttrs.Get(AttrKey(inParentFid, inName), time(0));
+    if (theAttrPtr) {
+        theAttrPtr->fileSize = inFileSize;
+    }
+}
+
+    void
+KfsMetaCache::InvalidateAttr(
+    kfsFileId_t   inParentFid,
+    const string& inName,
+    kfsFileId_t   inFid)
+{
+    if (mMaxEntries <= 0) {
+        return;
+    }
+    if (inFid > 0) {
+        InvalidateChunks(inFid);
+    }
+    KfsServerAttr theAttr;
+    if (! mAttrs.Erase(AttrKey(inParentFid, inName), &theAttr)) {
+        return;
+    }
+    if (theAttr.fileId != inFid) {
+        InvalidateChunks(theAttr.fileId);
+    }
+    mStats.mInvalidateCount++;
+}
+
+    bool
+KfsMetaCache::GetChunk(
+    kfsFileId_t inFid,
+    int         inChunkNum,
+    ChunkAttr&  outChunk)
+{
+    if (mMaxEntries <= 0) {
+        return false;
+    }
+    const ChunkAttr* const theChunkPtr =
+        mChunks.Get(ChunkKey(inFid, inChunkNum), time(0));
+    if (! theChunkPtr) {
+        mStats.mLayoutMissCount++;
+        return false;
+    }
+    mStats.mLayoutHitCount++;
+    outChunk = *theChunkPtr;
+    return true;
+}
+
+    void
+KfsMetaCache::PutChunk(
+    kfsFileId_t      inFid,
+    int              inChunkNum,
+    const ChunkAttr& inChunk)
+{
+    if (mMaxEntries <= 0 || inChunk.chunkId <= 0 ||
+            inChunk.chunkServerLoc.empty()) {
+        return;
+    }
+    mStats.mEvictCount += mChunks.Put(ChunkKey(inFid, inChunkNum), inChunk,
+        time(0) + mTtlSec, mMaxEntries);
+}
+
+    void
+KfsMetaCache::InvalidateChunk(
+    kfsFileId_t inFid,
+    int         inChunkNum)
+{
+    if (mMaxEntries > 0 && mChunks.Erase(ChunkKey(inFid, inChunkNum))) {
+        mStats.mInvalidateCount++;
+    }
+}
+
+    void
+KfsMetaCache::InvalidateChunks(
+    kfsFileId_t inFid)
+{
+    if (mMaxEntries <= 0) {
+        return;
+    }
+    mStats.mInvalidateCount += mChunks.Erase(
+        ChunkKey(inFid, std::numeric_limits<int>::min()),
+        ChunkKey(inFid, std::numeric_limits<int>::max()));
+}
+
+    void
+KfsMetaCache::Clear()
+{
+    mAttrs.Clear();
+    mChunks.Clear();
+}
+
+} /* namespace KFS */
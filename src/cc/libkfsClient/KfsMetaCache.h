@@ -0,0 +1,243 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Client side meta data cache: file attributes and chunk layouts.
+//
+//----------------------------------------------------------------------------
+
+#ifndef KFS_META_CACHE_H
+#define KFS_META_CACHE_H
+
+#include <time.h>
+#include <string>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <utility>
+
+#include "common/kfstypes.h"
+#include "KfsAttr.h"
+
+namespace KFS {
+
+///
+/// Bounded, LRU and TTL based, cache of the meta server lookup results.
+/// The attributes are keyed by <parent directory fid, name>, i.e. the
+/// cache also maps the path names to fids, one path component at a time.
+/// The chunk layouts (chunk id, version, and servers) are keyed by <fid,
+/// chunk #>, and only the layouts of the full chunks, i.e. the chunks
+/// that aren't the last chunk of the file, are cached: the full chunks
+/// are normally not written to anymore.
+/// The client invalidates the entries on local mutations, and on the
+/// errors that indicate that the entry is stale. Other clients' changes
+/// become visible once the entries expire.
+/// The cache is not thread safe, the client mutex protects it.
+///
+class KfsMetaCache
+{
+public:
+    struct Stats
+    {
+        Stats()
+            : mAttrHitCount(0),
+              mAttrMissCount(0),
+              mLayoutHitCount(0),
+              mLayoutMissCount(0),
+              mInvalidateCount(0),
+              mEvictCount(0)
+            {}
+        int64_t mAttrHitCount;
+        int64_t mAttrMissCount;
+        int64_t mLayoutHitCount;
+        int64_t mLayoutMissCount;
+        int64_t mInvalidateCount;
+        int64_t mEvictCount;
+    };
+
+    KfsMetaCache();
+    ~KfsMetaCache();
+    /// @param[in] inMaxEntries max. # of attribute entries, and max. # of
+    /// chunk layout entries; 0 disables the cache.
+    /// @param[in] inTtlSec entry time to live in seconds.
+    void SetParameters(
+        int inMaxEntries,
+        int inTtlSec);
+    bool IsEnabled() const
+        { return (mMaxEntries > 0); }
+    bool GetAttr(
+        kfsFileId_t          inParentFid,
+        const std::string&   inName,
+        KfsServerAttr&       outAttr);
+    void PutAttr(
+        kfsFileId_t          inParentFid,
+        const std::string&   inName,
+        const KfsServerAttr& inAttr);
+    /// Update the file size of the existing entry.
+    void SetFileSize(
+        kfsFileId_t        inParentFid,
+        const std::string& inName,
+        off_t              inFileSize);
+    /// Invalidate the attributes, and the chunk layouts of the file. The
+    /// chunk layouts can outlive the attributes, thus the caller passes
+    /// the file's fid when it knows it. Otherwise only the layouts of the
+    /// fid of the cached attributes, if any, are invalidated.
+    void InvalidateAttr(
+        kfsFileId_t        inParentFid,
+        const std::string& inName,
+        kfsFileId_t        inFid = -1);
+    bool GetChunk(
+        kfsFileId_t inFid,
+        int         inChunkNum,
+        ChunkAttr&  outChunk);
+    void PutChunk(
+        kfsFileId_t      inFid,
+        int              inChunkNum,
+        const ChunkAttr& inChunk);
+    void InvalidateChunk(
+        kfsFileId_t inFid,
+        int         inChunkNum);
+    void InvalidateChunks(
+        kfsFileId_t inFid);
+    void Clear();
+    Stats GetStats() const
+        { return mStats; }
+
+private:
+    template<typename KT, typename VT>
+    class Lru
+    {
+    public:
+        typedef std::list<KT> List;
+        struct Entry
+        {
+            VT                          mVal;
+            time_t                      mExpires;
+            typename List::iterator     mLruIt;
+        };
+        typedef std::map<KT, Entry> Map;
+
+        Lru()
+            : mMap(),
+              mList()
+            {}
+        VT* Get(
+            const KT& inKey,
+            time_t    inNow)
+        {
+            typename Map::iterator const theIt = mMap.find(inKey);
+            if (theIt == mMap.end()) {
+                return 0;
+            }
+            if (theIt->second.mExpires < inNow) {
+                Erase(theIt);
+                return 0;
+            }
+            mList.splice(mList.begin(), mList, theIt->second.mLruIt);
+            return &theIt->second.mVal;
+        }
+        /// @retval # of evicted entries
+        int Put(
+            const KT& inKey,
+            const VT& inVal,
+            time_t    inExpires,
+            size_t    inMaxSize)
+        {
+            std::pair<typename Map::iterator, bool> const theRes =
+                mMap.insert(std::make_pair(inKey, Entry()));
+            Entry& theEntry = theRes.first->second;
+            theEntry.mVal     = inVal;
+            theEntry.mExpires = inExpires;
+            if (theRes.second) {
+                theEntry.mLruIt = mList.insert(mList.begin(), inKey);
+            } else {
+                mList.splice(mList.begin(), mList, theEntry.mLruIt);
+            }
+            int theEvictCount = 0;
+            while (mMap.size() > inMaxSize) {
+                mMap.erase(mList.back());
+                mList.pop_back();
+                theEvictCount++;
+            }
+            return theEvictCount;
+        }
+        void Erase(
+            typename Map::iterator inIt)
+        {
+            mList.erase(inIt->second.mLruIt);
+            mMap.erase(inIt);
+        }
+        /// Erase the entry, expired or not.
+        bool Erase(
+            const KT& inKey,
+            VT*       outValPtr = 0)
+        {
+            typename Map::iterator const theIt = mMap.find(inKey);
+            if (theIt == mMap.end()) {
+                return false;
+            }
+            if (outValPtr) {
+                *outValPtr = theIt->second.mVal;
+            }
+            Erase(theIt);
+            return true;
+        }
+        /// Erase keys in [inFirst, inLast).
+        int Erase(
+            const KT& inFirst,
+            const KT& inLast)
+        {
+            int theCount = 0;
+            typename Map::iterator theIt = mMap.lower_bound(inFirst);
+            while (theIt != mMap.end() && theIt->first < inLast) {
+                mList.erase(theIt->second.mLruIt);
+                mMap.erase(theIt++);
+                theCount++;
+            }
+            return theCount;
+        }
+        void Clear()
+        {
+            mMap.clear();
+            mList.clear();
+        }
+    private:
+        Map  mMap;
+        List mList;
+    };
+    typedef std::pair<kfsFileId_t, std::string> AttrKey;
+    typedef std::pair<kfsFileId_t, int>         ChunkKey;
+
+    int                          mMaxEntries;
+    int                          mTtlSec;
+    Lru<AttrKey, KfsServerAttr>  mAttrs;
+    Lru<ChunkKey, ChunkAttr>     mChunks;
+    Stats                        mStats;
+
+private:
+    KfsMetaCache(
+        const KfsMetaCache& inCache);
+    KfsMetaCache& operator=(
+        const KfsMetaCache& inCache);
+};
+
+} /* namespace KFS */
+
+#endif /* KFS_META_CACHE_H */
@@ -115,7 +115,14 @@ ReaddirOp::Request(ostream &os)
     os << "Cseq: " << seq << "\r\n";
     os << "Version: " << KFS_VERSION_STR << "\r\n";
     os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
-    os << "Directory File-handle: " << fid << "\r\n\r\n";
+    os << "Directory File-handle: " << fid << "\r\n";
+    if (maxEntries > 0) {
+        os << "Max-entries: " << maxEntries << "\r\n";
+        if (! cursor.empty()) {
+            os << "Cursor: " << cursor << "\r\n";
+        }
+    }
+    os << "\r\n";
 }
 
 void
@@ -164,7 +171,14 @@ ReaddirPlusOp::Request(ostream &os)
     os << "Cseq: " << seq << "\r\n";
     os << "Client-Protocol-Version: " << KFS_CLIENT_PROTO_VERS << "\r\n";
     os << "Version: " << KFS_VERSION_STR << "\r\n";
-    os << "Directory File-handle: " << fid << "\r\n\r\n";
+    os << "Directory File-handle: " << fid << "\r\n";
+    if (maxEntries > 0) {
+        os << "Max-entries: " << maxEntries << "\r\n";
+        if (! cursor.empty()) {
+            os << "Cursor: " << cursor << "\r\n";
+        }
+    }
+    os << "\r\n";
 }
 
 void
@@ -662,6 +676,8 @@ void
 ReaddirOp::ParseResponseHeaderSelf(const Properties &prop)
 {
     numEntries = prop.getValue("Num-Entries", 0);
+    hasMoreEntries = prop.getValue("Has-more-entries", 0) != 0;
+    nextCursor = prop.getValue("Cursor", "");
 }
 
 void
@@ -690,6 +706,8 @@ void
 ReaddirPlusOp::ParseResponseHeaderSelf(const Properties &prop)
 {
     numEntries = prop.getValue("Num-Entries", 0);
+    hasMoreEntries = prop.getValue("Has-more-entries", 0) != 0;
+    nextCursor = prop.getValue("Cursor", "");
 }
 
 void
@@ -248,8 +248,18 @@ struct RenameOp : public KfsOp {
 struct ReaddirOp : public KfsOp {
     kfsFileId_t fid; // fid of the directory
     int numEntries; // # of entries in the directory
-    ReaddirOp(kfsSeq_t s, kfsFileId_t f):
-        KfsOp(CMD_READDIR, s), fid(f), numEntries(0)
+    // when maxEntries > 0, the server returns at most that many entries
+    // following the position given by the cursor; the cursor is opaque to
+    // the client: empty to start from the beginning, otherwise the value
+    // returned with the previous page
+    int maxEntries;
+    std::string cursor;
+    bool hasMoreEntries; // the server has more entries past this page
+    std::string nextCursor; // where to resume for the next page
+    ReaddirOp(kfsSeq_t s, kfsFileId_t f, const std::string &c = std::string(),
+        int maxEnt = 0):
+        KfsOp(CMD_READDIR, s), fid(f), numEntries(0), maxEntries(maxEnt),
+        cursor(c), hasMoreEntries(false)
     {
 
     }
@@ -325,8 +335,18 @@ struct DumpChunkMapOp : public KfsOp {
 struct ReaddirPlusOp : public KfsOp {
     kfsFileId_t fid; // fid of the directory
     int numEntries; // # of entries in the directory
-    ReaddirPlusOp(kfsSeq_t s, kfsFileId_t f):
-        KfsOp(CMD_READDIRPLUS, s), fid(f), numEntries(0)
+    // when maxEntries > 0, the server returns at most that many entries
+    // following the position given by the cursor; the cursor is opaque to
+    // the client: empty to start from the beginning, otherwise the value
+    // returned with the previous page
+    int maxEntries;
+    std::string cursor;
+    bool hasMoreEntries; // the server has more entries past this page
+    std::string nextCursor; // where to resume for the next page
+    ReaddirPlusOp(kfsSeq_t s, kfsFileId_t f, const std::string &c = std::string(),
+        int maxEnt = 0):
+        KfsOp(CMD_READDIRPLUS, s), fid(f), numEntries(0), maxEntries(maxEnt),
+        cursor(c), hasMoreEntries(false)
     {
 
     }
@@ -108,6 +108,8 @@ public:
           mIdleTimeoutSec(inIdleTimeoutSec),
           mLogPrefixPtr(inLogPrefixPtr ? inLogPrefixPtr : "PW"),
           mPreAllocateFlag(inPreAllocateFlag),
+          mRecordBlockSize(0),
+          mRecordBlockCompressFlag(true),
           mChunkServerInitialSeqNum(
             inChunkServerInitialSeqNum > 0 ? inChunkServerInitialSeqNum :
                 GetInitalSeqNum(0x19885a10)),
@@ -128,6 +130,16 @@ public:
         mNetManager.MainLoop();
         mNetManager.UnRegisterTimeoutHandler(this);
     }
+    void SetRecordBlocks(
+        int  inBlockSize,
+        bool inCompressFlag)
+    {
+        // The appenders pick up the settings when created, on the worker
+        // thread.
+        QCRTASSERT(! mWorker.IsStarted());
+        mRecordBlockSize         = inBlockSize > 0 ? inBlockSize : 0;
+        mRecordBlockCompressFlag = inCompressFlag;
+    }
     void Start()
     {
         if (mWorker.IsStarted()) {
@@ -533,6 +545,10 @@ private:
         {
             WorkQueue::Init(mWorkQueue);
             CleanupList::Init(*this);
+            if (inOwner.mRecordBlockSize > 0) {
+                mWAppender.SetRecordBlocks(inOwner.mRecordBlockSize,
+                    inOwner.mRecordBlockCompressFlag);
+            }
         }
         ~Appender()
         {
@@ -743,6 +759,8 @@ private:
     const int         mIdleTimeoutSec;
     const char* const mLogPrefixPtr;
     const bool        mPreAllocateFlag;
+    int               mRecordBlockSize;
+    bool              mRecordBlockCompressFlag;
     int64_t           mChunkServerInitialSeqNum;
     DoNotDeallocate   mDoNotDeallocate;
     StopRequest       mStopRequest;
@@ -948,6 +966,14 @@ KfsProtocolWorker::~KfsProtocolWorker()
     delete &mImpl;
 }
 
+    void
+KfsProtocolWorker::SetRecordBlocks(
+    int  inBlockSize,
+    bool inCompressFlag)
+{
+    mImpl.SetRecordBlocks(inBlockSize, inCompressFlag);
+}
+
     void
 KfsProtocolWorker::Start()
 {
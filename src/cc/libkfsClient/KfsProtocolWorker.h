@@ -128,6 +128,11 @@ public:
         int64_t     inChunkServerInitialSeqNum    = 0,
         bool        inPreAllocateFlag             = false);
     ~KfsProtocolWorker();
+    // Pack the appended records into record blocks, see
+    // WriteAppender::SetRecordBlocks(). Must be called before Start().
+    void SetRecordBlocks(
+        int  inBlockSize,
+        bool inCompressFlag = true);
     int Execute(
         RequestType  inRequestType,
         FileInstance inFileInstance,
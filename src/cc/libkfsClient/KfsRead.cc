@@ -34,6 +34,7 @@
 #include <cerrno>
 #include <iostream>
 #include <string>
+#include <algorithm>
 
 using std::string;
 using std::ostringstream;
@@ -41,8 +42,11 @@ using std::istringstream;
 using std::min;
 using std::max;
 using std::endl;
+using std::vector;
 using namespace KFS;
 
+extern struct timeval gDefaultTimeout;
+
 static double ComputeTimeDiff(const struct timeval &startTime, const struct timeval &endTime)
 {
     float timeSpent;
@@ -52,6 +56,15 @@ static double ComputeTimeDiff(const struct timeval &startTime, const struct time
     return timeSpent / 1e6;
 }
 
+static int64_t
+TimeNowMs()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return ((int64_t)now.tv_sec * 1000 + now.tv_usec / 1000);
+}
+
 static bool
 NeedToRetryRead(int status)
 {
@@ -113,7 +126,13 @@ KfsClientImpl::ReadPrefetch(int fd, char *buf, size_t numBytes)
         return 0;
     }
 
-    TcpSocketPtr sockPtr = pos->GetPreferredChunkServerSockPtr();    
+    // The async reader uses the socket without holding the client mutex:
+    // it can not share the pooled connection with the other files.
+    TcpSocketPtr sockPtr = KfsConnPool::Connect(
+        pos->GetPreferredServerLocation(), false);
+    if (! sockPtr->IsGood()) {
+        return 0;
+    }
     pos->prefetchReq = new AsyncReadReq(fd, sockPtr, nextSeq(), 
                                         chunk->chunkId, chunk->chunkVersion,
                                         pos->chunkOffset,
@@ -161,9 +180,7 @@ KfsClientImpl::Read(int fd, char *buf, size_t numBytes)
                 // the caller is giving us the same buffer in which prefetch was done, but is saying it wants less data. 
                 return numBytes;
             // read the remaining: since we didn't get all the data, reset connections and get the rest
-            if (pos->preferredServer)
-                pos->preferredServer->Close();
-            pos->preferredServer = NULL;
+            pos->ResetServers();
             ClearCurrChunkAttr(fd);
 
             ssize_t rest = Read(fd, buf + numIO, numBytes - numIO);
@@ -175,10 +192,9 @@ KfsClientImpl::Read(int fd, char *buf, size_t numBytes)
             KFS_LOG_VA_INFO("Prefetch on chunk %lld (fd = %d) failed; falling thru sync path", 
                             chunk->chunkId, fd);
             // it is possible that the prefetch failed because the
-            // server closed connection on us.  Close the socket so
+            // server closed connection on us.  Drop the connections so
             // that we can do a fast reset on the read.
-            pos->preferredServer->Close();
-            pos->preferredServer = NULL;
+            pos->ResetServers();
             ClearCurrChunkAttr(fd);
         }
         numIO = 0;
@@ -186,7 +202,16 @@ KfsClientImpl::Read(int fd, char *buf, size_t numBytes)
 
     // flush buffer so sizes are updated properly
     ChunkBuffer *cb = FdBuffer(fd);
-    if (cb->dirty)
+    if (IsWriteBehind(fd)) {
+        // wait for the data to be written before reading it back; leave
+        // the write error, if any, for the next write, sync or close
+        if (cb->dirty || (mWriteBehind &&
+                mWriteBehind->IsPending(FdInfo(fd)->instance))) {
+            const int status = SyncWriteBehind(fd, false);
+            if (status < 0)
+                return status;
+        }
+    } else if (cb->dirty)
 	FlushBuffer(fd);
 
     cb->allocate();
@@ -206,8 +231,10 @@ KfsClientImpl::Read(int fd, char *buf, size_t numBytes)
     // of bytes or we hit EOF.
     while (nread < numBytes) {
         ChunkAttr *chunk = GetCurrChunk(fd);
+        // the next chunk read ahead is adopted before the lease is
+        // acquired, keep it
         if (chunk && (!mLeaseClerk.IsLeaseValid(chunk->chunkId)) && pos->pendingChunkRead)
-            pos->pendingChunkRead->Reset();
+            pos->pendingChunkRead->Reset(true);
         //
         // Basic invariant: when we enter this loop, the connections
         // we have to the chunkservers (if any) are correct.  As we
@@ -313,6 +340,11 @@ KfsClientImpl::IsChunkReadable(int fd, int &leaseStatus)
         if (res >= 0) {
             chunk = GetCurrChunk(fd);
             if (pos->preferredServer == NULL && chunk->chunkId != (kfsChunkId_t)-1) {
+                if (pos->pendingChunkRead &&
+                        pos->pendingChunkRead->AdoptNextChunk(fd)) {
+                    // already connected, and read ahead is in flight
+                    break;
+                }
                 // use nonblocking connect to chunkserver; if one fails to
                 // connect, we switch to another replica. 
                 res = OpenChunk(fd, true);
@@ -342,7 +374,9 @@ KfsClientImpl::IsChunkLeaseGood(int fd, kfsChunkId_t chunkId, const string &path
     if (chunkId > 0) {
         if ((!mLeaseClerk.IsLeaseValid(chunkId)) &&
 	    ((leaseStatus = GetLease(fd, chunkId, pathname)) < 0)) {
-	    // couldn't get a valid lease
+	    // couldn't get a valid lease; the chunk might be gone, or
+	    // its location stale
+	    InvalidateCachedChunk(fd);
 	    return false;
 	}
 	if (mLeaseClerk.ShouldRenewLease(chunkId)) {
@@ -410,6 +444,7 @@ KfsClientImpl::ReadChunk(int fd, char *buf, size_t numBytes)
                 if (pos->chunkServers.size() == 0) {
                     pos->ResetServers();
                     chunk->chunkId = -1;
+                    InvalidateCachedChunk(fd);
                 }
                 continue;
             }
@@ -470,6 +505,7 @@ KfsClientImpl::ReadChunk(int fd, char *buf, size_t numBytes)
         // Ok...so, we need to retry the read.  so, re-determine where
         // the chunk went and then retry.
         chunk->chunkId = -1;
+        InvalidateCachedChunk(fd);
         pos->ResetServers();
     } while (++retryCount < mMaxNumRetriesPerOp);
     return numIO;
@@ -478,148 +514,453 @@ KfsClientImpl::ReadChunk(int fd, char *buf, size_t numBytes)
 PendingChunkRead::PendingChunkRead(
     KfsClientImpl& impl,
     size_t         readAhead)
-    : mReadOp(-1, -1, -1),
-      mSocket(0),
-      mImpl(impl),
+    : mImpl(impl),
       mFd(-1),
-      mReadAhead(readAhead)
+      mReadAhead(readAhead),
+      mWindow(0),
+      mLastEnd(0),
+      mLastSize(0),
+      mStride(0),
+      mSocket(),
+      mQueue(),
+      mIssueOffset(0),
+      mNextChunkNum(-1),
+      mNextChunkId(-1),
+      mNextLocation(),
+      mNextSocket(),
+      mNextChunkSize(0),
+      mNextQueue(),
+      mNextIssueOffset(0),
+      mLocateId(-1),
+      mLocateChunkNum(-1)
 {
 }
 
 PendingChunkRead::~PendingChunkRead()
 {
-    PendingChunkRead::Reset();
+    // The connections go away with the file table entry: drop the
+    // requests without touching the file position.
+    Discard(mQueue, mSocket.get());
+    DiscardNextChunk();
+}
+
+size_t
+PendingChunkRead::QueuedBytes(const Queue& queue)
+{
+    size_t bytes = 0;
+    for (Queue::const_iterator it = queue.begin(); it != queue.end(); ++it) {
+        bytes += (*it)->numBytes;
+    }
+    return bytes;
 }
 
 bool
-PendingChunkRead::Start(int fd, size_t off)
+PendingChunkRead::Discard(Queue& queue, const TcpSocket* sock)
 {
-    if (mFd >= 0) {
-        // mImpl.GetCurrChunk(fd)->chunkId = -1;
-        delete [] mReadOp.contentBuf;
-        mReadOp.ReleaseContentBuf();
-        const int curFd = mFd;
-        mFd = -1;
-        mImpl.FdPos(curFd)->ResetServers();
+    mImpl.mReadAheadStats.mWasteByteCount += QueuedBytes(queue);
+    bool abandonedFlag = true;
+    for (Queue::iterator it = queue.begin(); it != queue.end(); ++it) {
+        if (! sock || ! mImpl.mConnPool.Abandon(sock, (*it)->seq)) {
+            abandonedFlag = false;
+        }
+        delete *it;
     }
-    mFd = fd;
-    if (mFd < 0 || mReadAhead <= 0) {
-        mFd = -1;
-        return false;
+    queue.clear();
+    return abandonedFlag;
+}
+
+void
+PendingChunkRead::DiscardNextChunk(bool relinquishLease)
+{
+    CancelLocate();
+    Discard(mNextQueue, mNextSocket.get());
+    mNextSocket.reset();
+    mNextChunkNum = -1;
+    if (mNextChunkId >= 0 && relinquishLease) {
+        // the reader might never get to the chunk: do not hold the
+        // lease, and make the writers wait for it to expire
+        mImpl.RelinquishLease(mNextChunkId);
     }
+    mNextChunkId = -1;
+}
+
+void
+PendingChunkRead::Reset(bool keepNextChunk)
+{
+    if (! keepNextChunk) {
+        DiscardNextChunk();
+    }
+    TcpSocketPtr const sock = mSocket;
+    mSocket.reset();
+    if (mQueue.empty()) {
+        return;
+    }
+    // The responses are in flight: the pool drops them as they arrive on
+    // the shared connection.
+    if (Discard(mQueue, sock.get())) {
+        return;
+    }
+    // Otherwise close the connection, rather than read and discard the
+    // data: the file position, or the pool can still hold it. Reconnect
+    // to the same server right away, otherwise the next read would take
+    // the fail over path, and wait. ResetServers() clears the preferred
+    // server before it cancels the read ahead, and there is nothing to
+    // reconnect in that case.
+    sock->Close();
     FilePosition& pos = *mImpl.FdPos(mFd);
-    mSocket = pos.preferredServer;
-    if (! mSocket) {
-        mFd = -1;
-        return false;
+    if (pos.preferredServer == sock.get()) {
+        pos.SetPreferredServer(pos.GetPreferredServerLocation(), true);
     }
-    ChunkAttr& chunk = *mImpl.GetCurrChunk(mFd);
-    mReadOp.contentLength = 0;
-    mReadOp.seq           = mImpl.nextSeq();
-    mReadOp.chunkId       = chunk.chunkId;
-    mReadOp.chunkVersion  = chunk.chunkVersion;
-    mReadOp.offset        = pos.chunkOffset + off;
-    mReadOp.status        = 0;
-    if (mReadOp.offset >= chunk.chunkSize) {
-        mFd = -1;
+}
+
+bool
+PendingChunkRead::Issue(TcpSocket* sock, const ChunkAttr& chunk,
+    off_t offset, size_t numBytes, Queue& queue)
+{
+    ReadOp* const op = new ReadOp(mImpl.nextSeq(), chunk.chunkId,
+        chunk.chunkVersion);
+    op->offset   = offset;
+    op->numBytes = numBytes;
+    if (DoOpSend(op, sock, &mImpl.mConnPool) < 0) {
+        delete op;
         return false;
     }
-    mReadOp.numBytes = min(size_t(kMaxReadRequest),
-        min(size_t(chunk.chunkSize - mReadOp.offset), mReadAhead));
-    const size_t blkOff(mReadOp.offset % KFS::CHECKSUM_BLOCKSIZE);
-    // if the read isn't block aligned, do the minimal read in this call; then,
-    // we try to force subsequent reads to be block aligned.
-    mReadOp.numBytes = blkOff != 0 ?
-        min(mReadOp.numBytes, KFS::CHECKSUM_BLOCKSIZE - blkOff) :
-        mReadOp.numBytes;
-    if (mSocket && ((int) mReadOp.numBytes > 0) && 
-    		(mReadOp.numBytes < CHUNKSIZE)) {
-        if (DoOpSend(&mReadOp, mSocket)) {
+    queue.push_back(op);
+    mImpl.mReadAheadStats.mRequestCount++;
+    return true;
+}
+
+void
+PendingChunkRead::Update(int fd, size_t numBytes)
+{
+    if (fd < 0 || numBytes <= 0 || mReadAhead <= 0) {
+        Reset();
+        return;
+    }
+    mFd = fd;
+    FilePosition& pos   = *mImpl.FdPos(fd);
+    const off_t   start = pos.fileOffset;
+    if (start == mLastEnd) {
+        mStride = 0;
+    } else if (mStride <= 0 || start - mLastEnd != mStride ||
+            (off_t)numBytes != mLastSize) {
+        // Random access: stop reading ahead until a pattern emerges.
+        mStride   = max(off_t(0), start - mLastEnd);
+        mLastEnd  = start + numBytes;
+        mLastSize = numBytes;
+        mWindow   = 0;
+        Reset();
+        return;
+    }
+    mLastEnd  = start + numBytes;
+    mLastSize = numBytes;
+    mWindow   = mWindow <= 0 ?
+        min(mReadAhead, size_t(kMaxReadRequest)) :
+        min(mReadAhead, 2 * mWindow);
+    if (mStride > 0 && numBytes > size_t(kMaxReadRequest)) {
+        Reset();
+        return;
+    }
+
+    const off_t next = pos.chunkOffset + numBytes + mStride;
+    if (! mQueue.empty() && (mSocket.get() != pos.preferredServer ||
+            mQueue.front()->offset != next)) {
+        Reset(true);
+    }
+    if (! pos.preferredServer) {
+        return;
+    }
+    if (mQueue.empty()) {
+        mSocket      = pos.GetPreferredChunkServerSockPtr();
+        mIssueOffset = next;
+    }
+    ChunkAttr& chunk  = *mImpl.GetCurrChunk(fd);
+    size_t     queued = QueuedBytes(mQueue) + QueuedBytes(mNextQueue);
+    while (queued < mWindow && mIssueOffset < chunk.chunkSize) {
+        size_t size = numBytes;
+        if (mStride <= 0) {
+            // if the read isn't block aligned, do the minimal read first;
+            // the subsequent reads are then block aligned, and the server
+            // can verify the checksums efficiently
+            const size_t blkOff = mIssueOffset % CHECKSUM_BLOCKSIZE;
+            size = blkOff != 0 ?
+                CHECKSUM_BLOCKSIZE - blkOff : size_t(kMaxReadRequest);
+        }
+        size = min(size, size_t(chunk.chunkSize - mIssueOffset));
+        if (! Issue(mSocket.get(), chunk, mIssueOffset, size, mQueue)) {
             chunk.chunkId = -1;
+            mImpl.InvalidateCachedChunk(fd);
+            // ResetServers() discards the requests in flight
             pos.ResetServers();
-            mFd = -1;
+            return;
         }
+        mIssueOffset += size + mStride;
+        queued       += size;
+    }
+    // Set up the next chunk two windows ahead of the chunk end, so that
+    // the set up is done by the time the window reaches the end.
+    if (mStride <= 0 && chunk.chunkSize >= (off_t)KFS::CHUNKSIZE &&
+            mIssueOffset + 2 * (off_t)mReadAhead >= chunk.chunkSize) {
+        StartNextChunk(fd, queued, mIssueOffset >= chunk.chunkSize);
+    }
+}
+
+void
+PendingChunkRead::StartNextChunk(int fd, size_t queued, bool sendFlag)
+{
+    FilePosition&   pos      = *mImpl.FdPos(fd);
+    FileTableEntry& entry    = *mImpl.FdInfo(fd);
+    const int       chunkNum = pos.chunkNum + 1;
+
+    if (entry.fattr.fileSize < 0 ||
+            (off_t)chunkNum * (off_t)KFS::CHUNKSIZE >= entry.fattr.fileSize) {
+        return;
+    }
+    if (mNextChunkNum != chunkNum) {
+        if (mNextChunkNum >= 0) {
+            DiscardNextChunk();
+        }
+        // Locating the chunk, and getting its size overlaps with the
+        // current chunk reads in flight, and happens without the client
+        // mutex held: one of the subsequent updates sends the requests.
+        if (! LocateNextChunk(fd, chunkNum)) {
+            return;
+        }
+    }
+    const ChunkAttr& chunk = entry.cattr[chunkNum];
+    if (chunk.chunkId <= 0) {
+        DiscardNextChunk();
+        return;
+    }
+    while (sendFlag && queued < mWindow &&
+            mNextIssueOffset < mNextChunkSize) {
+        const size_t size = min(size_t(kMaxReadRequest),
+            size_t(mNextChunkSize - mNextIssueOffset));
+        if (! Issue(mNextSocket.get(), chunk, mNextIssueOffset, size,
+                mNextQueue)) {
+            DiscardNextChunk();
+            return;
+        }
+        mNextIssueOffset += size;
+        queued           += size;
+    }
+}
+
+bool
+PendingChunkRead::LocateNextChunk(int fd, int chunkNum)
+{
+    if (mLocateId >= 0 && mLocateChunkNum != chunkNum) {
+        CancelLocate();
+    }
+    FileTableEntry& entry = *mImpl.FdInfo(fd);
+    if (! mImpl.mReadAheadLocator) {
+        mImpl.mReadAheadLocator = new KfsReadAheadLocator(
+            mImpl.mMetaServerLoc);
+    }
+    KfsReadAheadLocator& locator = *mImpl.mReadAheadLocator;
+    if (mLocateId < 0) {
+        KfsReadAheadLocator::Request req;
+        req.mFileId   = entry.fattr.fileId;
+        req.mChunkNum = chunkNum;
+        req.mPathName = entry.pathname;
+        req.mHostName = mImpl.mHostname;
+        std::map<int, ChunkAttr>::const_iterator const it =
+            entry.cattr.find(chunkNum);
+        if (it != entry.cattr.end() && it->second.chunkId > 0) {
+            req.mChunk = it->second;
+        } else if (mImpl.mMetaCache.GetChunk(
+                entry.fattr.fileId, chunkNum, req.mChunk)) {
+            entry.cattr[chunkNum] = req.mChunk;
+        }
+        req.mHasLeaseFlag = req.mChunk.chunkId > 0 &&
+            mImpl.mLeaseClerk.IsLeaseValid(req.mChunk.chunkId);
+        mLocateId       = locator.Start(req);
+        mLocateChunkNum = chunkNum;
+        return false;
+    }
+    KfsReadAheadLocator::Result res;
+    if (! locator.Get(mLocateId, res)) {
+        return false;
+    }
+    mLocateId = -1;
+    if (res.mStatus < 0) {
+        KFS_LOG_VA_DEBUG("read ahead: chunk %d set up failed: %d",
+            chunkNum, res.mStatus);
+        return false;
+    }
+    if (res.mLocatedFlag) {
+        mImpl.SetLocatedChunk(entry, chunkNum, res.mChunk);
+    }
+    if (res.mLeaseId >= 0) {
+        mImpl.mLeaseClerk.RegisterLease(res.mChunk.chunkId, res.mLeaseId);
+        mNextChunkId = res.mChunk.chunkId;
+    }
+    mNextChunkNum    = chunkNum;
+    mNextLocation    = res.mLocation;
+    mNextSocket      = res.mSockPtr;
+    mNextChunkSize   = res.mChunk.chunkSize;
+    mNextIssueOffset = 0;
+    // the next chunk requests, and the ops of the file once it gets to
+    // the chunk, share the connection: match their responses
+    mImpl.mConnPool.Add(mNextLocation, mNextSocket);
+    if (entry.cattr[chunkNum].chunkId != res.mChunk.chunkId) {
+        // the layout changed while the locator was running
+        DiscardNextChunk();
+        return false;
+    }
+    return true;
+}
+
+void
+PendingChunkRead::CancelLocate()
+{
+    if (mLocateId >= 0 && mImpl.mReadAheadLocator) {
+        mImpl.mReadAheadLocator->Cancel(mLocateId);
+    }
+    mLocateId = -1;
+}
+
+bool
+PendingChunkRead::AdoptNextChunk(int fd)
+{
+    if (mNextChunkNum < 0) {
+        return false;
+    }
+    FilePosition& pos   = *mImpl.FdPos(fd);
+    ChunkAttr&    chunk = *mImpl.GetCurrChunk(fd);
+    if (mNextChunkNum != pos.chunkNum || mNextQueue.empty() ||
+            mNextQueue.front()->offset != pos.chunkOffset ||
+            mNextQueue.front()->chunkId != chunk.chunkId ||
+            pos.preferredServer || ! mQueue.empty()) {
+        DiscardNextChunk(mNextChunkNum != pos.chunkNum);
+        return false;
+    }
+    vector<ChunkServerConn>::iterator const it = find(
+        pos.chunkServers.begin(), pos.chunkServers.end(), mNextLocation);
+    if (it != pos.chunkServers.end()) {
+        it->sock = mNextSocket;
     } else {
-        mFd = -1;
+        pos.chunkServers.push_back(ChunkServerConn(mNextLocation));
+        pos.chunkServers.back().sock = mNextSocket;
     }
-    KFS_LOG_VA_DEBUG("starting pending read chunk: %d offset: %d size: %d %s",
-        (int)mReadOp.chunkId, (int)mReadOp.offset, (int)mReadOp.numBytes,
-        mFd >= 0 ? "OK" : "failed");
-    return (mFd >= 0);
+    pos.SetPreferredServer(mNextLocation);
+    chunk.chunkSize = mNextChunkSize;
+    mFd          = fd;
+    if (pos.preferredServer) {
+        mSocket = pos.GetPreferredChunkServerSockPtr();
+    } else {
+        mSocket.reset();
+    }
+    mIssueOffset = mNextIssueOffset;
+    mQueue.swap(mNextQueue);
+    if (! mSocket) {
+        Discard(mQueue, mNextSocket.get());
+    }
+    // the lease is now the current chunk's lease, and CloseChunk()
+    // relinquishes it
+    DiscardNextChunk(false);
+    if (! mSocket) {
+        return false;
+    }
+    mImpl.mReadAheadStats.mNextChunkCount++;
+    return true;
 }
 
 ssize_t
 PendingChunkRead::Read(char *buf, size_t numBytes)
 {
-    if (mFd < 0) {
-        return 0;
-    }
-    const bool attachFlag = numBytes >= mReadOp.numBytes;
-    if (attachFlag) {
-        mReadOp.AttachContentBuf(buf, numBytes);
-    }
+    ssize_t total     = 0;
+    off_t   end       = -1;
+    bool    resetFlag = false;
+    while (! mQueue.empty() && ! resetFlag) {
+        ReadOp&      op    = *mQueue.front();
+        const size_t avail = numBytes - total;
+        // return the data of the adjacent requests that fit, in one go
+        if (total > 0 && (op.offset != end || avail < op.numBytes)) {
+            break;
+        }
+        const bool attachFlag = avail >= op.numBytes;
+        if (attachFlag) {
+            op.AttachContentBuf(buf + total, avail);
+        }
 
-    struct timeval readStart, readEnd;
+        struct timeval readStart, readEnd;
 
-    gettimeofday(&readStart, NULL);
+        gettimeofday(&readStart, NULL);
 
-    if (DoOpResponse(&mReadOp, mSocket) < 0 || mReadOp.status < 0 ||
-            ! mImpl.VerifyChecksum(&mReadOp, mSocket)) {
-        if (! attachFlag) {
-            delete [] mReadOp.contentBuf;
+        if (DoOpResponse(&op, mSocket.get(), &mImpl.mConnPool) < 0 ||
+                op.status < 0 || ! mImpl.VerifyChecksum(&op, mSocket.get())) {
+            if (! attachFlag) {
+                delete [] op.contentBuf;
+            }
+            op.ReleaseContentBuf();
+            const int status = op.status < 0 ? op.status : -EAGAIN;
+            mQueue.pop_front();
+            delete &op;
+            mImpl.FdPos(mFd)->ResetServers();
+            return (total > 0 ? total : status);
         }
-        mReadOp.ReleaseContentBuf();
-        mImpl.FdPos(mFd)->ResetServers();
-        mFd = -1;
-        return (mReadOp.status < 0 ? mReadOp.status : -EAGAIN);
-    }
 
-    const ssize_t numRd = min(mReadOp.contentLength, numBytes);
+        const size_t numRd = min(size_t(op.contentLength), avail);
 
-    gettimeofday(&readEnd, NULL);
+        gettimeofday(&readEnd, NULL);
 
-    if (! attachFlag) {
-        memcpy(buf, mReadOp.contentBuf, numRd);
-        delete [] mReadOp.contentBuf;
-    }
-    mReadOp.ReleaseContentBuf();
-    mReadOp.contentLength = 0;
-    KFS_LOG_VA_DEBUG("pending chunk read done chunk: %d offset: %d size: %d ret: %d",
-        (int)mReadOp.chunkId, (int)mReadOp.offset, (int)mReadOp.numBytes,
-        (int)numRd);
+        if (! attachFlag) {
+            memcpy(buf + total, op.contentBuf, numRd);
+            delete [] op.contentBuf;
+        }
+        op.ReleaseContentBuf();
+        KFS_LOG_VA_DEBUG("pending chunk read done chunk: %d offset: %d size: %d ret: %d",
+            (int)op.chunkId, (int)op.offset, (int)op.numBytes, (int)numRd);
+        PendingChunkRead::Stats& stats = mImpl.mReadAheadStats;
+        stats.mHitCount++;
+        stats.mHitByteCount += numRd;
+        if (size_t(op.contentLength) > numRd) {
+            stats.mWasteByteCount += op.contentLength - numRd;
+        }
 
-    double timeSpent = ComputeTimeDiff(readStart, readEnd);
-    FilePosition* pos = mImpl.FdPos(mFd);
+        double timeSpent = ComputeTimeDiff(readStart, readEnd);
+        FilePosition* pos = mImpl.FdPos(mFd);
 
-    if (timeSpent > 5.0) {
-        ostringstream os;
+        if (timeSpent > 5.0) {
+            ostringstream os;
 
 
-        os << pos->GetPreferredServerLocation().ToString().c_str() << ':' 
-           << " c=" << mReadOp.chunkId << " o=" << pos->chunkOffset << " n=" << numBytes
-           << " got=" << numRd << " time=" << timeSpent;
-        KFS_LOG_VA_INFO("Read done from %s", os.str().c_str());
+            os << pos->GetPreferredServerLocation().ToString().c_str() << ':' 
+               << " c=" << op.chunkId << " o=" << op.offset << " n=" << op.numBytes
+               << " got=" << numRd << " time=" << timeSpent;
+            KFS_LOG_VA_INFO("Read done from %s", os.str().c_str());
+
+            struct sockaddr_in saddr;
+            if (pos->GetPreferredServerAddr(saddr) == 0) {
+                mImpl.GetTelemetryReporter().publish(saddr.sin_addr, timeSpent, "READ_DRIVE", op.drivename,
+                                                     1, (double *) &op.diskIOTime, &timeSpent);
+            }
+            
+            if (timeSpent > 30.0) {
+                // the server is really overloaded or there is a network
+                // issue in getting data from the server.  In either case,
+                // reset the connection and try next read using a
+                // different socket 
+                KFS_LOG_VA_INFO("Read from %s took way too long (%.2lf secs) ; resetting connections",
+                                pos->GetPreferredServerLocation().ToString().c_str(), timeSpent);
+                resetFlag = true;
+            }
 
-        struct sockaddr_in saddr;
-        if (pos->GetPreferredServerAddr(saddr) == 0) {
-            mImpl.GetTelemetryReporter().publish(saddr.sin_addr, timeSpent, "READ_DRIVE", mReadOp.drivename,
-                                                 1, (double *) &mReadOp.diskIOTime, &timeSpent);
         }
-        
-        if (timeSpent > 30.0) {
-            // the server is really overloaded or there is a network
-            // issue in getting data from the server.  In either case,
-            // reset the connection and try next read using a
-            // different socket 
-            KFS_LOG_VA_INFO("Read from %s took way too long (%.2lf secs) ; resetting connections",
-                            pos->GetPreferredServerLocation().ToString().c_str(), timeSpent);
-            pos->ResetServers();
+        const bool shortFlag = numRd < op.numBytes;
+        end = op.offset + op.numBytes;
+        mQueue.pop_front();
+        delete &op;
+        total += numRd;
+        if (shortFlag) {
+            break;
         }
-
     }
-    mFd = -1;
-
-    return numRd;
+    if (resetFlag) {
+        mImpl.FdPos(mFd)->ResetServers();
+    }
+    return total;
 }
 
 ssize_t
@@ -644,7 +985,7 @@ KfsClientImpl::ReadFromServer(int fd, char *buf, size_t numBytes)
             return -EAGAIN;
         } else if ((res = pos->pendingChunkRead->Read(buf, numBytes)) != 0) {
             if (res > 0) {
-                pos->pendingChunkRead->Start(fd, res);
+                pos->pendingChunkRead->Update(fd, res);
             }
             return res;
         }
@@ -661,7 +1002,7 @@ KfsClientImpl::ReadFromServer(int fd, char *buf, size_t numBytes)
 
     if (pos->pendingChunkRead) {
         if (res > 0) {
-            pos->pendingChunkRead->Start(fd, res);
+            pos->pendingChunkRead->Update(fd, res);
         } else {
             pos->pendingChunkRead->Reset();
         }
@@ -688,8 +1029,13 @@ KfsClientImpl::DoSmallReadFromServer(int fd, char *buf, size_t numBytes)
     // make sure we aren't overflowing...
     assert(buf + op.numBytes <= buf + numBytes);
 
-    (void)DoOpCommon(&op, mFileTable[fd]->currPos.preferredServer);
-    VerifyChecksum(&op, mFileTable[fd]->currPos.preferredServer);
+    TcpSocket *sock = mFileTable[fd]->currPos.preferredServer;
+    if (DoOpSend(&op, sock, &mConnPool) >= 0) {
+        vector<ReadOp *> ops(1, &op);
+        sock = HedgeRead(fd, ops, 1, sock);
+        DoOpResponse(&op, sock, &mConnPool);
+    }
+    VerifyChecksum(&op, sock);
     ssize_t numIO = (op.status >= 0) ? op.contentLength : op.status;
     op.ReleaseContentBuf();
 
@@ -894,6 +1240,20 @@ KfsClientImpl::DoLargeReadFromServer(int fd, char *buf, size_t numBytes)
     return numIO;
 }
 
+///
+/// The sequence numbers of the ops [first, next) that were sent, and whose
+/// responses were not received.
+///
+static vector<kfsSeq_t>
+InFlightSeqs(const vector<ReadOp *> &ops, size_t first, size_t next)
+{
+    vector<kfsSeq_t> seqs;
+    for (size_t i = first; i < next; i++) {
+        seqs.push_back(ops[i]->seq);
+    }
+    return seqs;
+}
+
 ///
 /// Common work for a read op that can be pipelined.
 /// The idea is to plumb the pipe with a set of requests; then,
@@ -921,20 +1281,26 @@ KfsClientImpl::DoPipelinedRead(int fd, vector<ReadOp *> &ops, TcpSocket *sock)
 
         gettimeofday(&op->submitTime, NULL);
 
-	res = DoOpSend(op, sock);
-	if (res < 0)
+	res = DoOpSend(op, sock, &mConnPool);
+	if (res < 0) {
+            CancelOps(sock, InFlightSeqs(ops, first, next));
 	    return -1;
+        }
     }
 
+    sock = HedgeRead(fd, ops, next, sock);
+
     // run the pipe: whenever one op finishes, queue another
     while (next < ops.size()) {
         struct timeval now;
 
 	op = ops[first];
 
-	res = DoOpResponse(op, sock);
-	if (res < 0)
+	res = DoOpResponse(op, sock, &mConnPool);
+	if (res < 0) {
+            CancelOps(sock, InFlightSeqs(ops, first, next));
 	    return -1;
+        }
 
         gettimeofday(&now, NULL);
 
@@ -946,9 +1312,11 @@ KfsClientImpl::DoPipelinedRead(int fd, vector<ReadOp *> &ops, TcpSocket *sock)
 
         gettimeofday(&op->submitTime, NULL);
 
-	res = DoOpSend(op, sock);
-	if (res < 0)
+	res = DoOpSend(op, sock, &mConnPool);
+	if (res < 0) {
+            CancelOps(sock, InFlightSeqs(ops, first, next));
 	    return -1;
+        }
 	++next;
     }
 
@@ -957,9 +1325,11 @@ KfsClientImpl::DoPipelinedRead(int fd, vector<ReadOp *> &ops, TcpSocket *sock)
         struct timeval now;
 	op = ops[first];
 
-	res = DoOpResponse(op, sock);
-	if (res < 0)
+	res = DoOpResponse(op, sock, &mConnPool);
+	if (res < 0) {
+            CancelOps(sock, InFlightSeqs(ops, first, next));
 	    return -1;
+        }
 
         gettimeofday(&now, NULL);
 
@@ -984,6 +1354,238 @@ KfsClientImpl::DoPipelinedRead(int fd, vector<ReadOp *> &ops, TcpSocket *sock)
     return 0;
 }
 
+TcpSocket *
+KfsClientImpl::HedgeRead(int fd, vector<ReadOp *> &ops, size_t count, TcpSocket *sock)
+{
+    if (! mReadHedgeTracker.IsEnabled() || count <= 0 ||
+            sock == NULL || ! sock->IsGood())
+        return sock;
+
+    const int64_t start = TimeNowMs();
+    TcpSocket *socks[2] = { sock, NULL };
+    kfsSeq_t waitSeqs[2] = { ops[0]->seq, -1 };
+    int res = WaitForResponse(socks, waitSeqs, 1, mReadHedgeTracker.GetDelayMs());
+    if (res != -1) {
+        // got the response, or an error which the response path handles
+        if (res >= 0)
+            mReadHedgeTracker.Update((int) (TimeNowMs() - start));
+        return sock;
+    }
+
+    // the server is slow: pick another replica
+    FilePosition *pos = FdPos(fd);
+    ChunkAttr *chunk = GetCurrChunk(fd);
+    const ServerLocation primaryLoc = pos->GetPreferredServerLocation();
+    vector<ServerLocation> loc;
+
+    for (vector<ServerLocation>::size_type i = 0; i < chunk->chunkServerLoc.size(); i++) {
+        if (! (chunk->chunkServerLoc[i] == primaryLoc))
+            loc.push_back(chunk->chunkServerLoc[i]);
+    }
+    random_shuffle(loc.begin(), loc.end());
+
+    TcpSocket *alt = NULL;
+    vector<ServerLocation>::size_type altIdx = 0;
+    for (; alt == NULL && altIdx < loc.size(); altIdx++) {
+        alt = pos->GetChunkServerSocket(loc[altIdx], true);
+    }
+    if (alt == NULL)
+        return sock;
+    const ServerLocation altLoc = loc[altIdx - 1];
+
+    // re-send the ops with new sequence numbers; the primary's responses
+    // carry the original ones.
+    vector<kfsSeq_t> seqs(count);
+    size_t i;
+    for (i = 0; i < count; i++) {
+        seqs[i] = ops[i]->seq;
+        ops[i]->seq = nextSeq();
+        if (DoOpSend(ops[i], alt, &mConnPool) < 0) {
+            ops[i]->status = 0;
+            break;
+        }
+    }
+    if (i < count) {
+        // The send failed part way: the replica can still respond to the
+        // ops sent so far. Drop their responses, or close the connection.
+        vector<kfsSeq_t> sent;
+        for (size_t k = 0; k <= i; k++) {
+            sent.push_back(ops[k]->seq);
+        }
+        for (i = 0; i < count; i++) {
+            ops[i]->seq = seqs[i];
+        }
+        CancelOps(alt, sent);
+        return sock;
+    }
+
+    mReadHedgeTracker.Issued();
+    KFS_LOG_VA_DEBUG("Hedging read of chunk %lld: %s didn't respond in %d ms; sent %d ops to %s",
+                     chunk->chunkId, primaryLoc.ToString().c_str(),
+                     mReadHedgeTracker.GetDelayMs(), (int) count,
+                     altLoc.ToString().c_str());
+
+    socks[1] = alt;
+    waitSeqs[0] = seqs[0];
+    waitSeqs[1] = ops[0]->seq;
+    res = WaitForResponse(socks, waitSeqs, 2, gDefaultTimeout.tv_sec * 1000);
+    if (res >= 0)
+        mReadHedgeTracker.Update((int) (TimeNowMs() - start));
+
+    if (res == 1) {
+        // the other replica won: cancel the requests to the slow server,
+        // and stick with the faster one.
+        mReadHedgeTracker.Won();
+        KFS_LOG_VA_INFO("Hedged read of chunk %lld: %s responded before %s",
+                        chunk->chunkId, altLoc.ToString().c_str(),
+                        primaryLoc.ToString().c_str());
+        CancelOps(sock, seqs);
+        pos->SetPreferredServer(altLoc);
+        return pos->GetPreferredServer();
+    }
+    for (i = 0; i < count; i++) {
+        const kfsSeq_t seq = ops[i]->seq;
+        ops[i]->seq = seqs[i];
+        seqs[i] = seq;
+    }
+    CancelOps(alt, seqs);
+    return sock;
+}
+
+int
+KfsClientImpl::WaitForResponse(TcpSocket **socks, const kfsSeq_t *seqs,
+    int count, int timeoutMs)
+{
+    const int64_t deadline = TimeNowMs() + timeoutMs;
+    struct pollfd pfd[2];
+
+    assert(count > 0 && count <= 2);
+    for (; ;) {
+        for (int i = 0; i < count; i++) {
+            // DoOpResponse() of another file could have kept it already
+            if (mConnPool.HasResponse(socks[i], seqs[i]))
+                return i;
+        }
+        const int64_t now = TimeNowMs();
+        if (now >= deadline)
+            return -1;
+        for (int i = 0; i < count; i++) {
+            pfd[i].fd = socks[i]->GetFd();
+            pfd[i].events = POLLIN;
+            pfd[i].revents = 0;
+        }
+        const int res = poll(pfd, count, (int) (deadline - now));
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res == 0)
+            return -1;
+        if (res < 0)
+            return -2;
+        for (int i = 0; i < count; i++) {
+            if (pfd[i].revents == 0)
+                continue;
+            // a connection that is not shared has only this file's ops
+            // in flight: take the first response as the op's
+            if (! mConnPool.IsExpected(socks[i], seqs[i]))
+                return i;
+            // the shared connection can carry the responses of other ops
+            // first: keep them, and wait for the op's own
+            const int ret = ReceiveResponse(socks[i], &mConnPool, seqs[i]);
+            if (ret > 0)
+                return i;
+            if (ret < 0)
+                return -2;
+        }
+    }
+}
+
+void
+KfsClientImpl::CancelOps(TcpSocket *sock, const vector<kfsSeq_t> &seqs)
+{
+    // the pooled connection is shared: drop the responses when they
+    // arrive; close the connection otherwise
+    if (! sock)
+        return;
+    for (vector<kfsSeq_t>::const_iterator it = seqs.begin(); it != seqs.end(); ++it) {
+        if (! mConnPool.Abandon(sock, *it)) {
+            sock->Close();
+            break;
+        }
+    }
+}
+
+void
+KfsClientImpl::SetReadHedging(int percentile, int minDelayMs, int maxDelayMs)
+{
+    MutexLock l(&mMutex);
+    mReadHedgeTracker.SetParameters(percentile, minDelayMs, maxDelayMs);
+}
+
+void
+KfsClientImpl::GetReadHedgingStats(int64_t &issued, int64_t &won)
+{
+    MutexLock l(&mMutex);
+    issued = mReadHedgeTracker.GetIssuedCount();
+    won = mReadHedgeTracker.GetWonCount();
+}
+
+void
+KfsClientImpl::GetReadAheadStats(PendingChunkRead::Stats& stats)
+{
+    MutexLock l(&mMutex);
+    stats = mReadAheadStats;
+}
+
+ReadHedgeTracker::ReadHedgeTracker()
+    : mPercentile(0),
+      mMinDelayMs(0),
+      mMaxDelayMs(0),
+      mDelayMs(0),
+      mSamples(),
+      mNextSample(0),
+      mSamplesSinceUpdate(0),
+      mIssuedCount(0),
+      mWonCount(0)
+{
+}
+
+void
+ReadHedgeTracker::SetParameters(int percentile, int minDelayMs, int maxDelayMs)
+{
+    mPercentile = max(0, min(100, percentile));
+    mMinDelayMs = max(0, minDelayMs);
+    mMaxDelayMs = max(mMinDelayMs, maxDelayMs);
+    ComputeDelay();
+}
+
+void
+ReadHedgeTracker::Update(int responseTimeMs)
+{
+    if (mSamples.size() < kMaxSamples) {
+        mSamples.push_back(responseTimeMs);
+    } else {
+        mSamples[mNextSample] = responseTimeMs;
+        mNextSample = (mNextSample + 1) % kMaxSamples;
+    }
+    if (++mSamplesSinceUpdate >= kUpdateInterval)
+        ComputeDelay();
+}
+
+void
+ReadHedgeTracker::ComputeDelay()
+{
+    mSamplesSinceUpdate = 0;
+    if (mSamples.size() < kMinSamples) {
+        mDelayMs = mMaxDelayMs;
+        return;
+    }
+    vector<int> sorted(mSamples);
+    const vector<int>::iterator it = sorted.begin() +
+        min(sorted.size() - 1, sorted.size() * mPercentile / 100);
+    nth_element(sorted.begin(), it, sorted.end());
+    mDelayMs = max(mMinDelayMs, min(mMaxDelayMs, *it));
+}
+
 bool
 KfsClientImpl::VerifyChecksum(ReadOp* op, TcpSocket* sock)
 {
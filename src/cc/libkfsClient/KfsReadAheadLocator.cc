@@ -0,0 +1,269 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Read ahead next chunk set up: locate, lease, connect, and size
+// the next chunk in the background.
+//
+//----------------------------------------------------------------------------
+
+#include "KfsReadAheadLocator.h"
+#include "KfsClientInt.h"
+#include "qcdio/qcstutils.h"
+#include "common/log.h"
+
+#include <stdlib.h>
+
+namespace KFS {
+
+using std::vector;
+
+static int
+GetStatus(KfsOp& inOp, TcpSocket* inSockPtr)
+{
+    if (! inSockPtr) {
+        return -EHOSTUNREACH;
+    }
+    const int theRet = DoOpCommon(&inOp, inSockPtr);
+    return (inOp.status < 0 ? inOp.status : (theRet < 0 ? -EHOSTUNREACH : 0));
+}
+
+KfsReadAheadLocator::KfsReadAheadLocator(
+    const ServerLocation& inMetaServer)
+    : QCRunnable(),
+      mMetaServer(inMetaServer),
+      mMetaSock(),
+      mSeq(1),
+      mNextId(0),
+      mStopFlag(false),
+      mEntries(),
+      mQueue(),
+      mThread(),
+      mMutex(),
+      mWorkCond()
+{
+    const int kStackSize = 128 << 10;
+    mThread.Start(this, kStackSize);
+}
+
+KfsReadAheadLocator::~KfsReadAheadLocator()
+{
+    KfsReadAheadLocator::Stop();
+}
+
+    void
+KfsReadAheadLocator::Stop()
+{
+    QCStMutexLocker theLock(mMutex);
+    mStopFlag = true;
+    mWorkCond.Notify();
+    theLock.Unlock();
+    mThread.Join();
+}
+
+    int64_t
+KfsReadAheadLocator::Start(
+    const Request& inRequest)
+{
+    QCStMutexLocker theLock(mMutex);
+    if (mStopFlag) {
+        return -1;
+    }
+    const int64_t theId = mNextId++;
+    mEntries[theId].mRequest = inRequest;
+    mQueue.push_back(theId);
+    mWorkCond.Notify();
+    return theId;
+}
+
+    bool
+KfsReadAheadLocator::Get(
+    int64_t inId,
+    Result& outResult)
+{
+    QCStMutexLocker theLock(mMutex);
+    Entries::iterator const theIt = mEntries.find(inId);
+    if (theIt == mEntries.end() || theIt->second.mState != kStateDone) {
+        return false;
+    }
+    outResult = theIt->second.mResult;
+    mEntries.erase(theIt);
+    return true;
+}
+
+    void
+KfsReadAheadLocator::Cancel(
+    int64_t inId)
+{
+    QCStMutexLocker theLock(mMutex);
+    Entries::iterator const theIt = mEntries.find(inId);
+    if (theIt == mEntries.end()) {
+        return;
+    }
+    Entry& theEntry = theIt->second;
+    switch (theEntry.mState) {
+        case kStateRunning:
+            // Run() relinquishes the lease, if any, once done.
+            theEntry.mState = kStateCancelled;
+            break;
+        case kStateDone:
+            if (theEntry.mResult.mLeaseId >= 0) {
+                theEntry.mState = kStateCancelled;
+                mQueue.push_back(inId);
+                mWorkCond.Notify();
+                break;
+            }
+            // Fall through.
+        default:
+            // Run() skips the queued ids that are no longer there.
+            mEntries.erase(theIt);
+            break;
+    }
+}
+
+    /* virtual */ void
+KfsReadAheadLocator::Run()
+{
+    QCStMutexLocker theLock(mMutex);
+    while (! mStopFlag) {
+        if (mQueue.empty()) {
+            mWorkCond.Wait(mMutex);
+            continue;
+        }
+        const int64_t theId = mQueue.front();
+        mQueue.pop_front();
+        Entries::iterator theIt = mEntries.find(theId);
+        if (theIt == mEntries.end()) {
+            continue;
+        }
+        Result theResult;
+        if (theIt->second.mState == kStateCancelled) {
+            theResult = theIt->second.mResult;
+            mEntries.erase(theIt);
+            QCStMutexUnlocker theUnlocker(mMutex);
+            Relinquish(theResult);
+            continue;
+        }
+        theIt->second.mState = kStateRunning;
+        const Request theRequest = theIt->second.mRequest;
+        {
+            QCStMutexUnlocker theUnlocker(mMutex);
+            Locate(theRequest, theResult);
+        }
+        // Cancel() does not erase the running entry.
+        theIt = mEntries.find(theId);
+        if (theIt->second.mState == kStateCancelled) {
+            mEntries.erase(theIt);
+            QCStMutexUnlocker theUnlocker(mMutex);
+            Relinquish(theResult);
+            continue;
+        }
+        theIt->second.mResult = theResult;
+        theIt->second.mState  = kStateDone;
+    }
+}
+
+    TcpSocket*
+KfsReadAheadLocator::GetMetaServerSocket()
+{
+    if (! mMetaSock.IsGood()) {
+        mMetaSock.Connect(mMetaServer);
+    }
+    return (mMetaSock.IsGood() ? &mMetaSock : 0);
+}
+
+    void
+KfsReadAheadLocator::Locate(
+    const Request& inRequest,
+    Result&        outResult)
+{
+    outResult.mChunk = inRequest.mChunk;
+    ChunkAttr& theChunk = outResult.mChunk;
+    if (theChunk.chunkId <= 0) {
+        GetAllocOp theOp(mSeq++, inRequest.mFileId,
+            (off_t)inRequest.mChunkNum * (off_t)CHUNKSIZE);
+        theOp.filename = inRequest.mPathName;
+        outResult.mStatus = GetStatus(theOp, GetMetaServerSocket());
+        if (outResult.mStatus < 0) {
+            return;
+        }
+        theChunk.chunkId        = theOp.chunkId;
+        theChunk.chunkVersion   = theOp.chunkVersion;
+        theChunk.chunkServerLoc = theOp.chunkServers;
+        outResult.mLocatedFlag  = true;
+    }
+    if (theChunk.chunkId <= 0 || theChunk.chunkServerLoc.empty()) {
+        outResult.mStatus = -EHOSTUNREACH;
+        return;
+    }
+    // prefer the local server, pick one at random otherwise
+    vector<ServerLocation>::const_iterator theLocIt;
+    for (theLocIt = theChunk.chunkServerLoc.begin();
+            theLocIt != theChunk.chunkServerLoc.end() &&
+                theLocIt->hostname != inRequest.mHostName;
+            ++theLocIt)
+        {}
+    if (theLocIt == theChunk.chunkServerLoc.end()) {
+        theLocIt = theChunk.chunkServerLoc.begin() +
+            rand() % theChunk.chunkServerLoc.size();
+    }
+    outResult.mLocation = *theLocIt;
+    if (! inRequest.mHasLeaseFlag) {
+        LeaseAcquireOp theOp(mSeq++, theChunk.chunkId,
+            inRequest.mPathName.c_str());
+        outResult.mStatus = GetStatus(theOp, GetMetaServerSocket());
+        if (outResult.mStatus < 0) {
+            KFS_LOG_VA_DEBUG("read ahead: lease chunk %lld failed: %d",
+                theChunk.chunkId, outResult.mStatus);
+            return;
+        }
+        outResult.mLeaseId = theOp.leaseId;
+    }
+    outResult.mSockPtr = KfsConnPool::Connect(outResult.mLocation, false);
+    SizeOp theOp(mSeq++, theChunk.chunkId, theChunk.chunkVersion);
+    theOp.size = 0;
+    outResult.mStatus = outResult.mSockPtr->IsGood() ?
+        GetStatus(theOp, outResult.mSockPtr.get()) : -EHOSTUNREACH;
+    if (outResult.mStatus < 0) {
+        KFS_LOG_VA_DEBUG("read ahead: size chunk %lld failed: %d",
+            theChunk.chunkId, outResult.mStatus);
+        Relinquish(outResult);
+        return;
+    }
+    theChunk.chunkSize = theOp.size;
+}
+
+    void
+KfsReadAheadLocator::Relinquish(
+    Result& ioResult)
+{
+    ioResult.mSockPtr.reset();
+    if (ioResult.mLeaseId < 0) {
+        return;
+    }
+    // the reader might never get to the chunk: do not hold the lease,
+    // and make the writers wait for it to expire
+    LeaseRelinquishOp theOp(mSeq++, ioResult.mChunk.chunkId,
+        ioResult.mLeaseId);
+    (void)GetStatus(theOp, GetMetaServerSocket());
+    ioResult.mLeaseId = -1;
+}
+
+} /* namespace KFS */
@@ -0,0 +1,159 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Read ahead next chunk set up: locate, lease, connect, and size
+// the next chunk in the background.
+//
+//----------------------------------------------------------------------------
+
+#ifndef KFS_READ_AHEAD_LOCATOR_H
+#define KFS_READ_AHEAD_LOCATOR_H
+
+#include "common/kfstypes.h"
+#include "common/kfsdecls.h"
+#include "libkfsIO/TcpSocket.h"
+#include "qcdio/qcthread.h"
+#include "qcdio/qcmutex.h"
+#include "KfsAttr.h"
+
+#include <string>
+#include <deque>
+#include <map>
+
+namespace KFS {
+
+///
+/// The read ahead hands the set up of the next chunk to the locator
+/// thread, instead of doing the meta and chunk server round trips with
+/// the client mutex held. The thread locates the chunk, unless its
+/// layout is known, acquires the read lease, unless the client has a
+/// valid one, connects to the chunk server, and gets the chunk size.
+/// It uses its own meta server connection, and never acquires the client
+/// mutex. The read ahead polls for the result with Get(), and sends the
+/// next chunk requests once it is there.
+/// A request that is cancelled after the lease was acquired has its
+/// lease relinquished by the thread.
+///
+class KfsReadAheadLocator : public QCRunnable
+{
+public:
+    struct Request
+    {
+        Request()
+            : mFileId(-1),
+              mChunkNum(-1),
+              mPathName(),
+              mHostName(),
+              mChunk(),
+              mHasLeaseFlag(false)
+            {}
+        kfsFileId_t mFileId;
+        int         mChunkNum;
+        std::string mPathName;
+        std::string mHostName;     // prefer the chunk server on this host
+        ChunkAttr   mChunk;        // chunk id <= 0 -- locate the chunk
+        bool        mHasLeaseFlag;
+    };
+    struct Result
+    {
+        Result()
+            : mStatus(0),
+              mLocatedFlag(false),
+              mChunk(),
+              mLeaseId(-1),
+              mLocation(),
+              mSockPtr()
+            {}
+        int            mStatus;
+        bool           mLocatedFlag; // mChunk came from the meta server
+        ChunkAttr      mChunk;       // chunkSize is set
+        int64_t        mLeaseId;     // -1 -- no lease acquired
+        ServerLocation mLocation;
+        TcpSocketPtr   mSockPtr;     // not pooled yet: the pool isn't
+                                     // thread safe
+    };
+
+    KfsReadAheadLocator(
+        const ServerLocation& inMetaServer);
+    ~KfsReadAheadLocator();
+    /// @retval the request id, or -1 if the thread is stopped.
+    int64_t Start(
+        const Request& inRequest);
+    /// @retval true if the request is done, and outResult is set; the
+    /// request is then forgotten.
+    bool Get(
+        int64_t inId,
+        Result& outResult);
+    /// Forget the request, done or not.
+    void Cancel(
+        int64_t inId);
+    void Stop();
+    virtual void Run();
+
+private:
+    enum State
+    {
+        kStateQueued,
+        kStateRunning,
+        kStateDone,
+        kStateCancelled
+    };
+    struct Entry
+    {
+        Entry()
+            : mRequest(),
+              mResult(),
+              mState(kStateQueued)
+            {}
+        Request mRequest;
+        Result  mResult;
+        State   mState;
+    };
+    typedef std::map<int64_t, Entry> Entries;
+    typedef std::deque<int64_t>      Queue;
+
+    const ServerLocation mMetaServer;
+    TcpSocket            mMetaSock;
+    kfsSeq_t             mSeq;
+    int64_t              mNextId;
+    bool                 mStopFlag;
+    Entries              mEntries;
+    Queue                mQueue;
+    QCThread             mThread;
+    QCMutex              mMutex;
+    QCCondVar            mWorkCond;
+
+    TcpSocket* GetMetaServerSocket();
+    void Locate(
+        const Request& inRequest,
+        Result&        outResult);
+    void Relinquish(
+        Result& ioResult);
+private:
+    KfsReadAheadLocator(
+        const KfsReadAheadLocator& inLocator);
+    KfsReadAheadLocator& operator=(
+        const KfsReadAheadLocator& inLocator);
+};
+
+} /* namespace KFS */
+
+#endif /* KFS_READ_AHEAD_LOCATOR_H */
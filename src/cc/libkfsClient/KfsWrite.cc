@@ -111,6 +111,18 @@ KfsClientImpl::AtomicRecordAppend(int fd, const char *buf, int reclen)
     return AtomicRecordAppend(fd, buf, reclen, lock);
 }
 
+int
+KfsClientImpl::SetRecordAppendBlocks(int blockSize, bool compressFlag)
+{
+    MutexLock lock(&mMutex);
+    if (mProtocolWorker) {
+        return -EBUSY;
+    }
+    mRecordAppendBlockSize         = max(0, blockSize);
+    mRecordAppendBlockCompressFlag = compressFlag;
+    return 0;
+}
+
 int
 KfsClientImpl::AtomicRecordAppend(int fd, const char *buf, int reclen, MutexLock& lock)
 {
@@ -133,6 +145,8 @@ KfsClientImpl::AtomicRecordAppend(int fd, const char *buf, int reclen, MutexLock
     if (! mProtocolWorker) {
         mProtocolWorker = new KfsProtocolWorker(
             mMetaServerLoc.hostname, mMetaServerLoc.port);
+        mProtocolWorker->SetRecordBlocks(
+            mRecordAppendBlockSize, mRecordAppendBlockCompressFlag);
         mProtocolWorker->Start();
     }
 
@@ -227,7 +241,10 @@ KfsClientImpl::WriteAsync(int fd, const char *buf, size_t numBytes)
         ChunkAttr *chunk = GetCurrChunk(fd);
         size_t nbytes = min(numBytes - ndone, (size_t) (CHUNKSIZE - pos->chunkOffset));
 
-        TcpSocketPtr sockPtr = pos->GetPreferredChunkServerSockPtr();
+        // the async writer does not hold the client mutex: do not share
+        // the pooled connection
+        TcpSocketPtr sockPtr = KfsConnPool::Connect(
+            pos->GetPreferredServerLocation(), false);
         AsyncWriteReq *asyncWriteReq = new AsyncWriteReq(fd, sockPtr, nextSeq(),
                                                          chunk->chunkId, chunk->chunkVersion,
                                                          pos->chunkOffset,
@@ -313,6 +330,14 @@ KfsClientImpl::Write(int fd, const char *buf, size_t numBytes)
     if ((mFileTable[fd]->openMode & O_APPEND) != 0) {
         return AtomicRecordAppend(fd, buf, numBytes, l);
     }
+    // With write behind the allocation and the writes are done by the
+    // write behind threads; report their error, if any.
+    const bool writeBehind = IsWriteBehind(fd);
+    if (writeBehind && mWriteBehind) {
+        const int status = mWriteBehind->GetError(mFileTable[fd]->instance);
+        if (status < 0)
+            return status;
+    }
     //
     // Loop thru chunk after chunk until we write the desired #
     // of bytes.
@@ -326,12 +351,12 @@ KfsClientImpl::Write(int fd, const char *buf, size_t numBytes)
 	// LocateChunk(fd, pos->chunkNum);
 
 	// need to retry here...
-	if ((numIO = DoAllocation(fd)) < 0) {
+	if (! writeBehind && (numIO = DoAllocation(fd)) < 0) {
 	    // allocation failed...bail
 	    break;
 	}
 
-	if (pos->preferredServer == NULL) {
+	if (! writeBehind && pos->preferredServer == NULL) {
 	    numIO = OpenChunk(fd);
 	    if (numIO < 0) {
 		// KFS_LOG_VA_DEBUG("OpenChunk(%lld)", numIO);
@@ -339,7 +364,7 @@ KfsClientImpl::Write(int fd, const char *buf, size_t numBytes)
 	    }
 	}
 
-	if (nleft < cb->bufsz || cb->dirty) {
+	if (writeBehind || nleft < cb->bufsz || cb->dirty) {
 	    // either the write is small or there is some dirty
 	    // data...so, aggregate as much as possible and then it'll
 	    // get flushed
@@ -367,6 +392,13 @@ KfsClientImpl::Write(int fd, const char *buf, size_t numBytes)
 	    // KFS_LOG_VA_DEBUG("Seek(%lld)", numIO);
 	    break;
 	}
+	if (writeBehind) {
+	    fa->fileSize = max(fa->fileSize, pos->fileOffset);
+	    // hand off the full buffer now, instead of with the next write
+	    if (cb->dirty && cb->length >= cb->bufsz &&
+		    (numIO = WriteBehindBuffer(fd)) < 0)
+		break;
+	}
     }
 
     if (nwrote == 0 && numIO < 0)
@@ -375,7 +407,7 @@ KfsClientImpl::Write(int fd, const char *buf, size_t numBytes)
     if (nwrote != numBytes) {
 	KFS_LOG_VA_DEBUG("----Write done: asked: %llu, got: %llu-----",
 			  numBytes, nwrote);
-    } else if (cb->dirty &&
+    } else if (! writeBehind && cb->dirty &&
             cb->length >= max(
                 CHECKSUM_BLOCKSIZE + GetChecksumBlockTailSize(cb->start),
                 min(cb->bufsz >> 1, size_t(1) << 20))) {
@@ -405,8 +437,6 @@ KfsClientImpl::WriteToBuffer(int fd, const char *buf, size_t numBytes)
 	    return status;
     }
 
-    cb->allocate();
-
     off_t start = pos->chunkOffset - cb->start;
     size_t previous = cb->length;
     if (cb->dirty && ((start != (off_t) previous) ||
@@ -416,6 +446,10 @@ KfsClientImpl::WriteToBuffer(int fd, const char *buf, size_t numBytes)
 	    return status;
     }
 
+    // Allocate only after the flushes: with write behind, a flush hands
+    // the buffer off to the write behind thread.
+    cb->allocate();
+
     if (!cb->dirty) {
 	cb->chunkno = pos->chunkNum;
 	cb->start = pos->chunkOffset;
@@ -456,6 +490,9 @@ KfsClientImpl::WriteToBuffer(int fd, const char *buf, size_t numBytes)
 ssize_t
 KfsClientImpl::FlushBuffer(int fd, bool flushOnlyIfHasFullChecksumBlock)
 {
+    if (IsWriteBehind(fd))
+        return WriteBehindBuffer(fd);
+
     ssize_t numIO = 0;
     size_t extra = 0;
     ChunkBuffer *cb = FdBuffer(fd);
@@ -477,6 +514,58 @@ KfsClientImpl::FlushBuffer(int fd, bool flushOnlyIfHasFullChecksumBlock)
     return numIO;
 }
 
+bool
+KfsClientImpl::IsWriteBehind(int fd) const
+{
+    const FileTableEntry& entry = *mFileTable[fd];
+    return (entry.writeBehind > 0 && entry.buffer.bufsz > 0 &&
+        entry.openMode != O_RDONLY && (entry.openMode & O_APPEND) == 0 &&
+        ! entry.fattr.isDirectory);
+}
+
+ssize_t
+KfsClientImpl::WriteBehindBuffer(int fd)
+{
+    FileTableEntry& entry = *mFileTable[fd];
+    ChunkBuffer& cb = entry.buffer;
+
+    if (! cb.dirty || cb.length <= 0)
+        return 0;
+    if (! mWriteBehind) {
+        mWriteBehind = new KfsWriteBehind(
+            mMetaServerLoc, WRITE_BEHIND_THREADS, mMaxNumRetriesPerOp);
+    }
+    // The write behind thread owns the buffer from now on, the next
+    // write allocates a new one.
+    char* const  buf    = cb.buf;
+    const size_t len    = cb.length;
+    const off_t  offset = (off_t)cb.chunkno * (off_t)KFS::CHUNKSIZE + cb.start;
+    cb.buf = 0;
+    cb.invalidate();
+    const int status = mWriteBehind->Enqueue(entry.instance,
+        entry.fattr.fileId, entry.pathname, offset, buf, len,
+        entry.writeBehind);
+    return (status < 0 ? status : (ssize_t)len);
+}
+
+int
+KfsClientImpl::SyncWriteBehind(int fd, bool resetError)
+{
+    const ssize_t res = WriteBehindBuffer(fd);
+    if (! mWriteBehind)
+        return 0;
+    const int status = mWriteBehind->Sync(mFileTable[fd]->instance, resetError);
+    KFS_LOG_STREAM_DEBUG <<
+        "write behind sync: " << mFileTable[fd]->pathname <<
+        " fd: " << fd << " handed off: " << res << " status: " << status <<
+    KFS_LOG_EOM;
+    // The write behind threads might have allocated the chunks, and
+    // changed their versions; re-fetch the chunk attributes on access.
+    FdInfo(fd)->cattr.clear();
+    FdPos(fd)->ResetServers();
+    return status;
+}
+
 ssize_t
 KfsClientImpl::WriteToServer(int fd, off_t offset, const char *buf, size_t numBytes)
 {
@@ -754,13 +843,13 @@ KfsClientImpl::AllocateWriteId(int fd, off_t offset, size_t numBytes,
 
     op.isForRecordAppend = isForRecordAppend;
     op.chunkServerLoc = chunk->chunkServerLoc;
-    res = DoOpSend(&op, masterSock);
+    res = DoOpSend(&op, masterSock, &mConnPool);
     if ((res < 0) || (op.status < 0)) {
         if (op.status < 0)
             return op.status;
         return res;
     }
-    res = DoOpResponse(&op, masterSock);
+    res = DoOpResponse(&op, masterSock, &mConnPool);
     if ((res < 0) || (op.status < 0)) {
         if (op.status < 0)
             return op.status;
@@ -795,6 +884,7 @@ KfsClientImpl::PushData(int fd, vector<WritePrepareOp *> &ops,
 
     for (uint32_t i = start; i < last; i++) {        
         numBytes += ops[i]->numBytes;
+        // no reply for a prepare: it is not recorded as in flight
         res = DoOpSend(ops[i], masterSock);
         if (res < 0)
             break;
@@ -813,7 +903,7 @@ KfsClientImpl::SendCommit(int fd, off_t offset, size_t numBytes,
 
     sop.Init(nextSeq(), chunk->chunkId, chunk->chunkVersion, offset, numBytes, checksums, writeId);
 
-    res = DoOpSend(&sop, masterSock);
+    res = DoOpSend(&sop, masterSock, &mConnPool);
 
     if (res < 0)
         return sop.status;
@@ -827,7 +917,7 @@ KfsClientImpl::GetCommitReply(WriteSyncOp &sop, TcpSocket *masterSock)
 {
     int res;
 
-    res = DoOpResponse(&sop, masterSock);
+    res = DoOpResponse(&sop, masterSock, &mConnPool);
 
     if (sop.status != 0)
         KFS_LOG_STREAM_INFO << "sync status: " << sop.status << " offset = " << sop.offset 
@@ -924,7 +1014,7 @@ KfsClientImpl::IssueCommit(int fd, vector<WriteInfo> &writeId, TcpSocket *master
     if (res < 0)
         return sop.status;
 
-    res = DoOpResponse(&sop, masterSock);
+    res = DoOpResponse(&sop, masterSock, &mConnPool);
     if (res < 0)
         return sop.status;
     return sop.status;
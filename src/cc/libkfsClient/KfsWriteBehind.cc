@@ -0,0 +1,616 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Client write behind: write the data handed off by the application
+// to the chunk servers in the background.
+//
+//----------------------------------------------------------------------------
+
+#include "KfsWriteBehind.h"
+#include "KfsClientInt.h"
+#include "qcdio/qcstutils.h"
+#include "qcdio/qcdebug.h"
+#include "common/log.h"
+
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/time.h>
+
+namespace KFS {
+
+using std::string;
+using std::vector;
+using std::istringstream;
+using std::min;
+
+static int64_t
+MicroSecs()
+{
+    struct timeval theTime;
+    gettimeofday(&theTime, 0);
+    return (int64_t(theTime.tv_sec) * 1000 * 1000 + theTime.tv_usec);
+}
+
+static int
+GetStatus(KfsOp& inOp, TcpSocket* inSockPtr)
+{
+    if (! inSockPtr) {
+        return -EHOSTUNREACH;
+    }
+    const int theRet = DoOpCommon(&inOp, inSockPtr);
+    return (inOp.status < 0 ? inOp.status : (theRet < 0 ? -EHOSTUNREACH : 0));
+}
+
+struct KfsWriteBehind::File
+{
+    struct Chunk
+    {
+        Chunk()
+            : mAttr(),
+              mAllocatingFlag(false)
+            {}
+        ChunkAttr mAttr;
+        bool      mAllocatingFlag;
+    };
+    typedef std::map<int, Chunk> Chunks;
+
+    File(
+        kfsFileId_t    inFileId,
+        const string&  inPathName)
+        : mFileId(inFileId),
+          mPathName(inPathName),
+          mPendingBytes(0),
+          mPendingCount(0),
+          mStatus(0),
+          mChunks()
+        {}
+    const kfsFileId_t mFileId;
+    const string      mPathName;
+    size_t            mPendingBytes;
+    int               mPendingCount;
+    int               mStatus;
+    Chunks            mChunks;
+};
+
+struct KfsWriteBehind::Extent
+{
+    Extent(
+        File&  inFile,
+        off_t  inFileOffset,
+        char*  inBufPtr,
+        size_t inLength)
+        : mFile(inFile),
+          mFileOffset(inFileOffset),
+          mBufPtr(inBufPtr),
+          mLength(inLength),
+          mBusyFlag(false)
+        {}
+    ~Extent()
+        { delete [] mBufPtr; }
+    int GetChunkNum() const
+        { return (int)(mFileOffset / (off_t)CHUNKSIZE); }
+    // Extents that have data in the same checksum block can not be written
+    // concurrently, and must be written in the order they were queued.
+    bool Overlaps(
+        const Extent& inExtent) const
+    {
+        return (&mFile == &inExtent.mFile &&
+            GetFirstBlock() <= inExtent.GetLastBlock() &&
+            inExtent.GetFirstBlock() <= GetLastBlock()
+        );
+    }
+    off_t GetFirstBlock() const
+        { return (mFileOffset / (off_t)CHECKSUM_BLOCKSIZE); }
+    off_t GetLastBlock() const
+        { return ((mFileOffset + (off_t)mLength - 1) /
+            (off_t)CHECKSUM_BLOCKSIZE); }
+    File&        mFile;
+    const off_t  mFileOffset;
+    char* const  mBufPtr;
+    const size_t mLength;
+    bool         mBusyFlag;
+private:
+    Extent(
+        const Extent& inExtent);
+    Extent& operator=(
+        const Extent& inExtent);
+};
+
+// Per thread connections. The sequence numbers only have to be unique
+// per connection.
+class KfsWriteBehind::Worker
+{
+public:
+    Worker(
+        const ServerLocation& inMetaServer)
+        : mMetaServer(inMetaServer),
+          mMetaSock(),
+          mConns(),
+          mSeq(1)
+        {}
+    kfsSeq_t NextSeq()
+        { return mSeq++; }
+    TcpSocket* GetMetaServerSocket()
+    {
+        if (! mMetaSock.IsGood()) {
+            mMetaSock.Connect(mMetaServer);
+        }
+        return (mMetaSock.IsGood() ? &mMetaSock : 0);
+    }
+    TcpSocket* GetChunkServerSocket(
+        const ServerLocation& inLocation)
+    {
+        vector<ChunkServerConn>::iterator theIt = std::find(
+            mConns.begin(), mConns.end(), inLocation);
+        if (theIt == mConns.end()) {
+            const size_t kMaxConnections = 64;
+            if (mConns.size() >= kMaxConnections) {
+                mConns.clear();
+            }
+            mConns.push_back(ChunkServerConn(inLocation));
+            theIt = mConns.end() - 1;
+        }
+        theIt->Connect();
+        return (theIt->sock->IsGood() ? theIt->sock.get() : 0);
+    }
+private:
+    const ServerLocation    mMetaServer;
+    TcpSocket               mMetaSock;
+    vector<ChunkServerConn> mConns;
+    kfsSeq_t                mSeq;
+};
+
+KfsWriteBehind::KfsWriteBehind(
+    const ServerLocation& inMetaServer,
+    int                   inThreadCount,
+    int                   inMaxRetryCount)
+    : QCRunnable(),
+      mMetaServer(inMetaServer),
+      mThreadCount(std::max(1, inThreadCount)),
+      mMaxRetryCount(std::max(1, inMaxRetryCount)),
+      mStopFlag(false),
+      mFiles(),
+      mQueue(),
+      mStats(),
+      mThreads(new QCThread[mThreadCount]),
+      mMutex(),
+      mWorkCond(),
+      mDoneCond()
+{
+    const int kStackSize = 256 << 10;
+    for (int i = 0; i < mThreadCount; i++) {
+        mThreads[i].Start(this, kStackSize, "KfsWriteBehind");
+    }
+}
+
+KfsWriteBehind::~KfsWriteBehind()
+{
+    KfsWriteBehind::Stop();
+    delete [] mThreads;
+    for (Queue::iterator theIt = mQueue.begin();
+            theIt != mQueue.end();
+            ++theIt) {
+        delete *theIt;
+    }
+    for (Files::iterator theIt = mFiles.begin();
+            theIt != mFiles.end();
+            ++theIt) {
+        delete theIt->second;
+    }
+}
+
+    void
+KfsWriteBehind::Stop()
+{
+    QCStMutexLocker theLock(mMutex);
+    if (mStopFlag) {
+        return;
+    }
+    mStopFlag = true;
+    mWorkCond.NotifyAll();
+    theLock.Unlock();
+    for (int i = 0; i < mThreadCount; i++) {
+        mThreads[i].Join();
+    }
+}
+
+    KfsWriteBehind::File*
+KfsWriteBehind::GetFile(
+    FileInstance inInstance) const
+{
+    Files::const_iterator const theIt = mFiles.find(inInstance);
+    return (theIt == mFiles.end() ? 0 : theIt->second);
+}
+
+    int
+KfsWriteBehind::Enqueue(
+    FileInstance  inInstance,
+    kfsFileId_t   inFileId,
+    const string& inPathName,
+    off_t         inFileOffset,
+    char*         inBufPtr,
+    size_t        inLength,
+    size_t        inMaxPendingBytes)
+{
+    QCStMutexLocker theLock(mMutex);
+    File* theFilePtr = GetFile(inInstance);
+    if (! theFilePtr) {
+        theFilePtr = new File(inFileId, inPathName);
+        mFiles[inInstance] = theFilePtr;
+    }
+    File& theFile = *theFilePtr;
+    if (theFile.mStatus == 0 && theFile.mPendingCount > 0 &&
+            theFile.mPendingBytes + inLength > inMaxPendingBytes) {
+        const int64_t theStart = MicroSecs();
+        while (theFile.mStatus == 0 && theFile.mPendingCount > 0 &&
+                theFile.mPendingBytes + inLength > inMaxPendingBytes) {
+            mDoneCond.Wait(mMutex);
+        }
+        mStats.mEnqueueWaitCount++;
+        mStats.mEnqueueWaitUsecs += MicroSecs() - theStart;
+    }
+    if (theFile.mStatus < 0 || mStopFlag) {
+        delete [] inBufPtr;
+        return (theFile.mStatus < 0 ? theFile.mStatus : -EIO);
+    }
+    QCASSERT(inFileOffset / (off_t)CHUNKSIZE ==
+        (inFileOffset + (off_t)inLength - 1) / (off_t)CHUNKSIZE);
+    mQueue.push_back(new Extent(theFile, inFileOffset, inBufPtr, inLength));
+    theFile.mPendingBytes += inLength;
+    theFile.mPendingCount++;
+    mWorkCond.Notify();
+    return 0;
+}
+
+    int
+KfsWriteBehind::Sync(
+    FileInstance inInstance,
+    bool         inResetErrorFlag)
+{
+    QCStMutexLocker theLock(mMutex);
+    File* const theFilePtr = GetFile(inInstance);
+    if (! theFilePtr) {
+        return 0;
+    }
+    while (theFilePtr->mPendingCount > 0) {
+        mDoneCond.Wait(mMutex);
+    }
+    const int theStatus = theFilePtr->mStatus;
+    if (inResetErrorFlag) {
+        theFilePtr->mStatus = 0;
+    }
+    // The chunks might be re-allocated by the client or by another client
+    // after sync, forget the versions.
+    theFilePtr->mChunks.clear();
+    return theStatus;
+}
+
+    int
+KfsWriteBehind::Close(
+    FileInstance inInstance)
+{
+    QCStMutexLocker theLock(mMutex);
+    Files::iterator const theIt = mFiles.find(inInstance);
+    if (theIt == mFiles.end()) {
+        return 0;
+    }
+    File* const theFilePtr = theIt->second;
+    while (theFilePtr->mPendingCount > 0) {
+        mDoneCond.Wait(mMutex);
+    }
+    const int theStatus = theFilePtr->mStatus;
+    vector<ChunkAttr> theChunks;
+    for (File::Chunks::const_iterator theCIt = theFilePtr->mChunks.begin();
+            theCIt != theFilePtr->mChunks.end();
+            ++theCIt) {
+        if (theCIt->second.mAttr.didAllocation) {
+            theChunks.push_back(theCIt->second.mAttr);
+        }
+    }
+    delete theFilePtr;
+    mFiles.erase(theIt);
+    theLock.Unlock();
+
+    // Same as KfsClientImpl::CloseChunk(): let the chunk masters
+    // relinquish the write leases now, instead of waiting for them to
+    // expire.
+    kfsSeq_t theSeq = 1;
+    for (vector<ChunkAttr>::const_iterator theCIt = theChunks.begin();
+            theCIt != theChunks.end();
+            ++theCIt) {
+        TcpSocket theSock;
+        if (theSock.Connect(theCIt->chunkServerLoc[0]) < 0) {
+            continue;
+        }
+        CloseOp theOp(theSeq++, theCIt->chunkId);
+        theOp.chunkServerLoc = theCIt->chunkServerLoc;
+        DoOpCommon(&theOp, &theSock);
+    }
+    return theStatus;
+}
+
+    bool
+KfsWriteBehind::IsPending(
+    FileInstance inInstance) const
+{
+    QCStMutexLocker theLock(mMutex);
+    const File* const theFilePtr = GetFile(inInstance);
+    return (theFilePtr && theFilePtr->mPendingCount > 0);
+}
+
+    int
+KfsWriteBehind::GetError(
+    FileInstance inInstance) const
+{
+    QCStMutexLocker theLock(mMutex);
+    const File* const theFilePtr = GetFile(inInstance);
+    return (theFilePtr ? theFilePtr->mStatus : 0);
+}
+
+    KfsWriteBehind::Stats
+KfsWriteBehind::GetStats() const
+{
+    QCStMutexLocker theLock(mMutex);
+    return mStats;
+}
+
+    KfsWriteBehind::Extent*
+KfsWriteBehind::GetNextExtent()
+{
+    for (Queue::iterator theIt = mQueue.begin();
+            theIt != mQueue.end();
+            ++theIt) {
+        Extent& theExtent = **theIt;
+        if (theExtent.mBusyFlag) {
+            continue;
+        }
+        bool theConflictFlag = false;
+        for (Queue::iterator thePrevIt = mQueue.begin();
+                thePrevIt != theIt;
+                ++thePrevIt) {
+            if ((*thePrevIt)->Overlaps(theExtent)) {
+                theConflictFlag = true;
+                break;
+            }
+        }
+        if (! theConflictFlag) {
+            theExtent.mBusyFlag = true;
+            return &theExtent;
+        }
+    }
+    return 0;
+}
+
+    void
+KfsWriteBehind::Done(
+    Extent* inExtentPtr,
+    int     inStatus)
+{
+    File& theFile = inExtentPtr->mFile;
+    if (inStatus < 0) {
+        if (theFile.mStatus == 0) {
+            theFile.mStatus = inStatus;
+        }
+        mStats.mErrorCount++;
+    } else {
+        mStats.mWriteCount++;
+        mStats.mWriteByteCount += inExtentPtr->mLength;
+    }
+    theFile.mPendingBytes -= inExtentPtr->mLength;
+    theFile.mPendingCount--;
+    mQueue.remove(inExtentPtr);
+    delete inExtentPtr;
+    mDoneCond.NotifyAll();
+    // The extents that overlapped with this one can now be written.
+    mWorkCond.NotifyAll();
+}
+
+    /* virtual */ void
+KfsWriteBehind::Run()
+{
+    Worker          theWorker(mMetaServer);
+    QCStMutexLocker theLock(mMutex);
+    while (! mStopFlag) {
+        Extent* const theExtentPtr = GetNextExtent();
+        if (! theExtentPtr) {
+            mWorkCond.Wait(mMutex);
+            continue;
+        }
+        // Once a write fails discard the remaining data: the error is
+        // reported to the application.
+        int theStatus = theExtentPtr->mFile.mStatus;
+        if (theStatus == 0) {
+            QCStMutexUnlocker theUnlocker(mMutex);
+            theStatus = Write(theWorker, *theExtentPtr);
+        }
+        Done(theExtentPtr, theStatus);
+    }
+}
+
+    int
+KfsWriteBehind::GetChunk(
+    Worker&    inWorker,
+    File&      inFile,
+    int        inChunkNum,
+    int64_t    inFailedVersion,
+    ChunkAttr& outChunk)
+{
+    QCStMutexLocker theLock(mMutex);
+    File::Chunk& theChunk = inFile.mChunks[inChunkNum];
+    while (theChunk.mAllocatingFlag) {
+        mDoneCond.Wait(mMutex);
+    }
+    // Re-allocate after write failure, unless the other thread has done
+    // so already.
+    if (theChunk.mAttr.didAllocation &&
+            (inFailedVersion < 0 ||
+                theChunk.mAttr.chunkVersion != inFailedVersion)) {
+        outChunk = theChunk.mAttr;
+        return 0;
+    }
+    theChunk.mAllocatingFlag = true;
+    mStats.mAllocateCount++;
+    theLock.Unlock();
+
+    AllocateOp theOp(inWorker.NextSeq(), inFile.mFileId, inFile.mPathName);
+    theOp.fileOffset = (off_t)inChunkNum * (off_t)CHUNKSIZE;
+    TcpSocket* const theSockPtr = inWorker.GetMetaServerSocket();
+    int theStatus = GetStatus(theOp, theSockPtr);
+    if (theStatus >= 0 && theOp.chunkServers.empty()) {
+        theStatus = -EHOSTUNREACH;
+    }
+
+    theLock.Lock();
+    theChunk.mAllocatingFlag = false;
+    if (theStatus >= 0) {
+        theChunk.mAttr.chunkId        = theOp.chunkId;
+        theChunk.mAttr.chunkVersion   = theOp.chunkVersion;
+        theChunk.mAttr.chunkServerLoc = theOp.chunkServers;
+        theChunk.mAttr.didAllocation  = true;
+        outChunk = theChunk.mAttr;
+    } else {
+        theChunk.mAttr.didAllocation = false;
+    }
+    mDoneCond.NotifyAll();
+    return theStatus;
+}
+
+    int
+KfsWriteBehind::Write(
+    Worker& inWorker,
+    Extent& inExtent)
+{
+    const int   theChunkNum    = inExtent.GetChunkNum();
+    const off_t theChunkOffset = inExtent.mFileOffset % (off_t)CHUNKSIZE;
+    int64_t     theFailedVersion = -1;
+    int         theStatus        = 0;
+    for (int theRetry = 0; ; ) {
+        ChunkAttr theChunk;
+        theStatus = GetChunk(inWorker, inExtent.mFile, theChunkNum,
+            theFailedVersion, theChunk);
+        TcpSocket* const theSockPtr = theStatus < 0 ? 0 :
+            inWorker.GetChunkServerSocket(theChunk.chunkServerLoc[0]);
+        if (theStatus >= 0 && ! theSockPtr) {
+            theStatus = -EHOSTUNREACH;
+        }
+        vector<WriteInfo> theWriteIds;
+        if (theStatus >= 0) {
+            WriteIdAllocOp theOp(inWorker.NextSeq(),
+                theChunk.chunkId, theChunk.chunkVersion,
+                theChunkOffset, inExtent.mLength);
+            theOp.chunkServerLoc = theChunk.chunkServerLoc;
+            theStatus = GetStatus(theOp, theSockPtr);
+            istringstream theStream(theOp.writeIdStr);
+            for (size_t i = 0;
+                    theStatus >= 0 && i < theChunk.chunkServerLoc.size();
+                    i++) {
+                ServerLocation theLoc;
+                int64_t        theId;
+                theStream >> theLoc.hostname >> theLoc.port >> theId;
+                theWriteIds.push_back(WriteInfo(theLoc, theId));
+            }
+        }
+        // Same as DoLargeWriteToServer(): write prepare ops are at most
+        // MAX_BYTES_PER_WRITE_IO, aligned to checksum blocks, each
+        // followed by its commit (write sync). Only the commits have
+        // replies.
+        vector<WriteSyncOp> theSyncOps;
+        theSyncOps.reserve(
+            inExtent.mLength / CHECKSUM_BLOCKSIZE + 2);
+        for (size_t thePos = 0;
+                theStatus >= 0 && thePos < inExtent.mLength; ) {
+            WritePrepareOp theOp(inWorker.NextSeq(),
+                theChunk.chunkId, theChunk.chunkVersion, theWriteIds);
+            theOp.offset   = theChunkOffset + thePos;
+            theOp.numBytes = min(MAX_BYTES_PER_WRITE_IO,
+                inExtent.mLength - thePos);
+            if (theOp.numBytes > CHECKSUM_BLOCKSIZE &&
+                    theOp.numBytes % CHECKSUM_BLOCKSIZE != 0) {
+                theOp.numBytes -= theOp.numBytes % CHECKSUM_BLOCKSIZE;
+            }
+            if (OffsetToChecksumBlockStart(theOp.offset) != theOp.offset) {
+                theOp.numBytes = min((size_t)(
+                    OffsetToChecksumBlockEnd(theOp.offset) - theOp.offset),
+                    theOp.numBytes);
+            }
+            theOp.AttachContentBuf(inExtent.mBufPtr + thePos, theOp.numBytes);
+            theOp.contentLength = theOp.numBytes;
+            theOp.checksums = ComputeChecksums(
+                theOp.contentBuf, theOp.contentLength);
+            theOp.checksum  = ComputeBlockChecksum(
+                theOp.contentBuf, theOp.contentLength);
+            theStatus = DoOpSend(&theOp, theSockPtr);
+            theOp.ReleaseContentBuf();
+            if (theStatus < 0) {
+                theStatus = theOp.status < 0 ? theOp.status : -EHOSTUNREACH;
+                break;
+            }
+            theSyncOps.push_back(WriteSyncOp());
+            WriteSyncOp& theSyncOp = theSyncOps.back();
+            theSyncOp.Init(inWorker.NextSeq(),
+                theChunk.chunkId, theChunk.chunkVersion,
+                theOp.offset, theOp.numBytes, theOp.checksums, theWriteIds);
+            if (DoOpSend(&theSyncOp, theSockPtr) < 0) {
+                theStatus = theSyncOp.status < 0 ?
+                    theSyncOp.status : -EHOSTUNREACH;
+                break;
+            }
+            thePos += theOp.numBytes;
+        }
+        for (vector<WriteSyncOp>::iterator theIt = theSyncOps.begin();
+                theStatus >= 0 && theIt != theSyncOps.end();
+                ++theIt) {
+            if (DoOpResponse(&*theIt, theSockPtr) < 0 || theIt->status < 0) {
+                theStatus = theIt->status < 0 ? theIt->status : -EHOSTUNREACH;
+            }
+        }
+        if (theStatus >= 0) {
+            break;
+        }
+        if (theSockPtr) {
+            theSockPtr->Close();
+        }
+        KFS_LOG_STREAM_INFO << "write behind: " << inExtent.mFile.mPathName <<
+            " offset: " << inExtent.mFileOffset <<
+            " size: "   << inExtent.mLength <<
+            " chunk: "  << theChunk.chunkId <<
+            " version: " << theChunk.chunkVersion <<
+            " status: " << theStatus <<
+            " retry: "  << theRetry << " of " << mMaxRetryCount <<
+        KFS_LOG_EOM;
+        if (++theRetry >= mMaxRetryCount) {
+            break;
+        }
+        {
+            QCStMutexLocker theLock(mMutex);
+            mStats.mRetryCount++;
+            if (mStopFlag) {
+                break;
+            }
+        }
+        theFailedVersion = theChunk.chunkVersion;
+        sleep(RETRY_DELAY_SECS);
+    }
+    return theStatus;
+}
+
+} /* namespace KFS */
@@ -0,0 +1,160 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Client write behind: write the data handed off by the application
+// to the chunk servers in the background.
+//
+//----------------------------------------------------------------------------
+
+#ifndef KFS_WRITE_BEHIND_H
+#define KFS_WRITE_BEHIND_H
+
+#include "common/kfstypes.h"
+#include "common/kfsdecls.h"
+#include "qcdio/qcthread.h"
+#include "qcdio/qcmutex.h"
+
+#include <string>
+#include <list>
+#include <map>
+
+namespace KFS {
+
+struct ChunkAttr;
+
+///
+/// The write behind threads write the full client buffers to the chunk
+/// servers, while the application continues to fill the next buffer.
+/// Each thread runs one write id (allocate write id, write prepare and
+/// commit) at a time; the buffers of different chunks, and the non
+/// overlapping buffers of the same chunk, are written concurrently.
+/// The threads allocate the chunks with their own meta server
+/// connection, and never acquire the client mutex: the application
+/// thread can block in Enqueue() or Sync() while holding it.
+/// The first write error is recorded, the subsequent buffers of the
+/// file are discarded, and the error is returned by the next Enqueue(),
+/// Sync(), or Close().
+///
+class KfsWriteBehind : public QCRunnable
+{
+public:
+    typedef unsigned int FileInstance;
+    struct Stats
+    {
+        Stats()
+            : mWriteCount(0),
+              mWriteByteCount(0),
+              mAllocateCount(0),
+              mRetryCount(0),
+              mErrorCount(0),
+              mEnqueueWaitCount(0),
+              mEnqueueWaitUsecs(0)
+            {}
+        int64_t mWriteCount;
+        int64_t mWriteByteCount;
+        int64_t mAllocateCount;
+        int64_t mRetryCount;
+        int64_t mErrorCount;
+        int64_t mEnqueueWaitCount;
+        int64_t mEnqueueWaitUsecs;
+    };
+
+    KfsWriteBehind(
+        const ServerLocation& inMetaServer,
+        int                   inThreadCount,
+        int                   inMaxRetryCount);
+    ~KfsWriteBehind();
+    /// Queue the buffer for writing at the file offset. The buffer must be
+    /// allocated with new char[], Enqueue() takes the ownership. The
+    /// buffer must not straddle chunk boundary. Blocks while the number of
+    /// bytes queued and being written for the file exceeds
+    /// inMaxPendingBytes.
+    /// @retval 0 on success; the first write error of the file otherwise.
+    int Enqueue(
+        FileInstance       inInstance,
+        kfsFileId_t        inFileId,
+        const std::string& inPathName,
+        off_t              inFileOffset,
+        char*              inBufPtr,
+        size_t             inLength,
+        size_t             inMaxPendingBytes);
+    /// Wait for all queued buffers of the file to be written.
+    /// @retval 0 on success; the first write error, which is then reset
+    /// if inResetErrorFlag is set.
+    int Sync(
+        FileInstance inInstance,
+        bool         inResetErrorFlag = true);
+    /// Sync and forget the file.
+    int Close(
+        FileInstance inInstance);
+    bool IsPending(
+        FileInstance inInstance) const;
+    /// @retval the first write error of the file, without waiting.
+    int GetError(
+        FileInstance inInstance) const;
+    Stats GetStats() const;
+    void Stop();
+    virtual void Run();
+
+private:
+    class Worker;
+    struct File;
+    struct Extent;
+    typedef std::map<FileInstance, File*> Files;
+    typedef std::list<Extent*>            Queue;
+
+    const ServerLocation mMetaServer;
+    const int            mThreadCount;
+    const int            mMaxRetryCount;
+    bool                 mStopFlag;
+    Files                mFiles;
+    Queue                mQueue;
+    Stats                mStats;
+    QCThread*            mThreads;
+    mutable QCMutex      mMutex;
+    QCCondVar            mWorkCond;
+    QCCondVar            mDoneCond;
+
+    Extent* GetNextExtent();
+    void Done(
+        Extent* inExtentPtr,
+        int     inStatus);
+    int Write(
+        Worker& inWorker,
+        Extent& inExtent);
+    int GetChunk(
+        Worker&    inWorker,
+        File&      inFile,
+        int        inChunkNum,
+        int64_t    inFailedVersion,
+        ChunkAttr& outChunk);
+    File* GetFile(
+        FileInstance inInstance) const;
+private:
+    KfsWriteBehind(
+        const KfsWriteBehind& inWriteBehind);
+    KfsWriteBehind& operator=(
+        const KfsWriteBehind& inWriteBehind);
+};
+
+} /* namespace KFS */
+
+#endif /* KFS_WRITE_BEHIND_H */
@@ -0,0 +1,543 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Framed, optionally compressed, record blocks for record append.
+//
+//----------------------------------------------------------------------------
+
+#include "RecordBlock.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "common/kfstypes.h"
+#include "libkfsIO/IOBuffer.h"
+#include "libkfsIO/Checksum.h"
+
+namespace KFS
+{
+
+// Lz4 block format compressor and decompressor.
+// The compressor uses single probe hash table, similar to lz4 "fast" mode.
+class Lz4Block
+{
+public:
+    enum
+    {
+        kMinMatch     = 4,
+        kLastLiterals = 5,
+        kMfLimit      = 12,
+        kMaxOffset    = 65535,
+        kHashLog      = 12,
+        kHashSize     = 1 << kHashLog
+    };
+    static int MaxCompressedSize(
+        int inLength)
+        { return (inLength + inLength / 255 + 16); }
+    // Returns compressed size, or -1 if the output buffer is too small.
+    static int Compress(
+        const char* inSrcPtr,
+        int         inSrcLength,
+        char*       inDstPtr,
+        int         inDstCapacity,
+        int*        inHashTablePtr)
+    {
+        const unsigned char* const theSrcPtr =
+            reinterpret_cast<const unsigned char*>(inSrcPtr);
+        unsigned char*       theOutPtr    =
+            reinterpret_cast<unsigned char*>(inDstPtr);
+        unsigned char* const theOutEndPtr = theOutPtr + inDstCapacity;
+        int thePos    = 0;
+        int theAnchor = 0;
+        if (inSrcLength > kMfLimit) {
+            std::fill(inHashTablePtr, inHashTablePtr + kHashSize, -1);
+            const int theLimit    = inSrcLength - kMfLimit;
+            const int theMatchEnd = inSrcLength - kLastLiterals;
+            while (thePos < theLimit) {
+                const uint32_t theSeq  = Read32(theSrcPtr + thePos);
+                int&           theSlot = inHashTablePtr[Hash(theSeq)];
+                const int      theRef  = theSlot;
+                theSlot = thePos;
+                if (theRef < 0 || thePos - theRef > kMaxOffset ||
+                        Read32(theSrcPtr + theRef) != theSeq) {
+                    thePos++;
+                    continue;
+                }
+                int theLen = kMinMatch;
+                while (thePos + theLen < theMatchEnd &&
+                        theSrcPtr[theRef + theLen] ==
+                            theSrcPtr[thePos + theLen]) {
+                    theLen++;
+                }
+                if (! (theOutPtr = Sequence(theOutPtr, theOutEndPtr,
+                        theSrcPtr + theAnchor, thePos - theAnchor,
+                        thePos - theRef, theLen))) {
+                    return -1;
+                }
+                thePos   += theLen;
+                theAnchor = thePos;
+            }
+        }
+        if (! (theOutPtr = Sequence(theOutPtr, theOutEndPtr,
+                theSrcPtr + theAnchor, inSrcLength - theAnchor, 0, 0))) {
+            return -1;
+        }
+        return (int)(theOutPtr - reinterpret_cast<unsigned char*>(inDstPtr));
+    }
+    // Returns decompressed size, or -1 if the input is invalid.
+    static int Decompress(
+        const char* inSrcPtr,
+        int         inSrcLength,
+        char*       inDstPtr,
+        int         inDstCapacity)
+    {
+        const unsigned char*       thePtr    =
+            reinterpret_cast<const unsigned char*>(inSrcPtr);
+        const unsigned char* const theEndPtr = thePtr + inSrcLength;
+        unsigned char* const       theDstPtr =
+            reinterpret_cast<unsigned char*>(inDstPtr);
+        int                        theOutPos = 0;
+        while (thePtr < theEndPtr) {
+            const int theToken = *thePtr++;
+            int       theLen   = theToken >> 4;
+            if (theLen == 15 && ! ReadLength(thePtr, theEndPtr, theLen)) {
+                return -1;
+            }
+            if (theEndPtr - thePtr < theLen ||
+                    inDstCapacity - theOutPos < theLen) {
+                return -1;
+            }
+            memcpy(theDstPtr + theOutPos, thePtr, theLen);
+            thePtr    += theLen;
+            theOutPos += theLen;
+            if (thePtr >= theEndPtr) {
+                break; // Last sequence has only literals.
+            }
+            if (theEndPtr - thePtr < 2) {
+                return -1;
+            }
+            const int theOffset = thePtr[0] | (int(thePtr[1]) << 8);
+            thePtr += 2;
+            theLen = theToken & 0xF;
+            if (theLen == 15 && ! ReadLength(thePtr, theEndPtr, theLen)) {
+                return -1;
+            }
+            theLen += kMinMatch;
+            if (theOffset <= 0 || theOffset > theOutPos ||
+                    inDstCapacity - theOutPos < theLen) {
+                return -1;
+            }
+            // Byte by byte, as the match can overlap the output.
+            const unsigned char* theRefPtr = theDstPtr + theOutPos - theOffset;
+            unsigned char*       theOutPtr = theDstPtr + theOutPos;
+            for (int i = 0; i < theLen; i++) {
+                theOutPtr[i] = theRefPtr[i];
+            }
+            theOutPos += theLen;
+        }
+        return theOutPos;
+    }
+private:
+    static uint32_t Read32(
+        const unsigned char* inPtr)
+    {
+        return (uint32_t(inPtr[0]) | (uint32_t(inPtr[1]) << 8) |
+            (uint32_t(inPtr[2]) << 16) | (uint32_t(inPtr[3]) << 24));
+    }
+    static int Hash(
+        uint32_t inSeq)
+        { return (int)((inSeq * 2654435761U) >> (32 - kHashLog)); }
+    static unsigned char* WriteLength(
+        unsigned char*       inPtr,
+        unsigned char* const inEndPtr,
+        int                  inLength)
+    {
+        while (inLength >= 255) {
+            if (inPtr >= inEndPtr) {
+                return 0;
+            }
+            *inPtr++ = 255;
+            inLength -= 255;
+        }
+        if (inPtr >= inEndPtr) {
+            return 0;
+        }
+        *inPtr++ = (unsigned char)inLength;
+        return inPtr;
+    }
+    static bool ReadLength(
+        const unsigned char*&      ioPtr,
+        const unsigned char* const inEndPtr,
+        int&                       ioLength)
+    {
+        int theByte;
+        do {
+            if (ioPtr >= inEndPtr) {
+                return false;
+            }
+            theByte = *ioPtr++;
+            ioLength += theByte;
+        } while (theByte == 255);
+        return true;
+    }
+    static unsigned char* Sequence(
+        unsigned char*             inPtr,
+        unsigned char* const       inEndPtr,
+        const unsigned char* const inLiteralsPtr,
+        int                        inLiteralsLength,
+        int                        inOffset,
+        int                        inMatchLength)
+    {
+        if (inPtr >= inEndPtr) {
+            return 0;
+        }
+        unsigned char* const theTokenPtr = inPtr++;
+        *theTokenPtr = (unsigned char)(
+            std::min(inLiteralsLength, 15) << 4);
+        if (inLiteralsLength >= 15 && ! (inPtr =
+                WriteLength(inPtr, inEndPtr, inLiteralsLength - 15))) {
+            return 0;
+        }
+        if (inEndPtr - inPtr < inLiteralsLength) {
+            return 0;
+        }
+        memcpy(inPtr, inLiteralsPtr, inLiteralsLength);
+        inPtr += inLiteralsLength;
+        if (inMatchLength <= 0) {
+            return inPtr;
+        }
+        if (inEndPtr - inPtr < 2) {
+            return 0;
+        }
+        *inPtr++ = (unsigned char)(inOffset & 0xFF);
+        *inPtr++ = (unsigned char)((inOffset >> 8) & 0xFF);
+        const int theLen = inMatchLength - kMinMatch;
+        *theTokenPtr |= (unsigned char)std::min(theLen, 15);
+        if (theLen >= 15 && ! (inPtr =
+                WriteLength(inPtr, inEndPtr, theLen - 15))) {
+            return 0;
+        }
+        return inPtr;
+    }
+};
+
+static const char kRecordBlockMagic[4] = { 'K', 'F', 'R', 'B' };
+const int kRecordBlockFlagCompressed = 1;
+
+static inline void
+Put32(
+    char*    inPtr,
+    uint32_t inVal)
+{
+    inPtr[0] = (char)(inVal & 0xFF);
+    inPtr[1] = (char)((inVal >> 8) & 0xFF);
+    inPtr[2] = (char)((inVal >> 16) & 0xFF);
+    inPtr[3] = (char)((inVal >> 24) & 0xFF);
+}
+
+static inline uint32_t
+Get32(
+    const char* inPtr)
+{
+    const unsigned char* const thePtr =
+        reinterpret_cast<const unsigned char*>(inPtr);
+    return (uint32_t(thePtr[0]) | (uint32_t(thePtr[1]) << 8) |
+        (uint32_t(thePtr[2]) << 16) | (uint32_t(thePtr[3]) << 24));
+}
+
+RecordBlockWriter::RecordBlockWriter(
+    int  inBlockSize    /* = kDefaultBlockSize */,
+    bool inCompressFlag /* = true */)
+    : mRaw(),
+      mOut(),
+      mHashTable(),
+      mBlockSize(std::max(1, inBlockSize)),
+      mRecordsSize(0),
+      mRecordCount(0),
+      mCompressFlag(inCompressFlag)
+{
+}
+
+RecordBlockWriter::~RecordBlockWriter()
+{
+}
+
+    void
+RecordBlockWriter::SetParameters(
+    int  inBlockSize,
+    bool inCompressFlag)
+{
+    mBlockSize    = std::max(1, inBlockSize);
+    mCompressFlag = inCompressFlag;
+}
+
+    char*
+RecordBlockWriter::AddLength(
+    int inLength)
+{
+    const size_t theSize = mRaw.size();
+    mRaw.resize(theSize + kMaxRecordLenBytes + inLength);
+    char*    thePtr = &mRaw[theSize];
+    uint32_t theLen = (uint32_t)inLength;
+    while (theLen >= 0x80) {
+        *thePtr++ = (char)((theLen & 0x7F) | 0x80);
+        theLen >>= 7;
+    }
+    *thePtr++ = (char)theLen;
+    mRaw.resize(thePtr - &mRaw[0] + inLength);
+    mRecordsSize += inLength;
+    mRecordCount++;
+    return thePtr;
+}
+
+    bool
+RecordBlockWriter::Add(
+    IOBuffer& inBuffer,
+    int       inLength)
+{
+    if (inLength < 0) {
+        return false;
+    }
+    char* const thePtr = AddLength(inLength);
+    const int theLen = inBuffer.CopyOut(thePtr, inLength);
+    if (theLen < inLength) {
+        mRecordsSize -= inLength - theLen;
+        mRaw.resize(mRaw.size() - (inLength - theLen));
+    }
+    inBuffer.Consume(theLen);
+    return ((int)mRaw.size() >= mBlockSize);
+}
+
+    bool
+RecordBlockWriter::Add(
+    const char* inPtr,
+    int         inLength)
+{
+    if (inLength < 0) {
+        return false;
+    }
+    memcpy(AddLength(inLength), inPtr, inLength);
+    return ((int)mRaw.size() >= mBlockSize);
+}
+
+    int
+RecordBlockWriter::Seal(
+    IOBuffer& inBuffer)
+{
+    if (mRecordCount <= 0) {
+        return 0;
+    }
+    const int theRawLen = (int)mRaw.size();
+    mOut.resize(kHeaderSize + Lz4Block::MaxCompressedSize(theRawLen));
+    char* const thePtr     = &mOut[0];
+    int         thePayload = -1;
+    if (mCompressFlag) {
+        mHashTable.resize(Lz4Block::kHashSize);
+        thePayload = Lz4Block::Compress(&mRaw[0], theRawLen,
+            thePtr + kHeaderSize, (int)mOut.size() - kHeaderSize,
+            &mHashTable[0]);
+    }
+    const bool theCompressedFlag = thePayload > 0 && thePayload < theRawLen;
+    if (! theCompressedFlag) {
+        // Store, if compression is off or did not help.
+        thePayload = theRawLen;
+        memcpy(thePtr + kHeaderSize, &mRaw[0], theRawLen);
+    }
+    memcpy(thePtr, kRecordBlockMagic, sizeof(kRecordBlockMagic));
+    thePtr[4] = theCompressedFlag ? (char)kRecordBlockFlagCompressed : 0;
+    thePtr[5] = 0;
+    thePtr[6] = 0;
+    thePtr[7] = 0;
+    Put32(thePtr + 8,  (uint32_t)mRecordCount);
+    Put32(thePtr + 12, (uint32_t)theRawLen);
+    Put32(thePtr + 16, (uint32_t)thePayload);
+    Put32(thePtr + 20, ComputeBlockChecksum(&mRaw[0], theRawLen));
+    const int theLen = kHeaderSize + thePayload;
+    inBuffer.CopyIn(thePtr, theLen);
+    Clear();
+    return theLen;
+}
+
+    void
+RecordBlockWriter::Clear()
+{
+    mRaw.clear();
+    mRecordsSize = 0;
+    mRecordCount = 0;
+}
+
+RecordBlockReader::RecordBlockReader()
+    : mRaw(),
+      mInPtr(0),
+      mInLength(0),
+      mInPos(0),
+      mFileOffset(0),
+      mCurPtr(0),
+      mEndPtr(0),
+      mRecordsLeft(0),
+      mStatus(kErrNone),
+      mBlockCount(0),
+      mPaddingSize(0)
+{
+}
+
+RecordBlockReader::~RecordBlockReader()
+{
+}
+
+    void
+RecordBlockReader::SetInput(
+    const char* inPtr,
+    int         inLength,
+    int64_t     inFileOffset)
+{
+    mInPtr       = inPtr;
+    mInLength    = inPtr ? std::max(0, inLength) : 0;
+    mInPos       = 0;
+    mFileOffset  = std::max(int64_t(0), inFileOffset);
+    mCurPtr      = 0;
+    mEndPtr      = 0;
+    mRecordsLeft = 0;
+    mStatus      = kErrNone;
+}
+
+    int
+RecordBlockReader::SkipPadding()
+{
+    // The block magic never starts with 0: a zero is the zero fill at the
+    // end of the chunk, which must extend to the chunk boundary.
+    const char* thePtr = mInPtr + mInPos;
+    if (mInPos >= mInLength || *thePtr != 0) {
+        return 1;
+    }
+    const int64_t thePos   = mFileOffset + mInPos;
+    const int64_t theChunk = (int64_t)CHUNKSIZE;
+    const int     theLen   = (int)std::min(int64_t(mInLength - mInPos),
+        theChunk - thePos % theChunk);
+    const char* const theEndPtr = thePtr + theLen;
+    while (thePtr < theEndPtr && *thePtr == 0) {
+        ++thePtr;
+    }
+    if (thePtr < theEndPtr) {
+        return kErrBadMagic;
+    }
+    mInPos       += theLen;
+    mPaddingSize += theLen;
+    return (mInPos < mInLength ? 1 : 0);
+}
+
+    int
+RecordBlockReader::NextBlock()
+{
+    const int theRet = SkipPadding();
+    if (theRet <= 0) {
+        return theRet;
+    }
+    const int theRem = mInLength - mInPos;
+    if (theRem < RecordBlockWriter::kHeaderSize) {
+        return 0;
+    }
+    const char* const thePtr = mInPtr + mInPos;
+    if (memcmp(thePtr, kRecordBlockMagic, sizeof(kRecordBlockMagic)) != 0) {
+        return kErrBadMagic;
+    }
+    const int      theFlags    = thePtr[4] & 0xFF;
+    const uint32_t theCount    = Get32(thePtr + 8);
+    const uint32_t theRawLen   = Get32(thePtr + 12);
+    const uint32_t thePayload  = Get32(thePtr + 16);
+    const uint32_t theChecksum = Get32(thePtr + 20);
+    if ((theFlags & ~kRecordBlockFlagCompressed) != 0 ||
+            theRawLen > 0x7FFFFFFF || thePayload > 0x7FFFFFFF ||
+            theCount > theRawLen ||
+            ((theFlags & kRecordBlockFlagCompressed) == 0 ?
+                thePayload != theRawLen : thePayload > theRawLen)) {
+        return kErrBadBlock;
+    }
+    if (theRem - RecordBlockWriter::kHeaderSize < (int)thePayload) {
+        return 0; // Partial block.
+    }
+    const char* const theDataPtr = thePtr + RecordBlockWriter::kHeaderSize;
+    if ((theFlags & kRecordBlockFlagCompressed) != 0) {
+        mRaw.resize(std::max(theRawLen, uint32_t(1)));
+        if (Lz4Block::Decompress(theDataPtr, (int)thePayload,
+                &mRaw[0], (int)theRawLen) != (int)theRawLen) {
+            return kErrBadBlock;
+        }
+        mCurPtr = &mRaw[0];
+    } else {
+        mCurPtr = theDataPtr;
+    }
+    mEndPtr = mCurPtr + theRawLen;
+    if (ComputeBlockChecksum(mCurPtr, theRawLen) != theChecksum) {
+        mCurPtr = 0;
+        mEndPtr = 0;
+        return kErrChecksum;
+    }
+    mRecordsLeft = (int)theCount;
+    mInPos += RecordBlockWriter::kHeaderSize + (int)thePayload;
+    mBlockCount++;
+    return 1;
+}
+
+    int
+RecordBlockReader::Next(
+    const char*& outRecordPtr,
+    int&         outRecordLength)
+{
+    if (mStatus != kErrNone) {
+        return mStatus;
+    }
+    while (mRecordsLeft <= 0) {
+        if (mCurPtr != mEndPtr) {
+            return (mStatus = kErrBadBlock);
+        }
+        const int theRet = NextBlock();
+        if (theRet <= 0) {
+            if (theRet < 0) {
+                mStatus = theRet;
+            }
+            return theRet;
+        }
+    }
+    uint32_t theLen   = 0;
+    int      theShift = 0;
+    for (; ;) {
+        if (mCurPtr >= mEndPtr || theShift > 28) {
+            return (mStatus = kErrBadBlock);
+        }
+        const int theByte = *mCurPtr++ & 0xFF;
+        theLen |= uint32_t(theByte & 0x7F) << theShift;
+        if ((theByte & 0x80) == 0) {
+            break;
+        }
+        theShift += 7;
+    }
+    if (theLen > uint32_t(mEndPtr - mCurPtr)) {
+        return (mStatus = kErrBadBlock);
+    }
+    outRecordPtr    = mCurPtr;
+    outRecordLength = (int)theLen;
+    mCurPtr += theLen;
+    mRecordsLeft--;
+    return 1;
+}
+
+}
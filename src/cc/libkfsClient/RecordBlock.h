@@ -0,0 +1,183 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Framed, optionally compressed, record blocks for record append.
+//
+// A record block packs a number of whole records, each prefixed with its
+// length (base 128 varint). The block is preceded by a fixed size header:
+//
+//  offset size
+//  0      4    magic "KFRB"
+//  4      1    flags: 1 -- payload is compressed
+//  5      3    reserved, 0
+//  8      4    record count
+//  12     4    uncompressed length
+//  16     4    payload length
+//  20     4    uncompressed data checksum
+//
+// All integers are little endian. The compressed payload uses lz4 block
+// format. Each block is appended as a whole by a single record append,
+// therefore record boundaries are preserved. A block that does not fit into
+// the rest of the chunk goes into the next chunk, and the rest of the chunk
+// reads back as zeros.
+//
+//----------------------------------------------------------------------------
+
+#ifndef RECORD_BLOCK_H
+#define RECORD_BLOCK_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace KFS
+{
+
+class IOBuffer;
+
+class RecordBlockWriter
+{
+public:
+    enum
+    {
+        kHeaderSize        = 24,
+        kDefaultBlockSize  = 64 << 10,
+        kMaxRecordLenBytes = 5
+    };
+    RecordBlockWriter(
+        int  inBlockSize    = kDefaultBlockSize,
+        bool inCompressFlag = true);
+    ~RecordBlockWriter();
+    void SetParameters(
+        int  inBlockSize,
+        bool inCompressFlag);
+    // Add record to the block. Returns true if the block is full, and should
+    // be sealed.
+    bool Add(
+        IOBuffer& inBuffer,
+        int       inLength);
+    bool Add(
+        const char* inPtr,
+        int         inLength);
+    // Returns true if the record would not fit into the current block.
+    bool IsFull(
+        int inLength) const
+    {
+        return (mRecordCount > 0 &&
+            (int)mRaw.size() + kMaxRecordLenBytes + inLength > mBlockSize);
+    }
+    // Append framed block to the buffer, and reset the writer.
+    // Returns the framed block size.
+    int Seal(
+        IOBuffer& inBuffer);
+    void Clear();
+    bool IsEmpty() const
+        { return (mRecordCount <= 0); }
+    int GetRawSize() const
+        { return (int)mRaw.size(); }
+    int GetRecordsSize() const
+        { return mRecordsSize; }
+    int GetRecordCount() const
+        { return mRecordCount; }
+    int GetBlockSize() const
+        { return mBlockSize; }
+    bool IsCompressionEnabled() const
+        { return mCompressFlag; }
+private:
+    std::vector<char> mRaw;
+    std::vector<char> mOut;
+    std::vector<int>  mHashTable;
+    int               mBlockSize;
+    int               mRecordsSize;
+    int               mRecordCount;
+    bool              mCompressFlag;
+
+    char* AddLength(
+        int inLength);
+private:
+    RecordBlockWriter(
+        const RecordBlockWriter& inWriter);
+    RecordBlockWriter& operator=(
+        const RecordBlockWriter& inWriter);
+};
+
+// Iterates over the records of the blocks in the input buffer, the data
+// read from a file written with the record block writer.
+class RecordBlockReader
+{
+public:
+    enum
+    {
+        kErrNone     = 0,
+        kErrBadMagic = -1,
+        kErrBadBlock = -2,
+        kErrChecksum = -3
+    };
+    RecordBlockReader();
+    ~RecordBlockReader();
+    // The input buffer must remain valid until the next SetInput() call.
+    // inFileOffset is the file position of the first input byte: the zero
+    // fill at the end of a chunk is skipped up to the next chunk boundary.
+    // The input can end with a partial block, GetConsumed() returns the
+    // number of bytes of the blocks decoded, and of the zero fill skipped
+    // so far: once Next() returns 0, the remaining input should be
+    // prepended to the next input, at inFileOffset + GetConsumed().
+    void SetInput(
+        const char* inPtr,
+        int         inLength,
+        int64_t     inFileOffset);
+    // Returns 1 and the record, if there is one, 0 if more input is needed,
+    // or negative error code if the input has invalid block.
+    int Next(
+        const char*& outRecordPtr,
+        int&         outRecordLength);
+    int GetConsumed() const
+        { return mInPos; }
+    int64_t GetBlockCount() const
+        { return mBlockCount; }
+    int64_t GetPaddingSize() const
+        { return mPaddingSize; }
+    int GetStatus() const
+        { return mStatus; }
+private:
+    std::vector<char> mRaw;
+    const char*       mInPtr;
+    int               mInLength;
+    int               mInPos;
+    int64_t           mFileOffset;
+    const char*       mCurPtr;
+    const char*       mEndPtr;
+    int               mRecordsLeft;
+    int               mStatus;
+    int64_t           mBlockCount;
+    int64_t           mPaddingSize;
+
+    int SkipPadding();
+    int NextBlock();
+private:
+    RecordBlockReader(
+        const RecordBlockReader& inReader);
+    RecordBlockReader& operator=(
+        const RecordBlockReader& inReader);
+};
+
+}
+
+#endif /* RECORD_BLOCK_H */
@@ -41,6 +41,7 @@
 #include "KfsOps.h"
 #include "Utils.h"
 #include "KfsClient.h"
+#include "RecordBlock.h"
 
 namespace KFS
 {
@@ -124,6 +125,10 @@ public:
           mPrevRecordAppendOpSeq(-1),
           mGetRecordAppendOpStatusIndex(0u),
           mLogPrefix(inLogPrefix),
+          mBlockWriter(),
+          mBlocks(),
+          mRecordBlocksFlag(false),
+          mPendingRecordsSize(0),
           mStats(),
           mNetManager(mMetaServer.GetNetManager())
     {
@@ -158,6 +163,7 @@ public:
             return -EAGAIN;
         }
         mBuffer.Clear();
+        ClearRecordBlocks();
         mStats.Clear();
         mPartialBuffersCount   = 0;
         mOpeningFlag           = true;
@@ -191,6 +197,7 @@ public:
             return -EAGAIN;
         }
         mBuffer.Clear();
+        ClearRecordBlocks();
         mStats.Clear();
         mPartialBuffersCount   = 0;
         mPathName              = inFileNamePtr;
@@ -229,6 +236,7 @@ public:
             return -EAGAIN;
         }
         mClosingFlag = true;
+        SealRecordBlockIfNeeded();
         if (! mCurOpPtr) {
             StartAppend();
         }
@@ -247,7 +255,15 @@ public:
         if (inLength <= 0) {
             return 0;
         }
-        if (mMaxPartialBuffersCount == 0 ||
+        if (mRecordBlocksFlag) {
+            // The block is appended as a whole, once it is sealed.
+            if (mBlockWriter.IsFull(inLength)) {
+                SealRecordBlock();
+            }
+            mBlockWriter.Add(inBuffer, inLength);
+            mPendingRecordsSize += inLength;
+            SealRecordBlockIfNeeded();
+        } else if (mMaxPartialBuffersCount == 0 ||
                 inLength < IOBufferData::GetDefaultBufferSize() * 2) {
             // If record is too small, just copy it into the last buffer.
             mBuffer.ReplaceKeepBuffersFull(&inBuffer,
@@ -265,12 +281,8 @@ public:
                 mStats.mBufferCompactionCount++;
             }
         }
-        const int kMinWriteQueueEntrySize = 256;
-        if (mWriteQueue.empty() ||
-                mWriteQueue.back() > kMinWriteQueueEntrySize) {
-            mWriteQueue.push_back(inLength);
-        } else {
-            mWriteQueue.back() += inLength;
+        if (! mRecordBlocksFlag) {
+            QueueWrite(inLength);
         }
         if (! mCurOpPtr && mOpenFlag) {
             StartAppend();
@@ -293,6 +305,7 @@ public:
         mErrorCode    = 0;
         mWriteQueue.clear();
         mBuffer.Clear();
+        ClearRecordBlocks();
     }
     bool IsOpen() const
         { return (mOpenFlag && ! mClosingFlag); }
@@ -305,7 +318,10 @@ public:
     bool IsActive() const
         { return (mOpenFlag || mOpeningFlag); }
     int GetPendingSize() const
-        { return mBuffer.BytesConsumable(); }
+    {
+        return (mRecordBlocksFlag ?
+            mPendingRecordsSize : mBuffer.BytesConsumable());
+    }
     std::string GetServerLocation() const
         { return mChunkServer.GetServerLocation(); }
     int SetWriteThreshold(
@@ -313,6 +329,9 @@ public:
     {
         const bool theStartAppendFlag = mWriteThreshold > inThreshold;
         mWriteThreshold = inThreshold;
+        if (theStartAppendFlag) {
+            SealRecordBlockIfNeeded();
+        }
         if (theStartAppendFlag && ! mCurOpPtr && mOpenFlag &&
                 mErrorCode == 0 && ! mWriteQueue.empty()) {
             StartAppend();
@@ -366,6 +385,19 @@ public:
     void SetForcedAllocationInterval(
         int inInterval)
         { mForcedAllocationInterval = inInterval; }
+    int SetRecordBlocks(
+        int  inBlockSize,
+        bool inCompressFlag)
+    {
+        if (mPendingRecordsSize > 0 || ! mBuffer.IsEmpty()) {
+            return -EINVAL;
+        }
+        mRecordBlocksFlag = inBlockSize > 0;
+        if (mRecordBlocksFlag) {
+            mBlockWriter.SetParameters(inBlockSize, inCompressFlag);
+        }
+        return 0;
+    }
 
 protected:
     virtual void OpDone(
@@ -427,6 +459,8 @@ private:
     typedef KfsNetClient           ChunkServer;
     typedef std::vector<WriteInfo> WriteIds;
     typedef std::deque<int>        WriteQueue;
+    // Sealed record block: framed size, and the records size.
+    typedef std::deque<std::pair<int, int> > RecordBlocks;
     typedef std::string::size_type StringPos;
     struct NopDispatch
     {
@@ -484,6 +518,10 @@ private:
     int64_t                 mPrevRecordAppendOpSeq;
     unsigned int            mGetRecordAppendOpStatusIndex;
     std::string const       mLogPrefix;
+    RecordBlockWriter       mBlockWriter;
+    RecordBlocks            mBlocks;
+    bool                    mRecordBlocksFlag;
+    int                     mPendingRecordsSize;
     Stats                   mStats;
     NetManager&             mNetManager;
 
@@ -521,11 +559,69 @@ private:
         }
         return true;
     }
+    void QueueWrite(
+        int inLength)
+    {
+        const int kMinWriteQueueEntrySize = 256;
+        if (mWriteQueue.empty() ||
+                mWriteQueue.back() > kMinWriteQueueEntrySize) {
+            mWriteQueue.push_back(inLength);
+        } else {
+            mWriteQueue.back() += inLength;
+        }
+    }
+    void SealRecordBlock()
+    {
+        const int theRecordsSize = mBlockWriter.GetRecordsSize();
+        const int theRawSize     = mBlockWriter.GetRawSize();
+        const int theLength      = mBlockWriter.Seal(mBuffer);
+        if (theLength <= 0) {
+            return;
+        }
+        mBlocks.push_back(std::make_pair(theLength, theRecordsSize));
+        // Do not coalesce write queue entries: the block must not be split
+        // between two appends.
+        mWriteQueue.push_back(theLength);
+        mStats.mRecordBlockCount++;
+        mStats.mRecordBlockRawByteCount += theRawSize;
+        mStats.mRecordBlockByteCount    += theLength;
+    }
+    void SealRecordBlockIfNeeded()
+    {
+        if (mRecordBlocksFlag && ! mBlockWriter.IsEmpty() && (mClosingFlag ||
+                mBlockWriter.GetRawSize() >= mBlockWriter.GetBlockSize() ||
+                mBuffer.BytesConsumable() + mBlockWriter.GetRawSize() >=
+                    mWriteThreshold)) {
+            SealRecordBlock();
+        }
+    }
+    void ConsumeRecordBlocks(
+        int inLength)
+    {
+        if (! mRecordBlocksFlag) {
+            return;
+        }
+        // Appends always consist of whole blocks.
+        while (inLength > 0) {
+            QCRTASSERT(! mBlocks.empty() && mBlocks.front().first <= inLength);
+            inLength            -= mBlocks.front().first;
+            mPendingRecordsSize -= mBlocks.front().second;
+            mBlocks.pop_front();
+        }
+        QCRTASSERT(mPendingRecordsSize >= 0);
+    }
+    void ClearRecordBlocks()
+    {
+        mBlockWriter.Clear();
+        mBlocks.clear();
+        mPendingRecordsSize = 0;
+    }
     void StartAppend()
     {
         if (mSleepingFlag || mErrorCode) {
             return;
         }
+        SealRecordBlockIfNeeded();
         mCurOpPtr = 0;
         if (mClosingFlag && mWriteQueue.empty()) {
             if (! mChunkServer.WasDisconnected()) {
@@ -1014,6 +1110,7 @@ private:
         QCRTASSERT(mAppendLength > 0 && theConsumed == mAppendLength &&
                 mSpaceAvailable >= mAppendLength);
         mSpaceAvailable -= mAppendLength;
+        ConsumeRecordBlocks(theConsumed);
         // The queue can change in the case if it had only one record when
         // append started, and then the next record arrived and the two
         // (short) records were coalesced into one.
@@ -1653,4 +1750,12 @@ WriteAppender::SetForcedAllocationInterval(
     return mImpl.SetForcedAllocationInterval(inInterval);
 }
 
+    int
+WriteAppender::SetRecordBlocks(
+    int  inBlockSize,
+    bool inCompressFlag /* = true */)
+{
+    return mImpl.SetRecordBlocks(inBlockSize, inCompressFlag);
+}
+
 }
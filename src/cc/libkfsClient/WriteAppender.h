@@ -73,7 +73,10 @@ public:
               mRetriesCount(0),
               mBufferCompactionCount(0),
               mAppendCount(0),
-              mAppendByteCount(0)
+              mAppendByteCount(0),
+              mRecordBlockCount(0),
+              mRecordBlockRawByteCount(0),
+              mRecordBlockByteCount(0)
             {}
         void Clear()
             { *this = Stats(); }
@@ -92,6 +95,9 @@ public:
             mBufferCompactionCount   += inStats.mBufferCompactionCount;
             mAppendCount             += inStats.mAppendCount;
             mAppendByteCount         += inStats.mAppendByteCount;
+            mRecordBlockCount        += inStats.mRecordBlockCount;
+            mRecordBlockRawByteCount += inStats.mRecordBlockRawByteCount;
+            mRecordBlockByteCount    += inStats.mRecordBlockByteCount;
             return *this;
         }
         std::ostream& Display(
@@ -127,7 +133,13 @@ public:
                 "AppendCount"                << theDelimiterPtr <<
                     mAppendCount             << theSeparatorPtr <<
                 "AppendByteCount"            << theDelimiterPtr <<
-                    mAppendByteCount
+                    mAppendByteCount         << theSeparatorPtr <<
+                "RecordBlocks"               << theDelimiterPtr <<
+                    mRecordBlockCount        << theSeparatorPtr <<
+                "RecordBlockRawBytes"        << theDelimiterPtr <<
+                    mRecordBlockRawByteCount << theSeparatorPtr <<
+                "RecordBlockBytes"           << theDelimiterPtr <<
+                    mRecordBlockByteCount
             ;
             return inStream;
         }
@@ -143,6 +155,9 @@ public:
         Counter mBufferCompactionCount;
         Counter mAppendCount;
         Counter mAppendByteCount;
+        Counter mRecordBlockCount;
+        Counter mRecordBlockRawByteCount;
+        Counter mRecordBlockByteCount;
     };
     typedef KfsNetClient MetaServer;
     WriteAppender(
@@ -194,6 +209,13 @@ public:
     bool GetPreAllocation() const;
     void SetForcedAllocationInterval(
         int inInterval);
+    // Pack the appended records into framed blocks of the specified size,
+    // optionally compressed, see RecordBlock.h. Each block is appended
+    // atomically. Block size 0 turns this off. Can only be changed while no
+    // data is pending.
+    int SetRecordBlocks(
+        int  inBlockSize,
+        bool inCompressFlag = true);
 private:
     class Impl;
     Impl& mImpl;
@@ -38,7 +38,6 @@
 
 using std::min;
 using std::vector;
-using std::list;
 
 namespace KFS {
 
@@ -26,6 +26,8 @@
 
 #include "Counter.h"
 
+#include <sys/time.h>
+
 using namespace KFS;
 
 /// A few commonly needed counters
@@ -56,3 +58,95 @@ void InitCounterManager()
 }
 
 
+Histogram::Histogram(const char *name)
+    : Counter(name),
+      mSum(0),
+      mMin(0),
+      mMax(0),
+      mRateStart(time(0)),
+      mRateCount(0),
+      mRate(0)
+{
+    std::fill(mBuckets, mBuckets + kBucketCount, int64_t(0));
+}
+
+int64_t
+Histogram::NowUsec()
+{
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return (int64_t(now.tv_sec) * 1000000 + now.tv_usec);
+}
+
+void
+Histogram::Reset()
+{
+    Counter::Reset();
+    std::fill(mBuckets, mBuckets + kBucketCount, int64_t(0));
+    mSum       = 0;
+    mMin       = 0;
+    mMax       = 0;
+    mRateStart = time(0);
+    mRateCount = 0;
+    mRate      = 0;
+}
+
+int64_t
+Histogram::BucketValue(int idx)
+{
+    if (idx < kSubBucketCount) {
+        return idx;
+    }
+    const int     shift = (idx >> kSubBucketBits) - 1;
+    const int64_t width = int64_t(1) << shift;
+    return ((int64_t(kSubBucketCount + (idx & (kSubBucketCount - 1))) <<
+        shift) + width / 2);
+}
+
+int64_t
+Histogram::GetPercentile(double fraction) const
+{
+    if (mCount <= 0) {
+        return 0;
+    }
+    // Rank of the value, 1 based.
+    int64_t rank = (int64_t)(fraction * mCount + 0.5);
+    rank = std::max(int64_t(1), std::min(rank, (int64_t)mCount));
+    int64_t seen = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        seen += mBuckets[i];
+        if (seen >= rank) {
+            return std::max(mMin, std::min(mMax, BucketValue(i)));
+        }
+    }
+    return mMax;
+}
+
+double
+Histogram::GetRate()
+{
+    const time_t now = time(0);
+    if (now >= mRateStart + kRateIntervalSec) {
+        mRate      = (double)mRateCount / (now - mRateStart);
+        mRateStart = now;
+        mRateCount = 0;
+    }
+    return mRate;
+}
+
+void
+Histogram::Show(std::ostringstream &os)
+{
+    const double rate = GetRate();
+    os << mName << ": "
+        "count=" << mCount <<
+        ",sum="  << mSum <<
+        ",min="  << mMin <<
+        ",max="  << mMax <<
+        ",p50="  << GetPercentile(0.5) <<
+        ",p90="  << GetPercentile(0.9) <<
+        ",p99="  << GetPercentile(0.99) <<
+        ",p999=" << GetPercentile(0.999) <<
+        ",rate=" << rate <<
+    "\r\n";
+}
@@ -29,6 +29,7 @@
 #define LIBKFSIO_COUNTER_H
 
 #include <stdint.h>
+#include <time.h>
 #include <algorithm>
 #include <string>
 #include <sstream>
@@ -91,6 +92,82 @@ protected:
     float mTimeSpent;
 };
 
+/// Log-linear histogram of non negative values, typically latencies in
+/// micro seconds. Each power of two range is split into 16 equal width
+/// buckets, so the percentiles are within about 3% of the exact values,
+/// and recording a value costs a few arithmetic operations.
+/// Show() emits a single "name: key=value,..." line, that is parsed along
+/// with the other counters by the stats RPC clients.
+/// The histogram is not synchronized: it must be updated by the thread
+/// that runs the net manager, like the other counters.
+class Histogram : public Counter {
+public:
+    Histogram(const char *name);
+
+    /// Record a value.
+    void Record(int64_t value) {
+        if (value < 0) {
+            value = 0;
+        }
+        mBuckets[BucketIndex(value)]++;
+        if (mCount == 0 || value < mMin) {
+            mMin = value;
+        }
+        if (value > mMax) {
+            mMax = value;
+        }
+        mSum += value;
+        mCount++;
+        mRateCount++;
+    }
+    /// Record the time elapsed since the start time.
+    void RecordUsec(int64_t startUsec, int64_t nowUsec) {
+        Record(nowUsec - startUsec);
+    }
+    /// @retval the approximate value below which the given fraction
+    /// (0 to 1) of the recorded values fall
+    int64_t GetPercentile(double fraction) const;
+    int64_t GetSum() const { return mSum; }
+    int64_t GetMin() const { return mMin; }
+    int64_t GetMax() const { return mMax; }
+    virtual void Show(std::ostringstream &os);
+    virtual void Reset();
+
+    static int64_t NowUsec();
+private:
+    enum { kSubBucketBits = 4 };
+    enum { kSubBucketCount = 1 << kSubBucketBits };
+    // Values of 2^40 usec (~12 days) and above go into the last bucket.
+    enum { kMaxExponent = 40 };
+    enum {
+        kBucketCount = (kMaxExponent - kSubBucketBits + 2) * kSubBucketCount
+    };
+    enum { kRateIntervalSec = 10 };
+
+    int64_t mBuckets[kBucketCount];
+    int64_t mSum;
+    int64_t mMin;
+    int64_t mMax;
+    time_t  mRateStart;
+    int64_t mRateCount;
+    double  mRate;
+
+    static int BucketIndex(int64_t value) {
+        if (value < kSubBucketCount) {
+            return (int)value;
+        }
+        const int exp = 63 - __builtin_clzll((unsigned long long)value);
+        if (exp > kMaxExponent) {
+            return kBucketCount - 1;
+        }
+        return (((exp - kSubBucketBits + 1) << kSubBucketBits) +
+            (int)((value >> (exp - kSubBucketBits)) & (kSubBucketCount - 1)));
+    }
+    /// @retval the middle of the bucket's value range
+    static int64_t BucketValue(int idx);
+    double GetRate();
+};
+
 class ShowCounter {
     std::ostringstream &os;
 public:
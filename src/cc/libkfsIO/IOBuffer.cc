@@ -32,12 +32,12 @@
 #include <stdlib.h>
 #include <iostream>
 #include <algorithm>
+#include <boost/static_assert.hpp>
 
 #include "IOBuffer.h"
 #include "Globals.h"
 
 using std::min;
-using std::list;
 
 using namespace KFS;
 using namespace KFS::libkfsio;
@@ -49,26 +49,8 @@ static libkfsio::IOBufferAllocator* sIOBufferAllocator = 0;
 static volatile bool sIsIOBufferAllocatorUsed = false;
 int IOBufferData::sDefaultBufferSize = 4 << 10;
 
-struct IOBufferArrayDeallocator
-{
-    void operator()(char* buf) { delete [] buf; }
-};
-
-struct IOBufferDeallocator
-{
-    void operator()(char* buf) { sIOBufferAllocator->Deallocate(buf); }
-};
-
-struct IOBufferDeallocatorCustom
-{
-    IOBufferDeallocatorCustom(
-        libkfsio::IOBufferAllocator& allocator)
-        : mAllocator(allocator)
-        {}
-    void operator()(char* buf) { mAllocator.Deallocate(buf); }
-private:
-    libkfsio::IOBufferAllocator& mAllocator;
-};
+// Block headers are small and allocated / freed frequently, use pool.
+typedef boost::fast_pool_allocator<char[32]> IOBufferBlockAllocator;
 
 // Call this function if you want to change the default allocator.
 bool libkfsio::SetIOBufferAllocator(libkfsio::IOBufferAllocator* allocator)
@@ -91,12 +73,39 @@ inline int IOBufferData::MaxConsumable(int numBytes) const
     return std::max(0, std::min(BytesConsumable(), numBytes));
 }
 
+IOBufferData::Block*
+IOBufferData::NewBlock(char* buf, libkfsio::IOBufferAllocator* allocator)
+{
+    BOOST_STATIC_ASSERT(
+        sizeof(IOBufferBlockAllocator::value_type) >= sizeof(IOBufferData::Block));
+    IOBufferData::Block* const block = reinterpret_cast<IOBufferData::Block*>(
+        IOBufferBlockAllocator::allocate());
+    if (! block) {
+        abort();
+    }
+    block->mData      = buf;
+    block->mAllocator = allocator;
+    block->mRefCount  = 1;
+    return block;
+}
+
+void IOBufferData::Release(IOBufferData::Block* block)
+{
+    if (block->mAllocator) {
+        block->mAllocator->Deallocate(block->mData);
+    } else {
+        delete [] block->mData;
+    }
+    IOBufferBlockAllocator::deallocate(
+        reinterpret_cast<IOBufferBlockAllocator::value_type*>(block));
+}
+
 inline void IOBufferData::Init(char* buf, int bufSize)
 {
     // glibc malloc returns 2 * sizeof(size_t) aligned blocks.
     const int size = std::max(0, bufSize);
-    mData.reset(buf ? buf : new char [size], IOBufferArrayDeallocator());
-    mProducer = mData.get();
+    mBlock    = NewBlock(buf ? buf : new char [size], 0);
+    mProducer = mBlock->mData;
     mEnd      = mProducer + size;
     mConsumer = mProducer;
 }
@@ -108,31 +117,30 @@ inline void IOBufferData::Init(char* buf, libkfsio::IOBufferAllocator& allocator
             sDefaultBufferSize = sIOBufferAllocator->GetBufferSize();
         }
         sIsIOBufferAllocatorUsed = true;
-        mData.reset(buf ? buf : allocator.Allocate(),
-            IOBufferDeallocator());
-    } else {
-        mData.reset(buf ? buf : allocator.Allocate(),
-            IOBufferDeallocatorCustom(allocator));
     }
-    if (! (mProducer = mData.get())) {
+    char* const data = buf ? buf : allocator.Allocate();
+    if (! data) {
         abort();
     }
+    mBlock    = NewBlock(data, &allocator);
+    mProducer = data;
     mEnd      = mProducer + allocator.GetBufferSize();
     mConsumer = mProducer;
 }
 
 // setup a new IOBufferData for read access by block sharing.  
 IOBufferData::IOBufferData(const IOBufferData &other, char *s, char *e)
-    : mData(other.mData),
+    : mBlock(other.mBlock),
       mEnd(e),
       mProducer(e),
       mConsumer(s)
 {
-    assert(s <= e && (! s || s >= mData.get()));
+    assert(s <= e && (! s || (mBlock && s >= mBlock->mData)));
+    Ref();
 }
 
 IOBufferData::IOBufferData()
-    : mData(),
+    : mBlock(0),
       mEnd(0),
       mProducer(0),
       mConsumer(0)
@@ -145,7 +153,7 @@ IOBufferData::IOBufferData()
 }
 
 IOBufferData::IOBufferData(int bufsz)
-    : mData(),
+    : mBlock(0),
       mEnd(0),
       mProducer(0),
       mConsumer(0)
@@ -154,7 +162,7 @@ IOBufferData::IOBufferData(int bufsz)
 }
 
 IOBufferData::IOBufferData(char* buf, int offset, int size, libkfsio::IOBufferAllocator& allocator)
-    : mData(),
+    : mBlock(0),
       mEnd(0),
       mProducer(0),
       mConsumer(0)
@@ -165,7 +173,7 @@ IOBufferData::IOBufferData(char* buf, int offset, int size, libkfsio::IOBufferAl
 }
 
 IOBufferData::IOBufferData(char* buf, int bufSize, int offset, int size)
-    : mData(),
+    : mBlock(0),
       mEnd(0),
       mProducer(0),
       mConsumer(0)
@@ -175,10 +183,6 @@ IOBufferData::IOBufferData(char* buf, int bufSize, int offset, int size)
     IOBufferData::Consume(offset);
 }
 
-IOBufferData::~IOBufferData()
-{
-}
-
 int IOBufferData::ZeroFill(int numBytes)
 {
     const int nbytes = MaxAvailable(numBytes);
@@ -206,6 +210,11 @@ int IOBufferData::Trim(int numBytes)
 {
     const int nbytes = MaxConsumable(numBytes);
     mProducer = mConsumer + nbytes;
+    if (IsShared()) {
+        // The trimmed bytes might still be in use by the other buffers:
+        // do not append over them.
+        mEnd = mProducer;
+    }
     return nbytes;
 }
 
@@ -345,6 +354,32 @@ inline void IOBuffer::DebugVerify(bool updateChecksum)                 {}
 inline void IOBuffer::DebugVerify() const                              {}
 #endif
 
+void IOBuffer::BList::Reserve(size_t cnt)
+{
+    const size_t sz  = size();
+    const size_t cap = mCapEnd - mBuf;
+    if (mStart != mBuf && sz + cnt <= cap && sz <= cap / 2) {
+        // Reclaim the space at the front.
+        Relocate(mBuf, mStart, sz);
+        mStart = mBuf;
+        mEnd   = mBuf + sz;
+        return;
+    }
+    const size_t kMinCapacity = 8;
+    const size_t capacity     = std::max(kMinCapacity, 2 * sz + cnt);
+    IOBufferData* const buf   = static_cast<IOBufferData*>(
+        malloc(capacity * sizeof(*buf)));
+    if (! buf) {
+        abort();
+    }
+    Relocate(buf, mStart, sz);
+    free(mBuf);
+    mBuf    = buf;
+    mStart  = buf;
+    mEnd    = buf + sz;
+    mCapEnd = buf + capacity;
+}
+
 IOBuffer::IOBuffer()
     : mBuf(), mByteCount(0)
 #ifdef DEBUG_IOBuffer
@@ -376,12 +411,13 @@ int IOBuffer::Append(IOBuffer *ioBuf)
     for (it = ioBuf->mBuf.begin(); it != ioBuf->mBuf.end(); ) {
         const int nb = it->BytesConsumable();
         if (nb > 0) {
-            mBuf.splice(mBuf.end(), ioBuf->mBuf, it++);
             nBytes += nb;
+            ++it;
         } else {
             it = ioBuf->mBuf.erase(it);
         }
     }
+    mBuf.splice(ioBuf->mBuf);
     assert(mByteCount >= 0 &&
         ioBuf->mByteCount == nBytes && ioBuf->mBuf.empty());
     ioBuf->mByteCount = 0;
@@ -405,7 +441,7 @@ int IOBuffer::Move(IOBuffer *other, int numBytes)
         const int     nb = s.BytesConsumable();
         if (nBytes >= nb) {
             if (nb > 0) {
-                mBuf.splice(mBuf.end(), other->mBuf, other->mBuf.begin());
+                mBuf.splice_front(other->mBuf);
                 nBytes -= nb;
             } else {
                 other->mBuf.pop_front();
@@ -436,7 +472,7 @@ void IOBuffer::Move(IOBuffer *other)
 {
     DebugChecksum(*other, other->mByteCount);
     assert(mByteCount >= 0 && other->mByteCount >= 0);
-    mBuf.splice(mBuf.end(), other->mBuf);
+    mBuf.splice(other->mBuf);
     mByteCount += other->mByteCount;
     other->mByteCount = 0;
     other->DebugVerify(true);
@@ -455,9 +491,10 @@ IOBuffer::SplitBufferListAt(IOBuffer::BList& buf, int& nBytes)
             continue;
         }
         if (nb > nBytes) {
-            buf.insert(iter, IOBufferData(
+            iter = buf.insert(iter, IOBufferData(
                 data, data.Consumer(), data.Consumer() + nBytes));
-            nBytes -= data.Consume(nBytes);
+            ++iter;
+            nBytes -= iter->Consume(nBytes);
             assert(nBytes == 0);
         } else {
             nBytes -= nb;
@@ -477,6 +514,7 @@ void IOBuffer::Replace(IOBuffer *other, int offset, int numBytes)
     // extend buffer if needed
     if (nBytes > 0) {
         ZeroFill(nBytes);
+        iter = mBuf.end();
     }
     // split "other" at numBytes
     nBytes = numBytes;
@@ -501,7 +539,7 @@ void IOBuffer::Replace(IOBuffer *other, int offset, int numBytes)
     mByteCount += nBytes;
 
     // now, put the thing at insertPt
-    mBuf.splice(iter, other->mBuf, other->mBuf.begin(), otherEnd);
+    mBuf.splice(iter, other->mBuf, otherEnd);
     assert(mByteCount >= 0);
     other->DebugVerify(true);
     DebugVerify(true);
@@ -580,7 +618,10 @@ void IOBuffer::ReplaceKeepBuffersFull(IOBuffer* srcBuf, int inOffset, int numByt
                 d = &dst.back();
             }
         }
-        if (d) {
+        // Filling the buffer in front of offset appends to it, therefore
+        // only the last buffer can be filled: the following buffers
+        // have to be replaced.
+        if (d && di == dst.end()) {
             while (rem > 0 && ! src.empty() && ! d->IsFull()) {
                 IOBufferData& s = src.front();
                 rem -= s.Consume(d->CopyIn(&s, rem));
@@ -604,7 +645,7 @@ void IOBuffer::ReplaceKeepBuffersFull(IOBuffer* srcBuf, int inOffset, int numByt
             if (di != dst.end() && nb != di->BytesConsumable()) {
                 break;
             }
-            dst.splice(di, src, src.begin());
+            di = dst.splice(di, src, src.begin() + 1);
             if (di != dst.end()) {
                 di = dst.erase(di);
                 while (di != dst.end() && di->IsEmpty()) {
@@ -633,9 +674,11 @@ void IOBuffer::ReplaceKeepBuffersFull(IOBuffer* srcBuf, int inOffset, int numByt
             BList::iterator in = di;
             IOBufferData fp(*in); // Make a shallow copy.
             *in = IOBufferData(); // Replace with new buffer.
+            const size_t pos = di - dst.begin();
             while ((dl -= fp.Consume(in->CopyIn(fp.Consumer(), dl))) > 0) {
                 in = dst.insert(++in, IOBufferData());
             }
+            di = dst.begin() + pos; // Insert invalidates iterators.
             // If more than one buffer was created, then postion to the one
             // at the requested offset.
             while ((dl = di->BytesConsumable()) < off) {
@@ -741,10 +784,13 @@ int IOBuffer::Read(int fd, int maxReadAhead /* = -1 */)
         }
     }
 
+    // Read at least 64K or 4 buffers per system call, so that larger
+    // buffers reduce the number of system calls.
     const ssize_t kMaxReadv     = 64 << 10;
     const int     kMaxReadvBufs(kMaxReadv / (4 << 10) + 1);
+    const ssize_t maxReadv      = std::max(kMaxReadv, ssize_t(bufSize) * 4);
     const int     maxReadvBufs  = std::min(IOV_MAX,
-        std::min(kMaxReadvBufs, int(kMaxReadv / bufSize + 1)));
+        std::min(kMaxReadvBufs, int(maxReadv / bufSize + 1)));
     struct iovec  readVec[kMaxReadvBufs];
     ssize_t       totRead = 0;
     bool          useLast = ! mBuf.empty() && ! mBuf.back().IsFull();
@@ -831,7 +877,9 @@ int IOBuffer::Write(int fd)
     DebugVerify();
     const int    kMaxWritevBufs      = 32;
     const int    maxWriteBufs        = std::min(IOV_MAX, kMaxWritevBufs);
-    const int    kPreferredWriteSize = 64 << 10;
+    const int    preferredWriteSize  = std::max(64 << 10,
+        4 * (sIOBufferAllocator ? int(sIOBufferAllocator->GetBufferSize()) :
+            IOBufferData::GetDefaultBufferSize()));
     struct iovec writeVec[kMaxWritevBufs];
     ssize_t      totWr = 0;
 
@@ -841,7 +889,7 @@ int IOBuffer::Write(int fd)
         ssize_t         toWr;
         for (it = mBuf.begin(), nVec = 0, toWr = 0;
                 it != mBuf.end() && nVec < maxWriteBufs &&
-                    toWr < kPreferredWriteSize;
+                    toWr < preferredWriteSize;
                 ) {
             const int nBytes = it->BytesConsumable();
             if (nBytes <= 0) {
@@ -1101,7 +1149,7 @@ void IOBuffer::MakeBuffersFull()
         }
         if (mBuf.empty() || mBuf.back().IsFull()) {
             if (s.HasCompleteBuffer() && (s.IsFull() || &s == &buf.back())) {
-                mBuf.splice(mBuf.end(), buf, buf.begin());
+                mBuf.splice_front(buf);
                 continue;
             }
             mBuf.push_back(IOBufferData());
@@ -27,15 +27,16 @@
 #define _LIBIO_IOBUFFER_H
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <cassert>
-#include <list>
+#include <new>
 #include <exception>
 #include <streambuf>
 #include <ostream>
 #include <istream>
 #include <limits>
 
-#include <boost/shared_ptr.hpp>
 #include <boost/pool/pool_alloc.hpp> 
 
 namespace KFS
@@ -53,6 +54,13 @@ namespace KFS
 /// In the current implementation, IOBufferData objects are single
 /// producer, multiple consumers.
 ///
+/// The data blocks are reference counted with intrusive atomic reference
+/// counts, therefore the copies of a block can be released by different
+/// threads, for example the disk io threads release the buffers of the
+/// cancelled writes.  An IOBuffer or IOBufferData itself is not thread
+/// safe: it can be handed off from one thread to another with the
+/// appropriate synchronization, like a queue with a mutex.
+///
 
 ///
 /// \class IOBufferData
@@ -94,7 +102,26 @@ public:
     /// set the producer/consumer based on the start/end positions
     /// that are passed in
     IOBufferData(const IOBufferData &other, char *s, char *e);
-    ~IOBufferData();
+    IOBufferData(const IOBufferData &other)
+        : mBlock(other.mBlock),
+          mEnd(other.mEnd),
+          mProducer(other.mProducer),
+          mConsumer(other.mConsumer)
+        { Ref(); }
+    IOBufferData& operator=(const IOBufferData &other)
+    {
+        if (mBlock != other.mBlock) {
+            UnRef();
+            mBlock = other.mBlock;
+            Ref();
+        }
+        mEnd      = other.mEnd;
+        mProducer = other.mProducer;
+        mConsumer = other.mConsumer;
+        return *this;
+    }
+    ~IOBufferData()
+        { UnRef(); }
 
     ///
     /// Read data from file descriptor into the buffer.
@@ -179,20 +206,26 @@ public:
     int IsEmpty() const { return mProducer <= mConsumer; }
     /// Returns true if has whole data buffer.
     bool HasCompleteBuffer() const {
-        return (mData.get() == mConsumer &&
+        return (mBlock && mBlock->mData == mConsumer &&
             mConsumer + sDefaultBufferSize == mEnd);
     }
     bool IsShared() const {
-        return (! mData.unique());
+        return (mBlock && mBlock->mRefCount > 1);
     }
     static int GetDefaultBufferSize() {
         return sDefaultBufferSize;
     }
 
 private:
-    /// Data buffer that is ref-counted for sharing.
-    typedef boost::shared_ptr<char> IOBufferBlockPtr;
-    IOBufferBlockPtr mData;
+    /// Data buffer that is ref-counted for sharing.  The reference
+    /// count is intrusive, and atomic, see the comment at the top.
+    struct Block
+    {
+        char*                        mData;
+        libkfsio::IOBufferAllocator* mAllocator; // 0 means delete []
+        int                          mRefCount;
+    };
+    Block*           mBlock;
     /// Pointers that correspond to the start/end of the buffer
     char             *mEnd;
     /// Pointers into mData that correspond to producer/consumer
@@ -207,6 +240,21 @@ private:
     inline int MaxAvailable(int numBytes) const;
     inline int MaxConsumable(int numBytes) const;
 
+    void Ref()
+    {
+        if (mBlock) {
+            __sync_add_and_fetch(&mBlock->mRefCount, 1);
+        }
+    }
+    void UnRef()
+    {
+        if (mBlock && __sync_sub_and_fetch(&mBlock->mRefCount, 1) <= 0) {
+            Release(mBlock);
+        }
+    }
+    static Block* NewBlock(char* buf, libkfsio::IOBufferAllocator* allocator);
+    static void Release(Block* block);
+
     static int sDefaultBufferSize;
 };
 
@@ -220,10 +268,161 @@ private:
 class IOBuffer
 {
 private:
-    typedef std::list<
-        IOBufferData,
-        boost::fast_pool_allocator<IOBufferData>
-    > BList;
+    /// Contiguous array of IOBufferData with O(1) append and removal at
+    /// either end.  IOBufferData has no self references, and is relocated
+    /// with memmove(), which avoids reference count updates when the array
+    /// grows, or when blocks are moved from one buffer to another.
+    /// Iterators are invalidated by any modification, except by removal
+    /// from the front or the back.
+    class BList
+    {
+    public:
+        typedef IOBufferData*       iterator;
+        typedef const IOBufferData* const_iterator;
+
+        BList()
+            : mBuf(0), mStart(0), mEnd(0), mCapEnd(0)
+            {}
+        ~BList()
+        {
+            clear();
+            free(mBuf);
+        }
+        iterator       begin()       { return mStart; }
+        iterator       end()         { return mEnd;   }
+        const_iterator begin() const { return mStart; }
+        const_iterator end()   const { return mEnd;   }
+        bool           empty() const { return (mStart == mEnd); }
+        size_t         size()  const { return (mEnd - mStart); }
+        IOBufferData&       front()       { return *mStart;    }
+        IOBufferData&       back()        { return *(mEnd - 1); }
+        const IOBufferData& front() const { return *mStart;    }
+        const IOBufferData& back()  const { return *(mEnd - 1); }
+        void push_back(const IOBufferData& buf)
+        {
+            if (mEnd < mCapEnd) {
+                new (mEnd) IOBufferData(buf);
+                ++mEnd;
+            } else {
+                // buf can be an element of this list.
+                const IOBufferData tmp(buf);
+                Reserve(1);
+                new (mEnd) IOBufferData(tmp);
+                ++mEnd;
+            }
+        }
+        void pop_front()
+        {
+            mStart->~IOBufferData();
+            if (++mStart == mEnd) {
+                mStart = mBuf;
+                mEnd   = mBuf;
+            }
+        }
+        void pop_back()
+        {
+            (--mEnd)->~IOBufferData();
+            if (mStart == mEnd) {
+                mStart = mBuf;
+                mEnd   = mBuf;
+            }
+        }
+        iterator erase(iterator pos)
+            { return erase(pos, pos + 1); }
+        iterator erase(iterator first, iterator last)
+        {
+            for (iterator it = first; it != last; ++it) {
+                it->~IOBufferData();
+            }
+            if (first == mStart) {
+                mStart = last;
+                if (mStart == mEnd) {
+                    mStart = mBuf;
+                    mEnd   = mBuf;
+                }
+                return mStart;
+            }
+            Relocate(first, last, mEnd - last);
+            mEnd -= last - first;
+            return first;
+        }
+        iterator insert(iterator pos, const IOBufferData& buf)
+        {
+            const IOBufferData tmp(buf);
+            pos = MakeRoom(pos, 1);
+            new (pos) IOBufferData(tmp);
+            return pos;
+        }
+        void clear()
+        {
+            for (iterator it = mStart; it != mEnd; ++it) {
+                it->~IOBufferData();
+            }
+            mStart = mBuf;
+            mEnd   = mBuf;
+        }
+        void swap(BList& other)
+        {
+            std::swap(mBuf,    other.mBuf);
+            std::swap(mStart,  other.mStart);
+            std::swap(mEnd,    other.mEnd);
+            std::swap(mCapEnd, other.mCapEnd);
+        }
+        /// Move [other.begin(), last) in front of pos.
+        iterator splice(iterator pos, BList& other, iterator last)
+        {
+            const size_t cnt = last - other.mStart;
+            if (cnt <= 0) {
+                return pos;
+            }
+            pos = MakeRoom(pos, cnt);
+            Relocate(pos, other.mStart, cnt);
+            other.mStart = last;
+            if (other.mStart == other.mEnd) {
+                other.mStart = other.mBuf;
+                other.mEnd   = other.mBuf;
+            }
+            return (pos + cnt);
+        }
+        /// Move all elements of other to the end.
+        void splice(BList& other)
+        {
+            if (empty()) {
+                swap(other);
+                return;
+            }
+            splice(mEnd, other, other.mEnd);
+        }
+        /// Move the first element of other to the end.
+        void splice_front(BList& other)
+            { splice(mEnd, other, other.mStart + 1); }
+    private:
+        IOBufferData* mBuf;
+        IOBufferData* mStart;
+        IOBufferData* mEnd;
+        IOBufferData* mCapEnd;
+
+        static void Relocate(
+            IOBufferData* dst, IOBufferData* src, size_t cnt)
+        {
+            memmove(static_cast<void*>(dst), static_cast<void*>(src),
+                cnt * sizeof(*dst));
+        }
+        void Reserve(size_t cnt);
+        iterator MakeRoom(iterator pos, size_t cnt)
+        {
+            if (mEnd + cnt > mCapEnd) {
+                const size_t off = pos - mStart;
+                Reserve(cnt);
+                pos = mStart + off;
+            }
+            Relocate(pos + cnt, pos, mEnd - pos);
+            mEnd += cnt;
+            return pos;
+        }
+        BList(const BList&);
+        BList& operator=(const BList&);
+    };
 public:
     typedef BList::const_iterator iterator;
 
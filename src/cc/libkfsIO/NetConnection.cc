@@ -101,7 +101,7 @@ void NetConnection::HandleErrorEvent()
 
 void NetConnection::HandleTimeoutEvent()
 {
-    const int timeOut = GetInactivityTimeout();
+    const int timeOut = GetInactivityTimeoutMs();
     if (timeOut < 0) {
         NET_CONNECTION_LOG_STREAM_DEBUG <<
             "ignoring timeout event, time out value: " << timeOut <<
@@ -35,6 +35,8 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/pool/pool_alloc.hpp> 
 #include <list>
+#include <limits>
+#include <algorithm>
 
 namespace KFS
 {
@@ -76,7 +78,7 @@ public:
           mSock(sock),
           mInBuffer(),
           mOutBuffer(), 
-          mInactivityTimeoutSecs(-1),
+          mInactivityTimeoutMs(-1),
           maxReadAhead(-1),
           mPeerName() {
         assert(mSock);
@@ -105,14 +107,26 @@ public:
     /// the owning object; maybe time to close the connection
     /// Setting new timeout resets the timer.
     void SetInactivityTimeout(int nsecs) {
-        if (mInactivityTimeoutSecs != nsecs) {
-            mInactivityTimeoutSecs = nsecs;
+        SetInactivityTimeoutMs(nsecs < 0 ? -1 :
+            std::min(nsecs, std::numeric_limits<int>::max() / 1000) * 1000);
+    }
+
+    /// Same as the above, with millisecond resolution.
+    void SetInactivityTimeoutMs(int nmsecs) {
+        if (mInactivityTimeoutMs != nmsecs) {
+            mInactivityTimeoutMs = nmsecs;
             Update();
         }
     }
 
+    /// Returns the timeout rounded up to seconds.
     int GetInactivityTimeout() const {
-        return mInactivityTimeoutSecs;
+        return (mInactivityTimeoutMs < 0 ? -1 :
+            (mInactivityTimeoutMs + 999) / 1000);
+    }
+
+    int GetInactivityTimeoutMs() const {
+        return mInactivityTimeoutMs;
     }
 
     /// Callback for handling a read.  That is, select() thinks that
@@ -286,8 +300,8 @@ public:
               mConnectPending(false),
               mFd(-1),
               mWriteByteCount(0),
-              mTimerWheelSlot(-1),
-              mExpirationTime(-1),
+              mExpirationMs(-1),
+              mTimer(0),
               mNetManager(0),
               mListIt()
             {}
@@ -296,6 +310,9 @@ public:
         bool IsConnectPending() const     { return mConnectPending; }
 
     private:
+        /// Inactivity timer, owned by the net manager.
+        class Timer;
+
         bool           mIn:1;
         bool           mOut:1;
         bool           mAdded:1;
@@ -305,8 +322,11 @@ public:
         bool           mConnectPending:1;
         int            mFd;
         int            mWriteByteCount;
-        int            mTimerWheelSlot;
-        time_t         mExpirationTime;
+        /// Inactivity timeout expiration time. The timer expiration is
+        /// only moved closer, when the timer fires it is re-scheduled if the
+        /// connection was active in the mean time.
+        int64_t        mExpirationMs;
+        Timer*         mTimer;
         NetManager*    mNetManager;
         List::iterator mListIt;
 
@@ -340,7 +360,7 @@ private:
 
     /// When was the last activity on this connection
     /// # of bytes from the out buffer that should be sent out.
-    int			mInactivityTimeoutSecs;
+    int			mInactivityTimeoutMs;
     int                 maxReadAhead;
     std::string         mPeerName;
 
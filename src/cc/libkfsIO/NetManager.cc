@@ -24,7 +24,7 @@
 //----------------------------------------------------------------------------
 
 #include <cerrno>
-#include <limits>
+#include <algorithm>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -40,10 +40,12 @@
 using std::list;
 using std::min;
 using std::max;
-using std::numeric_limits;
+using std::swap;
 using namespace KFS;
 using namespace KFS::libkfsio;
 
+typedef QCDLList<NetManager::TimerMs, 0> TimerMsList;
+
 class NetManager::Waker
 {
 public:
@@ -117,18 +119,44 @@ private:
    Waker& operator=(const Waker&); 
 };
 
+class NetConnection::NetManagerEntry::Timer : public KfsCallbackObj
+{
+public:
+    Timer(NetManager& netManager, NetConnection& conn)
+        : KfsCallbackObj(),
+          mNetManager(netManager),
+          mConn(conn),
+          mTimer(netManager, *this)
+        { SET_HANDLER(this, &Timer::EventHandler); }
+    NetManager::TimerMs& Get()
+        { return mTimer; }
+private:
+    NetManager&         mNetManager;
+    NetConnection&      mConn;
+    NetManager::TimerMs mTimer;
+
+    int EventHandler(int /* type */, void* /* data */)
+    {
+        // The handler can close the connection, and delete this timer.
+        mNetManager.ConnectionTimerExpired(mConn);
+        return 0;
+    }
+private:
+    Timer(const Timer&);
+    Timer& operator=(const Timer&);
+};
+
 NetManager::NetManager(int timeoutMs)
-    : mRemove(),
-      mTimerWheelBucketItr(mRemove.end()),
+    : mConnections(),
+      mRemove(),
+      mConnectionsItr(mRemove.end()),
       mCurConnection(0),
-      mCurTimerWheelSlot(0),
       mConnectionsCount(0),
       mDiskOverloaded(false),
       mNetworkOverloaded(false),
       mIsOverloaded(false),
       mRunFlag(true),
       mShutdownFlag(false),
-      mTimerRunningFlag(false),
       mIsForkedChild(false),
       mTimeoutMs(timeoutMs),
       mStartTime(time(0)),
@@ -139,8 +167,15 @@ NetManager::NetManager(int timeoutMs)
       mTimerOverrunSec(0),
       mPoll(*(new QCFdPoll())),
       mWaker(*(new Waker())),
-      mPollEventHook(0)
-{}
+      mPollEventHook(0),
+      mTimerWheelMsTime(ITimeout::NowMs()),
+      mTimerMsCount(0),
+      mNowMs(mTimerWheelMsTime)
+{
+    for (int i = 0; i <= kTimerWheelMsRunning; i++) {
+        TimerMsList::Init(mTimerWheelMs[i]);
+    }
+}
 
 NetManager::~NetManager()
 {
@@ -167,9 +202,9 @@ NetManager::AddConnection(NetConnectionPtr &conn)
         abort();
     }
     if (! entry->mAdded) {
-        entry->mTimerWheelSlot = kTimerWheelSize;
-        entry->mListIt = mTimerWheel[kTimerWheelSize].insert(
-            mTimerWheel[kTimerWheelSize].end(), conn);
+        entry->mListIt = mConnections.insert(mConnections.end(), conn);
+        entry->mExpirationMs = -1;
+        entry->mTimer = new ConnectionTimer(*this, *conn);
         mConnectionsCount++;
         assert(mConnectionsCount > 0);
         entry->mAdded = true;
@@ -215,31 +250,37 @@ NetManager::UnRegisterTimeoutHandler(ITimeout *handler)
 inline void
 NetManager::UpdateTimer(NetConnection::NetManagerEntry& entry, int timeOut)
 {
-    assert(entry.mAdded);
+    assert(entry.mAdded && entry.mTimer);
 
-    int timerWheelSlot;
+    TimerMs& timer = entry.mTimer->Get();
     if (timeOut < 0) {
-        timerWheelSlot = kTimerWheelSize;
-    } else if ((timerWheelSlot = mCurTimerWheelSlot +
-            // When the timer is running the effective wheel size "grows" by 1:
-            // leave (move) entries with timeouts >= kTimerWheelSize in (to) the
-            // current slot.
-            min((kTimerWheelSize - (mTimerRunningFlag ? 0 : 1)), timeOut)) >=
-            kTimerWheelSize) {
-        timerWheelSlot -= kTimerWheelSize;
-    }
-    // This method can be invoked from timeout handler.
-    // Make sure  that the entry doesn't get moved to the end of the current
-    // list, which can be traversed by the timer.
-    if (timerWheelSlot != entry.mTimerWheelSlot) {
-        if (mTimerWheelBucketItr == entry.mListIt) {
-            ++mTimerWheelBucketItr;
-        }
-        mTimerWheel[timerWheelSlot].splice(
-            mTimerWheel[timerWheelSlot].end(),
-            mTimerWheel[entry.mTimerWheelSlot], entry.mListIt);
-        entry.mTimerWheelSlot = timerWheelSlot;
+        entry.mExpirationMs = -1;
+        timer.Cancel();
+        return;
     }
+    // The connection activity only moves the expiration time forward,
+    // re-schedule the timer only if the expiration time gets closer.
+    // ConnectionTimerExpired() re-schedules the timer if it fires early.
+    entry.mExpirationMs = mNowMs + timeOut;
+    if (! timer.IsScheduled() ||
+            entry.mExpirationMs < timer.GetExpirationTime()) {
+        timer.ScheduleAt(entry.mExpirationMs);
+    }
+}
+
+void
+NetManager::ConnectionTimerExpired(NetConnection& conn)
+{
+    NetConnection::NetManagerEntry& entry = *conn.GetNetManagerEntry();
+    if (! entry.mAdded || entry.mExpirationMs < 0) {
+        return;
+    }
+    if (mNowMs < entry.mExpirationMs) {
+        entry.mTimer->Get().ScheduleAt(entry.mExpirationMs);
+        return;
+    }
+    assert(conn.IsGood());
+    conn.HandleTimeoutEvent();
 }
 
 inline static int CheckFatalSysError(int err, const char* msg)
@@ -284,11 +325,15 @@ NetManager::UpdateSelf(NetConnection::NetManagerEntry& entry, int fd, bool reset
         entry.mAdded = false;
         mConnectionsCount--;
         mNumBytesToSend -= entry.mWriteByteCount;
-        if (mTimerWheelBucketItr == entry.mListIt) {
-            ++mTimerWheelBucketItr;
+        // The timer can be running, i.e. this method can be invoked from
+        // ConnectionTimerExpired(). The timer destructor cancels the timer.
+        delete entry.mTimer;
+        entry.mTimer        = 0;
+        entry.mExpirationMs = -1;
+        if (mConnectionsItr == entry.mListIt) {
+            ++mConnectionsItr;
         }
-        mRemove.splice(mRemove.end(),
-            mTimerWheel[entry.mTimerWheelSlot], entry.mListIt);
+        mRemove.splice(mRemove.end(), mConnections, entry.mListIt);
         // Do not reset entry->mNetManager, it is an error to add connection to
         // a different net manager even after close.
         if (mPollEventHook) {
@@ -303,11 +348,7 @@ NetManager::UpdateSelf(NetConnection::NetManagerEntry& entry, int fd, bool reset
     }
     // Update timer.
     if (resetTimer) {
-        const int timeOut = conn.GetInactivityTimeout();
-        if (timeOut >= 0) {
-            entry.mExpirationTime = mNow + timeOut;
-        }
-        UpdateTimer(entry, timeOut);
+        UpdateTimer(entry, conn.GetInactivityTimeoutMs());
     }
     // Update pending send.
     assert(entry.mWriteByteCount >= 0 &&
@@ -356,7 +397,8 @@ NetManager::Wakeup()
 void
 NetManager::MainLoop()
 {
-    mNow = time(0);
+    mNowMs = ITimeout::NowMs();
+    mNow   = time_t(mNowMs / 1000);
     time_t lastTimerTime = mNow;
     CheckFatalSysError(
         mPoll.Add(mWaker.GetFd(), QCFdPoll::kOpTypeIn),
@@ -378,20 +420,18 @@ NetManager::MainLoop()
             // read event is pending. 
             // The "lazy" processing here is to reduce number of system calls.
             if (! mIsOverloaded) {
-                for (int i = 0; i <= kTimerWheelSize; i++) {
-                    for (List::iterator c = mTimerWheel[i].begin();
-                            c != mTimerWheel[i].end(); ) {
-                        assert(*c);
-                        NetConnection& conn = **c;
-                        ++c;
-                        conn.Update(false);
-                    }
+                for (List::iterator c = mConnections.begin();
+                        c != mConnections.end(); ) {
+                    assert(*c);
+                    NetConnection& conn = **c;
+                    ++c;
+                    conn.Update(false);
                 }
             }
         }
         const int ret = mPoll.Poll(
             mConnectionsCount + 1,
-            mWaker.Sleep() ? mTimeoutMs : 0
+            mWaker.Sleep() ? GetPollTimeoutMs(ITimeout::NowMs()) : 0
         );
         mWaker.Wake();
         if (ret < 0 && ret != -EINTR && ret != -EAGAIN) {
@@ -400,7 +440,8 @@ NetManager::MainLoop()
             KFS_LOG_EOM;
         }
         const int64_t nowMs = ITimeout::NowMs();
-        mNow = time_t(nowMs / 1000);
+        mNowMs = nowMs;
+        mNow   = time_t(nowMs / 1000);
         // Unregister will set pointer to 0, but will never remove the list
         // node, so that the iterator always remains valid.
         for (list<ITimeout *>::iterator it = mTimeoutHandlers.begin();
@@ -449,8 +490,8 @@ NetManager::MainLoop()
             conn.Update();
         }
         mRemove.clear();
-        mNow = time(0);
-        int slotCnt = min(int(kTimerWheelSize), int(mNow - lastTimerTime));
+        mNowMs = ITimeout::NowMs();
+        mNow   = time_t(mNowMs / 1000);
         if (lastTimerTime + timerOverrunWarningTime < mNow) {
             KFS_LOG_STREAM_INFO <<
                 "timer overrun " << (mNow - lastTimerTime) <<
@@ -459,38 +500,11 @@ NetManager::MainLoop()
             mTimerOverrunCount++;
             mTimerOverrunSec += mNow - lastTimerTime;
         }
-        mTimerRunningFlag = true;
-        while (slotCnt-- > 0) {
-            List& bucket = mTimerWheel[mCurTimerWheelSlot];
-            mTimerWheelBucketItr = bucket.begin();
-            while (mTimerWheelBucketItr != bucket.end()) {
-                assert(*mTimerWheelBucketItr);
-                NetConnection& conn = **mTimerWheelBucketItr;
-                assert(conn.IsGood());
-                ++mTimerWheelBucketItr;
-                NetConnection::NetManagerEntry& entry =
-                    *conn.GetNetManagerEntry();
-                const int timeOut = conn.GetInactivityTimeout();
-                if (timeOut < 0) {
-                    // No timeout, move it to the corresponding list.
-                    UpdateTimer(entry, timeOut);
-                } else if (entry.mExpirationTime <= mNow) {
-                    conn.HandleTimeoutEvent();
-                } else {
-                    // Not expired yet, move to the new slot, taking into the
-                    // account possible timer overrun.
-                    UpdateTimer(entry,
-                        slotCnt + int(entry.mExpirationTime - mNow));
-                }
-            }
-            if (++mCurTimerWheelSlot >= kTimerWheelSize) {
-                mCurTimerWheelSlot = 0;
-            }
-            mRemove.clear();
-        }
-        mTimerRunningFlag = false;
         lastTimerTime = mNow;
-        mTimerWheelBucketItr = mRemove.end();
+        // The connections closed by the timer handlers are kept in the
+        // remove list until the timers have run.
+        RunTimersMs(mNowMs);
+        mRemove.clear();
     }
     CheckFatalSysError(
         mPoll.Remove(mWaker.GetFd()),
@@ -526,21 +540,155 @@ NetManager::CleanUp()
 {
     mShutdownFlag = true;
     mTimeoutHandlers.clear();
-    for (int i = 0; i <= kTimerWheelSize; i++) {
-        for (mTimerWheelBucketItr = mTimerWheel[i].begin();
-                mTimerWheelBucketItr != mTimerWheel[i].end(); ) {
-            NetConnection* const conn = mTimerWheelBucketItr->get();
-            ++mTimerWheelBucketItr;
-            if (conn) {
-                if (conn->IsGood()) {
-                    conn->HandleErrorEvent();
-                }
+    for (mConnectionsItr = mConnections.begin();
+            mConnectionsItr != mConnections.end(); ) {
+        NetConnection* const conn = mConnectionsItr->get();
+        ++mConnectionsItr;
+        if (conn) {
+            if (conn->IsGood()) {
+                conn->HandleErrorEvent();
             }
         }
-        assert(mTimerWheel[i].empty());
-        mRemove.clear();
     }
-    mTimerWheelBucketItr = mRemove.end();
+    assert(mConnections.empty());
+    mRemove.clear();
+    mConnectionsItr = mRemove.end();
+    // Cancel the remaining deadline timers, the owners can not be notified
+    // at this point.
+    for (int i = 0; i <= kTimerWheelMsRunning; i++) {
+        TimerMs* timer;
+        while ((timer = TimerMsList::PopFront(mTimerWheelMs[i]))) {
+            timer->mSlot = -1;
+            mTimerMsCount--;
+        }
+    }
+    assert(mTimerMsCount == 0);
+}
+
+void
+NetManager::ScheduleTimerMs(TimerMs& timer)
+{
+    if (timer.mSlot >= 0) {
+        TimerMsList::Remove(mTimerWheelMs[timer.mSlot], timer);
+        mTimerMsCount--;
+    } else if (mTimerMsCount <= 0 && mTimerWheelMsTime < mNowMs) {
+        // The wheel time doesn't advance while there are no timers.
+        mTimerWheelMsTime = mNowMs;
+    }
+    const int64_t expires = max(timer.mExpirationMs, mTimerWheelMsTime);
+    // Find the lowest level where the expiration time and the wheel time
+    // differ only in the bits covered by the level.
+    const int64_t diff = expires ^ mTimerWheelMsTime;
+    int           slot = kTimerWheelMsOverflow;
+    for (int level = 0, shift = 0;
+            level < kTimerWheelMsLevels;
+            level++, shift += kTimerWheelMsLevelBits) {
+        if ((diff >> (shift + kTimerWheelMsLevelBits)) == 0) {
+            slot = level * kTimerWheelMsSlots +
+                int((expires >> shift) & kTimerWheelMsSlotMask);
+            break;
+        }
+    }
+    TimerMsList::PushBack(mTimerWheelMs[slot], timer);
+    timer.mSlot = slot;
+    mTimerMsCount++;
+}
+
+void
+NetManager::CancelTimerMs(TimerMs& timer)
+{
+    if (timer.mSlot < 0) {
+        return;
+    }
+    TimerMsList::Remove(mTimerWheelMs[timer.mSlot], timer);
+    timer.mSlot = -1;
+    mTimerMsCount--;
+    assert(mTimerMsCount >= 0);
+}
+
+void
+NetManager::CascadeTimersMs(int slot)
+{
+    TimerMs* list[1];
+    TimerMsList::Init(list);
+    swap(list[0], mTimerWheelMs[slot][0]);
+    TimerMs* timer;
+    while ((timer = TimerMsList::PopFront(list))) {
+        timer->mSlot = -1;
+        mTimerMsCount--;
+        ScheduleTimerMs(*timer);
+    }
+}
+
+void
+NetManager::RunTimersMs(int64_t nowMs)
+{
+    while (mTimerWheelMsTime <= nowMs) {
+        if (mTimerMsCount <= 0) {
+            mTimerWheelMsTime = nowMs + 1;
+            break;
+        }
+        const int64_t now = mTimerWheelMsTime;
+        if ((now & kTimerWheelMsSlotMask) == 0) {
+            // Move timers from the higher levels slots that start at this
+            // time down, starting from the highest level.
+            int level = 1;
+            while (level < kTimerWheelMsLevels &&
+                    ((now >> (level * kTimerWheelMsLevelBits)) &
+                        kTimerWheelMsSlotMask) == 0) {
+                level++;
+            }
+            if (level >= kTimerWheelMsLevels) {
+                CascadeTimersMs(kTimerWheelMsOverflow);
+                level = kTimerWheelMsLevels - 1;
+            }
+            for ( ; level > 0; level--) {
+                CascadeTimersMs(level * kTimerWheelMsSlots + int(
+                    (now >> (level * kTimerWheelMsLevelBits)) &
+                    kTimerWheelMsSlotMask));
+            }
+        }
+        // Move the expired timers into the running list, and advance the
+        // wheel time first, in order to schedule the timers re-scheduled by
+        // the handlers no earlier than the next tick. The handlers can
+        // cancel, re-schedule, or delete any timer, including the ones in
+        // the running list: pop the timers one at a time.
+        TimerMs** const running = mTimerWheelMs[kTimerWheelMsRunning];
+        assert(TimerMsList::IsEmpty(running));
+        swap(running[0], mTimerWheelMs[int(now & kTimerWheelMsSlotMask)][0]);
+        TimerMsList::Iterator it(running);
+        TimerMs*              timer;
+        while ((timer = it.Next())) {
+            timer->mSlot = kTimerWheelMsRunning;
+        }
+        mTimerWheelMsTime = now + 1;
+        while ((timer = TimerMsList::PopFront(running))) {
+            timer->mSlot = -1;
+            mTimerMsCount--;
+            timer->mObj.HandleEvent(EVENT_TIMEOUT, timer);
+        }
+    }
+}
+
+int
+NetManager::GetPollTimeoutMs(int64_t nowMs) const
+{
+    if (mTimerMsCount <= 0) {
+        return mTimeoutMs;
+    }
+    // Find the first non empty slot in the first level up to the next
+    // cascade time. If none, then wakeup at the next cascade time, which
+    // can be the current wheel time.
+    const int64_t end = (mTimerWheelMsTime + kTimerWheelMsSlotMask) &
+        ~int64_t(kTimerWheelMsSlotMask);
+    int64_t       next;
+    for (next = mTimerWheelMsTime; next < end; next++) {
+        if (! TimerMsList::IsEmpty(
+                mTimerWheelMs[int(next & kTimerWheelMsSlotMask)])) {
+            break;
+        }
+    }
+    return int(max(int64_t(0), min(int64_t(mTimeoutMs), next - nowMs)));
 }
 
 inline const NetManager*
@@ -549,45 +697,102 @@ NetManager::GetNetManager(const NetConnection& conn)
     return conn.GetNetManagerEntry()->mNetManager;
 }
 
+NetManager::TimerMs::TimerMs(NetManager& netManager, KfsCallbackObj& obj)
+    : mNetManager(netManager),
+      mObj(obj),
+      mExpirationMs(-1),
+      mSlot(-1)
+{
+    TimerMsList::Init(*this);
+}
+
+void
+NetManager::TimerMs::ScheduleIn(int64_t tmMs)
+{
+    if (tmMs < 0) {
+        Cancel();
+        return;
+    }
+    ScheduleAt(mNetManager.NowMs() + tmMs);
+}
+
+void
+NetManager::TimerMs::ScheduleAt(int64_t expirationMs)
+{
+    mExpirationMs = expirationMs;
+    mNetManager.ScheduleTimerMs(*this);
+}
+
+void
+NetManager::TimerMs::ScheduleNoLaterThanIn(int64_t tmMs)
+{
+    if (tmMs < 0) {
+        return;
+    }
+    const int64_t expirationMs = mNetManager.NowMs() + tmMs;
+    if (! IsScheduled() || expirationMs < mExpirationMs) {
+        ScheduleAt(expirationMs);
+    }
+}
+
+void
+NetManager::TimerMs::Cancel()
+{
+    mNetManager.CancelTimerMs(*this);
+}
+
+int64_t
+NetManager::TimerMs::GetRemainingTime() const
+{
+    if (! IsScheduled()) {
+        return -1;
+    }
+    return max(int64_t(0), mExpirationMs - mNetManager.NowMs());
+}
+
 inline time_t
 NetManager::Timer::Handler::Now() const
 {
-    return GetNetManager(*mConn)->Now();
+    return mNetManager.Now();
+}
+
+inline void
+NetManager::Timer::Handler::Schedule()
+{
+    if (mTimeoutSec < 0) {
+        mTimer.Cancel();
+    } else {
+        mTimer.ScheduleIn(int64_t(mTimeoutSec) * 1000);
+    }
 }
 
 NetManager::Timer::Handler::Handler(NetManager& netManager, KfsCallbackObj& obj, int tmSec)
     : KfsCallbackObj(),
+      mNetManager(netManager),
       mObj(obj),
       mStartTime(tmSec >= 0 ? netManager.Now() : 0),
-      mSock(numeric_limits<int>::max()), // Fake fd, for IsGood()
-      mConn(new NetConnection(&mSock, this, false, false))
+      mTimeoutSec(tmSec),
+      mTimer(netManager, *this)
 {
     SET_HANDLER(this, &Handler::EventHandler);
-    mConn->SetMaxReadAhead(0); // Do not add this to poll.
-    mConn->SetInactivityTimeout(tmSec);
-    netManager.AddConnection(mConn);
+    Schedule();
 }
 
 void
 NetManager::Timer::Handler::SetTimeout(int tmSec)
 {
-    const int prevTm = mConn->GetInactivityTimeout();
-    mStartTime = Now();
-    if (prevTm != tmSec) {
-        mConn->SetInactivityTimeout(tmSec); // Reset timer.
-    } else {
-        mConn->Update(); // Reset timer.
-    }
+    mStartTime  = Now();
+    mTimeoutSec = tmSec;
+    Schedule();
 }
 
 time_t
 NetManager::Timer::Handler::GetRemainingTime() const
 {
-    const int tmSec = mConn->GetInactivityTimeout();
-    if (tmSec < 0) {
-        return tmSec;
+    if (mTimeoutSec < 0) {
+        return mTimeoutSec;
     }
-    const time_t next = mStartTime + tmSec;
+    const time_t next = mStartTime + mTimeoutSec;
     const time_t now  = Now();
     return (next > now ? next - now : 0);
 }
@@ -596,11 +801,10 @@ int
 NetManager::Timer::Handler::EventHandler(int type, void* /* data */)
 {
     switch (type) {
-        case EVENT_NET_ERROR: // Invoked from net manager cleanup code.
-            Cleanup();
-            // Fall through
-        case EVENT_INACTIVITY_TIMEOUT:
+        case EVENT_TIMEOUT:
+            // Re-arm first, the callback can change the timeout.
             mStartTime = Now();
+            Schedule();
             return mObj.HandleEvent(EVENT_INACTIVITY_TIMEOUT, 0);
         default:
             assert(! "unexpected event type");
@@ -608,20 +812,12 @@ NetManager::Timer::Handler::EventHandler(int type, void* /* data */)
     return 0;
 }
 
-void
-NetManager::Timer::Handler::Cleanup()
-{
-    mConn->Close();
-    // Reset fd to prevent calling close().
-    mSock = TcpSocket();
-}
-
 void
 NetManager::Timer::Handler::ResetTimeout()
 {
-    if (mConn->GetInactivityTimeout() >= 0) {
+    if (mTimeoutSec >= 0) {
         mStartTime = Now();
-        mConn->Update();
+        Schedule();
     }
 }
 
@@ -631,14 +827,10 @@ NetManager::Timer::Handler::ScheduleTimeoutNoLaterThanIn(int tmSec)
     if (tmSec < 0) {
         return;
     }
-    const int    curTimeout = mConn->GetInactivityTimeout();
-    const time_t now        = Now();
-    if (curTimeout < 0 || now + tmSec < mStartTime + curTimeout) {
-        mStartTime = now;
-        if (curTimeout != tmSec) {
-            mConn->SetInactivityTimeout(tmSec);
-        } else {
-            mConn->Update();
-        }
+    const time_t now = Now();
+    if (mTimeoutSec < 0 || now + tmSec < mStartTime + mTimeoutSec) {
+        mStartTime  = now;
+        mTimeoutSec = tmSec;
+        Schedule();
     }
 }
@@ -30,6 +30,7 @@
 
 #include "ITimeout.h"
 #include "NetConnection.h"
+#include "qcdio/qcdllist.h"
 
 class QCFdPoll;
 namespace KFS
@@ -48,6 +49,10 @@ namespace KFS
 /// timeout.  Interested handlers can register with the net manager to
 /// be notified of timeout.  In the current implementation, the
 /// timeout interval is mSelectTimeout.
+///
+/// Connection inactivity timeouts and individual deadlines (TimerMs) are
+/// kept in a hierarchical timer wheel with millisecond resolution, and the
+/// poll timeout is adjusted so that these fire on time.
 //
 
 class NetManager {
@@ -90,6 +95,8 @@ public:
         { return mStartTime; }
     time_t Now() const
         { return mNow; }
+    int64_t NowMs() const
+        { return mNowMs; }
     time_t UpTime() const
         { return (mNow - mStartTime); }
     bool IsRunning() const
@@ -117,8 +124,51 @@ public:
         mPollEventHook = hook;
         return prev;
     }
-    // Hack to use net manager's timer wheel, with no fd/socket.
-    // Has about 100 bytes overhead.
+    /// One shot timer with millisecond resolution. On expiration the
+    /// callback object is invoked with EVENT_TIMEOUT, and the timer pointer
+    /// as event data, so that the same object can own more than one timer.
+    /// The timer can be re-scheduled or canceled from the callback.
+    /// Must only be used from the net manager's thread.
+    class TimerMs
+    {
+    public:
+        TimerMs(NetManager& netManager, KfsCallbackObj& obj);
+        ~TimerMs()
+            { TimerMs::Cancel(); }
+        /// Schedule expiration in tmMs milliseconds from now.
+        /// Negative value cancels the timer.
+        void ScheduleIn(int64_t tmMs);
+        /// Schedule expiration at the absolute time in milliseconds, as
+        /// returned by NetManager::NowMs().
+        void ScheduleAt(int64_t expirationMs);
+        /// Move the expiration time closer, if it is scheduled to expire
+        /// later than in tmMs milliseconds, or isn't scheduled.
+        void ScheduleNoLaterThanIn(int64_t tmMs);
+        void Cancel();
+        bool IsScheduled() const
+            { return (mSlot >= 0); }
+        /// Returns -1 if not scheduled.
+        int64_t GetExpirationTime() const
+            { return (IsScheduled() ? mExpirationMs : int64_t(-1)); }
+        /// Returns -1 if not scheduled.
+        int64_t GetRemainingTime() const;
+    private:
+        NetManager&     mNetManager;
+        KfsCallbackObj& mObj;
+        int64_t         mExpirationMs;
+        int             mSlot;
+        TimerMs*        mPrevPtr[1];
+        TimerMs*        mNextPtr[1];
+
+        friend class NetManager;
+        friend class QCDLListOp<TimerMs, 0>;
+    private:
+        TimerMs(const TimerMs&);
+        TimerMs& operator=(const TimerMs&);
+    };
+
+    /// Periodic timer with one second resolution: the callback object is
+    /// invoked with EVENT_INACTIVITY_TIMEOUT every "timeout" seconds.
     class Timer
     {
     public:
@@ -136,7 +186,7 @@ public:
         time_t GetStartTime() const
             { return mHandler.mStartTime; }
         int GetTimeout() const
-            { return mHandler.mConn->GetInactivityTimeout(); }
+            { return mHandler.mTimeoutSec; }
         void ScheduleTimeoutNoLaterThanIn(int tmSec)
             { mHandler.ScheduleTimeoutNoLaterThanIn(tmSec); }
         // Negative timeouts are infinite, always greater than non negative.
@@ -147,20 +197,19 @@ public:
         struct Handler : public KfsCallbackObj
         {
             Handler(NetManager& netManager, KfsCallbackObj& obj, int tmSec);
-            ~Handler()
-                { Handler::Cleanup(); }
             void SetTimeout(int tmSec);
             time_t GetRemainingTime() const;
             int EventHandler(int type, void* data);
-            void Cleanup();
             void ResetTimeout();
             void ScheduleTimeoutNoLaterThanIn(int tmSec);
             inline time_t Now() const;
+            inline void Schedule();
 
-            KfsCallbackObj&  mObj;
-            time_t           mStartTime;
-            TcpSocket        mSock;
-            NetConnectionPtr mConn;
+            NetManager&     mNetManager;
+            KfsCallbackObj& mObj;
+            time_t          mStartTime;
+            int             mTimeoutSec;
+            TimerMs         mTimer;
         private:
             Handler(const Handler&);
             Handler& operator=(const Handler&);
@@ -177,14 +226,26 @@ public:
 private:
     class Waker;
     typedef NetConnection::NetManagerEntry::List List;
-    enum { kTimerWheelSize = (1 << 8) };
+    typedef NetConnection::NetManagerEntry::Timer ConnectionTimer;
+    enum
+    {
+        kTimerWheelMsLevelBits = 8,
+        kTimerWheelMsSlots     = 1 << kTimerWheelMsLevelBits,
+        kTimerWheelMsSlotMask  = kTimerWheelMsSlots - 1,
+        kTimerWheelMsLevels    = 4,
+        // Timers beyond the last level (~49 days) are kept in the overflow
+        // list, and re-inserted when the last level wraps around.
+        kTimerWheelMsOverflow  = kTimerWheelMsLevels * kTimerWheelMsSlots,
+        // The expired timers are moved into the "running" list, so that
+        // the handlers can cancel or re-schedule any of them.
+        kTimerWheelMsRunning   = kTimerWheelMsOverflow + 1
+    };
 
-    /// Timer wheel.
-    List                mTimerWheel[kTimerWheelSize + 1];
+    /// Connections.
+    List                mConnections;
     List                mRemove;
-    List::iterator      mTimerWheelBucketItr;
+    List::iterator      mConnectionsItr;
     NetConnection*      mCurConnection;
-    int                 mCurTimerWheelSlot;
     int                 mConnectionsCount;
     /// when the system is overloaded--either because of disk or we
     /// have too much network I/O backlogged---we avoid polling fd's for
@@ -195,7 +256,6 @@ private:
     bool                mIsOverloaded;
     volatile bool       mRunFlag;
     bool                mShutdownFlag;
-    bool                mTimerRunningFlag;
     bool                mIsForkedChild;
     /// timeout interval specified in the call to select().
     const int           mTimeoutMs;
@@ -208,6 +268,13 @@ private:
     QCFdPoll&           mPoll;
     Waker&              mWaker;
     PollEventHook*      mPollEventHook;
+    /// Millisecond timer wheel: kTimerWheelMsLevels levels with
+    /// kTimerWheelMsSlots each, plus overflow, and running lists.
+    /// All timers expiring before mTimerWheelMsTime have been fired.
+    TimerMs*            mTimerWheelMs[kTimerWheelMsRunning + 1][1];
+    int64_t             mTimerWheelMsTime;
+    int                 mTimerMsCount;
+    int64_t             mNowMs;
 
     /// Handlers that are notified whenever a call to select()
     /// returns.  To the handlers, the notification is a timeout signal.
@@ -216,7 +283,15 @@ private:
     void CheckIfOverloaded();
     void CleanUp();
     inline void UpdateTimer(NetConnection::NetManagerEntry& entry, int timeOut);
+    void ConnectionTimerExpired(NetConnection& conn);
     void UpdateSelf(NetConnection::NetManagerEntry& entry, int fd, bool resetTimer);
+    void ScheduleTimerMs(TimerMs& timer);
+    void CancelTimerMs(TimerMs& timer);
+    void CascadeTimersMs(int slot);
+    void RunTimersMs(int64_t nowMs);
+    int GetPollTimeoutMs(int64_t nowMs) const;
+
+    friend class NetConnection::NetManagerEntry::Timer;
 private:
     NetManager(const NetManager&);
     NetManager& operator=(const NetManager&);
@@ -38,6 +38,8 @@
 #include <string>
 #include <sstream>
 #include <set>
+#include <vector>
+#include <algorithm>
 using std::string;
 using std::ostringstream;
 
@@ -57,6 +59,123 @@ using std::ostringstream;
 
 namespace KFS
 {
+	/// Compact index of the chunks hosted by a chunk server, used to
+	/// visit only the chunks of the server when the server goes down,
+	/// hibernates, or retires, instead of scanning the whole chunk map.
+	/// The ids are kept in a sorted vector, 8 bytes per chunk; erased ids
+	/// stay in place as tombstones (~chunkId), and the ids that arrive out
+	/// of order wait in a small set. Both are folded into the vector once
+	/// they grow past a fraction of its size, which keeps the amortized
+	/// cost of insert and erase logarithmic.
+	/// The index is a superset: the users must check the chunk placement.
+	class ChunkIdIndex {
+	public:
+		typedef std::vector<chunkId_t> Ids;
+
+		ChunkIdIndex()
+			: mIds(), mPending(), mErasedCount(0)
+			{}
+		void Insert(chunkId_t chunkId) {
+			if (mIds.empty() || Id(mIds.back()) < chunkId) {
+				// new chunk ids are handed out in increasing order
+				mIds.push_back(chunkId);
+				return;
+			}
+			Ids::iterator const it = Find(chunkId);
+			if (it != mIds.end()) {
+				if (*it != chunkId) {
+					*it = chunkId;
+					mErasedCount--;
+				}
+				return;
+			}
+			if (mPending.insert(chunkId).second &&
+					mPending.size() > MergeThreshold(8)) {
+				Merge();
+			}
+		}
+		void Erase(chunkId_t chunkId) {
+			if (mPending.erase(chunkId) > 0) {
+				return;
+			}
+			Ids::iterator const it = Find(chunkId);
+			if (it == mIds.end() || *it != chunkId) {
+				return;
+			}
+			*it = ~chunkId;
+			if (++mErasedCount > MergeThreshold(4)) {
+				Merge();
+			}
+		}
+		size_t Size() const {
+			return (mIds.size() - mErasedCount + mPending.size());
+		}
+		/// Move the ids, in increasing order, into ids, and leave the
+		/// index empty.
+		void Take(Ids& ids) {
+			Merge();
+			ids.clear();
+			ids.swap(mIds);
+		}
+		/// Call func for each id, in increasing order. The func must
+		/// not modify the index.
+		template<typename T> void ForEach(T& func) {
+			Merge();
+			for (Ids::const_iterator it = mIds.begin();
+					it != mIds.end(); ++it) {
+				func(*it);
+			}
+		}
+	private:
+		typedef std::set<chunkId_t, std::less<chunkId_t>,
+			boost::fast_pool_allocator<chunkId_t>
+		> Pending;
+		enum { kMinMergeThreshold = 1024 };
+
+		Ids     mIds;
+		Pending mPending;
+		size_t  mErasedCount;
+
+		static chunkId_t Id(chunkId_t entry) {
+			return (entry < 0 ? ~entry : entry);
+		}
+		static bool IdLess(chunkId_t lhs, chunkId_t rhs) {
+			return (Id(lhs) < Id(rhs));
+		}
+		size_t MergeThreshold(size_t fraction) const {
+			return std::max(size_t(kMinMergeThreshold),
+				mIds.size() / fraction);
+		}
+		Ids::iterator Find(chunkId_t chunkId) {
+			Ids::iterator const it = std::lower_bound(
+				mIds.begin(), mIds.end(), chunkId, &IdLess);
+			return ((it == mIds.end() || Id(*it) != chunkId) ?
+				mIds.end() : it);
+		}
+		void Merge() {
+			if (mPending.empty() && mErasedCount <= 0) {
+				return;
+			}
+			Ids ids;
+			ids.reserve(Size());
+			Pending::const_iterator pi = mPending.begin();
+			for (Ids::const_iterator it = mIds.begin();
+					it != mIds.end(); ++it) {
+				if (*it < 0) {
+					continue;
+				}
+				while (pi != mPending.end() && *pi < *it) {
+					ids.push_back(*pi++);
+				}
+				ids.push_back(*it);
+			}
+			ids.insert(ids.end(), pi, mPending.end());
+			mIds.swap(ids);
+			mPending.clear();
+			mErasedCount = 0;
+		}
+	};
+
         /// Chunk server connects to the meta server, sends a HELLO
         /// message to configure its state with the meta server,  and
         /// from then onwards, the meta server then drives the RPCs.
@@ -233,6 +352,18 @@ namespace KFS
 			mChunksToMove.clear();
 		}
 
+		/// The layout manager keeps the index of the chunks hosted by
+		/// this server in sync with the chunk placement.
+		void HostedChunkAdded(chunkId_t chunkId) {
+			mHostedChunks.Insert(chunkId);
+		}
+		void HostedChunkRemoved(chunkId_t chunkId) {
+			mHostedChunks.Erase(chunkId);
+		}
+		ChunkIdIndex& GetHostedChunks() {
+			return mHostedChunks;
+		}
+
 		/// Whenever this node re-replicates a chunk that was targeted
 		/// for rebalancing, update the set.
 		void MovingChunkDone(chunkId_t chunkId) {
@@ -257,7 +388,7 @@ namespace KFS
                 void NotifyChunkVersChange(fid_t fid, chunkId_t chunkId, seq_t chunkVers);
 
 		/// Dispatch all the pending RPCs to the chunk server.
-		void Dispatch();
+		virtual void Dispatch();
 
 		/// An op has been dispatched.  Stash a pointer to that op
 		/// in the list of dispatched ops.
@@ -367,7 +498,7 @@ namespace KFS
                 /// The chunk server went down.  So, fail all the
                 /// outstanding ops. 
                 ///
-                void FailPendingOps();
+                virtual void FailPendingOps();
 
 		/// For monitoring purposes, dump out state as a string.
 		/// @param [out] result   The state of this server
@@ -394,7 +525,7 @@ namespace KFS
         protected:
 		/// Enqueue a request to be dispatched to this server
 		/// @param[in] r  the request to be enqueued.
-		void Enqueue(MetaChunkRequest *r);
+		virtual void Enqueue(MetaChunkRequest *r);
 
                 /// A sequence # associated with each RPC we send to
                 /// chunk server.  This variable tracks the seq # that
@@ -441,6 +572,9 @@ namespace KFS
 		/// This set was previously computed by the rebalance planner.
 		ChunkIdSet mChunksToMove;
 
+		/// Chunks hosted by this server.
+		ChunkIdIndex mHostedChunks;
+
                 /// Location of the server at which clients can
                 /// connect to
 		ServerLocation mLocation;
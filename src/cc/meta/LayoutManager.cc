@@ -28,11 +28,14 @@
 #include <algorithm>
 #include <functional>
 #include <sstream>
+#include <stdio.h>
+#include <unistd.h>
 #include <boost/lexical_cast.hpp>
 #include <openssl/rand.h>
 
 #include "LayoutManager.h"
 #include "kfstree.h"
+#include "logger.h"
 #include "libkfsIO/Globals.h"
 #include "common/log.h"
 #include "common/properties.h"
@@ -115,6 +118,25 @@ template<typename T, typename I> static T& EraseReallocIfNeeded(T& vec, I b, I e
 	return ReallocIfNeeded(vec);
 }
 
+// Keep the servers' hosted chunk indexes in sync with the chunk placement.
+static void
+HostedChunkAdded(const vector<ChunkServerPtr>& servers, chunkId_t chunkId)
+{
+	for (vector<ChunkServerPtr>::const_iterator it = servers.begin();
+			it != servers.end(); ++it) {
+		(*it)->HostedChunkAdded(chunkId);
+	}
+}
+
+static void
+HostedChunkRemoved(const vector<ChunkServerPtr>& servers, chunkId_t chunkId)
+{
+	for (vector<ChunkServerPtr>::const_iterator it = servers.begin();
+			it != servers.end(); ++it) {
+		(*it)->HostedChunkRemoved(chunkId);
+	}
+}
+
 class ChunkIdMatcher {
 	chunkId_t myid;
 public:
@@ -271,7 +293,6 @@ LayoutManager::LayoutManager() :
 	mMinRebalanceSpaceUtilThreshold(0.0),
 	mIsExecutingRebalancePlan(false),
 	mLastChunkRebalanced(1),
-	mLastChunkReplicated(1),
 	mRecoveryStartTime(0),
 	mStartTime(time(0)),
 	mRecoveryIntervalSecs(KFS::LEASE_INTERVAL_SECS),
@@ -295,7 +316,9 @@ LayoutManager::LayoutManager() :
 	mCSGracefulRestartTimeout(15 * 60),
 	mCSGracefulRestartAppendWithWidTimeout(40 * 60),
 	mLastReplicationCheckTime(TimeNow()),
-	mLastRecomputeDirsizeTime(TimeNow())
+	mReplicationCheckScan(*this),
+	mFsckScan(*this),
+	mChunkMapDumpScan(*this)
 {
 	// pthread_mutex_init(&mChunkServersMutex, NULL);
 
@@ -305,6 +328,13 @@ LayoutManager::LayoutManager() :
 	mTotalReplicationStats = new Counter("Total Num Replications");
 	mFailedReplicationStats = new Counter("Num Failed Replications");
 	mStaleChunkCount = new Counter("Num Stale Chunks");
+	mReplicationCheckerStats = new Counter("Replication Checker");
+	mReplicationWorkSearchStats = new Counter("Replication Work Search");
+	mServerDownStats = new Counter("Server Down");
+	mChunksWithLeasesStats = new Counter("Chunks With Leases");
+	mExpiredLeasesStats = new Counter("Expired Leases");
+	mLastCleanupExpiredLeasesStats =
+		new Counter("Expired Leases Last Cleanup");
 	// how much to be done before we are done
 	globals().counterManager.AddCounter(mReplicationTodoStats);
 	// how many chunks are "endangered"
@@ -314,6 +344,13 @@ LayoutManager::LayoutManager() :
 	globals().counterManager.AddCounter(mTotalReplicationStats);
 	globals().counterManager.AddCounter(mFailedReplicationStats);
 	globals().counterManager.AddCounter(mStaleChunkCount);
+	// # of passes and time spent handing out replication work
+	globals().counterManager.AddCounter(mReplicationCheckerStats);
+	globals().counterManager.AddCounter(mReplicationWorkSearchStats);
+	globals().counterManager.AddCounter(mServerDownStats);
+	globals().counterManager.AddCounter(mChunksWithLeasesStats);
+	globals().counterManager.AddCounter(mExpiredLeasesStats);
+	globals().counterManager.AddCounter(mLastCleanupExpiredLeasesStats);
 }
 
 void
@@ -834,6 +871,7 @@ LayoutManager::AddNotStableChunk(
 		const bool beginMakeStableFlag = msi->second.mSize < 0;
 		if (beginMakeStableFlag) {
 			pinfo.chunkServers.push_back(server);
+			server->HostedChunkAdded(chunkId);
 			if (InRecoveryPeriod() ||
 					! mPendingBeginMakeStable.empty()) {
 				// Allow chunk servers to connect back.
@@ -883,6 +921,7 @@ LayoutManager::AddNotStableChunk(
 			mARAChunkCache.Invalidate(fileId, chunkId);
 		}
 		pinfo.chunkServers.push_back(server);
+		server->HostedChunkAdded(chunkId);
 	} else if (! appendFlag) {
 		const bool kPendingAddFlag = true;
 		server->MakeChunkStable(
@@ -929,25 +968,41 @@ struct ExpireLeaseIfOwner
 {
 	const ChunkServer * const target;
 	const time_t              expire;
+	bool                      expiredFlag;
 	ExpireLeaseIfOwner(const ChunkServer *t)
-		: target(t), expire(TimeNow() - 1)
+		: target(t), expire(TimeNow() - 1), expiredFlag(false)
 	{}
 	void operator () (LeaseInfo& li) {
 		if (li.chunkServer.get() == target) {
 			li.expires = expire;
 			li.ownerWasDownFlag = li.ownerWasDownFlag ||
 				(target && target->IsDown());
+			expiredFlag = true;
+		}
+	}
+	// Expire the leases of the chunk, and reschedule the lease cleanup.
+	static void Apply(const ChunkServer *t, chunkId_t chunkId,
+			vector<LeaseInfo>& leases, LeaseExpiryQueue& queue) {
+		const ExpireLeaseIfOwner res = for_each(
+			leases.begin(), leases.end(), ExpireLeaseIfOwner(t));
+		if (res.expiredFlag) {
+			queue.Schedule(chunkId, res.expire);
 		}
 	}
 };
 
+template<typename T>
 class MapPurger {
-	ReplicationCandidates&   crset;
+	T&                       crset;
+	CRCandidateSet* const    prioritySet;
         ARAChunkCache&           araChunkCache;
+	LeaseExpiryQueue&        leaseExpiryQueue;
 	const ChunkServer* const target;
 public:
-	MapPurger(ReplicationCandidates &c, ARAChunkCache& ac, const ChunkServer *t)
-		: crset(c), araChunkCache(ac), target(t)
+	MapPurger(T &c, CRCandidateSet *p, ARAChunkCache& ac,
+			LeaseExpiryQueue& lq, const ChunkServer *t)
+		: crset(c), prioritySet(p), araChunkCache(ac),
+		  leaseExpiryQueue(lq), target(t)
 		{}
 	void operator () (CSMap::value_type& p) {
 		ChunkPlacementInfo& c = p.second;
@@ -962,8 +1017,8 @@ public:
 		if (i == c.chunkServers.end()) {
 			return;
 		}
-		for_each(c.chunkLeases.begin(), c.chunkLeases.end(),
-			ExpireLeaseIfOwner(target));
+		ExpireLeaseIfOwner::Apply(target, p.first, c.chunkLeases,
+			leaseExpiryQueue);
 		EraseReallocIfNeeded(c.chunkServers, i, c.chunkServers.end());
                 // Chunk replication chain has changed: invalidate write append
                 // cache entry, if any. It is an error to attempt to append to
@@ -978,9 +1033,37 @@ public:
 		araChunkCache.Invalidate(c.fid, p.first);
 		// we need to check the replication level of this chunk
 		crset.insert(p.first);
+		if (prioritySet && c.chunkServers.size() == 1) {
+			prioritySet->insert(p.first);
+		}
+	}
+};
+
+// Apply the chunk map functor to the chunks in the server's hosted chunk
+// index, rather than to the whole chunk map.
+template<typename T>
+class HostedChunkVisitor {
+	CSMap& csmap;
+	T&     func;
+public:
+	HostedChunkVisitor(CSMap& m, T& f)
+		: csmap(m), func(f)
+		{}
+	void operator () (chunkId_t chunkId) {
+		CSMapIter const it = csmap.find(chunkId);
+		if (it != csmap.end()) {
+			func(*it);
+		}
 	}
 };
 
+// The replication candidates are queued on the rack of the first replica.
+static inline int
+ReplicationSourceRack(const ChunkPlacementInfo& c)
+{
+	return (c.chunkServers.empty() ? -1 : c.chunkServers.front()->GetRack());
+}
+
 class MapRetirer {
 	ReplicationCandidates &crset;
 	ChunkServer *retiringServer;
@@ -1088,26 +1171,109 @@ LayoutManager::DumpChunkReplicationCandidates(ostringstream &os)
 }
 
 void
-LayoutManager::Fsck(ostringstream &os)
+LayoutManager::ChunkMapScan::Submit(MetaRequest *req)
 {
-	ostringstream lost;
-	ostringstream endangered;
-	int lostBlocks = 0, endangeredBlocks = 0;
-	for (CSMapConstIter citer = mChunkToServerMap.begin(); 	
-			citer != mChunkToServerMap.end(); ++citer) {
-		if (citer->second.chunkServers.size() == 0) {
-			lost << citer->second.fid << ' ';
-			lostBlocks++;
-		}
-		if (citer->second.chunkServers.size() == 1) {
-			endangered << citer->second.fid << ' ';
-			endangeredBlocks++;
-		}
+	req->suspended = true;
+	// A pass that is already in progress has missed a part of the map:
+	// the request waits for the next one.
+	if (IsActive()) {
+		mNextRequests.push_back(req);
+		return;
 	}
-	os << "Num endangered blocks: " << endangeredBlocks << endl;
-	os << "Num lost blocks: " << lostBlocks << endl;
-	os << "Endangered files: " << endangered.str() << endl;
-	os << "Lost files: " << lost.str() << endl;
+	mRequests.push_back(req);
+	gMetaScanner.Schedule(*this);
+}
+
+void
+LayoutManager::ChunkMapScan::Start()
+{
+	mFirstFlag = true;
+	mCursor    = chunkId_t();
+}
+
+bool
+LayoutManager::ChunkMapScan::Next()
+{
+	// The map changes between the slices: find the successor of the last
+	// visited chunk, instead of keeping an iterator.
+	CSMap& map = mLayoutManager.mChunkToServerMap;
+	CSMapIter const it = mFirstFlag ? map.begin() : map.upper_bound(mCursor);
+	if (it == map.end()) {
+		return false;
+	}
+	mFirstFlag = false;
+	mCursor    = it->first;
+	Visit(*it);
+	return true;
+}
+
+void
+LayoutManager::ChunkMapScan::Done()
+{
+	std::vector<MetaRequest*> reqs;
+	reqs.swap(mRequests);
+	if (! mNextRequests.empty()) {
+		mRequests.swap(mNextRequests);
+		gMetaScanner.Schedule(*this);
+	}
+	for (std::vector<MetaRequest*>::const_iterator it = reqs.begin();
+			it != reqs.end(); ++it) {
+		MetaRequest* const req = *it;
+		Complete(*req);
+		req->suspended = false;
+		oplog.dispatch(req);
+	}
+}
+
+void
+LayoutManager::FsckScan::Start()
+{
+	ChunkMapScan::Start();
+	mLost.str(string());
+	mEndangered.str(string());
+	mLostCount       = 0;
+	mEndangeredCount = 0;
+}
+
+void
+LayoutManager::FsckScan::Visit(CSMap::value_type& entry)
+{
+	if (entry.second.chunkServers.size() == 0) {
+		mLost << entry.second.fid << ' ';
+		mLostCount++;
+	}
+	if (entry.second.chunkServers.size() == 1) {
+		mEndangered << entry.second.fid << ' ';
+		mEndangeredCount++;
+	}
+}
+
+void
+LayoutManager::FsckScan::Done()
+{
+	ostringstream os;
+	os << "Num endangered blocks: " << mEndangeredCount << endl;
+	os << "Num lost blocks: " << mLostCount << endl;
+	os << "Endangered files: " << mEndangered.str() << endl;
+	os << "Lost files: " << mLost.str() << endl;
+	mStatus = os.str();
+	mLost.str(string());
+	mEndangered.str(string());
+	ChunkMapScan::Done();
+}
+
+void
+LayoutManager::FsckScan::Complete(MetaRequest& req)
+{
+	MetaFsck& fsck = static_cast<MetaFsck&>(req);
+	fsck.status     = 0;
+	fsck.fsckStatus = mStatus;
+}
+
+void
+LayoutManager::Fsck(MetaFsck *req)
+{
+	mFsckScan.Submit(req);
 }
 
 // Dump chunk block map to response stream
@@ -1118,21 +1284,77 @@ LayoutManager::DumpChunkToServerMap(ostringstream &os)
 			 MapDumperStream(os));
 }
 
-// Give preference to chunks at replication level of 1
 void
-LayoutManager::RebuildPriorityReplicationList()
+LayoutManager::ChunkMapDumpScan::Start()
 {
-	mPriorityChunkReplicationCandidates.clear();
-	for (ReplicationCandidates::const_iterator citer = mChunkReplicationCandidates.begin();
-		citer != mChunkReplicationCandidates.end(); ++citer) {
-		const chunkId_t chunkId = *citer;
-		CSMapIter iter = mChunkToServerMap.find(chunkId);
+	ChunkMapScan::Start();
+	mDir = mNextDir;
+	// The server list is small: write it out right away.
+	string fn = mDir + "/network.def";
+	ofstream ofs(fn.c_str());
+	for_each(mLayoutManager.mChunkServers.begin(),
+		mLayoutManager.mChunkServers.end(), PrintChunkServerInfo(ofs));
+	ofs.close();
 
-		if (iter == mChunkToServerMap.end())
-			continue;
-		if (iter->second.chunkServers.size() == 1)
-			mPriorityChunkReplicationCandidates.insert(chunkId);
+	// Write into a temporary file, and rename it once the dump is
+	// complete, so that chunkmap.txt always holds a complete dump.
+	mFileName    = mDir + "/chunkmap.txt";
+	mTmpFileName = mFileName + ".tmp";
+	mStream.clear();
+	mStream.open(mTmpFileName.c_str());
+	mStatus = mStream ? 0 : -EIO;
+	if (mStatus != 0) {
+		KFS_LOG_STREAM_ERROR << "failed to create " << mTmpFileName <<
+		KFS_LOG_EOM;
+	}
+}
+
+void
+LayoutManager::ChunkMapDumpScan::Visit(CSMap::value_type& entry)
+{
+	if (mStatus == 0) {
+		MapDumper dumper(mStream);
+		dumper(entry);
+	}
+}
+
+void
+LayoutManager::ChunkMapDumpScan::Done()
+{
+	if (mStream.is_open()) {
+		mStream.close();
+		if (mStatus == 0 && mStream.fail()) {
+			mStatus = -EIO;
+		}
+		if (mStatus == 0 &&
+				rename(mTmpFileName.c_str(), mFileName.c_str()) != 0) {
+			mStatus = errno > 0 ? -errno : -EIO;
+			KFS_LOG_STREAM_ERROR << "failed to rename " <<
+				mTmpFileName << " to " << mFileName <<
+			KFS_LOG_EOM;
+		}
+		if (mStatus != 0) {
+			unlink(mTmpFileName.c_str());
+		}
 	}
+	ChunkMapScan::Done();
+}
+
+void
+LayoutManager::ChunkMapDumpScan::Complete(MetaRequest& req)
+{
+	MetaDumpChunkToServerMap& dump =
+		static_cast<MetaDumpChunkToServerMap&>(req);
+	dump.status      = mStatus;
+	dump.chunkmapFile = mFileName;
+}
+
+void
+LayoutManager::DumpChunkToServerMap(const string& dirToUse,
+	MetaDumpChunkToServerMap *req)
+{
+	mChunkMapDumpScan.SetDir(dirToUse);
+	mChunkMapDumpScan.Submit(req);
 }
 
 void
@@ -1145,6 +1367,9 @@ LayoutManager::ServerDown(ChunkServer *server)
 	if (i == mChunkServers.end())
 		return;
 
+	struct timeval start;
+	gettimeofday(&start, 0);
+
 	if (! server->IsDown()) {
 		server->ForceDown();
 	}
@@ -1168,14 +1393,22 @@ LayoutManager::ServerDown(ChunkServer *server)
         const bool canBeMaster = server->CanBeChunkMaster();
 	server->FailPendingOps();
 
+	// Only the chunks hosted by the server need to be purged. The server
+	// is going away, and so is its index.
+	ChunkIdIndex::Ids hostedChunks;
+	server->GetHostedChunks().Take(hostedChunks);
+
 	// check if this server was sent to hibernation
 	bool isHibernating = false;
 	for (uint32_t j = 0; j < mHibernatingServers.size(); j++) {
 		if (mHibernatingServers[j].location == server->GetServerLocation()) {
 			// record all the blocks that need to be checked for
 			// re-replication later
-			MapPurger purge(mHibernatingServers[j].blocks, mARAChunkCache, server);
-			for_each(mChunkToServerMap.begin(), mChunkToServerMap.end(), purge);
+			MapPurger<ChunkIdSet> purge(mHibernatingServers[j].blocks,
+				0, mARAChunkCache, mChunksWithLeases, server);
+			for_each(hostedChunks.begin(), hostedChunks.end(),
+				HostedChunkVisitor<MapPurger<ChunkIdSet> >(
+					mChunkToServerMap, purge));
 			isHibernating = true;
 			break;
 		}
@@ -1191,13 +1424,22 @@ LayoutManager::ServerDown(ChunkServer *server)
 			hsi.location     = server->GetServerLocation();
 			hsi.sleepEndTime = TimeNow() + replicationDelay;
 			mHibernatingServers.push_back(hsi);
-			MapPurger purge(mHibernatingServers.back().blocks, mARAChunkCache, server);
-			for_each(mChunkToServerMap.begin(), mChunkToServerMap.end(), purge);
+			MapPurger<ChunkIdSet> purge(mHibernatingServers.back().blocks,
+				0, mARAChunkCache, mChunksWithLeases, server);
+			for_each(hostedChunks.begin(), hostedChunks.end(),
+				HostedChunkVisitor<MapPurger<ChunkIdSet> >(
+					mChunkToServerMap, purge));
 		} else {
-			MapPurger purge(mChunkReplicationCandidates, mARAChunkCache, server);
-			for_each(mChunkToServerMap.begin(), mChunkToServerMap.end(), purge);
+			// Chunks left with a single copy are added to the
+			// priority list by the purger.
+			MapPurger<ReplicationCandidates> purge(
+				mChunkReplicationCandidates,
+				&mPriorityChunkReplicationCandidates,
+				mARAChunkCache, mChunksWithLeases, server);
+			for_each(hostedChunks.begin(), hostedChunks.end(),
+				HostedChunkVisitor<MapPurger<ReplicationCandidates> >(
+					mChunkToServerMap, purge));
 		}
-		RebuildPriorityReplicationList();
 	}
 
 	// for reporting purposes, record when it went down
@@ -1249,7 +1491,17 @@ LayoutManager::ServerDown(ChunkServer *server)
 		mMastersCount++;
 		mChunkServers.front()->SetCanBeChunkMaster(true);
 	}
-	
+
+	struct timeval end;
+	gettimeofday(&end, 0);
+	const float timeSpent = ComputeTimeDiff(start, end);
+	mServerDownStats->Update(1);
+	mServerDownStats->Update(timeSpent);
+	KFS_LOG_STREAM_INFO << "server down: " << loc.ToString() <<
+		" reason: " << reason <<
+		" chunks: " << hostedChunks.size() <<
+		" time: "   << timeSpent << " sec" <<
+	KFS_LOG_EOM;
 }
 
 int
@@ -1278,7 +1530,8 @@ LayoutManager::RetireServer(const ServerLocation &loc, int downtime)
 	}
 
 	MapRetirer retirer(mChunkReplicationCandidates, retiringServer.get());
-	for_each(mChunkToServerMap.begin(), mChunkToServerMap.end(), retirer);
+	HostedChunkVisitor<MapRetirer> visitor(mChunkToServerMap, retirer);
+	retiringServer->GetHostedChunks().ForEach(visitor);
 
 	return 0;
 }
@@ -1776,10 +2029,11 @@ LayoutManager::AllocateChunk(MetaAllocate *r)
 	v.chunkOffsetIndex = (r->offset / CHUNKSIZE);
 	v.chunkServers = r->servers;
 	v.chunkLeases.push_back(l);
+	HostedChunkAdded(v.chunkServers, r->chunkId);
 
 	mChunkToServerMap[r->chunkId] = v;
 
-	mChunksWithLeases.insert(r->chunkId);
+	mChunksWithLeases.Schedule(r->chunkId, l.expires);
 
 	if (r->servers.size() < (uint32_t) r->numReplicas)
 		ChangeChunkReplication(r->chunkId);
@@ -1891,7 +2145,7 @@ LayoutManager::GetChunkWriteLease(MetaAllocate *r, bool &isNewLease)
 
 	v.chunkLeases.push_back(lease);
 
-	mChunksWithLeases.insert(r->chunkId);
+	mChunksWithLeases.Schedule(r->chunkId, lease.expires);
 
 	r->master = r->servers[0];
 	KFS_LOG_STREAM_INFO <<
@@ -2093,7 +2347,7 @@ LayoutManager::GetChunkReadLease(MetaLeaseAcquire *req)
 	v.chunkLeases.push_back(lease);
 	req->leaseId = lease.leaseId;
 
-	mChunksWithLeases.insert(req->chunkId);
+	mChunksWithLeases.Schedule(req->chunkId, lease.expires);
 
 	return 0;
 }
@@ -2161,8 +2415,8 @@ LayoutManager::LeaseRenew(MetaLeaseRenew *req)
 		// can't renew dead leases; get a new one
 		return -ELEASEEXPIRED;
 	}
+	// The chunk stays scheduled at the old expiration time, or earlier.
 	l->expires = now + LEASE_INTERVAL_SECS;
-	mChunksWithLeases.insert(req->chunkId);
 	return 0;
 }
 
@@ -2185,8 +2439,9 @@ LayoutManager::ChunkCorrupt(MetaChunkCorrupt *r)
 	EraseReallocIfNeeded(v.chunkServers, remove_if(
 		v.chunkServers.begin(), v.chunkServers.end(),
 		ChunkServerMatcher(r->server.get())), v.chunkServers.end());
-	for_each(v.chunkLeases.begin(), v.chunkLeases.end(),
-		ExpireLeaseIfOwner(r->server.get()));
+	r->server->HostedChunkRemoved(r->chunkId);
+	ExpireLeaseIfOwner::Apply(r->server.get(), r->chunkId, v.chunkLeases,
+		mChunksWithLeases);
         if (prevNumSrv != v.chunkServers.size()) {
             // Invalidate cache.
             mARAChunkCache.Invalidate(r->fid);
@@ -2236,6 +2491,7 @@ LayoutManager::DeleteChunk(chunkId_t chunkId)
 
 	vector<ChunkServerPtr> const c(iter->second.chunkServers);
 	// remove the mapping
+	HostedChunkRemoved(c, chunkId);
 	mChunkToServerMap.erase(iter);
 	mPendingBeginMakeStable.erase(chunkId);
 	mPendingMakeStable.erase(chunkId);
@@ -2300,12 +2556,17 @@ LayoutManager::AddChunkToServerMapping(chunkId_t chunkId, fid_t fid,
 	v.chunkOffsetIndex = (offset / CHUNKSIZE);
         v.chunkServers.push_back(c->shared_from_this());
         mChunkToServerMap[chunkId] = v;
+	c->HostedChunkAdded(chunkId);
 }
 
 void
 LayoutManager::RemoveChunkToServerMapping(chunkId_t chunkId)
 {
-        mChunkToServerMap.erase(chunkId);
+        CSMapIter const iter = mChunkToServerMap.find(chunkId);
+	if (iter != mChunkToServerMap.end()) {
+		HostedChunkRemoved(iter->second.chunkServers, chunkId);
+		mChunkToServerMap.erase(iter);
+	}
 	mPendingBeginMakeStable.erase(chunkId);
 	mPendingMakeStable.erase(chunkId);
 }
@@ -2324,6 +2585,7 @@ LayoutManager::UpdateChunkToServerMapping(chunkId_t chunkId, ChunkServer *c)
 		c->GetServerName() << KFS_LOG_EOM;
 	*/
         iter->second.chunkServers.push_back(c->shared_from_this());
+	c->HostedChunkAdded(chunkId);
 
         return 0;
 }
@@ -2468,26 +2730,41 @@ LayoutManager::UpServers(ostringstream &os)
 }
 
 class ReReplicationCheckIniter {
-	CRCandidateSet &crset;
+	ReplicationCandidates &crset;
 	CRCandidateSet &prioritySet;
 public:
-	ReReplicationCheckIniter(CRCandidateSet &c, CRCandidateSet &p) : crset(c), prioritySet(p) { }
-	void operator () (const CSMap::value_type p) {
-		crset.insert(p.first);
+	ReReplicationCheckIniter(ReplicationCandidates &c, CRCandidateSet &p) : crset(c), prioritySet(p) { }
+	void operator () (const CSMap::value_type& p) {
+		crset.insert(p.first, ReplicationSourceRack(p.second),
+			(int)p.second.chunkServers.size());
 		if (p.second.chunkServers.size() == 1)
 			prioritySet.insert(p.first);
 	}
 };
 
 
+void
+LayoutManager::ReplicationCheckScan::Start()
+{
+	ChunkMapScan::Start();
+	mLayoutManager.mPriorityChunkReplicationCandidates.clear();
+}
+
+void
+LayoutManager::ReplicationCheckScan::Visit(CSMap::value_type& entry)
+{
+	ReReplicationCheckIniter initer(
+		mLayoutManager.mChunkReplicationCandidates,
+		mLayoutManager.mPriorityChunkReplicationCandidates);
+	initer(entry);
+}
+
 // Periodically, check the replication level of ALL chunks in the system.
+// The chunks are queued in the background, see ReplicationCheckScan.
 void
 LayoutManager::InitCheckAllChunks()
 {
-	mPriorityChunkReplicationCandidates.clear();
-	for_each(mChunkToServerMap.begin(), mChunkToServerMap.end(),
-		ReReplicationCheckIniter(mChunkReplicationCandidates, 
-					mPriorityChunkReplicationCandidates));
+	gMetaScanner.Schedule(mReplicationCheckScan);
 }
 
 /// functor to tell if a lease has expired
@@ -2547,14 +2824,10 @@ bool
 LayoutManager::ExpiredLeaseCleanup(
 	chunkId_t                 chunkId,
 	time_t                    now,
-	int                       ownerDownExpireDelay /* = 0 */,
-	const CRCandidateSetIter* chunksWithLeasesIt   /* = 0 */)
+	int                       ownerDownExpireDelay /* = 0 */)
 {
 	CSMapIter const iter = mChunkToServerMap.find(chunkId);
 	if (iter == mChunkToServerMap.end()) {
-		if (chunksWithLeasesIt) {
-			mChunksWithLeases.erase(*chunksWithLeasesIt);
-		}
 		return true;
 	}
 	ChunkPlacementInfo& c = iter->second;
@@ -2579,15 +2852,13 @@ LayoutManager::ExpiredLeaseCleanup(
 	// trim the list
 	const bool retVal = EraseReallocIfNeeded(
 		c.chunkLeases, i, c.chunkLeases.end()).empty();
-	if (retVal && chunksWithLeasesIt) {
-		mChunksWithLeases.erase(*chunksWithLeasesIt);
-	}
+	mExpiredLeasesStats->Update((int)leases.size());
 	for_each(leases.begin(), leases.end(),
 		DecChunkWriteCount(mChunkToServerMap, c.fid, chunkId));
-	// If the chunk disappeared or cleaned up in the process then most likely
-	// mChunksWithLeases is already cleaned up, if not then it will be
-	// cleaned on the next timer run. mChunksWithLeases is only used for
-	// lease cleanup, stale entry should not cause a problem.
+	// If the chunk disappeared or cleaned up in the process, then the
+	// mChunksWithLeases entry, if any, is stale. mChunksWithLeases is only
+	// used for lease cleanup, stale entry should not cause a problem: the
+	// cleanup will find no leases, and drop it.
 	return retVal;
 }
 
@@ -2612,12 +2883,36 @@ struct UptimeLess :
 void
 LayoutManager::LeaseCleanup()
 {
-	const time_t now = TimeNow();
-	for (CRCandidateSetIter citer = mChunksWithLeases.begin();
-		citer != mChunksWithLeases.end(); ) {
-		CRCandidateSetIter it = citer++;
-		ExpiredLeaseCleanup(*it, now, mLeaseOwnerDownExpireDelay, &it);
+	const time_t   now     = TimeNow();
+	const uint64_t expired = mExpiredLeasesStats->GetValue();
+	chunkId_t      chunkId;
+	while (mChunksWithLeases.PopExpired(now, chunkId)) {
+		if (ExpiredLeaseCleanup(
+				chunkId, now, mLeaseOwnerDownExpireDelay)) {
+			continue;
+		}
+		CSMapConstIter const it = mChunkToServerMap.find(chunkId);
+		if (it == mChunkToServerMap.end()) {
+			continue;
+		}
+		// Come back when the earliest of the remaining leases
+		// expires, or when the owner down delay of an expired write
+		// lease ends.
+		const vector<LeaseInfo>& leases = it->second.chunkLeases;
+		time_t next = 0;
+		for (vector<LeaseInfo>::const_iterator li = leases.begin();
+				li != leases.end(); ++li) {
+			const time_t expires = li->expires > now ? li->expires :
+				li->expires + mLeaseOwnerDownExpireDelay;
+			if (li == leases.begin() || expires < next) {
+				next = expires;
+			}
+		}
+		mChunksWithLeases.Schedule(chunkId, max(next, now + 1));
 	}
+	mLastCleanupExpiredLeasesStats->Set(
+		(int)(mExpiredLeasesStats->GetValue() - expired));
+	mChunksWithLeasesStats->Set((int)mChunksWithLeases.size());
 	// also clean out the ARACache of old entries
 	mARAChunkCache.Timeout(now - ARA_CHUNK_CACHE_EXPIRE_INTERVAL);
 	if (now - mLastReplicationCheckTime > NDAYS_PER_FULL_REPLICATION_CHECK * 60 * 60 * 24) {
@@ -2627,14 +2922,6 @@ LayoutManager::LeaseCleanup()
 		InitCheckAllChunks();
 		mLastReplicationCheckTime = now;
 	}
-	if (now - mLastRecomputeDirsizeTime > 60 * 60) {
-		KFS_LOG_STREAM_INFO << "Doing a recompute dir size..." <<
-		KFS_LOG_EOM;
-		metatree.recomputeDirSize();
-		mLastRecomputeDirsizeTime = now;
-		KFS_LOG_STREAM_INFO << "Recompute dir size is done..." <<
-		KFS_LOG_EOM;
-	}
 	ScheduleChunkServersRestart();
 }
 
@@ -2709,6 +2996,7 @@ LayoutManager::InvalidateWriteLease(chunkId_t chunkId)
 	if (l != v.chunkLeases.end()) {
 		// Invalidate the lease; the normal cleanup will fix things up.
 		l->expires = 0;
+		mChunksWithLeases.Schedule(chunkId, l->expires);
 	}
 }
 
@@ -2735,6 +3023,7 @@ LayoutManager::LeaseRelinquish(MetaLeaseRelinquish *req)
 	// the owner of the lease is giving up the lease; update the expires so
 	// that the normal lease cleanup will work out.
 	l->expires = 0;
+	mChunksWithLeases.Schedule(req->chunkId, l->expires);
 	if (l->leaseType == WRITE_LEASE && hadLeaseFlag) {
 		// For write append lease checksum and size always have to be
 		// specified for make chunk stable, otherwise run begin make
@@ -3102,6 +3391,7 @@ LayoutManager::AddServerToMakeStable(
 		" added: "         << info.serverAddedFlag <<
 	KFS_LOG_EOM;
 	servers.push_back(server);
+	server->HostedChunkAdded(chunkId);
 	info.numServers++;
 	info.serverAddedFlag = true;
 	if (info.beginMakeStableFlag) {
@@ -3408,6 +3698,7 @@ LayoutManager::MakeChunkStableDone(const MetaChunkMakeStable* req)
 				pinfo          = &ci->second;
 				updateSizeFlag = pinfo->chunkServers.empty();
 				ci->second.chunkServers.push_back(req->server);
+				req->server->HostedChunkAdded(req->chunkId);
 				/* if (updateSizeFlag) {
 					pathname = metatree.getPathname(
 						pinfo->fid);
@@ -3713,33 +4004,26 @@ LayoutManager::GetChunkSizeDone(MetaChunkSize* req)
 	if (! fa || fa->type != KFS_FILE) {
 		return 0;
 	}
-	vector<MetaChunkInfo*> chunkInfo;
-        const int status = metatree.getalloc(fa->id(), chunkInfo);
-	off_t spaceUsageDelta = 0;
+	MetaChunkInfo* lastChunk = NULL;
+        const int status = metatree.getLastChunk(fa->id(), &lastChunk);
 
-        if ((status != 0) || chunkInfo.empty()) {
+        if (status != 0) {
 		// don't write out a log entry
                 return -1;
         }
-	if (fa->filesize > 0) {
-		// stash the value for doing the delta calc
-		spaceUsageDelta = fa->filesize;
-	}
 	// only if we are looking at the last chunk of the file can we
 	// set the size.
-        MetaChunkInfo* lastChunk = chunkInfo.back();
-	off_t sizeEstimate = fa->filesize;
 	if (req->chunkId == lastChunk->chunkId) {
-		sizeEstimate = (fa->chunkcount - 1) * CHUNKSIZE +
-				req->chunkSize;
-		fa->filesize = sizeEstimate;
+		// the directory sizes are updated along with the file size
+		metatree.setFileSize(fa,
+			(fa->chunkcount - 1) * CHUNKSIZE + req->chunkSize);
 	}
 	if (fa->filesize == 0) {
 		// 0-length files are strange beasts: they typically
 		// shouldn't happen (unless they are kept to exchange
 		// status between processes); if we have such a file,
 		// ask the client to work out the size.
-		fa->filesize = -1;
+		metatree.setFileSize(fa, -1);
 		return -1;
 	}
 	KFS_LOG_STREAM_INFO <<
@@ -3749,32 +4033,8 @@ LayoutManager::GetChunkSizeDone(MetaChunkSize* req)
 		" filesize: " << fa->filesize <<
 	KFS_LOG_EOM;
 
-	// fa->filesize = max(fa->filesize, sizeEstimate);
 	// stash the value away so that we can log it.
 	req->filesize = fa->filesize;
-	//
-	// we possibly updated fa->filesize; so, compute the delta from
-	// before and after
-	//
-	spaceUsageDelta = fa->filesize - spaceUsageDelta;
-	if (spaceUsageDelta != 0) {
-		/*
-		if (pathname == "") {
-			pathname = metatree.getPathname(fid);
-		}
-		*/
-		if (! req->pathname.empty()) {
-			metatree.updateSpaceUsageForPath(req->pathname, spaceUsageDelta);
-		} else {
-			KFS_LOG_STREAM_INFO <<
-                            "Got size " << req->chunkSize <<
-                            " for file " << req->fid << ", chunk " << req->chunkId <<
-                            "; Will need to force recomputation of dir size" <<
-                        KFS_LOG_EOM;
-			// don't write out a log entry
-			// status = -1;
-		}
-	}
 	return 0;
 }
 
@@ -3945,7 +4205,6 @@ LayoutManager::ReplicateChunk(chunkId_t chunkId, ChunkPlacementInfo &clli,
 			// immediately, for example when send fails.
 			mNumOngoingReplications++;
 			clli.ongoingReplications++;
-			mLastChunkReplicated = chunkId;
 			mOngoingReplicationStats->Update(1);
 			mTotalReplicationStats->Update(1);
 			c->ReplicateChunk(fid, chunkId, -1,
@@ -4139,12 +4398,8 @@ LayoutManager::CheckHibernatingServersStatus()
 				"Hibernated server " << iter->location.ToString()  <<
 				" is NOT back as promised" <<
 			KFS_LOG_EOM;
-			if (mChunkReplicationCandidates.empty()) {
-				mChunkReplicationCandidates.swap(iter->blocks);
-			} else {
-				mChunkReplicationCandidates.insert(
-					iter->blocks.begin(), iter->blocks.end());
-			}
+			mChunkReplicationCandidates.insert(
+				iter->blocks.begin(), iter->blocks.end());
 		}
 		iter = mHibernatingServers.erase(iter);
 	}
@@ -4221,6 +4476,7 @@ LayoutManager::HandoutChunkReplicationWork(CRCandidateSet &candidates,
 		if (noSuchChunkFlag) {
 			// Delete stale mapping.
 			delset.insert(chunkId);
+			HostedChunkRemoved(iter->second.chunkServers, chunkId);
 			mChunkToServerMap.erase(iter);
 		} else if (extraReplicas > 0) {
 			ReplicateChunk(iter->first, iter->second, extraReplicas);
@@ -4237,22 +4493,259 @@ LayoutManager::HandoutChunkReplicationWork(CRCandidateSet &candidates,
 	}
 }
 
-void
-LayoutManager::ChunkReplicationChecker()
+// Resumable scan of a replication candidates queue: starts right after where
+// the previous scan of the queue left off, wraps around, and stops once every
+// entry was visited.  Without valid cursor the scan starts from the beginning
+// and stops at the end of the queue.  Entries can be erased and inserted while
+// the scan is in progress, as long as only the current entry is erased.
+class ReplicationQueueScanner {
+public:
+	typedef ReplicationCandidates::Queue        Queue;
+	typedef ReplicationCandidates::QueueEntry   QueueEntry;
+	typedef ReplicationCandidates::QueueEntries QueueEntries;
+
+	ReplicationQueueScanner(int rack, Queue& queue)
+		: mRack(rack),
+		  mQueue(&queue),
+		  mStart(queue.cursor),
+		  mResumeFlag(queue.cursorValidFlag),
+		  mWrappedFlag(false),
+		  mDoneFlag(false),
+		  mIt(queue.cursorValidFlag ?
+			queue.entries.upper_bound(queue.cursor) :
+			queue.entries.begin())
+		{}
+	bool IsDone() {
+		if (mDoneFlag) {
+			return true;
+		}
+		if (mIt == mQueue->entries.end()) {
+			if (mWrappedFlag || ! mResumeFlag) {
+				mDoneFlag = true;
+				return true;
+			}
+			mWrappedFlag = true;
+			mIt = mQueue->entries.begin();
+			if (mIt == mQueue->entries.end()) {
+				mDoneFlag = true;
+				return true;
+			}
+		}
+		// The cursor can be changed or invalidated while the scan is in
+		// progress, therefore compare with the cursor at the start.
+		mDoneFlag = mWrappedFlag && mStart < *mIt;
+		return mDoneFlag;
+	}
+	int GetRack() const {
+		return mRack;
+	}
+	Queue& GetQueue() {
+		return *mQueue;
+	}
+	QueueEntries::iterator& Iterator() {
+		return mIt;
+	}
+private:
+	int                    mRack;
+	Queue*                 mQueue;
+	QueueEntry             mStart;
+	bool                   mResumeFlag;
+	bool                   mWrappedFlag;
+	bool                   mDoneFlag;
+	QueueEntries::iterator mIt;
+};
+
+bool
+LayoutManager::IndexReplicationCandidates(CRCandidateSet &delset)
 {
-	if (! mPendingBeginMakeStable.empty() && ! InRecoveryPeriod()) {
-		ProcessPendingBeginMakeStable();
+	ChunkIdSet& unindexed = mChunkReplicationCandidates.GetUnindexed();
+	if (unindexed.empty()) {
+		return true;
 	}
-	if (InRecovery()) {
-		return;
+
+	struct timeval start;
+	gettimeofday(&start, 0);
+
+	const int kCheckTime = 256;
+	int       pass       = kCheckTime;
+
+	while (! unindexed.empty()) {
+		if (--pass <= 0) {
+			struct timeval now;
+			gettimeofday(&now, 0);
+			// leave the rest of the budget for handing out work
+			if (ComputeTimeDiff(start, now) >
+					MAX_TIME_FOR_CHUNK_REPLICATION_CHECK / 2)
+				return false;
+			pass = kCheckTime;
+		}
+		const chunkId_t chunkId = *unindexed.begin();
+		CSMapIter const iter    = mChunkToServerMap.find(chunkId);
+		if (iter == mChunkToServerMap.end()) {
+			unindexed.erase(unindexed.begin());
+			delset.insert(chunkId);
+			continue;
+		}
+		mChunkReplicationCandidates.Index(chunkId,
+			ReplicationSourceRack(iter->second),
+			(int)iter->second.chunkServers.size());
 	}
+	return true;
+}
 
-	CheckHibernatingServersStatus();
+bool
+LayoutManager::ProcessReplicationCandidate(
+	int                                           rack,
+	ReplicationCandidates::Queue                 &queue,
+	ReplicationCandidates::QueueEntries::iterator &it,
+	const ChunkServerPtr                         *server,
+	CRCandidateSet                               &delset)
+{
+	const ReplicationCandidates::QueueEntry entry = *it;
+	// Take the entry out of the queue; it is put back if the chunk has
+	// to be checked again later.
+	queue.entries.erase(it++);
+	queue.cursor          = entry;
+	queue.cursorValidFlag = true;
+
+	const chunkId_t chunkId = entry.second;
+	if (! mChunkReplicationCandidates.contains(chunkId) ||
+			delset.find(chunkId) != delset.end()) {
+		// stale entry
+		return false;
+	}
+	CSMapIter const iter = mChunkToServerMap.find(chunkId);
+	if (iter == mChunkToServerMap.end()) {
+		delset.insert(chunkId);
+		return false;
+	}
+	ChunkPlacementInfo& clli = iter->second;
+	if (clli.ongoingReplications > 0) {
+		// this chunk is being re-replicated; it will be put back
+		// into the queue by ChunkReplicationDone()
+		return false;
+	}
+	const int srcRack  = ReplicationSourceRack(clli);
+	const int replicas = (int)clli.chunkServers.size();
+	if (srcRack != rack || replicas != entry.first) {
+		// placement has changed since the chunk was queued
+		mChunkReplicationCandidates.Index(chunkId, srcRack, replicas);
+		return false;
+	}
+	if (server) {
+		// if the chunk is already hosted on this server, the chunk
+		// isn't a candidate for work to be sent to this server.
+		bool skipFlag = IsChunkHostedOnServer(clli.chunkServers, *server);
+		if (! skipFlag && mRacks.size() > 1) {
+			// when there is more than one rack, since we
+			// are re-replicating a chunk, we don't want to put two
+			// copies of a chunk on the same rack.  if one
+			// of the nodes is retiring, we don't want to
+			// count the node in this rack set---we want to
+			// put a block on to the same rack.
+			set<int> excludeRacks;
+			for_each(clli.chunkServers.begin(), clli.chunkServers.end(),
+				RackSetter(excludeRacks, true));
+			skipFlag = excludeRacks.find((*server)->GetRack()) !=
+				excludeRacks.end();
+		}
+		if (skipFlag) {
+			queue.entries.insert(entry);
+			return false;
+		}
+	}
 
-	CRCandidateSet delset;
-	HandoutChunkReplicationWork(mPriorityChunkReplicationCandidates, delset);
-	HandoutChunkReplicationWork(mChunkReplicationCandidates, delset);
+	int  extraReplicas   = 0;
+	bool noSuchChunkFlag = false;
+	if (! CanReplicateChunkNow(chunkId, clli, extraReplicas, noSuchChunkFlag)) {
+		// check later
+		queue.entries.insert(entry);
+		return false;
+	}
+	if (noSuchChunkFlag) {
+		// Delete stale mapping.
+		delset.insert(chunkId);
+		HostedChunkRemoved(iter->second.chunkServers, chunkId);
+		mChunkToServerMap.erase(iter);
+		return false;
+	}
+	if (extraReplicas > 0) {
+		const int numDone = server ?
+			ReplicateChunk(chunkId, clli, 1,
+				vector<ChunkServerPtr>(1, *server)) :
+			ReplicateChunk(chunkId, clli, extraReplicas);
+		if (numDone <= 0) {
+			queue.entries.insert(entry);
+		}
+		return (numDone > 0);
+	}
+	if (extraReplicas < 0) {
+		DeleteAddlChunkReplicas(chunkId, clli, -extraReplicas);
+	}
+	delset.insert(chunkId);
+	return false;
+}
+
+void
+LayoutManager::HandoutChunkReplicationWork(CRCandidateSet &delset)
+{
+	// Walk the per rack queues in round robin, to spread the replication
+	// sources, resuming each queue where the previous pass left off.
+	ReplicationCandidates::Queues& queues =
+		mChunkReplicationCandidates.GetQueues();
+	vector<ReplicationQueueScanner> scanners;
+	scanners.reserve(queues.size());
+	for (ReplicationCandidates::Queues::iterator it = queues.begin();
+			it != queues.end(); ) {
+		if (it->second.entries.empty()) {
+			queues.erase(it++);
+			continue;
+		}
+		scanners.push_back(ReplicationQueueScanner(it->first, it->second));
+		++it;
+	}
 
+	struct timeval start;
+	gettimeofday(&start, 0);
+
+	const int kCheckTime = 32;
+	int       pass       = kCheckTime;
+	size_t    active     = scanners.size();
+
+	while (active > 0) {
+		active = 0;
+		for (vector<ReplicationQueueScanner>::iterator it = scanners.begin();
+				it != scanners.end();
+				++it) {
+			if (it->IsDone()) {
+				continue;
+			}
+			active++;
+			if (--pass <= 0) {
+				struct timeval now;
+				gettimeofday(&now, 0);
+				if (ComputeTimeDiff(start, now) >
+						MAX_TIME_FOR_CHUNK_REPLICATION_CHECK)
+					// if we have spent more than 1 second here,
+					// stop serve other requests
+					return;
+				if (!IsAnyServerAvailForReReplication())
+					return;
+				pass = kCheckTime;
+			}
+			ProcessReplicationCandidate(it->GetRack(), it->GetQueue(),
+				it->Iterator(), 0, delset);
+			if (mNumOngoingReplications > (int64_t)mChunkServers.size() *
+					MAX_CONCURRENT_WRITE_REPLICATIONS_PER_NODE)
+				// throttle...we are handing out
+				return;
+		}
+	}
+}
+
+void
+LayoutManager::RemoveReplicationCandidates(const CRCandidateSet &delset)
+{
 	for (CRCandidateSet::const_iterator citer = delset.begin();
 			citer != delset.end();
 			++citer) {
@@ -4273,9 +4766,33 @@ LayoutManager::ChunkReplicationChecker()
 		mPriorityChunkReplicationCandidates.erase(*citer);
 		mChunkReplicationCandidates.erase(*citer);
 	}
+}
+
+void
+LayoutManager::ChunkReplicationChecker()
+{
+	if (! mPendingBeginMakeStable.empty() && ! InRecoveryPeriod()) {
+		ProcessPendingBeginMakeStable();
+	}
+	if (InRecovery()) {
+		return;
+	}
+
+	struct timeval start;
+	gettimeofday(&start, 0);
+
+	CheckHibernatingServersStatus();
+
+	CRCandidateSet delset;
+	HandoutChunkReplicationWork(mPriorityChunkReplicationCandidates, delset);
+	IndexReplicationCandidates(delset);
+	HandoutChunkReplicationWork(delset);
+	RemoveReplicationCandidates(delset);
 
 	if (mChunkReplicationCandidates.empty()) {
 		mPriorityChunkReplicationCandidates.clear();
+		// drop stale queue entries, if any
+		mChunkReplicationCandidates.clear();
 		// if there are any retiring servers, we need to make sure that
 		// the servers don't think there is a block to be replicated
 		// if there is any such, let us get them into the set of
@@ -4288,85 +4805,69 @@ LayoutManager::ChunkReplicationChecker()
 
 	mReplicationTodoStats->Set(mChunkReplicationCandidates.size());
 	mChunksWithOneReplicaStats->Set(mPriorityChunkReplicationCandidates.size());
+
+	struct timeval now;
+	gettimeofday(&now, 0);
+	mReplicationCheckerStats->Update(1);
+	mReplicationCheckerStats->Update(ComputeTimeDiff(start, now));
 }
 
 void
-LayoutManager::FindReplicationWorkForServer(ChunkServerPtr &server, chunkId_t chunkReplicated)
+LayoutManager::FindReplicationWorkForServer(ChunkServerPtr &server)
 {
-	vector<ChunkServerPtr> c;
-
 	if (server->IsRetiring())
 		return;
 
-	c.push_back(server);
-
-	// try to start where we were done with this server
-	ReplicationCandidates::iterator citer =
-		mChunkReplicationCandidates.find(chunkReplicated + 1);
-	if (citer == mChunkReplicationCandidates.end()) {
-		// try to start where we left off last time; if that chunk has
-		// disappeared, find something "closeby"
-		citer = mChunkReplicationCandidates.upper_bound(mLastChunkReplicated);
-	}
-
-	if (citer == mChunkReplicationCandidates.end()) {
-		mLastChunkReplicated = 1;
-		citer = mChunkReplicationCandidates.begin();
-	}
-
 	struct timeval start, now;
 
 	gettimeofday(&start, NULL);
 
-	for (; citer != mChunkReplicationCandidates.end(); ++citer) {
-		gettimeofday(&now, NULL);
-
-		if (ComputeTimeDiff(start, now) > MAX_TIME_TO_FIND_ADDL_REPLICATION_WORK)
-			// if we have spent more than 5 m-seconds here, stop
-			// serve other requests
-			break;
-
-		const chunkId_t chunkId = *citer;
-        	CSMapIter iter = mChunkToServerMap.find(chunkId);
-        	if (iter == mChunkToServerMap.end())
-			continue;
-
-		if (iter->second.ongoingReplications > 0)
-			continue;
-
-		// if the chunk is already hosted on this server, the chunk isn't a candidate for
-		// work to be sent to this server.
-		int  extraReplicas   = 0;
-		bool noSuchChunkFlag = false;
-		if (IsChunkHostedOnServer(iter->second.chunkServers, server) ||
-				(!CanReplicateChunkNow(iter->first, iter->second,
-					extraReplicas, noSuchChunkFlag)))
+	// Only look at the queues of the racks that can be the source of the
+	// replication: in a multi rack setup the chunks with a copy on the
+	// server's rack aren't candidates for work sent to this server.
+	// Except when a server on that rack is retiring: same as RackSetter,
+	// a copy on a retiring server doesn't count, so that its chunks can
+	// be moved within the rack.
+	bool skipOwnRackFlag = mRacks.size() > 1;
+	if (skipOwnRackFlag) {
+		vector<RackInfo>::iterator const rack = find_if(
+			mRacks.begin(), mRacks.end(),
+			RackMatcher(server->GetRack()));
+		skipOwnRackFlag = rack != mRacks.end() && find_if(
+			rack->getServers().begin(), rack->getServers().end(),
+			RetiringServerPred()) == rack->getServers().end();
+	}
+	CRCandidateSet delset;
+	ReplicationCandidates::Queues& queues =
+		mChunkReplicationCandidates.GetQueues();
+	bool doneFlag = false;
+	for (ReplicationCandidates::Queues::iterator qit = queues.begin();
+			! doneFlag && qit != queues.end();
+			++qit) {
+		if (skipOwnRackFlag && qit->first == server->GetRack()) {
 			continue;
-
-		if (noSuchChunkFlag) {
-			mChunkToServerMap.erase(iter);
-		} else if (extraReplicas > 0) {
-			if (mRacks.size() > 1) {
-				// when there is more than one rack, since we
-				// are re-replicating a chunk, we don't want to put two
-				// copies of a chunk on the same rack.  if one
-				// of the nodes is retiring, we don't want to
-				// count the node in this rack set---we want to
-				// put a block on to the same rack.
-				set<int> excludeRacks;
-				for_each(iter->second.chunkServers.begin(), iter->second.chunkServers.end(),
-					RackSetter(excludeRacks, true));
-				if (excludeRacks.find(server->GetRack()) != excludeRacks.end())
-					continue;
-			}
-			ReplicateChunk(iter->first, iter->second, 1, c);
-		} else if (! iter->second.chunkServers.empty()) {
-			CancelPendingMakeStable(iter->second.fid, iter->first);
 		}
-
-		if (server->GetNumChunkReplications() > MAX_CONCURRENT_WRITE_REPLICATIONS_PER_NODE)
-			break;
+		ReplicationQueueScanner scanner(qit->first, qit->second);
+		while (! scanner.IsDone()) {
+			gettimeofday(&now, NULL);
+			if ((doneFlag = ComputeTimeDiff(start, now) >
+					MAX_TIME_TO_FIND_ADDL_REPLICATION_WORK))
+				// if we have spent more than 5 m-seconds here, stop
+				// serve other requests
+				break;
+			ProcessReplicationCandidate(scanner.GetRack(),
+				scanner.GetQueue(), scanner.Iterator(), &server, delset);
+			if ((doneFlag = server->GetNumChunkReplications() >
+					MAX_CONCURRENT_WRITE_REPLICATIONS_PER_NODE))
+				break;
+		}
 	}
+	RemoveReplicationCandidates(delset);
+
+	gettimeofday(&now, NULL);
+	mReplicationWorkSearchStats->Update(1);
+	mReplicationWorkSearchStats->Update(ComputeTimeDiff(start, now));
+
 	// if there is any room left to do more work...
 	ExecuteRebalancePlan(server);
 }
@@ -4403,6 +4904,9 @@ LayoutManager::ChunkReplicationDone(MetaChunkReplicate *req)
 	}
 
 	req->server->ReplicateChunkDone(req->chunkId);
+	// The chunk was taken out of the replication queue when the
+	// replication was started: re-check it on the next pass.
+	mChunkReplicationCandidates.Reindex(req->chunkId);
 	vector<ChunkServerPtr>::iterator const source = find_if(
 		mChunkServers.begin(), mChunkServers.end(),
 		MatchingServer(req->srcLocation));
@@ -4470,7 +4974,7 @@ LayoutManager::ChunkReplicationDone(MetaChunkReplicate *req)
 
 	// since this server is now free, send more work its way...
 	if (req->server->GetNumChunkReplications() <= 1) {
-		FindReplicationWorkForServer(req->server, req->chunkId);
+		FindReplicationWorkForServer(req->server);
 	}
 }
 
@@ -4524,6 +5028,7 @@ LayoutManager::DeleteAddlChunkReplicas(chunkId_t chunkId, ChunkPlacementInfo &cl
 		copiesToDiscard.insert(copiesToDiscard.end(), servers.begin() + numReplicas, servers.end());
 	}
 	mChunkToServerMap[chunkId] = clli;
+	HostedChunkRemoved(copiesToDiscard, chunkId);
 
 	ostringstream msg;
 	msg << "Chunk " << chunkId << " lives on:\n";
@@ -4732,6 +5237,7 @@ LayoutManager::RebalanceServers()
 			(!CanReplicateChunkNow(chunkId, clli, extraReplicas, noSuchChunkFlag)))
 				continue;
 		if (noSuchChunkFlag) {
+			HostedChunkRemoved(iter->second.chunkServers, chunkId);
 			mChunkToServerMap.erase(iter--);
 			continue;
 		}
@@ -4932,6 +5438,7 @@ LayoutManager::ExecuteRebalancePlan(ChunkServerPtr &c)
 			continue;
 		}
 		if (noSuchChunkFlag) {
+			HostedChunkRemoved(iter->second.chunkServers, cid);
 			mChunkToServerMap.erase(iter);
 		} else {
 			ReplicateChunkToServers(cid, iter->second, 1, candidates);
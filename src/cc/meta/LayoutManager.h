@@ -45,6 +45,7 @@
 #include "LeaseCleaner.h"
 #include "ChunkReplicator.h"
 #include "ChunkServer.h"
+#include "MetaScanner.h"
 
 #include "libkfsIO/Counter.h"
 #include "common/properties.h"
@@ -441,7 +442,195 @@ namespace KFS
 	typedef ChunkServer::ChunkIdSet ChunkIdSet;
 	typedef ChunkIdSet CRCandidateSet;
 	typedef CRCandidateSet::iterator CRCandidateSetIter;
-        typedef CRCandidateSet ReplicationCandidates;
+
+	// Set of chunks that need re-replication checking.  In addition to
+	// the set itself, the candidates are indexed into per-rack queues: a
+	// chunk is queued on the rack of its first remaining replica (the
+	// replication source), and each queue is ordered by the # of remaining
+	// replicas, so that the chunks with fewest copies are handed out first.
+	// Handing out work then only touches the queues a given target server
+	// can take work from, and resumes from a per-queue cursor, rather than
+	// re-walking the whole backlog on every pass.
+	// Newly inserted chunks are "unindexed" until the layout manager looks
+	// up their placement and calls Index().  Queue entries are validated
+	// lazily: entries for chunks that are no longer candidates, or whose
+	// placement has changed, are dropped/re-indexed when encountered.
+	class ReplicationCandidates {
+	public:
+		typedef ChunkIdSet::const_iterator const_iterator;
+		typedef ChunkIdSet::iterator       iterator;
+		typedef ChunkIdSet::size_type      size_type;
+		// <# of remaining replicas, chunk id>
+		typedef std::pair<int, chunkId_t> QueueEntry;
+		typedef std::set<QueueEntry, std::less<QueueEntry>,
+			boost::fast_pool_allocator<QueueEntry>
+		> QueueEntries;
+		struct Queue {
+			Queue() : entries(), cursor(), cursorValidFlag(false) {}
+			QueueEntries entries;
+			// where the last scan of this queue left off
+			QueueEntry   cursor;
+			bool         cursorValidFlag;
+		};
+		// rack id -> queue of candidates with a replica on that rack
+		typedef std::map<int, Queue> Queues;
+
+		ReplicationCandidates()
+			: mSet(), mUnindexed(), mQueues()
+			{}
+		std::pair<iterator, bool> insert(chunkId_t chunkId) {
+			std::pair<iterator, bool> const ret = mSet.insert(chunkId);
+			if (ret.second) {
+				mUnindexed.insert(chunkId);
+			}
+			return ret;
+		}
+		template<typename IT> void insert(IT first, IT last) {
+			for (; first != last; ++first) {
+				insert(*first);
+			}
+		}
+		/// Insert a chunk whose placement is already known.
+		void insert(chunkId_t chunkId, int rack, int replicas) {
+			if (mSet.insert(chunkId).second) {
+				Index(chunkId, rack, replicas);
+			}
+		}
+		size_type erase(chunkId_t chunkId) {
+			mUnindexed.erase(chunkId);
+			return mSet.erase(chunkId);
+		}
+		const_iterator find(chunkId_t chunkId) const {
+			return mSet.find(chunkId);
+		}
+		const_iterator begin() const {
+			return mSet.begin();
+		}
+		const_iterator end() const {
+			return mSet.end();
+		}
+		bool contains(chunkId_t chunkId) const {
+			return (mSet.find(chunkId) != mSet.end());
+		}
+		size_type size() const {
+			return mSet.size();
+		}
+		bool empty() const {
+			return mSet.empty();
+		}
+		void clear() {
+			mSet.clear();
+			mUnindexed.clear();
+			mQueues.clear();
+		}
+		/// Place the chunk into the queue of the specified rack.
+		void Index(chunkId_t chunkId, int rack, int replicas) {
+			mUnindexed.erase(chunkId);
+			Queue& queue = mQueues[rack];
+			const QueueEntry entry(replicas, chunkId);
+			queue.entries.insert(entry);
+			// Make sure that the higher priority entries do
+			// not have to wait for the cursor to wrap around.
+			if (queue.cursorValidFlag && entry < queue.cursor) {
+				queue.cursorValidFlag = false;
+			}
+		}
+		/// The chunk placement might have changed (replication
+		/// finished or failed): look it up again on the next pass.
+		void Reindex(chunkId_t chunkId) {
+			if (contains(chunkId)) {
+				mUnindexed.insert(chunkId);
+			}
+		}
+		ChunkIdSet& GetUnindexed() {
+			return mUnindexed;
+		}
+		Queues& GetQueues() {
+			return mQueues;
+		}
+		size_type GetQueuedCount() const {
+			size_type ret = 0;
+			for (Queues::const_iterator it = mQueues.begin();
+					it != mQueues.end();
+					++it) {
+				ret += it->second.entries.size();
+			}
+			return ret;
+		}
+	private:
+		ChunkIdSet mSet;
+		ChunkIdSet mUnindexed;
+		Queues     mQueues;
+	private:
+		ReplicationCandidates(const ReplicationCandidates&);
+		ReplicationCandidates& operator=(const ReplicationCandidates&);
+	};
+
+	// Chunks with leases, ordered by the time when the earliest of the
+	// chunk's leases expires, so that the lease cleanup only visits the
+	// chunks with expired leases.
+	// The scheduled time of a chunk is never later than the expiration time
+	// of any of its leases; renewing a lease does not move the chunk, the
+	// cleanup finds that nothing has expired, and reschedules the chunk at
+	// the new earliest expiration time. Making a lease expire earlier
+	// requires rescheduling the chunk.
+	class LeaseExpiryQueue {
+	public:
+		typedef std::pair<time_t, chunkId_t> Entry;
+		typedef std::set<Entry, std::less<Entry>,
+			boost::fast_pool_allocator<Entry>
+		> Entries;
+		typedef std::map<chunkId_t, time_t, std::less<chunkId_t>,
+			boost::fast_pool_allocator<
+				std::pair<const chunkId_t, time_t> >
+		> Chunks;
+		typedef Chunks::size_type size_type;
+
+		LeaseExpiryQueue()
+			: mEntries(), mChunks()
+			{}
+		/// Check the chunk's leases no later than the specified time.
+		void Schedule(chunkId_t chunkId, time_t expires) {
+			std::pair<Chunks::iterator, bool> const res =
+				mChunks.insert(std::make_pair(chunkId, expires));
+			if (! res.second) {
+				if (res.first->second <= expires) {
+					return;
+				}
+				mEntries.erase(Entry(res.first->second, chunkId));
+				res.first->second = expires;
+			}
+			mEntries.insert(Entry(expires, chunkId));
+		}
+		/// Remove the chunk with the earliest time, if the time is
+		/// not past now.
+		bool PopExpired(time_t now, chunkId_t& chunkId) {
+			if (mEntries.empty() || mEntries.begin()->first > now) {
+				return false;
+			}
+			chunkId = mEntries.begin()->second;
+			mEntries.erase(mEntries.begin());
+			mChunks.erase(chunkId);
+			return true;
+		}
+		void erase(chunkId_t chunkId) {
+			Chunks::iterator const it = mChunks.find(chunkId);
+			if (it == mChunks.end()) {
+				return;
+			}
+			mEntries.erase(Entry(it->second, chunkId));
+			mChunks.erase(it);
+		}
+		size_type size() const {
+			return mChunks.size();
+		}
+	private:
+		Entries mEntries;
+		Chunks  mChunks;
+	private:
+		LeaseExpiryQueue(const LeaseExpiryQueue&);
+		LeaseExpiryQueue& operator=(const LeaseExpiryQueue&);
+	};
 
 	//
 	// For maintenance reasons, we'd like to schedule downtime for a server.
@@ -457,7 +646,7 @@ namespace KFS
 		// the server we put in hibernation
 		ServerLocation location;
 		// the blocks on this server
-		ReplicationCandidates blocks;
+		ChunkIdSet blocks;
 		// when is it likely to wake up
 		time_t sleepEndTime;
 	};
@@ -775,14 +964,22 @@ namespace KFS
 		/// Dump out the chunk location map to a string stream.
 		void DumpChunkToServerMap(ostringstream &os);
 
+		/// Dump out the chunk location map to a file in the
+		/// background, in time slices; the request is suspended until
+		/// the dump is complete.  The dump is written to a temporary
+		/// file, and renamed to <dir>/chunkmap.txt once complete.
+		void DumpChunkToServerMap(const std::string &dir,
+			MetaDumpChunkToServerMap *req);
+
 		/// Dump out the list of chunks that are currently replication
 		/// candidates.
 		void DumpChunkReplicationCandidates(ostringstream &os);
 
 		/// Check the replication level of all the blocks and report
-		/// back files that are under-replicated.
-		/// Returns true if the system is healthy.
-		void Fsck(ostringstream &os);
+		/// back files that are under-replicated. The chunk map is
+		/// scanned in the background; the request is suspended until
+		/// the end of the scan.
+		void Fsck(MetaFsck *req);
 
 		///
 		/// How many blocks are at replication level of 1.
@@ -928,13 +1125,6 @@ namespace KFS
 		/// this counter tracks the last chunk we checked
 		kfsChunkId_t mLastChunkRebalanced;
 
-		/// When a server goes down or needs retiring, we start
-		/// replicating blocks.  Whenever a replication finishes, we
-		/// find the next candidate.  We need to track "where" we left off
-		/// on a previous iteration, so that we can start from there and
-		/// run with it.
-		kfsChunkId_t mLastChunkReplicated;
-
 		/// After a crash, track the recovery start time.  For a timer
 		/// period that equals the length of lease interval, we only grant
 		/// lease renews and new leases to new chunks.  We however,
@@ -990,8 +1180,9 @@ namespace KFS
 		CRCandidateSet mPriorityChunkReplicationCandidates;
 
 		/// chunks to which a lease has been handed out; whenever we
-		/// cleanup the leases, this set is walked 
-		CRCandidateSet mChunksWithLeases;
+		/// cleanup the leases, the chunks whose time has come are
+		/// taken from the queue
+		LeaseExpiryQueue mChunksWithLeases;
 
 		/// For files that are being atomic record appended to, track the last
 		/// chunk of the file that we can use for subsequent allocations
@@ -1016,6 +1207,17 @@ namespace KFS
 		Counter *mFailedReplicationStats;
 		/// Track the # of stale chunks we have seen so far
 		Counter *mStaleChunkCount;
+		/// Time spent in the replication checker passes and in finding
+		/// work for servers that finished a replication.
+		Counter *mReplicationCheckerStats;
+		Counter *mReplicationWorkSearchStats;
+		/// # of servers taken down, and the time spent in ServerDown().
+		Counter *mServerDownStats;
+		/// # of chunks with leases, # of leases expired in total and
+		/// by the last cleanup
+		Counter *mChunksWithLeasesStats;
+		Counter *mExpiredLeasesStats;
+		Counter *mLastCleanupExpiredLeasesStats;
                 size_t mMastersCount;
                 size_t mSlavesCount;
                 bool   mAssignMasterByIpFlag;
@@ -1041,13 +1243,113 @@ namespace KFS
 		int64_t mCSGracefulRestartTimeout;
                 int64_t mCSGracefulRestartAppendWithWidTimeout;
                 time_t  mLastReplicationCheckTime;
-                time_t  mLastRecomputeDirsizeTime;
 
+		///
+		/// Time sliced walk over the chunk map, see MetaScanner. The
+		/// cursor is the last chunk id visited.
+		/// The requests submitted to the scan are suspended until the
+		/// end of the next complete pass.
+		///
+		class ChunkMapScan : public MetaScan {
+		public:
+			ChunkMapScan(const char *name, LayoutManager& m)
+				: MetaScan(name),
+				  mLayoutManager(m),
+				  mCursor(),
+				  mFirstFlag(true),
+				  mRequests(),
+				  mNextRequests()
+				{}
+			/// Suspend the request, and start a pass, or queue
+			/// the request for the next pass.
+			void Submit(MetaRequest *req);
+		protected:
+			LayoutManager& mLayoutManager;
+
+			virtual void Start();
+			virtual bool Next();
+			virtual void Done();
+			virtual void Visit(CSMap::value_type& entry) = 0;
+			/// Fill in the response of the request.
+			virtual void Complete(MetaRequest& /* req */) {}
+		private:
+			chunkId_t                  mCursor;
+			bool                       mFirstFlag;
+			std::vector<MetaRequest*>  mRequests;
+			std::vector<MetaRequest*>  mNextRequests;
+		};
+		/// Queue all chunks for the replication check.
+		class ReplicationCheckScan : public ChunkMapScan {
+		public:
+			ReplicationCheckScan(LayoutManager& m)
+				: ChunkMapScan("replication check", m)
+				{}
+		protected:
+			virtual void Start();
+			virtual void Visit(CSMap::value_type& entry);
+		};
+		/// Count the lost and the endangered chunks.
+		class FsckScan : public ChunkMapScan {
+		public:
+			FsckScan(LayoutManager& m)
+				: ChunkMapScan("fsck", m),
+				  mLost(),
+				  mEndangered(),
+				  mLostCount(0),
+				  mEndangeredCount(0),
+				  mStatus()
+				{}
+		protected:
+			virtual void Start();
+			virtual void Visit(CSMap::value_type& entry);
+			virtual void Done();
+			virtual void Complete(MetaRequest& req);
+		private:
+			ostringstream mLost;
+			ostringstream mEndangered;
+			int           mLostCount;
+			int           mEndangeredCount;
+			std::string   mStatus;
+		};
+		/// Write the chunk map to a file.
+		class ChunkMapDumpScan : public ChunkMapScan {
+		public:
+			ChunkMapDumpScan(LayoutManager& m)
+				: ChunkMapScan("chunk map dump", m),
+				  mDir("."),
+				  mNextDir("."),
+				  mFileName(),
+				  mTmpFileName(),
+				  mStream(),
+				  mStatus(0)
+				{}
+		protected:
+			virtual void Start();
+			virtual void Visit(CSMap::value_type& entry);
+			virtual void Done();
+			virtual void Complete(MetaRequest& req);
+		public:
+			/// The directory of the next pass.
+			void SetDir(const std::string& dir) {
+				mNextDir = dir;
+			}
+		private:
+			std::string   mDir;
+			std::string   mNextDir;
+			std::string   mFileName;
+			std::string   mTmpFileName;
+			std::ofstream mStream;
+			int           mStatus;
+		};
+		ReplicationCheckScan mReplicationCheckScan;
+		FsckScan             mFsckScan;
+		ChunkMapDumpScan     mChunkMapDumpScan;
+
+		/// @retval true if the chunk has no leases left
 		bool ExpiredLeaseCleanup(
 	            chunkId_t                 chunkId,
 	            time_t                    now,
-	            int                       ownerDownExpireDelay = 0,
-	            const CRCandidateSetIter* chunksWithLeasesIt   = 0);
+	            int                       ownerDownExpireDelay = 0);
 		/// Find a set of racks to place a chunk on; the racks are
 		/// ordered by space.
 		void FindCandidateRacks(std::vector<int> &result);
@@ -1120,17 +1422,32 @@ namespace KFS
 		/// The server has finished re-replicating a chunk.  If there is more
 		/// re-replication to be done, send it the server's way.
 		/// @param[in] server  The server to which re-replication work should be sent
-		/// @param[in] chunkReplicated  The chunkid that the server says
-		///     it finished replication.
-		void FindReplicationWorkForServer(ChunkServerPtr &server, chunkId_t chunkReplicated);
+		void FindReplicationWorkForServer(ChunkServerPtr &server);
 
 		/// From the candidates, handout work to nodes.  If any chunks are
 		/// over-replicated/chunk is deleted from system, add them to delset.
 		void HandoutChunkReplicationWork(CRCandidateSet &candidates,
 						CRCandidateSet &delset);
-		/// From the list of candidates, build a priority list---a list
-		/// of chunks with replication level of 1.
-		void RebuildPriorityReplicationList();
+		void HandoutChunkReplicationWork(CRCandidateSet &delset);
+
+		/// Lookup placement of the newly added replication candidates,
+		/// and put them into per rack queues.
+		/// @retval false if the time budget ran out
+		bool IndexReplicationCandidates(CRCandidateSet &delset);
+
+		/// Process one entry of the replication candidates queue.
+		/// If server is set, only hand out work to that server.
+		/// Advances the iterator past the entry.
+		/// @retval true if replication was started
+		bool ProcessReplicationCandidate(int rack,
+				ReplicationCandidates::Queue &queue,
+				ReplicationCandidates::QueueEntries::iterator &it,
+				const ChunkServerPtr *server,
+				CRCandidateSet &delset);
+
+		/// Done with the chunks in delset: notify the retiring servers,
+		/// and remove the chunks from the replication candidates.
+		void RemoveReplicationCandidates(const CRCandidateSet &delset);
 
 		/// There are more replicas of a chunk than the requested amount.  So,
 		/// delete the extra replicas and reclaim space.  When deleting the addtional
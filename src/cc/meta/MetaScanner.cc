@@ -0,0 +1,174 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \file MetaScanner.cc
+// \brief Resumable background scans that run on the metaserver thread in
+// bounded time slices, interleaved with the request processing.
+//
+//----------------------------------------------------------------------------
+
+#include "MetaScanner.h"
+#include "libkfsIO/Globals.h"
+#include "common/log.h"
+
+#include <algorithm>
+#include <cassert>
+#include <time.h>
+#include <sys/time.h>
+
+namespace KFS
+{
+using std::string;
+
+MetaScanner gMetaScanner;
+
+static string
+ScanCounterName(const char *name, const char *suffix)
+{
+	return (string("Scan ") + name + " " + suffix);
+}
+
+static inline int64_t
+NowUsec()
+{
+	struct timeval now;
+	gettimeofday(&now, 0);
+	return (int64_t(now.tv_sec) * 1000000 + now.tv_usec);
+}
+
+MetaScan::MetaScan(const char *name)
+	: mName(name),
+	  mActiveFlag(false),
+	  mPassItems(0),
+	  mPassSlices(0),
+	  mPassUsec(0),
+	  mPassStartTime(0),
+	  mPassesCounter(ScanCounterName(name, "passes").c_str()),
+	  mItemsCounter(ScanCounterName(name, "items").c_str()),
+	  mProgressCounter(ScanCounterName(name, "progress").c_str())
+{
+	libkfsio::globals().counterManager.AddCounter(&mPassesCounter);
+	libkfsio::globals().counterManager.AddCounter(&mItemsCounter);
+	libkfsio::globals().counterManager.AddCounter(&mProgressCounter);
+}
+
+MetaScan::~MetaScan()
+{
+	// The scanner must not be left with a dangling pointer.
+	assert(! mActiveFlag);
+}
+
+MetaScanner::MetaScanner()
+	: ITimeout(),
+	  mScans(),
+	  mSliceUsec(5000)
+{
+}
+
+bool
+MetaScanner::Schedule(MetaScan& scan)
+{
+	if (scan.mActiveFlag) {
+		return false;
+	}
+	if (mScans.empty()) {
+		libkfsio::globalNetManager().RegisterTimeoutHandler(this);
+	}
+	scan.mActiveFlag    = true;
+	scan.mPassItems     = 0;
+	scan.mPassSlices    = 0;
+	scan.mPassUsec      = 0;
+	scan.mPassStartTime = time(0);
+	scan.mProgressCounter.Set(0);
+	scan.Start();
+	mScans.push_back(&scan);
+	KFS_LOG_STREAM_INFO << "scan " << scan.mName << ": started" <<
+	KFS_LOG_EOM;
+	// Run the first slice on the next loop iteration.
+	libkfsio::globalNetManager().Wakeup();
+	return true;
+}
+
+void
+MetaScanner::Timeout()
+{
+	// Check the time once per this many items: an item takes well under
+	// a micro second in most scans.
+	const int kCheckInterval = 32;
+	const int64_t start    = NowUsec();
+	const int64_t deadline = start + mSliceUsec;
+	int64_t       now      = start;
+	int           left     = (int)mScans.size();
+	for (Scans::iterator it = mScans.begin();
+			it != mScans.end() && now < deadline; --left) {
+		MetaScan& scan = **it;
+		// Share the rest of the slice with the scans that follow.
+		const int64_t scanDeadline =
+			now + (deadline - now) / std::max(1, left);
+		const int64_t scanStart    = now;
+		int64_t       items        = 0;
+		bool          doneFlag     = false;
+		for (; ; ) {
+			items++;
+			if (! scan.Next()) {
+				doneFlag = true;
+				break;
+			}
+			if (items % kCheckInterval == 0 &&
+					(now = NowUsec()) >= scanDeadline) {
+				break;
+			}
+		}
+		now = NowUsec();
+		scan.mPassItems  += items;
+		scan.mPassSlices++;
+		scan.mPassUsec   += now - scanStart;
+		scan.mItemsCounter.Update((int)items);
+		scan.mProgressCounter.Set((int)std::min(scan.mPassItems,
+			int64_t(0x7FFFFFFF)));
+		if (! doneFlag) {
+			++it;
+			continue;
+		}
+		it = mScans.erase(it);
+		scan.mActiveFlag = false;
+		scan.mPassesCounter.Update(1);
+		scan.mPassesCounter.Update(float(scan.mPassUsec * 1e-6));
+		KFS_LOG_STREAM_INFO << "scan " << scan.mName << ": done" <<
+			" items: "   << scan.mPassItems <<
+			" slices: "  << scan.mPassSlices <<
+			" busy: "    << scan.mPassUsec * 1e-6 << " sec" <<
+			" elapsed: " << time(0) - scan.mPassStartTime <<
+			" sec" <<
+		KFS_LOG_EOM;
+		// Done() can schedule the next pass of this, or another scan.
+		scan.Done();
+	}
+	if (mScans.empty()) {
+		libkfsio::globalNetManager().UnRegisterTimeoutHandler(this);
+	} else {
+		// Do not wait for the poll timeout: process the pending
+		// network events, and come back.
+		libkfsio::globalNetManager().Wakeup();
+	}
+}
+
+}
@@ -0,0 +1,113 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \file MetaScanner.h
+// \brief Resumable background scans that run on the metaserver thread in
+// bounded time slices, interleaved with the request processing.
+//
+//----------------------------------------------------------------------------
+
+#ifndef META_METASCANNER_H
+#define META_METASCANNER_H
+
+#include "libkfsIO/ITimeout.h"
+#include "libkfsIO/Counter.h"
+
+#include <stdint.h>
+#include <string>
+#include <list>
+
+namespace KFS
+{
+	///
+	/// A walk over a metaserver data structure, such as the chunk map or
+	/// the directory tree, that can be suspended after any item. The scan
+	/// keeps its own cursor (a key, not an iterator), as the structure
+	/// changes between the time slices.
+	///
+	class MetaScan {
+	public:
+		MetaScan(const char *name);
+		virtual ~MetaScan();
+		const std::string& GetName() const {
+			return mName;
+		}
+		bool IsActive() const {
+			return mActiveFlag;
+		}
+		/// # of items processed by the current, or the last pass.
+		int64_t GetPassItems() const {
+			return mPassItems;
+		}
+	protected:
+		/// Position the cursor at the beginning.
+		virtual void Start() = 0;
+		/// Process the item at the cursor, and advance the cursor.
+		/// @retval false if the pass is complete
+		virtual bool Next() = 0;
+		/// The pass is complete.
+		virtual void Done() {}
+	private:
+		const std::string mName;
+		bool              mActiveFlag;
+		int64_t           mPassItems;
+		int64_t           mPassSlices;
+		int64_t           mPassUsec;
+		time_t            mPassStartTime;
+		/// # of completed passes, and the time spent in the slices
+		Counter           mPassesCounter;
+		/// # of items processed, by all passes
+		Counter           mItemsCounter;
+		/// # of items processed by the current pass
+		Counter           mProgressCounter;
+
+		friend class MetaScanner;
+	private:
+		MetaScan(const MetaScan&);
+		MetaScan& operator=(const MetaScan&);
+	};
+
+	///
+	/// Runs the active scans on each net manager loop iteration, for at
+	/// most the slice time in total, and wakes up the loop while any
+	/// scan is active, so that the scans proceed as fast as the request
+	/// load allows.
+	///
+	class MetaScanner : public ITimeout {
+	public:
+		MetaScanner();
+		void SetSliceUsec(int usec) {
+			mSliceUsec = usec > 0 ? usec : 1;
+		}
+		/// Start a pass of the scan.
+		/// @retval false if the pass is already in progress
+		bool Schedule(MetaScan& scan);
+		virtual void Timeout();
+	private:
+		typedef std::list<MetaScan*> Scans;
+		Scans mScans;
+		int   mSliceUsec;
+	};
+
+	extern MetaScanner gMetaScanner;
+}
+
+#endif // META_METASCANNER_H
@@ -23,6 +23,9 @@
 // \brief An online fsck: download the list of fileid's that are
 // missing blocks; then use the checkpoint/logs to print out the
 // pathname (i.e., inode # -> pathname)
+// With -d, an offline check of the directory sizes: load the checkpoint,
+// replay the logs, and compare the directory sizes maintained along the
+// way with the sizes recomputed from the files.
 // 
 //----------------------------------------------------------------------------
 
@@ -68,6 +71,7 @@ int main(int argc, char **argv)
     // use options: -l for logdir -c for checkpoint dir
     char optchar;
     bool help = false;
+    bool checkDirSizes = false;
     string logdir, cpdir;
     string metahost;
     string lockFn;
@@ -77,8 +81,11 @@ int main(int argc, char **argv)
     KFS::MsgLogger::Init(NULL);
     KFS::MsgLogger::SetLevel(MsgLogger::kLogLevelINFO);
 
-    while ((optchar = getopt(argc, argv, "hl:c:m:p:L:")) != -1) {
+    while ((optchar = getopt(argc, argv, "hdl:c:m:p:L:")) != -1) {
         switch (optchar) {
+            case 'd':
+                checkDirSizes = true;
+                break;
             case 'L':
                 lockFn = optarg;
                 break;
@@ -106,10 +113,25 @@ int main(int argc, char **argv)
 
     if (help) {
         cout << "Usage: " << argv[0] << " [-L <lockfile>] [-l <logdir>] [-c <cpdir>] [-m <metahost>] [-p <metaport>] "
-             << endl;
+             << "[-d]" << endl;
         exit(-1);
     }
 
+    if (checkDirSizes) {
+        metatree.disableFidToPathname();
+        logger_setup_paths(logdir);
+        checkpointer_setup_paths(cpdir);
+        status = restoreCheckpoint(lockFn);
+        if (status != 0)
+            panic("restore checkpoint failed!", false);
+        replayLogs();
+        const int mismatches = metatree.checkDirSizes(std::cout);
+        cout << "Directory sizes are " <<
+            (mismatches == 0 ? "CONSISTENT" : "INCONSISTENT") <<
+            " (" << mismatches << " mismatches)" << endl;
+        exit(mismatches == 0 ? 0 : 1);
+    }
+
     set<fid_t> lostFiles, endangeredFiles;
 
     getFsckInfo(metahost, metaport, lostFiles, endangeredFiles);
@@ -117,6 +117,7 @@ Tree::link(fid_t dir, const string fname, FileType type, fid_t myID,
 	insert(dentry);
 	if (fname != "." && fname != "..") {
 		MetaFattr *fattr = new MetaFattr(type, dentry->id(), numReplicas);
+		fattr->parent = dir;
 		insert(fattr);
 	}
 	return 0;
@@ -213,21 +214,11 @@ Tree::remove(fid_t dir, const string &fname, const string &pathname, off_t *file
 	if (fa->type != KFS_FILE)
 		return -EISDIR;
 
-	string pn = pathname;
-	if (fa->filesize > 0) {
-		if (pathname != "") {
-			updateSpaceUsageForPath(pathname, -fa->filesize);
-		} else {
-			pn = getPathname(dir);
-			updateSpaceUsageForPath(pn, -fa->filesize);
-		}
-
-		if (filesize != NULL)
-			*filesize = fa->filesize;
-	}
+	if (fa->filesize > 0 && filesize != NULL)
+		*filesize = fa->filesize;
 
-	if (pn != "") {
-		PathToFidCacheMapIter iter = mPathToFidCache.find(pn);
+	if (pathname != "") {
+		PathToFidCacheMapIter iter = mPathToFidCache.find(pathname);
 		if (iter != mPathToFidCache.end())
 			mPathToFidCache.erase(iter);
 	}
@@ -240,7 +231,8 @@ Tree::remove(fid_t dir, const string &fname, const string &pathname, off_t *file
 		getalloc(fa->id(), chunkInfo);
 		assert(fa->chunkcount == (long long)chunkInfo.size());
 		if (gLayoutManager.IsValidLeaseIssued(chunkInfo)) {
-			// put the file into dumpster
+			// put the file into dumpster; the file's space moves
+			// with it
 			int status = moveToDumpster(dir, fname);
 			KFS_LOG_STREAM_DEBUG << "Moving " << fname << " to dumpster" <<
 			KFS_LOG_EOM;
@@ -256,6 +248,8 @@ Tree::remove(fid_t dir, const string &fname, const string &pathname, off_t *file
 
 	UpdateNumFiles(-1);
 
+	if (fa->filesize > 0)
+		updateSpaceUsage(dir, -fa->filesize);
 	unlink(dir, fname, fa, false);
 	return 0;
 }
@@ -282,6 +276,7 @@ Tree::mkdir(fid_t dir, const string &dname, fid_t *newFid)
 		myID = (dname == "/") ? dir : fileID.genid();
 	MetaDentry *dentry = new MetaDentry(dir, dname, myID);
 	MetaFattr *fattr = new MetaFattr(KFS_DIR, dentry->id(), 1);
+	fattr->parent = dir;
 	insert(dentry);
 	insert(fattr);
 	int status = link(myID, ".", KFS_DIR, myID, 1);
@@ -339,17 +334,10 @@ Tree::rmdir(fid_t dir, const string &dname, const string &pathname)
 	if (!emptydir(myID))
 		return -ENOTEMPTY;
 
-	string pn = pathname;
-	if (fa->filesize > 0) {
-		if (pathname != "") {
-			updateSpaceUsageForPath(pathname, -fa->filesize);
-		} else {
-			pn = getPathname(dir);
-			updateSpaceUsageForPath(pn, -fa->filesize);
-		}
-	}
-	if (pn != "") {
-		PathToFidCacheMapIter iter = mPathToFidCache.find(pn);
+	if (fa->filesize > 0)
+		updateSpaceUsage(dir, -fa->filesize);
+	if (pathname != "") {
+		PathToFidCacheMapIter iter = mPathToFidCache.find(pathname);
 		if (iter != mPathToFidCache.end())
 			mPathToFidCache.erase(iter);
 	}
@@ -381,14 +369,17 @@ Tree::getFattr(fid_t fid)
 MetaDentry *
 Tree::getDentry(fid_t dir, const string &fname)
 {
-	vector <MetaDentry *> v;
-
-	if (readdir(dir, v) != 0)
+	const Key dkey(KFS_DENTRY, dir, MetaDentry::nameKey(fname));
+	Node *n = findLeaf(dkey);
+	if (n == NULL)
 		return NULL;
-
-	vector <MetaDentry *>::iterator d;
-	d = find_if(v.begin(), v.end(), DirMatch(fname));
-	return (d == v.end()) ? NULL : *d;
+	for (LeafIter li(n, n->findplace(dkey)); li.parent() != NULL &&
+			li.parent()->getkey(li.index()) == dkey; li.next()) {
+		MetaDentry * const d = refine<MetaDentry>(li.current());
+		if (d->compareName(fname) == 0)
+			return d;
+	}
+	return NULL;
 }
 
 /*
@@ -557,6 +548,7 @@ Tree::recomputeDirSize(fid_t dir, off_t &dirsz)
 		MetaFattr *fa = getFattr(entries[i]->id());
 		if (fa == NULL)
 			continue;
+		fa->parent = dir;
 		if (fa->type == KFS_DIR) {
 			// Do a depth first traversal
 			off_t subdirSz = 0;
@@ -574,6 +566,95 @@ Tree::recomputeDirSize(fid_t dir, off_t &dirsz)
 	dirsz = dirattr->filesize;
 }
 
+/*
+ * The parent links aren't stored in the checkpoint: set them from the
+ * directory entries after the checkpoint is loaded, so that the log replay
+ * can maintain the directory sizes.
+ */
+void
+Tree::linkParents()
+{
+	LeafIter li(firstLeaf(), 0);
+	Node *p = li.parent();
+	Meta *m = li.current();
+	while (m != NULL) {
+		if (m->metaType() == KFS_DENTRY) {
+			MetaDentry * const d = refine<MetaDentry>(m);
+			const string name = d->getName();
+			if (name != "." && name != "..") {
+				MetaFattr * const fa = getFattr(d->id());
+				if (fa != NULL)
+					fa->parent = d->getDir();
+			}
+		}
+		li.next();
+		p = li.parent();
+		m = (p == NULL) ? NULL : li.current();
+	}
+}
+
+/*
+ * Offline consistency check of the directory sizes maintained by
+ * updateSpaceUsage(): recompute the size of each directory without
+ * modifying it, and report the directories where the two differ.
+ */
+int
+Tree::checkDirSizes(ostream &os)
+{
+	int mismatches = 0;
+
+	checkDirSize(ROOTFID, "/", os, mismatches);
+	return mismatches;
+}
+
+/*
+ * @param[in] dir  The directory we are processing
+ * @param[in] path  The path name of the directory
+ * @retval  The recomputed size of the directory tree rooted at dir
+ */
+off_t
+Tree::checkDirSize(fid_t dir, const string &path, ostream &os,
+	int &mismatches)
+{
+	vector<MetaDentry *> entries;
+	MetaFattr *dirattr = getFattr(dir);
+
+	if (dirattr == NULL)
+		return 0;
+
+	readdir(dir, entries);
+	off_t dirsz = 0;
+	for (uint32_t i = 0; i < entries.size(); i++) {
+		const string entryname = entries[i]->getName();
+		if ((entryname == ".") || (entryname == "..") ||
+			(entries[i]->id() == dir))
+			continue;
+
+		MetaFattr *fa = getFattr(entries[i]->id());
+		if (fa == NULL)
+			continue;
+		if (fa->parent != dir) {
+			os << path << entryname << ": parent " << fa->parent <<
+				" expected " << dir << endl;
+			mismatches++;
+		}
+		if (fa->type == KFS_DIR) {
+			dirsz += checkDirSize(fa->id(), path + entryname + "/",
+				os, mismatches);
+			continue;
+		}
+		if (fa->filesize > 0)
+			dirsz += fa->filesize;
+	}
+	if (dirsz != dirattr->filesize) {
+		os << path << ": size " << dirattr->filesize <<
+			" expected " << dirsz <<
+			" difference " << dirattr->filesize - dirsz << endl;
+		mismatches++;
+	}
+	return dirsz;
+}
+
 /*
  * Given a dir, do a depth first traversal updating the replication count for
  * all files in the dir. tree to the specified value.
@@ -750,48 +831,49 @@ Tree::cleanupPathToFidCache()
  * At each level of the directory tree, we'd like to record the space used by
  * that subtree.  Then, on a stat of directory, we can provide "du" results for
  * the subtree.
- * To update space usage, start at the root and work down till the parent
- * directory where the file lives and update space used at each level by nbytes.
+ * To update space usage, start at the directory where the file lives, and
+ * follow the parent links up to the root, updating the space used at each
+ * level by nbytes.  The modification time of each directory is at least the
+ * modification time of the files with known size in its subtree, as computed
+ * by recomputeDirSize().
  */
 void
-Tree::updateSpaceUsageForPath(const string &path, off_t nbytes)
+Tree::updateSpaceUsage(fid_t dir, off_t nbytes, const struct timeval *mtime)
 {
-	string dumpster = "/" + DUMPSTERDIR + "/";
-	if ((nbytes == 0) || (path == "") || (path.compare(0, dumpster.size(), dumpster) == 0)) {
-		// either we dont' have a path or the path is in the dumpster
-		// and so, we don't update space used by the dumpster
-		return;
-	}
-	string component;
-	fid_t dir = ROOTFID;
-	string::size_type cstart = 1;
-	string::size_type slash = path.find('/', cstart);
-	MetaFattr *fa;
-
-	fa = lookup(dir, "/");
-	fa->filesize += nbytes;
-	if (fa->filesize < 0)
-		// sanity
-		fa->filesize = 0;
-	if (path.size() == cstart) {
-		return;
-	}
-
-	while (slash != string::npos) {
-		component.assign(path, cstart, slash - cstart);
-		fa = lookup(dir, component);
-		if (fa == NULL)
+	struct timeval mt;
+	if (mtime != NULL)
+		mt = *mtime;
+	while (nbytes != 0 || mtime != NULL) {
+		MetaFattr *fa = getFattr(dir);
+		if (fa == NULL || fa->type != KFS_DIR)
 			return;
 		fa->filesize += nbytes;
 		if (fa->filesize < 0)
 			// sanity
 			fa->filesize = 0;
-		dir = fa->id();
-		cstart = slash + 1;
-		slash = path.find('/', cstart);
+		if (mtime != NULL)
+			fa->mtime = max(fa->mtime, mt);
+		if (dir == ROOTFID || fa->parent == 0)
+			return;
+		dir = fa->parent;
 	}
 }
 
+/*
+ * Update the size of a file.  The files with unknown size (-1) don't count
+ * in the directory sizes.
+ */
+void
+Tree::setFileSize(MetaFattr *fa, off_t size)
+{
+	const off_t delta =
+		std::max(size, off_t(0)) - std::max(fa->filesize, off_t(0));
+	fa->filesize = size;
+	if (fa->parent != 0 && (delta != 0 || size > 0))
+		updateSpaceUsage(fa->parent, delta,
+			size > 0 ? &fa->mtime : NULL);
+}
+
 /*!
  * \brief read the contents of a directory
  * \param[in] dir	file id of directory
@@ -801,7 +883,7 @@ Tree::updateSpaceUsageForPath(const string &path, off_t nbytes)
 int
 Tree::readdir(fid_t dir, vector <MetaDentry *> &v)
 {
-	const Key dkey(KFS_DENTRY, dir);
+	const Key dkey(KFS_DENTRY, dir, Key::MATCH_ANY);
 	Node *l = findLeaf(dkey);
 	if (l == NULL)
 		return -ENOENT;
@@ -810,6 +892,79 @@ Tree::readdir(fid_t dir, vector <MetaDentry *> &v)
 	return 0;
 }
 
+/*!
+ * \brief read a range of the directory entries
+ * \param[in] dir	file id of directory
+ * \param[in] after	resume after the entries that this cursor was
+ *			advanced over; default cursor to start from the
+ *			beginning
+ * \param[in] maxEntries	max. # of entries to return
+ * \param[out] v	vector of directory entries
+ * \param[out] hasMore	set if there are entries past the returned ones
+ * \return		status code; -ENOENT if the directory doesn't exist
+ *
+ * The entries of a directory are ordered by the hash of their names, so
+ * the resume point is found by descending the tree to the cursor's key,
+ * rather than by scanning from the start of the directory; it doesn't
+ * matter whether the last entry returned was removed in the meantime.
+ */
+int
+Tree::readdir(fid_t dir, const ReaddirCursor &after, size_t maxEntries,
+	vector <MetaDentry *> &v, bool &hasMore)
+{
+	const Key dkey(KFS_DENTRY, dir, Key::MATCH_ANY);
+	hasMore = false;
+	if (findLeaf(dkey) == NULL)
+		return -ENOENT;
+	const Key start(KFS_DENTRY, dir,
+		after.key < 0 ? Key::MATCH_ANY : after.key);
+	Node *n = root;
+	int p = n->findplace(start);
+	while (!n->hasleaves() && p != n->children()) {
+		n = n->child(p);
+		p = n->findplace(start);
+	}
+	if (p == n->children())
+		return 0;
+	LeafIter li(n, p);
+	if (after.key >= 0) {
+		// Names with the same hash are in insertion order: skip the
+		// ones that were already returned.
+		for (int i = 0; i < after.count && li.parent() != NULL &&
+				li.parent()->getkey(li.index()) == start; i++)
+			li.next();
+	}
+	for (; li.parent() != NULL &&
+			li.parent()->getkey(li.index()) == dkey; li.next()) {
+		if (v.size() >= maxEntries) {
+			hasMore = true;
+			break;
+		}
+		v.push_back(refine<MetaDentry>(li.current()));
+	}
+	return 0;
+}
+
+/*!
+ * \brief return the information for the last chunk of a file,
+ * without enumerating all the file's chunks.
+ * \param[in] file	file id for the file
+ * \param[out] c	MetaChunkInfo
+ * \return		status code; -ENOENT if the file has no chunks
+ */
+int
+Tree::getLastChunk(fid_t file, MetaChunkInfo **c)
+{
+	// The chunk info keys are ordered by (file id, offset): the item
+	// that precedes the first chunk of the next file is the last
+	// chunk of this file, if it has any.
+	Meta * const m = findPrev(Key(KFS_CHUNKINFO, file + 1, 0));
+	if (m == NULL || m->metaType() != KFS_CHUNKINFO || m->id() != file)
+		return -ENOENT;
+	*c = refine<MetaChunkInfo>(m);
+	return 0;
+}
+
 /*!
  * \brief return a file's chunk information (if any)
  * \param[in] file	file id for the file
@@ -987,7 +1142,7 @@ Tree::assignChunkId(fid_t file, chunkOff_t offset,
 			if (c->chunkVersion == chunkVersion)
 				return -EEXIST;
 			c->chunkVersion = chunkVersion;
-			fa->filesize = -1;
+			setFileSize(fa, -1);
 			return 0;
 		}
 		boundary      = fa->nextChunkOffset;
@@ -1006,7 +1161,7 @@ Tree::assignChunkId(fid_t file, chunkOff_t offset,
 	fa->chunkcount++;
 	// we will know the size of the file only when the write to this chunk
 	// is finished.  so, until then....
-	fa->filesize = -1;
+	setFileSize(fa, -1);
 	if (boundary >= fa->nextChunkOffset) {
 		fa->nextChunkOffset = boundary + CHUNKSIZE;
 	}
@@ -1075,9 +1230,9 @@ Tree::coalesceBlocks(MetaFattr* srcFa, MetaFattr* dstFa,
 	// Update file size if needed. The file size includes "holes":
 	if (dstFa->nextChunkOffset > dstStartOffset) {
 		if (srcFa->filesize <= 0) {
-			dstFa->filesize = -1;
+			setFileSize(dstFa, -1);
 		} else {
-			dstFa->filesize = dstStartOffset + srcFa->filesize;
+			setFileSize(dstFa, dstStartOffset + srcFa->filesize);
 		}
 	}
 #ifdef COALESCE_BLOCKS_DEBUG
@@ -1090,7 +1245,7 @@ Tree::coalesceBlocks(MetaFattr* srcFa, MetaFattr* dstFa,
 #endif
 	srcFa->nextChunkOffset = 0;
 	srcFa->chunkcount = 0;
-	srcFa->filesize = 0;
+	setFileSize(srcFa, 0);
 	return 0;
 }
 
@@ -1154,7 +1309,7 @@ Tree::truncate(fid_t file, chunkOff_t offset, chunkOff_t *allocOffset)
 	getalloc(fa->id(), chunkInfo);
 	assert(fa->chunkcount == (long long)chunkInfo.size());
 
-	fa->filesize = -1;
+	setFileSize(fa, -1);
 
 	// compute the starting offset for what will be the
 	// "last" chunk for the file
@@ -1286,10 +1441,11 @@ Tree::rename(fid_t parent, const string &oldname, string &newname,
 			return status;
 	}
 
-	if (sfattr->filesize > 0) {
-		updateSpaceUsageForPath(oldpath, -sfattr->filesize);
-		updateSpaceUsageForPath(newname, sfattr->filesize);
+	if (sfattr->filesize > 0 && ddir != parent) {
+		updateSpaceUsage(parent, -sfattr->filesize);
+		updateSpaceUsage(ddir, sfattr->filesize);
 	}
+	sfattr->parent = ddir;
 
 	fid_t srcFid = src->id();
 
@@ -1397,9 +1553,6 @@ Tree::moveToDumpster(fid_t dir, const string &fname)
 	tempname += fname + boost::lexical_cast<string>(counter);
 
 	counter++;
-	// space accounting has been done before the call to this function.  so,
-	// we don't rename to do any accounting and hence pass in "" for the old
-	// path name.
 	return rename(dir, fname, tempname, "", true);
 }
 
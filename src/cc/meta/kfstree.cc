@@ -351,6 +351,41 @@ Tree::findLeaf(const Key &k) const
 	return (p != n->children() && n->getkey(p) == k) ? n : NULL;
 }
 
+/*
+ * Return the item with the largest key that is less than the
+ * specified key, or NULL if there is no such item.  Descend along
+ * the path to the first key >= k, remembering the nearest subtree
+ * to the left of the path; the item is either immediately to the
+ * left at the leaf level, or the rightmost item of that subtree.
+ */
+Meta *
+Tree::findPrev(const Key &k) const
+{
+	Node *n = root;
+	Node *left = NULL;
+
+	for (;;) {
+		int p = n->findplace(k);
+		if (n->hasleaves()) {
+			if (p > 0)
+				return n->leaf(p - 1);
+			break;
+		}
+		if (p == n->children()) {
+			left = n;
+			break;
+		}
+		if (p > 0)
+			left = n->child(p - 1);
+		n = n->child(p);
+	}
+	if (left == NULL)
+		return NULL;
+	while (!left->hasleaves())
+		left = left->child(left->children() - 1);
+	return left->leaf(left->children() - 1);
+}
+
 /*
  * If searching carries us into a new level-1 node below, shift the
  * next level of the descent path over by one, repeating as necessary
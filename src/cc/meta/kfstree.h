@@ -216,6 +216,7 @@ class Tree {
 	time_t mLastPathToFidCacheCleanupTime;
 
 	Node *findLeaf(const Key &k) const;
+	Meta *findPrev(const Key &k) const;
 	void unlink(fid_t dir, const string fname, MetaFattr *fa, bool save_fa);
 	int link(fid_t dir, const string fname, FileType type, fid_t myID, 
 		int16_t numReplicas);
@@ -224,6 +225,8 @@ class Tree {
 	bool is_descendant(fid_t src, fid_t dst);
 	void shift_path(vector <pathlink> &path);
 	void recomputeDirSize(fid_t dir, off_t &dirsz);
+	off_t checkDirSize(fid_t dir, const string &path, std::ostream &os,
+		int &mismatches);
 	int changeFileReplication(MetaFattr *fa, int16_t numReplicas);
 	int changeDirReplication(MetaFattr *dirattr, int16_t numReplicas);
 	int listPaths(std::ostream &ofs, std::string parent, fid_t dir, std::set<fid_t> specificIds);
@@ -270,6 +273,10 @@ public:
 	int listPaths(std::ostream &ofs, std::set<fid_t> specificIds);	
 	void cleanupPathToFidCache();
 	void recomputeDirSize();		//!< re-compute the size of each dir. in tree
+	void linkParents();			//!< set the parent of each file
+	//!< compare the size of each dir. with its recomputed size, and
+	//!< report the differences; returns the # of dirs that differ
+	int checkDirSizes(std::ostream &os);
 
 	int create(fid_t dir, const string &fname, fid_t *newFid, 
 			int16_t numReplicas, bool exclusive);
@@ -281,11 +288,16 @@ public:
 	int readdir(fid_t dir, vector <MetaDentry *> &result);
 	int getalloc(fid_t file, vector <MetaChunkInfo *> &result);
 	int getalloc(fid_t file, chunkOff_t offset, MetaChunkInfo **c);
+	int getLastChunk(fid_t file, MetaChunkInfo **c);
+	int readdir(fid_t dir, const ReaddirCursor &after, size_t maxEntries,
+		vector <MetaDentry *> &result, bool &hasMore);
 	int rename(fid_t dir, const string &oldname, string &newname, 
 			const string &oldpath, bool once);
 	MetaFattr *lookup(fid_t dir, const string &fname);
 	MetaFattr *lookupPath(fid_t rootdir, const string &path);
-	void updateSpaceUsageForPath(const string &path, off_t nbytes);
+	void updateSpaceUsage(fid_t dir, off_t nbytes,
+		const struct timeval *mtime = NULL);
+	void setFileSize(MetaFattr *fa, off_t size);
 	int getChunkVersion(fid_t file, chunkId_t chunkId, seq_t *chunkVersion);
 	int changePathReplication(fid_t file, int16_t numReplicas);
 
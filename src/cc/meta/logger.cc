@@ -58,6 +58,7 @@ Logger::dispatch(MetaRequest *r)
 		log(r);
 		cp.note_mutation();
 	}
+	UpdateRequestLatency(r);
 	gNetDispatch.Dispatch(r);
 }
 
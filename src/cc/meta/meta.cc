@@ -75,6 +75,21 @@ MetaDentry::show() const
 			"/parent/" + toString(dir);
 }
 
+/*
+ * 64-bit FNV-1a hash of the name; the sign bit is cleared so that the
+ * value can never be Key::MATCH_ANY.
+ */
+KeyData
+MetaDentry::nameKey(const string &fname)
+{
+	unsigned long long h = 14695981039346656037ULL;
+	for (string::const_iterator it = fname.begin(); it != fname.end(); ++it) {
+		h ^= (unsigned char)*it;
+		h *= 1099511628211ULL;
+	}
+	return (KeyData)(h & 0x7FFFFFFFFFFFFFFFULL);
+}
+
 bool
 MetaDentry::match(Meta *m)
 {
@@ -98,7 +98,10 @@ public:
 	MetaDentry(const MetaDentry *other) :
 		Meta(KFS_DENTRY, other->id()), dir(other->dir), name(other->name) { }
 
-	const Key key() const { return Key(KFS_DENTRY, dir); }
+	//!< entries are keyed by directory and name hash, so that a
+	//!< directory can be read in pages by seeking in the tree
+	const Key key() const { return Key(KFS_DENTRY, dir, nameKey(name)); }
+	static KeyData nameKey(const string &fname);
 	const string show() const;
 	//!< accessor that returns the name of this Dentry
 	const string getName() const { return name; }
@@ -111,6 +114,27 @@ public:
 	int checkpoint(ofstream &file) const;
 };
 
+/*!
+ * \brief position in a directory for a paged readdir: the name key of
+ * the last entry returned, and how many entries with that key were
+ * returned (names whose hashes collide).
+ */
+struct ReaddirCursor {
+	KeyData key;	//!< name key of the last entry; -1 at the start
+	int count;	//!< # of entries with that key already returned
+	ReaddirCursor(): key(-1), count(0) { }
+	void advance(const MetaDentry *d)
+	{
+		const KeyData k = MetaDentry::nameKey(d->getName());
+		if (k == key) {
+			count++;
+		} else {
+			key = k;
+			count = 1;
+		}
+	}
+};
+
 /*!
  * \brief Function object to search for file name in directory
  */
@@ -146,11 +170,15 @@ public:
 	//!< to append a chunk to the file.  The metaserver picks the file offset
 	//!< for the chunk based on what has been allocated so far.
 	off_t nextChunkOffset;
+	//!< id of the directory that contains the file, or 0 if it isn't
+	//!< known yet; used to account the size changes in the directories.
+	//!< not stored in the checkpoint, see Tree::linkParents()
+	fid_t parent;
 
 	MetaFattr(FileType t, fid_t id, int16_t n):
 		Meta(KFS_FATTR, id), type(t), 
 		numReplicas(n), chunkcount(0), filesize(-1),
-		nextChunkOffset(0)
+		nextChunkOffset(0), parent(0)
 	{
 		int UNUSED_ATTR s = gettimeofday(&crtime, NULL);
 		assert(s == 0);
@@ -163,13 +191,14 @@ public:
 		struct timeval ct, struct timeval crt,
 		long long c, int16_t n): Meta(KFS_FATTR, id),
 		type(t), numReplicas(n), mtime(mt), ctime(ct),
-		crtime(crt), chunkcount(c), filesize(-1), nextChunkOffset(0)
+		crtime(crt), chunkcount(c), filesize(-1), nextChunkOffset(0),
+		parent(0)
 	{ 
 		if (type == KFS_DIR)
 			filesize = 0;
 	}
 
-	MetaFattr(): Meta(KFS_FATTR, 0), type(KFS_NONE) { }
+	MetaFattr(): Meta(KFS_FATTR, 0), type(KFS_NONE), parent(0) { }
 
 	const Key key() const { return Key(KFS_FATTR, id()); }
 	const string show() const;
@@ -235,6 +235,15 @@ ReadMetaServerProperties(char *fileName)
 	string chunkmapDumpDir = gProp.getValue("metaServer.chunkmapDumpDir", ".");
 	setChunkmapDumpDir(chunkmapDumpDir);
 
+	// upper bounds for a paged directory listing reply
+	setReaddirLimits(
+		gProp.getValue("metaServer.maxReaddirEntries", 8 << 10),
+		gProp.getValue("metaServer.maxReaddirPlusBytes", 4 << 20));
+
+	// time budget of the background scans per net manager loop iteration
+	gMetaScanner.SetSliceUsec(
+		gProp.getValue("metaServer.scanSliceUsec", 5000));
+
 	ChunkServer::SetParameters(gProp);
         gLayoutManager.SetParameters(gProp);
 
@@ -441,24 +441,8 @@ replay_size(deque <string> &c)
 	ok = pop_offset(filesize, "filesize", c, ok);
 	if (ok) {
 		MetaFattr *fa = metatree.getFattr(fid);
-		if (fa != NULL) {
-			off_t delta = filesize;
-			if (fa->filesize > 0) {
-				// we are updating the size for a file.  if we
-				// had a value for the file's size and the log
-				// has a value, then the change in space usage
-				// for the tree is the difference between the
-				// two.
-				delta -= fa->filesize;
-			}
-
-			if (delta > 0) {
-				string pn = metatree.getPathname(fid);
-				metatree.updateSpaceUsageForPath(pn, delta);
-			}
-
-			fa->filesize = filesize;
-		}
+		if (fa != NULL)
+			metatree.setFileSize(fa, filesize);
 	}
 	return true;
 }
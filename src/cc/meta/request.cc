@@ -35,7 +35,6 @@
 #include "checkpoint.h"
 #include "util.h"
 #include "LayoutManager.h"
-#include "ChildProcessTracker.h"
 
 #include "libkfsIO/Globals.h"
 #include "common/log.h"
@@ -105,6 +104,10 @@ ParseHandlerMap gParseHandlers;
 typedef map<MetaOp, Counter *> OpCounterMap;
 typedef map<MetaOp, Counter *>::iterator OpCounterMapIter;
 OpCounterMap gCounters;
+// latency histograms, usec
+typedef map<MetaOp, Histogram *> OpHistogramMap;
+OpHistogramMap gLatencies;
+Histogram *gRequestLatency;
 Counter *gNumFiles, *gNumDirs, *gNumChunks;
 Counter *gPathToFidCacheHit, *gPathToFidCacheMiss;
 
@@ -114,6 +117,9 @@ string gMD5SumFn;
 bool gWormMode = false;
 static int16_t gMaxReplicasPerFile = MAX_REPLICAS_PER_FILE;
 static string gChunkmapDumpDir = ".";
+// upper bounds for a paged readdir / readdirplus reply
+static int gMaxReaddirEntries = 8 << 10;
+static int gMaxReaddirPlusBytes = 4 << 20;
 
 static bool
 file_exists(fid_t fid)
@@ -141,6 +147,13 @@ AddCounter(const char *name, MetaOp opName)
 	Counter *c = new Counter(name);
 	globals().counterManager.AddCounter(c);
 	gCounters[opName] = c;
+
+	string hname(name);
+	hname.erase(hname.find_last_not_of(' ') + 1);
+	hname += " latency";
+	Histogram *h = new Histogram(hname.c_str());
+	globals().counterManager.AddCounter(h);
+	gLatencies[opName] = h;
 }
 
 void
@@ -186,6 +199,9 @@ RegisterCounters()
 	globals().counterManager.AddCounter(gNumChunks);
 	globals().counterManager.AddCounter(gPathToFidCacheHit);
 	globals().counterManager.AddCounter(gPathToFidCacheMiss);
+
+	gRequestLatency = new Histogram("Request latency");
+	globals().counterManager.AddCounter(gRequestLatency);
 }
 
 static void
@@ -201,6 +217,18 @@ UpdateCounter(MetaOp opName)
 	c->Update(1);
 }
 
+void
+UpdateRequestLatency(const MetaRequest *r)
+{
+	if (r->submitTime <= 0 || gRequestLatency == NULL)
+		return;
+	const int64_t now = Histogram::NowUsec();
+	gRequestLatency->RecordUsec(r->submitTime, now);
+	OpHistogramMap::iterator iter = gLatencies.find(r->op);
+	if (iter != gLatencies.end())
+		iter->second->RecordUsec(r->submitTime, now);
+}
+
 void
 UpdateNumDirs(int count)
 {
@@ -300,6 +328,28 @@ setChunkmapDumpDir(string d)
 	gChunkmapDumpDir = d;
 }
 
+void
+setReaddirLimits(int maxEntries, int maxPlusBytes)
+{
+	gMaxReaddirEntries = max(1, maxEntries);
+	gMaxReaddirPlusBytes = max(1, maxPlusBytes);
+}
+
+/*
+ * Read the directory entries for a readdir request: all of them, or if
+ * the client asked for paging, the page that follows the cursor.
+ */
+static int
+readdirPage(fid_t dir, const ReaddirCursor &cursor, int maxEntries,
+	vector <MetaDentry *> &v, bool &hasMoreEntries)
+{
+	hasMoreEntries = false;
+	if (maxEntries <= 0)
+		return metatree.readdir(dir, v);
+	return metatree.readdir(dir, cursor,
+		min(maxEntries, gMaxReaddirEntries), v, hasMoreEntries);
+}
+
 static inline string FattrReply(const MetaFattr *fa)
 {
 	if (! fa) {
@@ -407,7 +457,12 @@ MetaReaddir::handle()
         // This piece of code was changed with svn version 75.
 	MetaFattr * const fa = metatree.getFattr(dir);
         status = (! fa) ? -ENOENT : (fa->type != KFS_DIR ? -ENOTDIR :
-            metatree.readdir(dir, v));
+            readdirPage(dir, cursor, maxEntries, v, hasMoreEntries));
+	if (status == 0 && hasMoreEntries) {
+		vector<MetaDentry *>::const_iterator it;
+		for (it = v.begin(); it != v.end(); ++it)
+			cursor.advance(*it);
+	}
 }
 
 class EnumerateLocations {
@@ -460,17 +515,16 @@ public:
 		}
 		// for a file, get the layout and provide location of last chunk
 		// so that the client can compute filesize
-		vector<MetaChunkInfo*> chunkInfo;
+		MetaChunkInfo* lastChunk = NULL;
 		vector<ChunkServerPtr> c;
-		int status = metatree.getalloc(fa->id(), chunkInfo);
+		int status = metatree.getLastChunk(fa->id(), &lastChunk);
 
-		if ((status != 0) || (chunkInfo.size() == 0)) {
+		if (status != 0) {
 			os << "Chunk-count: 0\r\n";
 			os << "File-size: 0\r\n";
 			os << "Replication: " << toString(fa->numReplicas) << "\r\n";
 			return;
 		}
-		MetaChunkInfo* lastChunk = chunkInfo.back();
 		ChunkLayoutInfo l;
 
 		l.offset = lastChunk->offset;
@@ -515,12 +569,26 @@ MetaReaddirPlus::handle()
 		status = -ENOTDIR;
 	} else {
 		vector<MetaDentry *> res;
-		status = metatree.readdir(dir, res);
+		status = readdirPage(dir, cursor, maxEntries, res,
+				hasMoreEntries);
 		if (status == 0) {
-			// now that we have the entire directory read, for each entry in the
-			// directory, get the attributes out.
-			numEntries = res.size();
-			for_each(res.begin(), res.end(), EnumerateReaddirPlusInfo(v));
+			// now that we have the directory entries read, for each
+			// entry get the attributes out.  when paging, stop once
+			// the reply gets too large; the client resumes from the
+			// cursor, which covers only the entries sent.
+			EnumerateReaddirPlusInfo enumerate(v);
+			vector<MetaDentry *>::const_iterator it;
+			numEntries = 0;
+			for (it = res.begin(); it != res.end(); ++it) {
+				enumerate(*it);
+				cursor.advance(*it);
+				numEntries++;
+				if (maxEntries > 0 && it + 1 != res.end() &&
+						v.tellp() >= gMaxReaddirPlusBytes) {
+					hasMoreEntries = true;
+					break;
+				}
+			}
 		}
 	}
 }
@@ -1024,6 +1092,9 @@ MetaReadConfig::handle()
 
 	setMaxReplicasPerFile(prop.getValue("metaServer.maxReplicasPerFile",
 				MAX_REPLICAS_PER_FILE));
+	setReaddirLimits(
+		prop.getValue("metaServer.maxReaddirEntries", 8 << 10),
+		prop.getValue("metaServer.maxReaddirPlusBytes", 4 << 20));
 	gLayoutManager.SetParameters(prop);
 	MsgLogger::GetLogger()->SetLogLevel(
 		prop.getValue("metaServer.loglevel",
@@ -1186,39 +1257,19 @@ MetaRecomputeDirsize::handle()
 {
 	status = 0;
 	KFS_LOG_STREAM_INFO << "Processing a recompute dir size..." << KFS_LOG_EOM;
+	// The sizes are maintained incrementally; recompute them from
+	// scratch to repair the accounting, if it has drifted.
 	metatree.recomputeDirSize();
 }
 
 /* virtual */ void
 MetaDumpChunkToServerMap::handle()
 {
-	pid_t pid;
-
-	if ((pid = fork()) == 0) {
-		// In the child process, we didn't setup the poll vector.  To
-		// avoid random crashes due to the d'tors trying to clear out
-		// entres from the poll vector, update the netManager so that it
-		// can "fake out" the closes.
-                MsgLogger::Stop();
-		globalNetManager().SetForkedChild();
-
-		// let the child write out the map; if the map is large, this'll
-		// take several seconds.  we get the benefits of writing out the
-		// map in the background while the metaserver continues to
-		// process other RPCs
-		gLayoutManager.DumpChunkToServerMap(gChunkmapDumpDir);
-		exit(0);
-	}
-	KFS_LOG_VA_INFO("child that is writing out the chunk->server map has pid: %d", pid);
-	// if fork() failed, let the sender know
-	if (pid < 0) {
-		status = -1;
-		return;
-	}
-	// hold on to the request until the child  finishes
-	chunkmapFile = gChunkmapDumpDir + "/chunkmap.txt." + boost::lexical_cast<string>(pid);
-	suspended = true;
-	gChildProcessTracker.Track(pid, this);
+	// The map is written out in time slices, while the metaserver
+	// continues to process other RPCs; hold on to the request until the
+	// dump is complete.
+	status = 0;
+	gLayoutManager.DumpChunkToServerMap(gChunkmapDumpDir, this);
 }
 
 /* virtual */ void
@@ -1233,10 +1284,8 @@ MetaDumpChunkReplicationCandidates::handle()
 /* virtual */ void
 MetaFsck::handle()
 {
-	ostringstream os;
 	status = 0;
-	gLayoutManager.Fsck(os);
-	fsckStatus = os.str();
+	gLayoutManager.Fsck(this);
 }
 
 /* virtual */ void
@@ -1372,6 +1421,7 @@ submit_request(MetaRequest *r)
 	string msg = r->Show();
 
 	gettimeofday(&s, NULL);
+	r->submitTime = int64_t(s.tv_sec) * 1000000 + s.tv_usec;
 
 	process_request(r);
 
@@ -2047,6 +2097,18 @@ parseHandlerRmdir(Properties &prop, MetaRequest **r)
 	return 0;
 }
 
+/*!
+ * \brief parse the readdir resume point: "Cursor: <name key> <count>"
+ */
+static void
+parseReaddirCursor(Properties &prop, ReaddirCursor &cursor)
+{
+	istringstream is(prop.getValue("Cursor", ""));
+	ReaddirCursor c;
+	if (is >> c.key >> c.count && c.key >= 0 && c.count >= 0)
+		cursor = c;
+}
+
 static int
 parseHandlerReaddir(Properties &prop, MetaRequest **r)
 {
@@ -2059,7 +2121,10 @@ parseHandlerReaddir(Properties &prop, MetaRequest **r)
 	dir = prop.getValue("Directory File-handle", (fid_t) -1);
 	if (dir < 0)
 		return -1;
-	*r = new MetaReaddir(seq, protoVers, dir);
+	MetaReaddir * const rd = new MetaReaddir(seq, protoVers, dir);
+	rd->maxEntries = prop.getValue("Max-entries", 0);
+	parseReaddirCursor(prop, rd->cursor);
+	*r = rd;
 	return 0;
 }
 
@@ -2075,7 +2140,10 @@ parseHandlerReaddirPlus(Properties &prop, MetaRequest **r)
 	dir = prop.getValue("Directory File-handle", (fid_t) -1);
 	if (dir < 0)
 		return -1;
-	*r = new MetaReaddirPlus(seq, protoVers, dir);
+	MetaReaddirPlus * const rd = new MetaReaddirPlus(seq, protoVers, dir);
+	rd->maxEntries = prop.getValue("Max-entries", 0);
+	parseReaddirCursor(prop, rd->cursor);
+	*r = rd;
 	return 0;
 }
 
@@ -2738,6 +2806,10 @@ MetaReaddir::response(ostream &os)
 		++numEntries;
 	}
 	os << "Num-Entries: " << numEntries << "\r\n";
+	if (hasMoreEntries && ! v.empty()) {
+		os << "Has-more-entries: 1\r\n";
+		os << "Cursor: " << cursor.key << " " << cursor.count << "\r\n";
+	}
 	os << "Content-length: " << entries.str().length() << "\r\n\r\n";
 	if (entries.str().length() > 0)
 		os << entries.str();
@@ -2750,6 +2822,10 @@ MetaReaddirPlus::response(ostream &os)
 		return;
 	}
 	os << "Num-Entries: " << numEntries << "\r\n";
+	if (hasMoreEntries) {
+		os << "Has-more-entries: 1\r\n";
+		os << "Cursor: " << cursor.key << " " << cursor.count << "\r\n";
+	}
 	os << "Content-length: " << v.str().length() << "\r\n\r\n";
 	os << v.str();
 }
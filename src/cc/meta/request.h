@@ -40,6 +40,7 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <boost/shared_ptr.hpp>
 
 #include "libkfsIO/KfsCallbackObj.h"
 #include "common/properties.h"
@@ -142,9 +143,10 @@ struct MetaRequest {
 	const bool mutation; //!< mutates metatree
 	bool suspended;  //!< is this request suspended somewhere
 	KfsCallbackObj *clnt; //!< a handle to the client that generated this request.
+	int64_t submitTime; //!< usec; 0 if the request wasn't submitted
 	MetaRequest(MetaOp o, seq_t ops, int pv, bool mu):
 		op(o), status(0), clientProtoVers(pv), statusMsg(), opSeqno(ops), seqno(0), mutation(mu),
-		suspended(false), clnt(NULL) { }
+		suspended(false), clnt(NULL), submitTime(0) { }
 	virtual ~MetaRequest() { }
 
         virtual void handle();
@@ -305,8 +307,12 @@ struct MetaRmdir: public MetaRequest {
 struct MetaReaddir: public MetaRequest {
 	fid_t dir;	//!< directory to read
 	vector <MetaDentry *> v; //!< vector of results
+	ReaddirCursor cursor; //!< resume point; advanced past the reply
+	int maxEntries; //!< max. # of entries to return; 0 all
+	bool hasMoreEntries; //!< set if the reply doesn't have all entries
 	MetaReaddir(seq_t s, int pv, fid_t d):
-		MetaRequest(META_READDIR, s, pv, false), dir(d) { }
+		MetaRequest(META_READDIR, s, pv, false), dir(d),
+		cursor(), maxEntries(0), hasMoreEntries(false) { }
         virtual void handle();
 	virtual int log(ofstream &file) const;
 	virtual void response(ostream &os);
@@ -326,8 +332,13 @@ struct MetaReaddirPlus: public MetaRequest {
 	fid_t dir;	//!< directory to read
 	ostringstream v; //!< results built out into a string
 	int numEntries; //!< # of entries in the directory
+	ReaddirCursor cursor; //!< resume point; advanced past the reply
+	int maxEntries; //!< max. # of entries to return; 0 all
+	bool hasMoreEntries; //!< set if the reply doesn't have all entries
 	MetaReaddirPlus(seq_t s, int pv, fid_t d):
-		MetaRequest(META_READDIRPLUS, s, pv, false), dir(d) { }
+		MetaRequest(META_READDIRPLUS, s, pv, false), dir(d),
+		numEntries(0), cursor(), maxEntries(0),
+		hasMoreEntries(false) { }
         virtual void handle();
 	virtual int log(ofstream &file) const;
 	virtual void response(ostream &os);
@@ -918,9 +929,7 @@ struct MetaChunkSize: public MetaChunkRequest {
 	chunkId_t chunkId; //!< input: the chunk whose size we need
 	off_t chunkSize; //!< output: the chunk size
 	off_t filesize; //!< for logging purposes: the size of the file
-	/// input: given the pathname, we can update space usage for the path
-	/// hierarchy corresponding to pathname; this will enable us to make "du"
-	/// instantaneous.
+	/// for logging purposes: the pathname of the file, if known
 	std::string pathname; 
 	MetaChunkSize(seq_t n, ChunkServer *s, fid_t f, chunkId_t c, 
 			const std::string &p) :
@@ -1551,11 +1560,14 @@ extern void setMD5SumFn(const char *md5sumFn);
 extern void setWORMMode(bool value);
 extern void setMaxReplicasPerFile(int16_t value);
 extern void setChunkmapDumpDir(string dir);
+extern void setReaddirLimits(int maxEntries, int maxPlusBytes);
 
 /* update counters for # of files/dirs/chunks in the system */
 extern void UpdateNumDirs(int count);
 extern void UpdateNumFiles(int count);
 extern void UpdateNumChunks(int count);
+/* record the time from the submission to the completion of the request */
+extern void UpdateRequestLatency(const MetaRequest *r);
 
 }
 #endif /* !defined(KFS_REQUEST_H) */
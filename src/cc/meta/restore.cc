@@ -297,6 +297,8 @@ Restorer::rebuild(const string cpname, int16_t minReplicas)
 	}
 
 	file.close();
+	if (is_ok)
+		metatree.linkParents();
 	return is_ok;
 }
 
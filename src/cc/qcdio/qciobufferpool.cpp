@@ -42,14 +42,16 @@ public:
           mFreeListPtr(0),
           mTotalCnt(0),
           mFreeCnt(0),
-          mBufSizeShift(0)
+          mBufSizeShift(0),
+          mHugePagesFlag(false)
         { List::Init(*this); }
     ~Partition()
         { Partition::Destroy(); }
     int Create(
         int  inNumBuffers,
         int  inBufferSize,
-        bool inLockMemoryFlag)
+        bool inLockMemoryFlag,
+        bool inUseHugePagesFlag)
     {
         int theBufSizeShift = -1;
         for (int i = inBufferSize; i > 0; i >>= 1, theBufSizeShift++)
@@ -67,12 +69,34 @@ public:
         size_t const kAlign    = kPageSize > size_t(inBufferSize) ?
             kPageSize : size_t(inBufferSize);
         mAllocSize = size_t(inNumBuffers) * inBufferSize + kAlign;
-        mAllocSize = (mAllocSize + kPageSize - 1) / kPageSize * kPageSize;
-        mAllocPtr = mmap(0, mAllocSize,
-            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        mAllocPtr  = MAP_FAILED;
+        if (inUseHugePagesFlag) {
+            // Huge pages reduce tlb misses with large pools. Use explicitly
+            // reserved huge pages if available, otherwise ask for
+            // transparent huge pages.
+            const size_t theSize = (mAllocSize + kHugePageSize - 1) /
+                kHugePageSize * kHugePageSize;
+#ifdef MAP_HUGETLB
+            mAllocPtr = mmap(0, theSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0);
+#endif
+            if (mAllocPtr != MAP_FAILED) {
+                mAllocSize     = theSize;
+                mHugePagesFlag = true;
+            }
+        }
         if (mAllocPtr == MAP_FAILED) {
-            mAllocPtr = 0;
-            return errno;
+            mAllocSize = (mAllocSize + kPageSize - 1) / kPageSize * kPageSize;
+            mAllocPtr = mmap(0, mAllocSize,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+            if (mAllocPtr == MAP_FAILED) {
+                mAllocPtr = 0;
+                return errno;
+            }
+#ifdef MADV_HUGEPAGE
+            mHugePagesFlag = inUseHugePagesFlag &&
+                madvise(mAllocPtr, mAllocSize, MADV_HUGEPAGE) == 0;
+#endif
         }
         if (inLockMemoryFlag && mlock(mAllocPtr, mAllocSize) != 0) {
             Destroy();
@@ -98,12 +122,13 @@ public:
         if (mAllocPtr && munmap(mAllocPtr, mAllocSize) != 0) {
             QCUtils::FatalError("munmap", errno);
         }
-        mAllocPtr     = 0;
-        mAllocSize    = 0;
-        mStartPtr     = 0;
-        mTotalCnt     = 0;
-        mFreeCnt      = 0;
-        mBufSizeShift = 0;
+        mAllocPtr      = 0;
+        mAllocSize     = 0;
+        mStartPtr      = 0;
+        mTotalCnt      = 0;
+        mFreeCnt       = 0;
+        mBufSizeShift  = 0;
+        mHugePagesFlag = false;
     }
     char* Get()
     {
@@ -143,12 +168,15 @@ public:
         { return (mFreeCnt <= 0); }
     bool IsFull() const
         { return (mFreeCnt >= mTotalCnt); }
+    bool IsUsingHugePages() const
+        { return mHugePagesFlag; }
 
     typedef QCDLList<Partition, 0> List;
 private:
     friend class QCDLListOp<Partition, 0>;
     friend class QCDLListOp<const Partition, 0>;
     typedef unsigned int BufferIndex;
+    enum { kHugePageSize = 2 << 20 };
 
     void*        mAllocPtr;
     size_t       mAllocSize;
@@ -157,6 +185,7 @@ private:
     int          mTotalCnt;
     int          mFreeCnt;
     int          mBufSizeShift;
+    bool         mHugePagesFlag;
     Partition*   mPrevPtr[1];
     Partition*   mNextPtr[1];
 };
@@ -178,7 +207,8 @@ QCIoBufferPool::Client::Unregister()
 QCIoBufferPool::QCIoBufferPool()
     : mMutex(),
       mBufferSize(0),
-      mFreeCnt(0)
+      mFreeCnt(0),
+      mHugePagesPartitionCnt(0)
 {
     QCIoBufferPoolClientList::Init(mClientListPtr);
     Partition::List::Init(mPartitionListPtr);
@@ -200,7 +230,8 @@ QCIoBufferPool::Create(
     int          inPartitionCount,
     int          inPartitionBufferCount,
     int          inBufferSize,
-    bool         inLockMemoryFlag)
+    bool         inLockMemoryFlag,
+    bool         inUseHugePagesFlag /* = false */)
 {
     QCStMutexLocker theLock(mMutex);
     Destroy();
@@ -210,12 +241,16 @@ QCIoBufferPool::Create(
         Partition& thePart = *(new Partition());
         Partition::List::PushBack(mPartitionListPtr, thePart);
         theErr = thePart.Create(
-            inPartitionBufferCount, inBufferSize, inLockMemoryFlag);
+            inPartitionBufferCount, inBufferSize, inLockMemoryFlag,
+            inUseHugePagesFlag);
         if (theErr) {
             Destroy();
             break;
         }
         mFreeCnt += thePart.GetFreeCount();
+        if (thePart.IsUsingHugePages()) {
+            mHugePagesPartitionCnt++;
+        }
     }
     return theErr;
 }
@@ -227,8 +262,9 @@ QCIoBufferPool::Destroy()
     while (! Partition::List::IsEmpty(mPartitionListPtr)) {
         delete Partition::List::PopBack(mPartitionListPtr);
     }
-    mBufferSize = 0;
-    mFreeCnt    = 0;
+    mBufferSize            = 0;
+    mFreeCnt               = 0;
+    mHugePagesPartitionCnt = 0;
 }
 
     char*
@@ -92,7 +92,8 @@ public:
         int          inPartitionCount,
         int          inPartitionBufferCount,
         int          inBufferSize,
-        bool         inLockMemoryFlag);
+        bool         inLockMemoryFlag,
+        bool         inUseHugePagesFlag = false);
     void Destroy();
     char* Get(
         RefillReqId inRefillReqId = kRefillReqIdUndefined);
@@ -112,6 +113,10 @@ public:
     int GetBufferSize() const
         { return mBufferSize; }
     int GetFreeBufferCount();
+    // Number of partitions backed by huge pages. Huge pages are used only
+    // if requested, and if the system supports these.
+    int GetHugePagesPartitionCount() const
+        { return mHugePagesPartitionCnt; }
 
 private:
     class Partition;
@@ -120,6 +125,7 @@ private:
     Partition* mPartitionListPtr[1];
     int        mBufferSize;
     int        mFreeCnt;
+    int        mHugePagesPartitionCnt;
 
     bool TryToRefill(
         RefillReqId inReqId,
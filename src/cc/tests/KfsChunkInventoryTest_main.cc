@@ -0,0 +1,322 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Chunk inventory test, no servers needed. Compact, update, and
+// remove chunks, with and without a compaction in progress, then check
+// that the inventory loads back only after a clean shutdown, and that
+// a corrupt or a truncated inventory is rejected.
+//
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "chunk/ChunkInventory.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::map;
+
+using namespace KFS;
+
+typedef ChunkInventory::Entry   Entry;
+typedef ChunkInventory::Entries Entries;
+typedef map<kfsChunkId_t, Entry> Chunks;
+
+static Entry
+makeEntry(kfsChunkId_t chunkId, int64_t version)
+{
+    Entry entry;
+    entry.fileId       = 1000 + chunkId / 8;
+    entry.chunkId      = chunkId;
+    entry.chunkVersion = version;
+    entry.chunkSize    = (chunkId * 4099) % CHUNKSIZE;
+    return entry;
+}
+
+static void
+update(ChunkInventory& inv, Chunks& chunks, kfsChunkId_t chunkId,
+    int64_t version)
+{
+    const Entry entry = makeEntry(chunkId, version);
+    inv.Update(entry.fileId, entry.chunkId, entry.chunkVersion,
+        entry.chunkSize);
+    chunks[chunkId] = entry;
+}
+
+static void
+remove(ChunkInventory& inv, Chunks& chunks, kfsChunkId_t chunkId)
+{
+    inv.Remove(chunkId);
+    chunks.erase(chunkId);
+}
+
+static bool
+compact(ChunkInventory& inv, const Chunks& chunks, bool waitFlag)
+{
+    Entries entries;
+    for (Chunks::const_iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        entries.push_back(it->second);
+    }
+    if (! inv.StartCompaction(entries)) {
+        cout << "compaction is already in progress" << endl;
+        return false;
+    }
+    if (! entries.empty()) {
+        cout << "the entries were not taken" << endl;
+        return false;
+    }
+    if (waitFlag && inv.IsCompacting(true)) {
+        cout << "the compaction is still in progress" << endl;
+        return false;
+    }
+    return true;
+}
+
+static bool
+check(const ChunkInventory& inv, const Chunks& chunks, bool expectLoadFlag,
+    const char* name)
+{
+    Entries entries;
+    string  errMsg;
+    const bool loadedFlag = inv.Load(entries, errMsg);
+    if (loadedFlag != expectLoadFlag) {
+        cout << name << ": load: " << loadedFlag << " expected: " <<
+            expectLoadFlag << " " << errMsg << endl;
+        return false;
+    }
+    if (! loadedFlag) {
+        cout << name << ": not loaded: " << errMsg << endl;
+        return entries.empty();
+    }
+    if (entries.size() != chunks.size()) {
+        cout << name << ": entries: " << entries.size() <<
+            " expected: " << chunks.size() << endl;
+        return false;
+    }
+    for (Entries::const_iterator it = entries.begin();
+            it != entries.end();
+            ++it) {
+        Chunks::const_iterator const ci = chunks.find(it->chunkId);
+        if (ci == chunks.end() ||
+                ci->second.fileId != it->fileId ||
+                ci->second.chunkVersion != it->chunkVersion ||
+                ci->second.chunkSize != it->chunkSize) {
+            cout << name << ": chunk: " << it->chunkId << " mismatch" << endl;
+            return false;
+        }
+    }
+    cout << name << ": loaded: " << entries.size() << " chunks" << endl;
+    return true;
+}
+
+static bool
+exists(const string& name)
+{
+    struct stat st;
+    return (stat(name.c_str(), &st) == 0);
+}
+
+static bool
+modify(const string& name, off_t pos, bool truncateFlag)
+{
+    const int fd = open(name.c_str(), O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok;
+    if (truncateFlag) {
+        ok = ftruncate(fd, pos) == 0;
+    } else {
+        char c = 0;
+        ok = pread(fd, &c, 1, pos) == 1;
+        c ^= 0x55;
+        ok = ok && pwrite(fd, &c, 1, pos) == 1;
+    }
+    close(fd);
+    return ok;
+}
+
+static int
+run(const string& dir, int numChunks)
+{
+    Chunks chunks;
+    {
+        ChunkInventory inv(dir);
+        if (! check(inv, chunks, false, "no inventory")) {
+            return 1;
+        }
+        // The initial inventory, as written after the restart scan.
+        for (int i = 1; i <= numChunks; i++) {
+            chunks[i] = makeEntry(i, 1);
+        }
+        if (! compact(inv, chunks, true) || ! inv.IsOpen()) {
+            return 1;
+        }
+        if (exists(inv.GetFilename() + ".tmp")) {
+            cout << "temporary file left behind" << endl;
+            return 1;
+        }
+        if (! check(inv, chunks, false, "no clean record")) {
+            return 1;
+        }
+        // Version changes, new chunks, and removals.
+        for (int i = 1; i <= numChunks; i++) {
+            update(inv, chunks, i, 2);
+        }
+        for (int i = numChunks + 1; i <= numChunks + numChunks / 4; i++) {
+            update(inv, chunks, i, 1);
+        }
+        for (int i = 2; i <= numChunks; i += 5) {
+            remove(inv, chunks, i);
+        }
+        if (! inv.NeedsCompaction(1024)) {
+            cout << "compaction expected" << endl;
+            return 1;
+        }
+        if (! inv.Close(true) ||
+                ! check(inv, chunks, true, "clean shutdown")) {
+            return 1;
+        }
+    }
+    {
+        // Restart: load, then compact in the background while chunks
+        // keep changing.
+        ChunkInventory inv(dir);
+        if (! check(inv, chunks, true, "restart")) {
+            return 1;
+        }
+        if (! compact(inv, chunks, false)) {
+            return 1;
+        }
+        for (int i = 3; i <= numChunks; i += 7) {
+            update(inv, chunks, i, 3);
+        }
+        for (int i = 4; i <= numChunks; i += 11) {
+            remove(inv, chunks, i);
+        }
+        Entries none;
+        if (inv.IsCompacting() && inv.StartCompaction(none)) {
+            cout << "second compaction started" << endl;
+            return 1;
+        }
+        if (inv.IsCompacting(true)) {
+            return 1;
+        }
+        if (inv.NeedsCompaction(1024)) {
+            cout << "no compaction expected" << endl;
+            return 1;
+        }
+        // Records appended after the compaction.
+        update(inv, chunks, 1, 4);
+        remove(inv, chunks, 5);
+        if (! inv.Close(true) ||
+                ! check(inv, chunks, true, "changes during compaction")) {
+            return 1;
+        }
+    }
+    {
+        // Shutdown with a compaction in progress.
+        ChunkInventory inv(dir);
+        if (! compact(inv, chunks, false)) {
+            return 1;
+        }
+        update(inv, chunks, 6, 5);
+        if (! inv.Close(true) ||
+                ! check(inv, chunks, true, "close while compacting")) {
+            return 1;
+        }
+        // Unclean shutdown.
+        if (! compact(inv, chunks, true)) {
+            return 1;
+        }
+        update(inv, chunks, 7, 5);
+        inv.Close(false);
+        if (! check(inv, chunks, false, "unclean shutdown")) {
+            return 1;
+        }
+        // Corrupt records.
+        if (! compact(inv, chunks, true) || ! inv.Close(true) ||
+                ! check(inv, chunks, true, "clean shutdown")) {
+            return 1;
+        }
+        struct stat st;
+        if (stat(inv.GetFilename().c_str(), &st) != 0 ||
+                ! modify(inv.GetFilename(), st.st_size / 2, false) ||
+                ! check(inv, chunks, false, "corrupt record")) {
+            return 1;
+        }
+        if (! compact(inv, chunks, true) || ! inv.Close(true) ||
+                stat(inv.GetFilename().c_str(), &st) != 0 ||
+                ! modify(inv.GetFilename(), st.st_size - 1, true) ||
+                ! check(inv, chunks, false, "truncated")) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int    numChunks = 50000;
+    string dir;
+    bool   help      = false;
+    char   optchar;
+
+    while ((optchar = getopt(argc, argv, "n:d:h")) != -1) {
+        switch (optchar) {
+            case 'n': numChunks = atoi(optarg); break;
+            case 'd': dir       = optarg;       break;
+            default:  help      = true;         break;
+        }
+    }
+    if (help || numChunks < 1024) {
+        cout << "Usage: " << argv[0] << " [-n <# of chunks, >= 1024>]"
+            " [-d <dir>]" << endl;
+        return 1;
+    }
+    bool rmdirFlag = false;
+    if (dir.empty()) {
+        char tmpl[] = "/tmp/KfsChunkInventoryTestXXXXXX";
+        if (! mkdtemp(tmpl)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        dir       = tmpl;
+        rmdirFlag = true;
+    }
+    const int ret = run(dir, numChunks);
+    unlink((dir + "/chunk_inventory").c_str());
+    if (rmdirFlag) {
+        rmdir(dir.c_str());
+    }
+    if (ret == 0) {
+        cout << "Test passed" << endl;
+    }
+    return ret;
+}
@@ -0,0 +1,202 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Micro benchmark for IOBuffer: the typical read / write / forward
+// patterns of the chunk server and the client, executed in memory and
+// over a socket pair.
+//
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <algorithm>
+#include <vector>
+
+#include "libkfsIO/IOBuffer.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+using namespace KFS;
+
+static double
+TimeNow()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (tv.tv_sec + tv.tv_usec * 1e-6);
+}
+
+static void
+Report(const char* name, int iterations, int64_t bytes, double start)
+{
+    const double elapsed = TimeNow() - start;
+    cout << name <<
+        ": " << iterations << " iterations"
+        " " << elapsed << " sec"
+        " " << (elapsed * 1e6 / iterations) << " usec/iteration"
+        " " << (bytes / elapsed / (1024. * 1024.)) << " MB/sec" <<
+    endl;
+}
+
+static void
+Check(bool cond, const char* msg)
+{
+    if (! cond) {
+        cout << "FAILED: " << msg << endl;
+        exit(1);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int  optchar;
+    int  iterations = 2000;
+    int  size       = 1 << 20;
+    int  ioSize     = 64 << 10;
+    bool help       = false;
+
+    while ((optchar = getopt(argc, argv, "n:s:b:h")) != -1) {
+        switch (optchar) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'b':
+                ioSize = atoi(optarg);
+                break;
+            default:
+                help = true;
+                break;
+        }
+    }
+    if (help || iterations <= 0 || size <= 0 || ioSize <= 0) {
+        cout << "Usage: " << argv[0] <<
+            " [-n <iterations>] [-s <buffer size>] [-b <io size>]" <<
+        endl;
+        return (help ? 0 : 1);
+    }
+
+    vector<char> src(size);
+    vector<char> dst(size);
+    for (int i = 0; i < size; i++) {
+        src[i] = (char)(i * 7 + 3);
+    }
+
+    // Client write path: copy in with application sized writes, then copy
+    // out into the "network".
+    double start = TimeNow();
+    for (int i = 0; i < iterations; i++) {
+        IOBuffer buf;
+        for (int pos = 0; pos < size; pos += ioSize) {
+            buf.CopyIn(&src[pos], std::min(ioSize, size - pos));
+        }
+        Check(buf.BytesConsumable() == size, "copy in");
+        Check(buf.CopyOut(&dst[0], size) == size, "copy out");
+    }
+    Report("copyin/copyout", iterations, int64_t(iterations) * size, start);
+    Check(memcmp(&src[0], &dst[0], size) == 0, "copy data mismatch");
+
+    // Chunk server forward path: clone the received data for the next
+    // server in the replication chain, and move the rest in io size chunks
+    // to the disk io buffer, as the write prepare / write ops do.
+    IOBuffer data;
+    data.CopyIn(&src[0], size);
+    start = TimeNow();
+    for (int i = 0; i < iterations; i++) {
+        IOBuffer* const clone = data.Clone();
+        IOBuffer  forward;
+        while (! clone->IsEmpty()) {
+            IOBuffer chunk;
+            chunk.Move(clone, ioSize);
+            forward.Move(&chunk);
+        }
+        Check(forward.BytesConsumable() == size, "forward");
+        delete clone;
+    }
+    Report("clone/move", iterations, int64_t(iterations) * size, start);
+
+    // Partial update: replace unaligned ranges, as record append and
+    // checksum block re-computation do.
+    start = TimeNow();
+    for (int i = 0; i < iterations; i++) {
+        IOBuffer buf;
+        buf.Copy(&data, size);
+        IOBuffer upd;
+        const int off = (i * 1013) % (size / 2);
+        upd.CopyIn(&src[off], ioSize / 3);
+        buf.Replace(&upd, off, ioSize / 3);
+        Check(buf.BytesConsumable() == size, "replace");
+        if (i + 1 == iterations) {
+            Check(buf.CopyOut(&dst[0], size) == size &&
+                memcmp(&src[0], &dst[0], size) == 0,
+                "replace data mismatch");
+        }
+    }
+    Report("copy/replace", iterations, int64_t(iterations) * size, start);
+
+    // Network read / write over a socket pair.
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+        perror("socketpair");
+        return 1;
+    }
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    const int netIterations = std::max(1, iterations / 4);
+    start = TimeNow();
+    int64_t total = 0;
+    for (int i = 0; i < netIterations; i++) {
+        IOBuffer out;
+        out.Copy(&data, size);
+        IOBuffer in;
+        while (! out.IsEmpty() || in.BytesConsumable() < size) {
+            if (! out.IsEmpty()) {
+                const int nw = out.Write(sv[0]);
+                Check(nw > 0 || nw == -EAGAIN, "write");
+            }
+            const int nr = in.Read(sv[1]);
+            Check(nr > 0 || nr == -EAGAIN, "read");
+        }
+        Check(in.BytesConsumable() == size, "read size");
+        if (i + 1 == netIterations) {
+            Check(in.CopyOut(&dst[0], size) == size &&
+                memcmp(&src[0], &dst[0], size) == 0,
+                "socket data mismatch");
+        }
+        total += size;
+    }
+    Report("socket write/read", netIterations, total, start);
+    close(sv[0]);
+    close(sv[1]);
+    return 0;
+}
@@ -0,0 +1,349 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief IOBuffer correctness test. Random sequences of Move, Replace,
+// Copy, Consume, Trim, ZeroFill and the other methods, on a few buffers
+// that share blocks with each other, with the sizes and the offsets
+// around the block boundaries. The contents of every buffer are checked
+// against a plain string after each operation.
+//
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "libkfsIO/IOBuffer.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+using namespace KFS;
+
+struct Buffer
+{
+    Buffer()
+        : buf(),
+          data()
+        {}
+    IOBuffer buf;
+    string   data; // the expected contents
+private:
+    Buffer(const Buffer&);
+    Buffer& operator=(const Buffer&);
+};
+
+static int sBlockSize = 0;
+static int sMaxSize   = 0;
+
+// Mostly sizes around the block boundaries, sometimes any size.
+static int
+randomSize()
+{
+    switch (rand() % 4) {
+        case 0:  return rand() % 16;
+        case 1:  return rand() % (3 * sBlockSize);
+        default: break;
+    }
+    return (1 + rand() % 3) * sBlockSize + rand() % 5 - 2;
+}
+
+// A small alphabet, so that IndexOf() finds something.
+static string
+randomData(int len)
+{
+    string str(len, 'a');
+    for (int i = 0; i < len; i++) {
+        str[i] = (char)('a' + rand() % 4);
+    }
+    return str;
+}
+
+static const char*
+check(const Buffer& b)
+{
+    if (b.buf.BytesConsumable() != (int)b.data.size()) {
+        return "byte count mismatch";
+    }
+    int total = 0;
+    for (IOBuffer::iterator it = b.buf.begin(); it != b.buf.end(); ++it) {
+        const int nb = it->BytesConsumable();
+        if (nb < 0 || total + nb > (int)b.data.size()) {
+            return "block byte count mismatch";
+        }
+        if (memcmp(it->Consumer(), b.data.data() + total, nb) != 0) {
+            return "contents mismatch";
+        }
+        total += nb;
+    }
+    if (total != (int)b.data.size()) {
+        return "block byte count sum mismatch";
+    }
+    vector<char> out(b.data.size() + 1);
+    if (b.buf.CopyOut(&out[0], (int)out.size()) != (int)b.data.size() ||
+            memcmp(&out[0], b.data.data(), b.data.size()) != 0) {
+        return "CopyOut mismatch";
+    }
+    return 0;
+}
+
+// Replace() model: [offset, offset + len) is replaced, the gap past the
+// end is zero filled.
+static void
+replaceModel(string& dst, string& src, int offset, int numBytes)
+{
+    const size_t len = std::min((size_t)std::max(0, numBytes), src.size());
+    if ((size_t)offset > dst.size()) {
+        dst.append(offset - dst.size(), '\0');
+    }
+    dst.replace(offset, std::min(len, dst.size() - offset), src, 0, len);
+    src.erase(0, len);
+}
+
+static const char*
+runOp(int op, Buffer& a, Buffer& b, string& name)
+{
+    const int size = randomSize();
+    switch (op) {
+        case 0: {
+            name = "CopyIn";
+            const string str = randomData(size);
+            if (a.buf.CopyIn(str.data(), size) != size) {
+                return "CopyIn return value";
+            }
+            a.data += str;
+            break;
+        }
+        case 1: {
+            name = "Move";
+            const int len = std::min(size, (int)b.data.size());
+            if (a.buf.Move(&b.buf, size) != len) {
+                return "Move return value";
+            }
+            a.data.append(b.data, 0, len);
+            b.data.erase(0, len);
+            break;
+        }
+        case 2:
+            name = "Move all";
+            a.buf.Move(&b.buf);
+            a.data += b.data;
+            b.data.clear();
+            break;
+        case 3:
+        case 4: {
+            const int offset = rand() % 4 == 0 ?
+                (int)a.data.size() + randomSize() :
+                (a.data.empty() ? 0 : rand() % (int)a.data.size());
+            if (op == 3) {
+                name = "Replace";
+                a.buf.Replace(&b.buf, offset, size);
+            } else {
+                name = "ReplaceKeepBuffersFull";
+                a.buf.ReplaceKeepBuffersFull(&b.buf, offset, size);
+            }
+            replaceModel(a.data, b.data, offset, size);
+            break;
+        }
+        case 5: {
+            name = "Copy";
+            const int len = std::min(size, (int)b.data.size());
+            if (a.buf.Copy(&b.buf, size) != len) {
+                return "Copy return value";
+            }
+            a.data.append(b.data, 0, len);
+            break;
+        }
+        case 6: {
+            name = "Consume";
+            const int len = std::min(size, (int)a.data.size());
+            if (a.buf.Consume(size) != len) {
+                return "Consume return value";
+            }
+            a.data.erase(0, len);
+            break;
+        }
+        case 7: {
+            name = "Trim";
+            const int len = rand() % 8 == 0 ? 0 :
+                (rand() % 2 == 0 ? (int)a.data.size() - size : size);
+            a.buf.Trim(len);
+            if (len <= 0) {
+                a.data.clear();
+            } else if (len < (int)a.data.size()) {
+                a.data.resize(len);
+            }
+            break;
+        }
+        case 8:
+            name = "ZeroFill";
+            a.buf.ZeroFill(size);
+            a.data.append(size, '\0');
+            break;
+        case 9: {
+            name = "ZeroFillLast";
+            const int len = a.buf.ZeroFillLast();
+            if (len < 0 || len >= sBlockSize) {
+                return "ZeroFillLast return value";
+            }
+            a.data.append(len, '\0');
+            break;
+        }
+        case 10: {
+            // Replace b with a clone of a: both share all the blocks.
+            name = "Clone";
+            IOBuffer* const clone = a.buf.Clone();
+            b.buf.Clear();
+            b.buf.Move(clone);
+            delete clone;
+            b.data = a.data;
+            break;
+        }
+        case 11: {
+            // Append the blocks of a clone of b: a and b share them.
+            name = "Append blocks";
+            IOBuffer* const clone = b.buf.Clone();
+            for (IOBuffer::iterator it = clone->begin();
+                    it != clone->end();
+                    ++it) {
+                a.buf.Append(*it);
+            }
+            delete clone;
+            a.data += b.data;
+            break;
+        }
+        case 12:
+            name = "Append";
+            if (a.buf.Append(&b.buf) != (int)b.data.size() ||
+                    ! b.buf.IsEmpty()) {
+                return "Append return value";
+            }
+            a.data += b.data;
+            b.data.clear();
+            break;
+        case 13: {
+            name = "MakeBuffersFull";
+            a.buf.MakeBuffersFull();
+            for (IOBuffer::iterator it = a.buf.begin(); it != a.buf.end(); ) {
+                const bool fullFlag = it->IsFull() && it->HasCompleteBuffer();
+                if (++it != a.buf.end() && ! fullFlag) {
+                    return "MakeBuffersFull: buffer not full";
+                }
+            }
+            break;
+        }
+        case 14: {
+            name = "IndexOf";
+            if (a.data.empty()) {
+                break;
+            }
+            const int    pos = rand() % (int)a.data.size();
+            const string str = a.data.substr(pos,
+                std::min(1 + rand() % 8, (int)a.data.size() - pos));
+            if (str.find('\0') != string::npos) {
+                break;
+            }
+            const int    off = rand() % 2 == 0 ? 0 : rand() % (pos + 1);
+            const size_t idx = a.data.find(str, off);
+            if (a.buf.IndexOf(off, str.c_str()) != (int)idx) {
+                return "IndexOf mismatch";
+            }
+            break;
+        }
+        default:
+            name = "Clear";
+            a.buf.Clear();
+            a.data.clear();
+            break;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int  iterations = 200000;
+    int  seed       = 1;
+    bool help       = false;
+    char optchar;
+
+    while ((optchar = getopt(argc, argv, "i:s:h")) != -1) {
+        switch (optchar) {
+            case 'i': iterations = atoi(optarg); break;
+            case 's': seed       = atoi(optarg); break;
+            default:  help       = true;         break;
+        }
+    }
+    if (help || iterations <= 0) {
+        cout << "Usage: " << argv[0] <<
+            " [-i <# of operations>] [-s <seed>]" << endl;
+        return 1;
+    }
+    srand(seed);
+    sBlockSize = IOBufferData::GetDefaultBufferSize();
+    sMaxSize   = 64 * sBlockSize;
+
+    const int kNumBuffers = 3;
+    const int kNumOps     = 16;
+    Buffer    buffers[kNumBuffers];
+    int       counts[kNumOps] = { 0 };
+    for (int i = 0; i < iterations; i++) {
+        // Clear is rare, keep the buffers large enough to span blocks.
+        const int op  = rand() % (kNumOps * 4) == 0 ? kNumOps - 1 :
+            rand() % (kNumOps - 1);
+        const int ai  = rand() % kNumBuffers;
+        const int bi  = (ai + 1 + rand() % (kNumBuffers - 1)) % kNumBuffers;
+        Buffer&   a   = buffers[ai];
+        Buffer&   b   = buffers[bi];
+        string    name;
+        const char* err = runOp(op, a, b, name);
+        for (int k = 0; ! err && k < kNumBuffers; k++) {
+            err = check(buffers[k]);
+        }
+        if (err) {
+            cout << "iteration: " << i << " seed: " << seed <<
+                " op: " << name << " buffers: " << ai << " " << bi <<
+                " error: " << err << endl;
+            return 1;
+        }
+        counts[op]++;
+        // Keep the buffers from growing without bound.
+        for (int k = 0; k < kNumBuffers; k++) {
+            Buffer& c = buffers[k];
+            if ((int)c.data.size() > sMaxSize) {
+                const int len = (int)c.data.size() - sMaxSize / 2;
+                c.buf.Consume(len);
+                c.data.erase(0, len);
+            }
+        }
+    }
+    cout << "operations:";
+    for (int i = 0; i < kNumOps; i++) {
+        cout << " " << counts[i];
+    }
+    cout << endl << "Test passed" << endl;
+    return 0;
+}
@@ -0,0 +1,350 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Io buffer pool benchmark: compare buffer sizes, and regular vs huge
+// pages backed pool. Reports system call count for network io, and data
+// tlb misses for the io and for the random access to the pool buffers,
+// when linux performance counters are available.
+//
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "libkfsIO/IOBuffer.h"
+#include "qcdio/qciobufferpool.h"
+#include "qcdio/qcutils.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+using namespace KFS;
+
+class PerfCounter
+{
+public:
+    enum Type
+    {
+        kTypeSyscalls,
+        kTypeDtlbReadMisses
+    };
+    PerfCounter(
+        Type inType)
+        : mFd(-1)
+    {
+#ifdef __linux__
+        struct perf_event_attr theAttr;
+        memset(&theAttr, 0, sizeof(theAttr));
+        theAttr.size       = sizeof(theAttr);
+        theAttr.disabled   = 1;
+        theAttr.exclude_hv = 1;
+        if (inType == kTypeSyscalls) {
+            const int theId = GetSyscallTracepointId();
+            if (theId < 0) {
+                return;
+            }
+            theAttr.type   = PERF_TYPE_TRACEPOINT;
+            theAttr.config = theId;
+        } else {
+            theAttr.type   = PERF_TYPE_HW_CACHE;
+            theAttr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+        mFd = (int)syscall(__NR_perf_event_open, &theAttr, 0, -1, -1, 0);
+#endif
+    }
+    ~PerfCounter()
+    {
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+    void Start()
+    {
+#ifdef __linux__
+        if (mFd >= 0) {
+            ioctl(mFd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    // Returns -1 if the counter isn't available.
+    int64_t Stop()
+    {
+#ifdef __linux__
+        uint64_t theVal = 0;
+        if (mFd >= 0) {
+            ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(mFd, &theVal, sizeof(theVal)) == sizeof(theVal)) {
+                return (int64_t)theVal;
+            }
+        }
+#endif
+        return -1;
+    }
+private:
+    int mFd;
+
+    static int GetSyscallTracepointId()
+    {
+        const char* const kPaths[] = {
+            "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+            "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+            0
+        };
+        for (const char* const* thePtr = kPaths; *thePtr; ++thePtr) {
+            std::ifstream theStream(*thePtr);
+            int theId = -1;
+            if (theStream >> theId) {
+                return theId;
+            }
+        }
+        return -1;
+    }
+};
+
+class PoolAllocator : public libkfsio::IOBufferAllocator
+{
+public:
+    PoolAllocator(
+        QCIoBufferPool& inPool)
+        : mPool(inPool)
+        {}
+    virtual size_t GetBufferSize() const
+        { return mPool.GetBufferSize(); }
+    virtual char* Allocate()
+    {
+        char* const theBufPtr = mPool.Get();
+        if (! theBufPtr) {
+            cout << "out of io buffers" << endl;
+            abort();
+        }
+        return theBufPtr;
+    }
+    virtual void Deallocate(
+        char* inBufferPtr)
+        { mPool.Put(inBufferPtr); }
+private:
+    QCIoBufferPool& mPool;
+};
+
+static double
+TimeNow()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (tv.tv_sec + tv.tv_usec * 1e-6);
+}
+
+static void
+Report(const char* name, double elapsed, double rate, const char* rateUnit,
+    int64_t syscalls, int64_t tlbMisses)
+{
+    cout << name <<
+        ": " << elapsed << " sec"
+        " " << rate << " " << rateUnit <<
+        " syscalls: ";
+    if (syscalls >= 0) {
+        cout << syscalls;
+    } else {
+        cout << "n/a";
+    }
+    cout << " dtlb misses: ";
+    if (tlbMisses >= 0) {
+        cout << tlbMisses;
+    } else {
+        cout << "n/a";
+    }
+    cout << endl;
+}
+
+int
+main(int argc, char **argv)
+{
+    int     optchar;
+    int     bufSize    = 4 << 10;
+    int64_t poolSize   = int64_t(256) << 20;
+    int64_t transfer   = int64_t(1) << 30;
+    int     passes     = 16;
+    bool    hugePages  = false;
+    bool    lockMemory = false;
+    bool    help       = false;
+
+    while ((optchar = getopt(argc, argv, "b:p:t:n:Hlh")) != -1) {
+        switch (optchar) {
+            case 'b':
+                bufSize = atoi(optarg);
+                break;
+            case 'p':
+                poolSize = (int64_t)atoll(optarg) << 20;
+                break;
+            case 't':
+                transfer = (int64_t)atoll(optarg) << 20;
+                break;
+            case 'n':
+                passes = atoi(optarg);
+                break;
+            case 'H':
+                hugePages = true;
+                break;
+            case 'l':
+                lockMemory = true;
+                break;
+            default:
+                help = true;
+                break;
+        }
+    }
+    if (help || bufSize <= 0 || poolSize < bufSize || transfer <= 0) {
+        cout << "Usage: " << argv[0] <<
+            " [-b <buffer size>] [-p <pool size MB>]"
+            " [-t <transfer size MB>] [-n <random access passes>]"
+            " [-H use huge pages] [-l lock memory]" <<
+        endl;
+        return (help ? 0 : 1);
+    }
+
+    QCIoBufferPool pool;
+    const int      bufCount = int(poolSize / bufSize);
+    const int      err      =
+        pool.Create(1, bufCount, bufSize, lockMemory, hugePages);
+    if (err) {
+        cout << "pool create: " << QCUtils::SysError(err) << endl;
+        return 1;
+    }
+    PoolAllocator allocator(pool);
+    if (! libkfsio::SetIOBufferAllocator(&allocator)) {
+        cout << "failed to set buffer allocator" << endl;
+        return 1;
+    }
+    cout << "buffer size: " << bufSize <<
+        " buffers: " << bufCount <<
+        " huge pages: " << (pool.GetHugePagesPartitionCount() > 0 ?
+            "yes" : "no") <<
+    endl;
+
+    PerfCounter syscalls(PerfCounter::kTypeSyscalls);
+    PerfCounter tlbMisses(PerfCounter::kTypeDtlbReadMisses);
+
+    // Network io: copy the data into the buffers, then send it trough
+    // a socket pair, as the chunk server does with the data read from disk.
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+        perror("socketpair");
+        return 1;
+    }
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    const int    kChunkSize = 1 << 20;
+    vector<char> src(kChunkSize);
+    for (int i = 0; i < kChunkSize; i++) {
+        src[i] = (char)(i * 7 + 3);
+    }
+    double start = TimeNow();
+    syscalls.Start();
+    tlbMisses.Start();
+    int64_t total = 0;
+    while (total < transfer) {
+        IOBuffer out;
+        out.CopyIn(&src[0], kChunkSize);
+        IOBuffer in;
+        while (! out.IsEmpty() || in.BytesConsumable() < kChunkSize) {
+            if (! out.IsEmpty()) {
+                const int nw = out.Write(sv[0]);
+                if (nw < 0 && nw != -EAGAIN) {
+                    cout << "write: " << QCUtils::SysError(-nw) << endl;
+                    return 1;
+                }
+            }
+            const int nr = in.Read(sv[1]);
+            if (nr < 0 && nr != -EAGAIN) {
+                cout << "read: " << QCUtils::SysError(-nr) << endl;
+                return 1;
+            }
+        }
+        total += kChunkSize;
+    }
+    int64_t nTlbMisses = tlbMisses.Stop();
+    int64_t nSyscalls  = syscalls.Stop();
+    double elapsed = TimeNow() - start;
+    Report("socket io", elapsed, total / elapsed / (1024. * 1024.), "MB/sec",
+        nSyscalls, nTlbMisses);
+    close(sv[0]);
+    close(sv[1]);
+
+    // Random access to the pool buffers: checksum, and buffer cache like
+    // access pattern. Touch every page in all buffers in random order.
+    vector<char*> bufs;
+    bufs.reserve(bufCount);
+    for (char* ptr; (ptr = pool.Get()); ) {
+        memset(ptr, (int)bufs.size(), bufSize);
+        bufs.push_back(ptr);
+    }
+    srandom(1);
+    std::random_shuffle(bufs.begin(), bufs.end());
+    const int kStride = 4 << 10;
+    vector<int> offsets;
+    for (int i = 0; i < bufSize; i += std::min(bufSize, kStride)) {
+        offsets.push_back(i);
+    }
+    start = TimeNow();
+    tlbMisses.Start();
+    int64_t sum = 0;
+    for (int p = 0; p < passes; p++) {
+        for (vector<int>::const_iterator it = offsets.begin();
+                it != offsets.end();
+                ++it) {
+            for (vector<char*>::const_iterator bi = bufs.begin();
+                    bi != bufs.end();
+                    ++bi) {
+                sum += (*bi)[*it + (p % 64)];
+            }
+        }
+    }
+    nTlbMisses = tlbMisses.Stop();
+    elapsed    = TimeNow() - start;
+    Report("random access", elapsed, double(passes) * bufs.size() *
+        offsets.size() / elapsed * 1e-6, "M accesses/sec", -1, nTlbMisses);
+    cout << "checksum: " << sum << endl;
+    for (vector<char*>::const_iterator bi = bufs.begin();
+            bi != bufs.end();
+            ++bi) {
+        pool.Put(*bi);
+    }
+    return 0;
+}
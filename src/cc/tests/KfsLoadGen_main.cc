@@ -0,0 +1,857 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Load generator: a number of client processes, each running a
+// number of threads with its own kfs client, issue a weighted random mix of
+// sequential reads, random reads, writes, atomic record appends, and file
+// create / stat / readdir. The throughput and the latency percentiles are
+// reported per operation type.
+//
+// The read files, and the record append file are created by the setup
+// step, and are re-used by the subsequent runs if their size matches.
+//
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <boost/scoped_array.hpp>
+
+#include "libkfsClient/KfsClient.h"
+#include "common/properties.h"
+#include "qcdio/qcthread.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::ostringstream;
+using std::setw;
+using std::left;
+using std::right;
+using std::fixed;
+using std::setprecision;
+
+using namespace KFS;
+
+enum OpType
+{
+    kOpSeqRead,
+    kOpRandRead,
+    kOpWrite,
+    kOpAppend,
+    kOpCreate,
+    kOpStat,
+    kOpReaddir,
+    kOpCount
+};
+
+static const char* const kOpNames[kOpCount] = {
+    "sread", "rread", "write", "append", "create", "stat", "readdir"
+};
+
+struct LoadConfig
+{
+    string  metaHost;
+    int     metaPort;
+    string  testDir;
+    int     numProcs;
+    int     numThreads;
+    int     durationSec;
+    int     weights[kOpCount];
+    int     ioSize;
+    int     recordSize;
+    int     numReadFiles;
+    int64_t readFileSize;
+    int64_t writeFileSize;
+    int     numReplicas;
+    string  logLevel;
+
+    string ReadFile(int i) const {
+        ostringstream os;
+        os << testDir << "/data/r" << i;
+        return os.str();
+    }
+    string AppendFile() const {
+        return testDir + "/append/a";
+    }
+};
+
+// Per operation type results: latency samples in usec.
+struct OpStats
+{
+    vector<uint32_t> latency;
+    int64_t          bytes;
+    int64_t          errors;
+
+    OpStats() : latency(), bytes(0), errors(0) {}
+    void Add(const OpStats& other) {
+        latency.insert(latency.end(),
+            other.latency.begin(), other.latency.end());
+        bytes  += other.bytes;
+        errors += other.errors;
+    }
+};
+
+static inline int64_t
+NowUsec()
+{
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return (int64_t(now.tv_sec) * 1000000 + now.tv_usec);
+}
+
+static bool
+ParseMix(const char* mix, int* weights)
+{
+    std::fill(weights, weights + kOpCount, 0);
+    std::istringstream is(mix);
+    string item;
+    while (std::getline(is, item, ',')) {
+        const size_t pos = item.find('=');
+        if (pos == string::npos) {
+            return false;
+        }
+        const string name = item.substr(0, pos);
+        int i = 0;
+        while (i < kOpCount && name != kOpNames[i]) {
+            i++;
+        }
+        if (i >= kOpCount) {
+            return false;
+        }
+        weights[i] = atoi(item.c_str() + pos + 1);
+        if (weights[i] < 0) {
+            return false;
+        }
+    }
+    int total = 0;
+    for (int i = 0; i < kOpCount; i++) {
+        total += weights[i];
+    }
+    return (total > 0);
+}
+
+class LoadWorker : public QCRunnable
+{
+public:
+    LoadWorker(const LoadConfig& cfg, const KfsClientPtr& client,
+            int procIdx, int threadIdx)
+        : mCfg(cfg),
+          mClient(client),
+          mSeed((unsigned int)(getpid() * 7919 + threadIdx)),
+          mEndUsec(0),
+          mLastOpEndUsec(0),
+          mBuf(new char[std::max(cfg.ioSize, cfg.recordSize)]),
+          mName(),
+          mMetaDir(),
+          mTotalWeight(0),
+          mSeqFds(cfg.numReadFiles, -1),
+          mRandFds(cfg.numReadFiles, -1),
+          mSeqFile(threadIdx % std::max(1, cfg.numReadFiles)),
+          mWriteFd(-1),
+          mWritePos(0),
+          mWriteFileCount(0),
+          mAppendFd(-1),
+          mCreateCount(0)
+    {
+        ostringstream os;
+        os << "p" << procIdx << ".t" << threadIdx;
+        mName = os.str();
+        mMetaDir = cfg.testDir + "/meta/" + mName;
+        memset(mBuf.get(), 'l', std::max(cfg.ioSize, cfg.recordSize));
+        for (int i = 0; i < kOpCount; i++) {
+            mTotalWeight += cfg.weights[i];
+        }
+    }
+    int Prepare() {
+        int res = mClient->Mkdirs(mMetaDir.c_str());
+        if (res < 0) {
+            return res;
+        }
+        res = mClient->Mkdirs((mCfg.testDir + "/write").c_str());
+        if (res < 0) {
+            return res;
+        }
+        // Continue the file sequence left by the previous runs, as the
+        // creates are exclusive.
+        vector<string> entries;
+        if ((res = mClient->Readdir(mMetaDir.c_str(), entries)) < 0) {
+            return res;
+        }
+        for (vector<string>::const_iterator it = entries.begin();
+                it != entries.end(); ++it) {
+            if (! it->empty() && (*it)[0] == 'f') {
+                mCreateCount++;
+            }
+        }
+        return 0;
+    }
+    void SetEndTime(int64_t endUsec) {
+        mEndUsec = endUsec;
+    }
+    virtual void Run() {
+        while (NowUsec() < mEndUsec) {
+            const int     op    = PickOp();
+            const int64_t start = NowUsec();
+            const int64_t res   = DoOp(op);
+            const int64_t end   = NowUsec();
+            mLastOpEndUsec = end;
+            OpStats& stats = mStats[op];
+            if (res < 0) {
+                stats.errors++;
+            } else {
+                stats.bytes += res;
+                stats.latency.push_back((uint32_t)std::min(
+                    end - start, int64_t(0xFFFFFFFF)));
+            }
+        }
+        Cleanup();
+    }
+    const OpStats& GetStats(int op) const {
+        return mStats[op];
+    }
+    int64_t GetLastOpEndTime() const {
+        return mLastOpEndUsec;
+    }
+private:
+    const LoadConfig&         mCfg;
+    KfsClientPtr              mClient;
+    unsigned int              mSeed;
+    int64_t                   mEndUsec;
+    int64_t                   mLastOpEndUsec;
+    boost::scoped_array<char> mBuf;
+    string                    mName;
+    string                    mMetaDir;
+    int                       mTotalWeight;
+    vector<int>               mSeqFds;
+    vector<int>               mRandFds;
+    int                       mSeqFile;
+    int                       mWriteFd;
+    int64_t                   mWritePos;
+    int                       mWriteFileCount;
+    int                       mAppendFd;
+    int                       mCreateCount;
+    OpStats                   mStats[kOpCount];
+
+    int PickOp() {
+        int val = (int)(rand_r(&mSeed) % mTotalWeight);
+        int op  = 0;
+        while (val >= mCfg.weights[op]) {
+            val -= mCfg.weights[op];
+            op++;
+        }
+        return op;
+    }
+    int GetReadFd(vector<int>& fds, int idx) {
+        if (fds[idx] < 0) {
+            fds[idx] = mClient->Open(mCfg.ReadFile(idx).c_str(), O_RDONLY);
+        }
+        return fds[idx];
+    }
+    string CreatedFile(int i) const {
+        ostringstream os;
+        os << mMetaDir << "/f" << i;
+        return os.str();
+    }
+    int64_t DoOp(int op) {
+        switch (op) {
+            case kOpSeqRead:  return SeqRead();
+            case kOpRandRead: return RandRead();
+            case kOpWrite:    return Write();
+            case kOpAppend:   return Append();
+            case kOpCreate:   return Create();
+            case kOpStat:     return Stat();
+            case kOpReaddir:  return Readdir();
+            default:          break;
+        }
+        return -EINVAL;
+    }
+    int64_t SeqRead() {
+        const int fd = GetReadFd(mSeqFds, mSeqFile);
+        if (fd < 0) {
+            return fd;
+        }
+        const ssize_t res = mClient->Read(fd, mBuf.get(), mCfg.ioSize);
+        if (res < mCfg.ioSize) {
+            // End of file: continue with the next one.
+            mClient->Seek(fd, 0);
+            mSeqFile = (mSeqFile + 1) % mCfg.numReadFiles;
+        }
+        return res;
+    }
+    int64_t RandRead() {
+        const int idx = (int)(rand_r(&mSeed) % mCfg.numReadFiles);
+        const int fd  = GetReadFd(mRandFds, idx);
+        if (fd < 0) {
+            return fd;
+        }
+        const int64_t blocks = std::max(int64_t(1),
+            mCfg.readFileSize / mCfg.ioSize);
+        const off_t pos = (off_t)((rand_r(&mSeed) % blocks) * mCfg.ioSize);
+        if (mClient->Seek(fd, pos) != pos) {
+            return -EIO;
+        }
+        return mClient->Read(fd, mBuf.get(), mCfg.ioSize);
+    }
+    int64_t Write() {
+        if (mWriteFd < 0) {
+            ostringstream os;
+            os << mCfg.testDir << "/write/" << mName << "." <<
+                mWriteFileCount++;
+            mWriteFd = mClient->Create(os.str().c_str(), mCfg.numReplicas);
+            if (mWriteFd < 0) {
+                const int res = mWriteFd;
+                mWriteFd = -1;
+                return res;
+            }
+            mWritePos = 0;
+        }
+        const ssize_t res = mClient->Write(mWriteFd, mBuf.get(), mCfg.ioSize);
+        if (res < 0) {
+            mClient->Close(mWriteFd);
+            mWriteFd = -1;
+            return res;
+        }
+        mWritePos += res;
+        if (mWritePos >= mCfg.writeFileSize) {
+            // The close flushes the buffered data: it is part of the
+            // write that completes the file.
+            const int status = mClient->Close(mWriteFd);
+            mWriteFd = -1;
+            if (status < 0) {
+                return status;
+            }
+        }
+        return res;
+    }
+    int64_t Append() {
+        if (mAppendFd < 0) {
+            mAppendFd = mClient->Open(mCfg.AppendFile().c_str(),
+                O_WRONLY | O_APPEND);
+            if (mAppendFd < 0) {
+                const int res = mAppendFd;
+                mAppendFd = -1;
+                return res;
+            }
+        }
+        return mClient->AtomicRecordAppend(
+            mAppendFd, mBuf.get(), mCfg.recordSize);
+    }
+    int64_t Create() {
+        const int fd = mClient->Create(
+            CreatedFile(mCreateCount).c_str(), mCfg.numReplicas, true);
+        if (fd < 0) {
+            return fd;
+        }
+        mCreateCount++;
+        const int res = mClient->Close(fd);
+        return (res < 0 ? res : 0);
+    }
+    int64_t Stat() {
+        struct stat st;
+        const string path = mCreateCount > 0 ?
+            CreatedFile(rand_r(&mSeed) % mCreateCount) : mMetaDir;
+        const int res = mClient->Stat(path.c_str(), st, false);
+        return (res < 0 ? res : 0);
+    }
+    int64_t Readdir() {
+        vector<string> entries;
+        const int res = mClient->Readdir(mMetaDir.c_str(), entries);
+        return (res < 0 ? res : 0);
+    }
+    void Cleanup() {
+        for (int i = 0; i < mCfg.numReadFiles; i++) {
+            if (mSeqFds[i] >= 0) {
+                mClient->Close(mSeqFds[i]);
+            }
+            if (mRandFds[i] >= 0) {
+                mClient->Close(mRandFds[i]);
+            }
+        }
+        if (mWriteFd >= 0) {
+            mClient->Close(mWriteFd);
+            mWriteFd = -1;
+        }
+        if (mAppendFd >= 0) {
+            mClient->Close(mAppendFd);
+            mAppendFd = -1;
+        }
+    }
+private:
+    LoadWorker(const LoadWorker&);
+    LoadWorker& operator=(const LoadWorker&);
+};
+
+static KfsClientPtr
+NewClient(const LoadConfig& cfg)
+{
+    // One client per thread: the client serializes the calls with its
+    // mutex, and a shared client would serialize the load.
+    KfsClientPtr client(new KfsClient());
+    if (client->Init(cfg.metaHost, cfg.metaPort) < 0 ||
+            ! client->IsInitialized()) {
+        cout << "unable to connect to meta server: " <<
+            cfg.metaHost << ":" << cfg.metaPort << endl;
+        client.reset();
+        return client;
+    }
+    client->SetLogLevel(cfg.logLevel);
+    return client;
+}
+
+// Create the files that the readers and the appenders use.
+static int
+Setup(const LoadConfig& cfg)
+{
+    KfsClientPtr const client = NewClient(cfg);
+    if (! client) {
+        return -1;
+    }
+    int res;
+    if ((res = client->Mkdirs((cfg.testDir + "/data").c_str())) < 0 ||
+            (res = client->Mkdirs((cfg.testDir + "/append").c_str())) < 0 ||
+            (res = client->Mkdirs((cfg.testDir + "/meta").c_str())) < 0) {
+        cout << "mkdirs failed: " << ErrorCodeToStr(res) << endl;
+        return -1;
+    }
+    const int  kBufSize = 1 << 20;
+    boost::scoped_array<char> buf(new char[kBufSize]);
+    memset(buf.get(), 'r', kBufSize);
+    for (int i = 0; i < cfg.numReadFiles; i++) {
+        const string path = cfg.ReadFile(i);
+        struct stat st;
+        if (client->Stat(path.c_str(), st) == 0 &&
+                st.st_size >= cfg.readFileSize) {
+            continue;
+        }
+        cout << "creating: " << path << " " << cfg.readFileSize << endl;
+        const int fd = client->Create(path.c_str(), cfg.numReplicas);
+        if (fd < 0) {
+            cout << "create " << path << " failed: " <<
+                ErrorCodeToStr(fd) << endl;
+            return -1;
+        }
+        for (int64_t pos = 0; pos < cfg.readFileSize; ) {
+            const int len = (int)std::min(int64_t(kBufSize),
+                cfg.readFileSize - pos);
+            const ssize_t n = client->Write(fd, buf.get(), len);
+            if (n != len) {
+                cout << "write " << path << " failed: " <<
+                    ErrorCodeToStr((int)n) << endl;
+                client->Close(fd);
+                return -1;
+            }
+            pos += n;
+        }
+        if ((res = client->Close(fd)) < 0) {
+            cout << "close " << path << " failed: " <<
+                ErrorCodeToStr(res) << endl;
+            return -1;
+        }
+    }
+    const int fd = client->Open(cfg.AppendFile().c_str(), O_CREAT | O_WRONLY,
+        cfg.numReplicas);
+    if (fd < 0) {
+        cout << "create " << cfg.AppendFile() << " failed: " <<
+            ErrorCodeToStr(fd) << endl;
+        return -1;
+    }
+    client->Close(fd);
+    return 0;
+}
+
+static bool
+WriteFully(int fd, const void* data, size_t len)
+{
+    const char* ptr = static_cast<const char*>(data);
+    while (len > 0) {
+        const ssize_t n = write(fd, ptr, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool
+ReadFully(int fd, void* data, size_t len)
+{
+    char* ptr = static_cast<char*>(data);
+    while (len > 0) {
+        const ssize_t n = read(fd, ptr, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Run the threads of one client process, and write the results into the
+// pipe: the load interval, from the threads start to the end of the last
+// op, then the per op type stats.
+static int
+RunProcess(const LoadConfig& cfg, int procIdx, int outFd)
+{
+    vector<LoadWorker*> workers;
+    // Create the clients before starting the threads: the client
+    // library initialization is not thread safe.
+    for (int i = 0; i < cfg.numThreads; i++) {
+        KfsClientPtr const client = NewClient(cfg);
+        if (! client) {
+            return -1;
+        }
+        LoadWorker* const worker = new LoadWorker(cfg, client, procIdx, i);
+        const int res = worker->Prepare();
+        if (res < 0) {
+            cout << "prepare failed: " << ErrorCodeToStr(res) << endl;
+            return -1;
+        }
+        workers.push_back(worker);
+    }
+    const int64_t startUsec = NowUsec();
+    const int64_t endUsec   = startUsec + int64_t(cfg.durationSec) * 1000000;
+    vector<QCThread*> threads;
+    for (int i = 0; i < cfg.numThreads; i++) {
+        workers[i]->SetEndTime(endUsec);
+        threads.push_back(new QCThread(workers[i], "loadgen"));
+        threads.back()->Start();
+    }
+    OpStats stats[kOpCount];
+    int64_t lastOpEndUsec = startUsec;
+    for (int i = 0; i < cfg.numThreads; i++) {
+        threads[i]->Join();
+        for (int op = 0; op < kOpCount; op++) {
+            stats[op].Add(workers[i]->GetStats(op));
+        }
+        lastOpEndUsec = std::max(lastOpEndUsec,
+            workers[i]->GetLastOpEndTime());
+        delete threads[i];
+        delete workers[i];
+    }
+    const int64_t loadUsec = lastOpEndUsec - startUsec;
+    if (! WriteFully(outFd, &loadUsec, sizeof(loadUsec))) {
+        return -1;
+    }
+    for (int op = 0; op < kOpCount; op++) {
+        const int64_t hdr[3] = {
+            (int64_t)stats[op].latency.size(), stats[op].bytes, stats[op].errors
+        };
+        if (! WriteFully(outFd, hdr, sizeof(hdr)) ||
+                (! stats[op].latency.empty() && ! WriteFully(outFd,
+                    &stats[op].latency[0],
+                    stats[op].latency.size() * sizeof(uint32_t)))) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint32_t
+Percentile(const vector<uint32_t>& sorted, double fraction)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    const size_t idx = std::min(sorted.size() - 1,
+        (size_t)(fraction * sorted.size()));
+    return sorted[idx];
+}
+
+static void
+PrintResults(OpStats* stats, double loadSec)
+{
+    cout << left << setw(9) << "op" << right <<
+        setw(10) << "count" <<
+        setw(8)  << "errors" <<
+        setw(11) << "ops/sec" <<
+        setw(9)  << "MB/sec" <<
+        setw(10) << "avg usec" <<
+        setw(10) << "p50" <<
+        setw(10) << "p90" <<
+        setw(10) << "p99" <<
+        setw(10) << "p99.9" <<
+        setw(10) << "max" <<
+    endl;
+    for (int op = 0; op < kOpCount; op++) {
+        vector<uint32_t>& lat = stats[op].latency;
+        if (lat.empty() && stats[op].errors == 0) {
+            continue;
+        }
+        std::sort(lat.begin(), lat.end());
+        double sum = 0;
+        for (vector<uint32_t>::const_iterator it = lat.begin();
+                it != lat.end(); ++it) {
+            sum += *it;
+        }
+        cout << left << setw(9) << kOpNames[op] << right <<
+            setw(10) << lat.size() <<
+            setw(8)  << stats[op].errors <<
+            fixed << setprecision(1) <<
+            setw(11) << lat.size() / loadSec <<
+            setw(9)  << stats[op].bytes / loadSec / (1024. * 1024.) <<
+            setprecision(0) <<
+            setw(10) << (lat.empty() ? 0. : sum / lat.size()) <<
+            setw(10) << Percentile(lat, 0.5) <<
+            setw(10) << Percentile(lat, 0.9) <<
+            setw(10) << Percentile(lat, 0.99) <<
+            setw(10) << Percentile(lat, 0.999) <<
+            setw(10) << (lat.empty() ? 0 : lat.back()) <<
+        endl;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    LoadConfig cfg;
+    cfg.metaHost      = "localhost";
+    cfg.metaPort      = 20000;
+    cfg.testDir       = "/loadgen";
+    cfg.numProcs      = 1;
+    cfg.numThreads    = 4;
+    cfg.durationSec   = 30;
+    cfg.ioSize        = 64 << 10;
+    cfg.recordSize    = 4 << 10;
+    cfg.numReadFiles  = 4;
+    cfg.readFileSize  = int64_t(64) << 20;
+    cfg.writeFileSize = int64_t(64) << 20;
+    cfg.numReplicas   = 1;
+    cfg.logLevel      = "WARN";
+    const char* mix   =
+        "sread=20,rread=20,write=10,append=10,create=10,stat=20,readdir=10";
+    const char* kfsPropsFile = 0;
+    bool help = false;
+    char optchar;
+
+    while ((optchar = getopt(argc, argv,
+            "p:s:P:d:n:t:T:x:b:a:F:S:W:r:vh")) != -1) {
+        switch (optchar) {
+            case 'p':
+                kfsPropsFile = optarg;
+                break;
+            case 's':
+                cfg.metaHost = optarg;
+                break;
+            case 'P':
+                cfg.metaPort = atoi(optarg);
+                break;
+            case 'd':
+                cfg.testDir = optarg;
+                break;
+            case 'n':
+                cfg.numProcs = atoi(optarg);
+                break;
+            case 't':
+                cfg.numThreads = atoi(optarg);
+                break;
+            case 'T':
+                cfg.durationSec = atoi(optarg);
+                break;
+            case 'x':
+                mix = optarg;
+                break;
+            case 'b':
+                cfg.ioSize = atoi(optarg);
+                break;
+            case 'a':
+                cfg.recordSize = atoi(optarg);
+                break;
+            case 'F':
+                cfg.numReadFiles = atoi(optarg);
+                break;
+            case 'S':
+                cfg.readFileSize = atoll(optarg) << 20;
+                break;
+            case 'W':
+                cfg.writeFileSize = atoll(optarg) << 20;
+                break;
+            case 'r':
+                cfg.numReplicas = atoi(optarg);
+                break;
+            case 'v':
+                cfg.logLevel = "INFO";
+                break;
+            case 'h':
+                help = true;
+                break;
+            default:
+                cout << "Unrecognized flag: " << optchar << endl;
+                help = true;
+                break;
+        }
+    }
+    if (kfsPropsFile) {
+        Properties props;
+        if (props.loadProperties(kfsPropsFile, '=', false) != 0) {
+            cout << "unable to read: " << kfsPropsFile << endl;
+            exit(-1);
+        }
+        cfg.metaHost = props.getValue("metaServer.name", cfg.metaHost);
+        cfg.metaPort = props.getValue("metaServer.port", cfg.metaPort);
+    }
+    const bool mixOk = ParseMix(mix, cfg.weights);
+    const bool needReadFiles =
+        cfg.weights[kOpSeqRead] > 0 || cfg.weights[kOpRandRead] > 0;
+    if (help || ! mixOk || cfg.numProcs <= 0 || cfg.numThreads <= 0 ||
+            cfg.durationSec <= 0 || cfg.ioSize <= 0 ||
+            cfg.recordSize <= 0 || cfg.numReplicas <= 0 ||
+            cfg.writeFileSize <= 0 ||
+            (needReadFiles &&
+                (cfg.numReadFiles <= 0 || cfg.readFileSize < cfg.ioSize))) {
+        cout << "Usage: " << argv[0] <<
+            " [-p <Kfs Client properties file>] [-s <meta server host>]"
+            " [-P <meta server port>] [-d <test dir>] [-n <processes>]"
+            " [-t <threads per process>] [-T <duration sec>]"
+            " [-x <op mix>] [-b <read / write size>] [-a <record size>]"
+            " [-F <read files>] [-S <read file MB>] [-W <write file MB>]"
+            " [-r <replicas>] [-v]" << endl;
+        cout << "      -x : comma separated op=weight list, ops: ";
+        for (int i = 0; i < kOpCount; i++) {
+            cout << (i > 0 ? ", " : "") << kOpNames[i];
+        }
+        cout << endl << "           default: " <<
+            "sread=20,rread=20,write=10,append=10,create=10,stat=20,readdir=10"
+            << endl;
+        exit(0);
+    }
+
+    cout << "meta server: " << cfg.metaHost << ":" << cfg.metaPort <<
+        " dir: "       << cfg.testDir <<
+        " processes: " << cfg.numProcs <<
+        " threads: "   << cfg.numThreads <<
+        " duration: "  << cfg.durationSec << " sec" <<
+        " mix: "       << mix <<
+    endl;
+
+    // Run the setup, and the load in child processes: the parent must not
+    // have the client library threads, or state when it forks.
+    pid_t pid = fork();
+    if (pid < 0) {
+        cout << "fork failed: " << strerror(errno) << endl;
+        exit(-1);
+    }
+    if (pid == 0) {
+        _exit(Setup(cfg) == 0 ? 0 : 1);
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) != pid ||
+            ! WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        cout << "setup failed" << endl;
+        exit(-1);
+    }
+
+    const int64_t start = NowUsec();
+    vector<pid_t> pids;
+    vector<int>   fds;
+    for (int i = 0; i < cfg.numProcs; i++) {
+        int pfd[2];
+        if (pipe(pfd) != 0) {
+            cout << "pipe failed: " << strerror(errno) << endl;
+            exit(-1);
+        }
+        pid = fork();
+        if (pid < 0) {
+            cout << "fork failed: " << strerror(errno) << endl;
+            exit(-1);
+        }
+        if (pid == 0) {
+            close(pfd[0]);
+            for (vector<int>::const_iterator it = fds.begin();
+                    it != fds.end(); ++it) {
+                close(*it);
+            }
+            _exit(RunProcess(cfg, i, pfd[1]) == 0 ? 0 : 1);
+        }
+        close(pfd[1]);
+        pids.push_back(pid);
+        fds.push_back(pfd[0]);
+    }
+    // The rates are over the load interval, excluding the forks, and the
+    // client initialization: the processes run concurrently, the mean of
+    // their intervals is used.
+    OpStats stats[kOpCount];
+    int     failed    = 0;
+    int64_t loadUsec  = 0;
+    int     loadCount = 0;
+    for (int i = 0; i < cfg.numProcs; i++) {
+        int64_t procLoadUsec = 0;
+        bool    ok           = ReadFully(fds[i], &procLoadUsec,
+            sizeof(procLoadUsec));
+        if (ok) {
+            loadUsec += procLoadUsec;
+            loadCount++;
+        }
+        for (int op = 0; ok && op < kOpCount; op++) {
+            int64_t hdr[3];
+            ok = ReadFully(fds[i], hdr, sizeof(hdr));
+            if (! ok) {
+                break;
+            }
+            OpStats& st = stats[op];
+            const size_t size = st.latency.size();
+            st.latency.resize(size + (size_t)hdr[0]);
+            ok = hdr[0] <= 0 || ReadFully(fds[i],
+                &st.latency[size], (size_t)hdr[0] * sizeof(uint32_t));
+            st.bytes  += hdr[1];
+            st.errors += hdr[2];
+        }
+        close(fds[i]);
+        if (waitpid(pids[i], &status, 0) != pids[i] || ! ok ||
+                ! WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+    const double elapsedSec = (NowUsec() - start) * 1e-6;
+    const double loadSec    = loadCount > 0 && loadUsec > 0 ?
+        loadUsec * 1e-6 / loadCount : double(cfg.durationSec);
+    if (failed > 0) {
+        cout << failed << " of " << cfg.numProcs <<
+            " client processes failed" << endl;
+    }
+    cout << "elapsed: " << elapsedSec << " sec" <<
+        " load: " << loadSec << " sec" << endl;
+    PrintResults(stats, loadSec);
+    return (failed > 0 ? 1 : 0);
+}
@@ -43,7 +43,7 @@ using namespace KFS;
 int numReplicas = 3;
 KfsClientPtr gKfsClient;
 static bool doMkdirs(const char *dirname);
-static off_t doWrite(const string &kfspathname, int numMBytes, size_t writeSizeBytes, double sleepSec, int cliBufSize);
+static off_t doWrite(const string &kfspathname, int numMBytes, size_t writeSizeBytes, double sleepSec, int cliBufSize, int writeBehind);
 
 int
 main(int argc, char **argv)
@@ -57,8 +57,9 @@ main(int argc, char **argv)
     double sleepSec = -1;
     const char* logLevel = "INFO";
     int cliBufSize = -1;
+    int writeBehind = -1;
 
-    while ((optchar = getopt(argc, argv, "f:p:m:b:r:S:l:s:")) != -1) {
+    while ((optchar = getopt(argc, argv, "f:p:m:b:r:S:l:s:w:")) != -1) {
         switch (optchar) {
             case 'f':
                 kfspathname = optarg;
@@ -84,6 +85,9 @@ main(int argc, char **argv)
             case 's':
                 cliBufSize = atoi(optarg);
                 break;
+            case 'w':
+                writeBehind = atoi(optarg);
+                break;
             default:
                 cout << "Unrecognized flag: " << optchar << endl;
                 help = true;
@@ -95,6 +99,7 @@ main(int argc, char **argv)
         cout << "Usage: " << argv[0] << " -p <Kfs Client properties file> "
              << " -m <# of MB to write> -b <write size in bytes> -f <Kfs file> "
              << " -S <sleep between writes>"
+             << " -s <client buffer size> -w <write behind bytes>"
              << endl;
         exit(0);
     }
@@ -127,7 +132,7 @@ main(int argc, char **argv)
 
     gettimeofday(&startTime, NULL);
 
-    bytesWritten = doWrite(kfspathname, numMBytes, writeSizeBytes, sleepSec, cliBufSize);
+    bytesWritten = doWrite(kfspathname, numMBytes, writeSizeBytes, sleepSec, cliBufSize, writeBehind);
 
     gettimeofday(&endTime, NULL);
 
@@ -136,6 +141,22 @@ main(int argc, char **argv)
 
     cout << "Write rate: " << (((double) bytesWritten * 8.0) / timeTaken) / (1024.0 * 1024.0) << " (Mbps)" << endl;
     cout << "Write rate: " << ((double) bytesWritten / timeTaken) / (1024.0 * 1024.0) << " (MBps)" << endl;
+    cout << "Elapsed: " << timeTaken << " (secs)" << endl;
+    if (writeBehind > 0) {
+        int64_t writes, bytes, allocations, retries, errors, waitUsecs;
+        gKfsClient->GetWriteBehindStats(writes, bytes, allocations, retries,
+            errors, waitUsecs);
+        cout << "Write behind:"
+            " writes: "      << writes <<
+            " bytes: "       << bytes <<
+            " allocations: " << allocations <<
+            " retries: "     << retries <<
+            " errors: "      << errors <<
+            " wait: "        << waitUsecs * 1e-6 << " (secs)" << endl;
+    }
+    // Let the client factory destroy the client, and stop the write behind
+    // threads, before the static destructors run.
+    gKfsClient.reset();
     return 0;
 }
 
@@ -156,7 +177,7 @@ doMkdirs(const char *dirname)
 }
 
 off_t
-doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sleepSec, int cliBufSize)
+doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sleepSec, int cliBufSize, int writeBehind)
 {
     const size_t mByte = 1024 * 1024;
     char dataBuf[mByte];
@@ -184,6 +205,11 @@ doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sle
         cout << "Setting kfs buffer size to: "
             << cliBufSize << " got: " << size << endl;
     }
+    if (writeBehind >= 0) {
+        const size_t size = gKfsClient->SetWriteBehind(fd, writeBehind);
+        cout << "Setting kfs write behind to: "
+            << writeBehind << " got: " << size << endl;
+    }
     struct timespec sleepTm;
     const bool doSleep = sleepSec > 0;
     if (doSleep) {
@@ -217,7 +243,12 @@ doWrite(const string &filename, int numMBytes, size_t writeSizeBytes, double sle
         }
     }
     //    cout << "write of " << nwrote / (1024 * 1024) << " (MB) is done" << endl;
-    gKfsClient->Close(fd);
+    // With write behind the write errors are reported by close.
+    res = gKfsClient->Close(fd);
+    if (res < 0) {
+        cout << "Close failed: " << res << endl;
+        return 0;
+    }
 
     return nwrote;
 }
@@ -60,9 +60,17 @@ main(int argc, char **argv)
     bool help = false;
     double sleepSec = -1;
     char record('x');
+    int recordBlockSize = 0;
+    bool compressFlag = false;
 
-    while ((optchar = getopt(argc, argv, "f:p:m:b:r:S:c:")) != -1) {
+    while ((optchar = getopt(argc, argv, "f:p:m:b:r:S:c:B:z")) != -1) {
         switch (optchar) {
+            case 'B':
+                recordBlockSize = atoi(optarg);
+                break;
+            case 'z':
+                compressFlag = true;
+                break;
             case 'c':
                 record = *optarg;
                 break;
@@ -95,6 +103,7 @@ main(int argc, char **argv)
         cout << "Usage: " << argv[0] << " -p <Kfs Client properties file> "
              << " -m <# of MB to write> -b <write size in bytes> -f <Kfs file> "
              << " -S <sleep between writes> -c <char for the record>"
+             << " -B <record block size> -z (compress record blocks)"
              << endl;
         exit(0);
     }
@@ -110,6 +119,10 @@ main(int argc, char **argv)
 
     KFS::MsgLogger::SetLevel(KFS::MsgLogger::kLogLevelDEBUG);
 
+    if (recordBlockSize > 0) {
+        gKfsClient->SetRecordAppendBlocks(recordBlockSize, compressFlag);
+    }
+
     string kfsdirname, kfsfilename;
     string::size_type slash = kfspathname.rfind('/');
     
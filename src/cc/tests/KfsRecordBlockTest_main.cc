@@ -0,0 +1,296 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Record block writer and reader round trip, no servers needed.
+// The records are empty, text, random bytes, and larger than a block; the
+// file image crosses a chunk boundary, with the zero fill that record
+// append leaves in front of it, and is read back in random size pieces.
+// Then check that a corrupt zero fill, and a corrupt block are reported.
+//
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include "common/kfstypes.h"
+#include "libkfsIO/IOBuffer.h"
+#include "libkfsClient/RecordBlock.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+using namespace KFS;
+
+struct Image
+{
+    Image()
+        : data(),
+          fileOffset(0),
+          paddingOffset(-1),
+          paddingSize(0),
+          compressedCount(0),
+          storedCount(0)
+        {}
+    string  data;
+    int64_t fileOffset;      // file position of data[0]
+    int64_t paddingOffset;   // position of the zero fill in data, or -1
+    int64_t paddingSize;
+    int     compressedCount;
+    int     storedCount;
+};
+
+static string
+makeRecord(int kind, int blockSize)
+{
+    static const char* const words[] = {
+        "chunk ", "server ", "append ", "record ", "block ", "lease ",
+        "meta ", "replica "
+    };
+    string rec;
+    switch (kind) {
+        case 0: // empty
+            break;
+        case 1: { // text, compresses well
+            const int len = rand() % 2000;
+            while ((int)rec.size() < len) {
+                rec += words[rand() % 8];
+            }
+            rec.resize(len);
+            break;
+        }
+        case 2: { // random bytes, does not compress
+            rec.resize(1 + rand() % 3000);
+            for (size_t i = 0; i < rec.size(); i++) {
+                rec[i] = (char)rand();
+            }
+            break;
+        }
+        default: { // larger than a block
+            rec.resize(blockSize + 1 + rand() % (2 * blockSize));
+            for (size_t i = 0; i < rec.size(); i++) {
+                rec[i] = (i % 7) == 0 ? (char)rand() : (char)('a' + i % 26);
+            }
+            break;
+        }
+    }
+    return rec;
+}
+
+// Append the block the way record append does: a block that does not fit
+// into the rest of the chunk goes into the next one, and the rest of the
+// chunk reads back as zeros.
+static void
+sealBlock(RecordBlockWriter& writer, Image& image)
+{
+    IOBuffer buf;
+    const int len = writer.Seal(buf);
+    if (len <= 0) {
+        return;
+    }
+    vector<char> block(len);
+    buf.CopyOut(&block[0], len);
+    const int64_t pos  = image.fileOffset + (int64_t)image.data.size();
+    const int64_t left = (int64_t)CHUNKSIZE - pos % (int64_t)CHUNKSIZE;
+    if (left < len) {
+        image.paddingOffset = (int64_t)image.data.size();
+        image.paddingSize   = left;
+        image.data.append((size_t)left, '\0');
+    }
+    if ((block[4] & 1) != 0) {
+        image.compressedCount++;
+    } else {
+        image.storedCount++;
+    }
+    image.data.append(&block[0], len);
+}
+
+static void
+writeImage(int numRecords, int blockSize, bool compressFlag,
+    int64_t fileOffset, vector<string>& records, Image& image)
+{
+    RecordBlockWriter writer(blockSize, compressFlag);
+    image = Image();
+    image.fileOffset = fileOffset;
+    records.clear();
+    int kind = 0;
+    int run  = 0;
+    for (int i = 0; i < numRecords; i++) {
+        // records of the same kind in runs, so that some blocks hold
+        // only the random bytes, and do not compress
+        if (run <= 0) {
+            kind = rand() % 4;
+            run  = kind == 3 ? 1 + rand() % 3 : 1 + rand() % 200;
+        }
+        run--;
+        records.push_back(makeRecord(kind, blockSize));
+        const string& rec = records.back();
+        if (writer.IsFull((int)rec.size())) {
+            sealBlock(writer, image);
+        }
+        if (writer.Add(rec.data(), (int)rec.size())) {
+            sealBlock(writer, image);
+        }
+    }
+    sealBlock(writer, image);
+}
+
+// Read the image back in pieces of up to maxPiece bytes, 0 -- all at once.
+// Returns the number of records matched, or the reader error.
+static int
+readImage(const Image& image, int maxPiece, const vector<string>& records,
+    int64_t& paddingSize)
+{
+    RecordBlockReader reader;
+    string  input;
+    int64_t inputOffset = image.fileOffset;
+    size_t  pos         = 0;
+    size_t  count       = 0;
+    while (pos < image.data.size() || ! input.empty()) {
+        const size_t piece = maxPiece <= 0 ? image.data.size() :
+            (size_t)(1 + rand() % maxPiece);
+        const size_t len = std::min(piece, image.data.size() - pos);
+        input.append(image.data, pos, len);
+        pos += len;
+        reader.SetInput(input.data(), (int)input.size(), inputOffset);
+        const char* rec;
+        int         recLen;
+        int         ret;
+        while ((ret = reader.Next(rec, recLen)) > 0) {
+            if (count >= records.size() ||
+                    records[count].size() != (size_t)recLen ||
+                    memcmp(records[count].data(), rec, recLen) != 0) {
+                cout << "record: " << count << " mismatch" << endl;
+                return -1000;
+            }
+            count++;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        inputOffset += reader.GetConsumed();
+        input.erase(0, reader.GetConsumed());
+        if (len == 0 && ! input.empty()) {
+            cout << "partial block at the end: " << input.size() << endl;
+            return -1000;
+        }
+    }
+    paddingSize = reader.GetPaddingSize();
+    return (int)count;
+}
+
+int
+main(int argc, char **argv)
+{
+    int  numRecords = 20000;
+    int  blockSize  = 16 << 10;
+    int  maxPiece   = 100 << 10;
+    int  seed       = 1;
+    bool help       = false;
+    char optchar;
+
+    while ((optchar = getopt(argc, argv, "n:b:p:s:h")) != -1) {
+        switch (optchar) {
+            case 'n': numRecords = atoi(optarg); break;
+            case 'b': blockSize  = atoi(optarg); break;
+            case 'p': maxPiece   = atoi(optarg); break;
+            case 's': seed       = atoi(optarg); break;
+            default:  help       = true;         break;
+        }
+    }
+    if (help || numRecords <= 0 || blockSize <= 0 || maxPiece <= 0) {
+        cout << "Usage: " << argv[0] << " [-n <# of records>]"
+            " [-b <block size>] [-p <max read size>] [-s <seed>]" << endl;
+        return 1;
+    }
+    srand(seed);
+
+    vector<string> records;
+    Image          image;
+    for (int pass = 0; pass < 2; pass++) {
+        const bool compressFlag = pass == 0;
+        // start a little before a chunk boundary, so that the image
+        // crosses it
+        const int64_t fileOffset = (int64_t)CHUNKSIZE * (pass + 1) -
+            (1 << 20) - rand() % (64 << 10);
+        writeImage(numRecords, blockSize, compressFlag, fileOffset,
+            records, image);
+        if (image.paddingOffset < 0) {
+            cout << "the image does not cross a chunk boundary,"
+                " use more records" << endl;
+            return 1;
+        }
+        if (compressFlag && (image.compressedCount <= 0 ||
+                image.storedCount <= 0)) {
+            cout << "compressed blocks: " << image.compressedCount <<
+                " stored blocks: " << image.storedCount <<
+                " expected both" << endl;
+            return 1;
+        }
+        const int pieces[] = { 0, maxPiece, 7 };
+        for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+            int64_t   paddingSize = 0;
+            const int ret = readImage(image, pieces[i], records, paddingSize);
+            if (ret != (int)records.size()) {
+                cout << "compress: " << compressFlag <<
+                    " read size: " << pieces[i] <<
+                    " records: " << ret << " expected: " <<
+                    records.size() << endl;
+                return 1;
+            }
+            if (paddingSize <= 0) {
+                cout << "the zero fill was not skipped" << endl;
+                return 1;
+            }
+        }
+        cout << "compress: " << compressFlag <<
+            " records: " << records.size() <<
+            " bytes: " << image.data.size() <<
+            " compressed blocks: " << image.compressedCount <<
+            " stored blocks: " << image.storedCount << endl;
+    }
+
+    // A non zero byte at the end of the zero fill.
+    int64_t paddingSize = 0;
+    Image   bad         = image;
+    bad.data[(size_t)(bad.paddingOffset + bad.paddingSize - 1)] = 1;
+    int ret = readImage(bad, maxPiece, records, paddingSize);
+    if (ret != RecordBlockReader::kErrBadMagic) {
+        cout << "corrupt zero fill: " << ret << " expected: " <<
+            (int)RecordBlockReader::kErrBadMagic << endl;
+        return 1;
+    }
+    // A corrupt block payload.
+    bad = image;
+    bad.data[RecordBlockWriter::kHeaderSize + 1] ^= 0x55;
+    ret = readImage(bad, maxPiece, records, paddingSize);
+    if (ret != RecordBlockReader::kErrChecksum &&
+            ret != RecordBlockReader::kErrBadBlock) {
+        cout << "corrupt block: " << ret << endl;
+        return 1;
+    }
+    cout << "Test passed" << endl;
+    return 0;
+}
@@ -0,0 +1,194 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/17
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Write several client buffers' worth of data with write behind on,
+// sequentially and then at random offsets, and verify the data read back.
+// The writes are sized so that they straddle the buffer boundaries, and
+// the random writes don't abut the buffered data: both make the client
+// hand the buffer off to the write behind thread in the middle of a write.
+//
+//----------------------------------------------------------------------------
+
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include "libkfsClient/KfsClient.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+using namespace KFS;
+
+static char
+pattern(off_t offset, int pass)
+{
+    return (char)((offset * 31 + pass * 7 + (offset >> 12)) & 0xFF);
+}
+
+static bool
+writeAt(KfsClientPtr& client, int fd, vector<char>& expected,
+    off_t offset, size_t len, int pass)
+{
+    vector<char> buf(len);
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = pattern(offset + i, pass);
+    }
+    if (client->Seek(fd, offset, SEEK_SET) != offset) {
+        cout << "seek to: " << offset << " failed" << endl;
+        return false;
+    }
+    const ssize_t res = client->Write(fd, &buf[0], len);
+    if (res != (ssize_t)len) {
+        cout << "write at: " << offset << " len: " << len <<
+            " failed: " << res << endl;
+        return false;
+    }
+    memcpy(&expected[offset], &buf[0], len);
+    return true;
+}
+
+int
+main(int argc, char **argv)
+{
+    string serverHost = "localhost";
+    int    port       = 20000;
+    string filename   = "/writebehind.test";
+    size_t bufSize    = 64 << 10;
+    size_t writeBehind = 1 << 20;
+    int    numBuffers = 40;
+    int    numRandom  = 200;
+    bool   help       = false;
+    char   optchar;
+
+    while ((optchar = getopt(argc, argv, "s:p:f:b:w:n:r:h")) != -1) {
+        switch (optchar) {
+            case 's': serverHost  = optarg;                break;
+            case 'p': port        = atoi(optarg);          break;
+            case 'f': filename    = optarg;                break;
+            case 'b': bufSize     = (size_t)atoll(optarg); break;
+            case 'w': writeBehind = (size_t)atoll(optarg); break;
+            case 'n': numBuffers  = atoi(optarg);          break;
+            case 'r': numRandom   = atoi(optarg);          break;
+            default:  help        = true;                  break;
+        }
+    }
+    if (help || bufSize == 0 || numBuffers <= 0 || writeBehind == 0) {
+        cout << "Usage: " << argv[0] << " -s <meta server> -p <port>"
+            " [-f <kfs file>] [-b <io buffer size>] [-w <write behind size>]"
+            " [-n <# of buffers to write>] [-r <# of random writes>]" << endl;
+        return 1;
+    }
+
+    KfsClientPtr client = getKfsClientFactory()->GetClient(serverHost, port);
+    if (! client) {
+        cout << "kfs client failed to initialize" << endl;
+        return 1;
+    }
+    client->Remove(filename.c_str());
+    int fd = client->Create(filename.c_str());
+    if (fd < 0) {
+        cout << "create: " << filename << " failed: " <<
+            ErrorCodeToStr(fd) << endl;
+        return 1;
+    }
+    client->SetIoBufferSize(fd, bufSize);
+    if (client->SetWriteBehind(fd, writeBehind) <= 0) {
+        cout << "write behind is not supported for: " << filename << endl;
+        return 1;
+    }
+    bufSize = client->GetIoBufferSize(fd);
+
+    const size_t fileSize = bufSize * numBuffers + bufSize / 3;
+    vector<char> expected(fileSize);
+    // Sequential writes that are not multiples of the buffer size.
+    const size_t writeSize = bufSize * 3 / 4 + 1;
+    for (size_t off = 0; off < fileSize; off += writeSize) {
+        if (! writeAt(client, fd, expected, off,
+                std::min(writeSize, fileSize - off), 0)) {
+            return 1;
+        }
+    }
+    // Writes at random offsets: each one hands off the buffered data of
+    // the previous one, as the two don't abut.
+    srand(1);
+    for (int i = 0; i < numRandom; i++) {
+        const size_t len = 1 + rand() % (bufSize + bufSize / 2);
+        const off_t  off = rand() % (fileSize - len);
+        if (! writeAt(client, fd, expected, off, len, i + 1)) {
+            return 1;
+        }
+    }
+    int status = client->Close(fd);
+    if (status < 0) {
+        cout << "close failed: " << ErrorCodeToStr(status) << endl;
+        return 1;
+    }
+    int64_t writes = 0, bytes = 0, allocs = 0, retries = 0, errors = 0;
+    int64_t waitUsecs = 0;
+    client->GetWriteBehindStats(writes, bytes, allocs, retries, errors,
+        waitUsecs);
+    cout << "write behind: writes: " << writes << " bytes: " << bytes <<
+        " errors: " << errors << endl;
+
+    fd = client->Open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cout << "open: " << filename << " failed: " <<
+            ErrorCodeToStr(fd) << endl;
+        return 1;
+    }
+    vector<char> data(fileSize + 1);
+    size_t nread = 0;
+    for (; ;) {
+        const ssize_t res = client->Read(fd, &data[nread],
+            data.size() - nread);
+        if (res < 0) {
+            cout << "read failed: " << ErrorCodeToStr(res) << endl;
+            return 1;
+        }
+        if (res == 0) {
+            break;
+        }
+        nread += res;
+        if (nread >= data.size()) {
+            break;
+        }
+    }
+    client->Close(fd);
+    if (nread != fileSize) {
+        cout << "size mismatch: expected: " << fileSize <<
+            " read: " << nread << endl;
+        return 1;
+    }
+    for (size_t i = 0; i < fileSize; i++) {
+        if (data[i] != expected[i]) {
+            cout << "data mismatch at: " << i << endl;
+            return 1;
+        }
+    }
+    client->Remove(filename.c_str());
+    cout << "Test passed: " << fileSize << " bytes" << endl;
+    return 0;
+}
@@ -31,10 +31,16 @@ extern "C" {
 };
 
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <string>
+#include <map>
 using std::string;
 using std::cout;
 using std::endl;
+using std::setw;
+using std::map;
+using std::istringstream;
 
 #include "libkfsIO/TcpSocket.h"
 #include "common/log.h"
@@ -45,7 +51,8 @@ using namespace KFS;
 using namespace KFS_MON;
 
 static void
-StatsMetaServer(const ServerLocation &location, bool rpcStats, int numSecs);
+StatsMetaServer(const ServerLocation &location, bool rpcStats,
+                bool latencyStats, int numSecs);
 
 void
 BasicStatsMetaServer(TcpSocket &metaServerSock, int numSecs);
@@ -54,7 +61,11 @@ void
 RpcStatsMetaServer(TcpSocket &metaServerSock, int numSecs);
 
 static void
-StatsChunkServer(const ServerLocation &location, bool rpcStats, int numSecs);
+StatsChunkServer(const ServerLocation &location, bool rpcStats,
+                 bool latencyStats, int numSecs);
+
+template<typename T> static void
+LatencyStats(TcpSocket &sock, int numSecs);
 
 static void
 BasicStatsChunkServer(TcpSocket &chunkServerSock, int numSecs);
@@ -73,14 +84,14 @@ int main(int argc, char **argv)
 {
     char optchar;
     bool help = false, meta = false, chunk = false;
-    bool rpcStats = false, verboseLogging = false;
+    bool rpcStats = false, latencyStats = false, verboseLogging = false;
     const char *server = NULL;
     int port = -1, numSecs = 10;
 
 
     KFS::MsgLogger::Init(NULL);
 
-    while ((optchar = getopt(argc, argv, "hcmn:p:s:tv")) != -1) {
+    while ((optchar = getopt(argc, argv, "hcmln:p:s:tv")) != -1) {
         switch (optchar) {
             case 'm': 
                 meta = true;
@@ -100,6 +111,9 @@ int main(int argc, char **argv)
             case 't':
                 rpcStats = true;
                 break;
+            case 'l':
+                latencyStats = true;
+                break;
             case 'h':
                 help = true;
                 break;
@@ -117,9 +131,10 @@ int main(int argc, char **argv)
 
     if (help || (server == NULL) || (port < 0)) {
         cout << "Usage: " << argv[0] << " [-m|-c] -s <server name> -p <port>" 
-             << " [-n <secs>] [-t] {-v}"  << endl;
+             << " [-n <secs>] [-t|-l] {-v}"  << endl;
         cout << "Use -m for metaserver and -c for chunk server" << endl;
         cout << "Use -t for RPC stats" << endl;
+        cout << "Use -l for latency histograms (micro seconds)" << endl;
         exit(-1);
     }
 
@@ -132,9 +147,9 @@ int main(int argc, char **argv)
     ServerLocation location(server, port);
 
     if (meta)
-        StatsMetaServer(location, rpcStats, numSecs);
+        StatsMetaServer(location, rpcStats, latencyStats, numSecs);
     else if (chunk)
-        StatsChunkServer(location, rpcStats, numSecs);
+        StatsChunkServer(location, rpcStats, latencyStats, numSecs);
 }
 
 static void
@@ -146,8 +161,70 @@ PrintRpcStat(const string &statName, Properties &prop)
 }
 
 
+///
+/// Histogram counters are reported as
+/// "name: count=N,sum=S,min=..,max=..,p50=..,p90=..,p99=..,p999=..,rate=R".
+/// Print the ones that have values as a table.
+///
+static void
+PrintLatencyStats(const Properties &stats)
+{
+    static const char* const kColumns[] = {
+        "count", "rate", "min", "p50", "p90", "p99", "p999", "max", 0
+    };
+    cout << std::left << setw(40) << "name" << std::right;
+    for (const char* const* c = kColumns; *c; ++c) {
+        cout << setw(10) << *c;
+    }
+    cout << endl;
+    for (Properties::iterator it = stats.begin(); it != stats.end(); ++it) {
+        const string& value = it->second;
+        if (value.compare(0, 6, "count=") != 0) {
+            continue;
+        }
+        map<string, string> fields;
+        istringstream is(value);
+        string field;
+        while (getline(is, field, ',')) {
+            const size_t pos = field.find('=');
+            if (pos != string::npos) {
+                fields[field.substr(0, pos)] = field.substr(pos + 1);
+            }
+        }
+        if (fields["count"] == "0") {
+            continue;
+        }
+        cout << std::left << setw(40) << it->first << std::right;
+        for (const char* const* c = kColumns; *c; ++c) {
+            cout << setw(10) << fields[*c];
+        }
+        cout << endl;
+    }
+}
+
+template<typename T> void
+LatencyStats(TcpSocket &sock, int numSecs)
+{
+    int cmdSeqNum = 1;
+
+    while (1) {
+        T op(cmdSeqNum);
+        ++cmdSeqNum;
+        if (DoOpCommon(&op, &sock) < 0) {
+            KFS_LOG_ERROR("Server isn't responding to stats");
+            exit(0);
+        }
+        PrintLatencyStats(op.stats);
+        cout << "----------------------------------" << endl;
+        if (numSecs == 0)
+            break;
+        sleep(numSecs);
+    }
+}
+
 void
-StatsMetaServer(const ServerLocation &location, bool rpcStats, int numSecs)
+StatsMetaServer(const ServerLocation &location, bool rpcStats,
+                bool latencyStats, int numSecs)
 {
     TcpSocket metaServerSock;
 
@@ -157,7 +234,9 @@ StatsMetaServer(const ServerLocation &location, bool rpcStats, int numSecs)
         exit(0);
     }
 
-    if (rpcStats) {
+    if (latencyStats) {
+        LatencyStats<MetaStatsOp>(metaServerSock, numSecs);
+    } else if (rpcStats) {
         RpcStatsMetaServer(metaServerSock, numSecs);
     } else {
         BasicStatsMetaServer(metaServerSock, numSecs);
@@ -252,7 +331,8 @@ PrintMetaBasicStatsHeader()
 }
 
 void
-StatsChunkServer(const ServerLocation &location, bool rpcStats, int numSecs)
+StatsChunkServer(const ServerLocation &location, bool rpcStats,
+                 bool latencyStats, int numSecs)
 {
     TcpSocket chunkServerSock;
 
@@ -262,7 +342,9 @@ StatsChunkServer(const ServerLocation &location, bool rpcStats, int numSecs)
         exit(0);
     }
 
-    if (rpcStats) {
+    if (latencyStats) {
+        LatencyStats<ChunkStatsOp>(chunkServerSock, numSecs);
+    } else if (rpcStats) {
         RpcStatsChunkServer(chunkServerSock, numSecs);
     } else {
         BasicStatsChunkServer(chunkServerSock, numSecs);